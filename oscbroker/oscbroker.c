@@ -0,0 +1,716 @@
+/******************************************************************************
+ *  oscbroker
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *
+ *  This is a daemon that forwards OSC packets to the subscribers whose
+ *  address patterns match them. Subscriptions come and go at runtime through
+ *  /_broker messages. A control thread applies them and publishes a new
+ *  oscmatch set, so the data path never waits for a change, and packets are
+ *  sent to each subscriber in batches straight from the receive buffer.
+ *
+ ******************************************************************************/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE		// F_SETPIPE_SZ
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <pthread.h>
+
+#include "oscmatch.h"
+#include "../oscnet/oscnet.h"
+#include "../oscpack/oscunpack.h"
+
+#define OSCBROKER "oscbroker"
+
+// Packets received before forwarding
+#define BATCH 64
+
+// Control messages bigger than this are dropped
+#define CONTROL_SIZE 1024
+
+#define PREFIX "/_broker/"
+
+const char usage[] =
+"usage: oscbroker [options] port tcp|udp\n" \
+"       oscbroker [options] unix:/path|unixdgram:/path|shm://name\n" \
+"    Options:\n" \
+"        -subs file      subscriptions to start with\n" \
+"\n" \
+"Subscribers send these messages to the broker, with the address of the\n" \
+"destination as three strings, a local endpoint as one, or nothing to use\n" \
+"the sender of a udp message:\n" \
+"\n" \
+"        /_broker/subscribe   ,s[sss]  pattern [host port proto]\n" \
+"        /_broker/unsubscribe ,s[sss]  pattern [host port proto]\n" \
+"        /_broker/leave       ,[sss]   [host port proto]\n" \
+"\n" \
+"Patterns use the OSC wildcards ? * [a-z] [!a-z] {a,b} within a part and //\n" \
+"for any number of parts. A packet goes once to every destination with a\n" \
+"matching pattern; bundles go unchanged to every destination matched by one\n" \
+"of their messages. Each line of the -subs file is a pattern and a\n" \
+"destination:\n" \
+"\n" \
+"        /mixer/ch/[1-8]/*   127.0.0.1 9000 udp\n" \
+"        //meter             unix:/tmp/meters\n" \
+"\n";
+
+struct dest {
+	char* spec;
+	oscnet_t* net;
+	int32_t id;				// index in the table
+	int32_t patterns;		// subscriptions, counted by the control thread
+
+	// Only used by the data thread
+	uint8_t* bufs[BATCH];
+	int32_t sizes[BATCH];
+	int npkt;
+	uint32_t stamp;			// last packet queued, to send each packet once
+	uint64_t forwarded;
+	uint64_t errors;
+};
+
+// Destinations by ID, published with each set
+struct table {
+	int32_t n;
+	struct dest* dests[];
+};
+
+// A control message on its way to the control thread, written to the pipe
+// with only size bytes of buf. Smaller than PIPE_BUF, so each one is written
+// whole.
+struct control {
+	int32_t size;
+	uint32_t fromlen;
+	struct sockaddr_storage from;
+	uint8_t buf[CONTROL_SIZE];
+};
+
+#define CONTROL_HEADER offsetof(struct control, buf)
+
+static oscmatch_t* match;
+static int ctlpipe[2];
+
+// Owned by the control thread
+static struct dest** dests;
+static int32_t ndests;
+static struct table* table;			// published last
+static int datagram;
+
+// Owned by the data thread
+static struct dest** touched;
+static int32_t ntouched, maxtouched;
+static int32_t* ids;
+static int32_t maxids = 256;
+
+static uint64_t received, lost, forwarded, unmatched, malformed, controls, dropped;
+static uint64_t subscribes, unsubscribes, badcontrols, publishes;
+static volatile sig_atomic_t done;
+
+/* ----------------------------------------------------------------------------
+ *	Control thread
+ */
+
+static void closedest(void* arg)
+{
+	struct dest* d = (struct dest*)arg;
+
+	// Its packets were counted while it was in a table
+	forwarded += d->forwarded;
+	oscnet_close(d->net);
+	free(d->spec);
+	free(d);
+}
+
+static struct dest* finddest(const char* spec)
+{
+	int32_t i;
+
+	for (i = 0; i < ndests; ++i) {
+		if (dests[i] && strcmp(dests[i]->spec, spec) == 0) {
+			return dests[i];
+		}
+	}
+	return NULL;
+}
+
+static struct dest* opendest(const char* spec)
+{
+	char buf[1024];
+	char *host, *port, *proto;
+	struct dest* d;
+	int32_t i;
+	void* p;
+
+	for (i = 0; i < ndests && dests[i]; ++i)
+		;
+	if (i == ndests) {
+		if ((p = realloc(dests, (ndests + 1) * sizeof(*dests))) == NULL) {
+			return NULL;
+		}
+		dests = (struct dest**)p;
+		dests[ndests++] = NULL;
+	}
+	if ((d = (struct dest*)calloc(1, sizeof(struct dest))) == NULL ||
+		(d->spec = strdup(spec)) == NULL) {
+		fprintf(stderr, "%s: Critical memory error...\n", OSCBROKER);
+		free(d);
+		return NULL;
+	}
+	if (oscnet_islocal(spec)) {
+		d->net = oscnet_connect(spec, NULL, NULL);
+	}
+	else {
+		snprintf(buf, sizeof(buf), "%s", spec);
+		host = strtok(buf, " ");
+		port = strtok(NULL, " ");
+		proto = strtok(NULL, " ");
+		d->net = proto ? oscnet_connect(host, port, proto) : NULL;
+	}
+	if (d->net == NULL) {
+		fprintf(stderr, "%s: cannot open %s\n", OSCBROKER, spec);
+		free(d->spec);
+		free(d);
+		return NULL;
+	}
+	d->id = i;
+	dests[i] = d;
+	return d;
+}
+
+// Takes a destination out of the table once it has no subscriptions. The
+// readers may still be sending to it, so it is closed after the next publish.
+static void dropdest(struct dest* d)
+{
+	if (d->patterns > 0) {
+		return;
+	}
+	dests[d->id] = NULL;
+	if (oscmatch_defer(match, closedest, d) == -1) {
+		dests[d->id] = d;
+	}
+}
+
+static int subscribe(const char* pattern, const char* spec)
+{
+	struct dest* d;
+	int rv;
+
+	if ((d = finddest(spec)) == NULL && (d = opendest(spec)) == NULL) {
+		return -1;
+	}
+	if ((rv = oscmatch_add(match, pattern, d->id)) == -1) {
+		fprintf(stderr, "%s: bad pattern %s\n", OSCBROKER, pattern);
+		dropdest(d);
+		return -1;
+	}
+	d->patterns += rv == 0;
+	subscribes += rv == 0;
+	return rv == 0;
+}
+
+static int unsubscribe(const char* pattern, const char* spec)
+{
+	struct dest* d;
+	int32_t n;
+
+	if ((d = finddest(spec)) == NULL) {
+		return 0;
+	}
+	if (pattern) {
+		n = oscmatch_remove(match, pattern, d->id) == 0;
+	}
+	else {
+		n = oscmatch_remove_id(match, d->id);
+	}
+	d->patterns -= n;
+	unsubscribes += n;
+	dropdest(d);
+	return n > 0;
+}
+
+// Destination named by the arguments after it, or the sender of the message
+static int destspec(oscargs_t* it, const struct control* c, char* spec, size_t size)
+{
+	char host[NI_MAXHOST], serv[NI_MAXSERV];
+	char args[3][256];
+	oscarg_t a;
+	int n;
+
+	for (n = 0; oscargs_next(it, &a); ++n) {
+		if (n == 3) {
+			return -1;
+		}
+		if (a.type == 's') {
+			snprintf(args[n], sizeof(args[n]), "%s", a.s);
+		}
+		else if (a.type == 'i') {
+			// A port may come as an integer
+			snprintf(args[n], sizeof(args[n]), "%d", a.i);
+		}
+		else {
+			return -1;
+		}
+	}
+	if (n == 1 && oscnet_islocal(args[0])) {
+		snprintf(spec, size, "%s", args[0]);
+	}
+	else if (n == 3) {
+		snprintf(spec, size, "%s %s %s", args[0], args[1], args[2]);
+	}
+	else if (n == 0 && datagram && c->fromlen > 0 &&
+			 getnameinfo((const struct sockaddr*)&c->from, c->fromlen, host, sizeof(host),
+						 serv, sizeof(serv), NI_NUMERICHOST | NI_NUMERICSERV) == 0) {
+		snprintf(spec, size, "%s %s udp", host, serv);
+	}
+	else {
+		return -1;
+	}
+	return 0;
+}
+
+// Applies one control message. Returns 1 if the subscriptions changed.
+static int control(const struct control* c)
+{
+	char spec[2048];
+	const char* pattern = NULL;
+	const char* cmd;
+	oscmsg_t msg;
+	oscargs_t it;
+	oscarg_t arg;
+
+	if (oscunpack(c->buf, c->size, &msg) == -1) {
+		badcontrols++;
+		return 0;
+	}
+	cmd = msg.address + strlen(PREFIX);
+	oscargs(&msg, &it);
+	if (strcmp(cmd, "subscribe") == 0 || strcmp(cmd, "unsubscribe") == 0) {
+		if (!oscargs_next(&it, &arg) || arg.type != 's') {
+			badcontrols++;
+			return 0;
+		}
+		pattern = arg.s;
+	}
+	else if (strcmp(cmd, "leave") != 0) {
+		badcontrols++;
+		return 0;
+	}
+	if (destspec(&it, c, spec, sizeof(spec)) == -1) {
+		fprintf(stderr, "%s: %s without a destination\n", OSCBROKER, msg.address);
+		badcontrols++;
+		return 0;
+	}
+	if (cmd[0] == 's') {
+		return subscribe(pattern, spec) > 0;
+	}
+	return unsubscribe(pattern, spec) > 0;
+}
+
+// Hands the subscriptions and a copy of the destinations to the readers
+static int publish(void)
+{
+	struct table* t;
+
+	if ((t = (struct table*)malloc(sizeof(struct table) + ndests * sizeof(*dests))) == NULL) {
+		fprintf(stderr, "%s: Critical memory error...\n", OSCBROKER);
+		return -1;
+	}
+	t->n = ndests;
+	if (ndests > 0) {
+		memcpy(t->dests, dests, ndests * sizeof(*dests));
+	}
+	if (oscmatch_publish(match, t) == -1) {
+		free(t);
+		return -1;
+	}
+	// The data thread may still route with the old table, so it is freed
+	// after a later publish; if that can not be recorded it is leaked
+	oscmatch_defer(match, free, table);
+	table = t;
+	publishes++;
+	return 0;
+}
+
+static void* controlloop(void* arg)
+{
+	struct pollfd pfd;
+	struct control c;
+	int changed;
+	ssize_t n;
+
+	(void)arg;
+	pfd.fd = ctlpipe[0];
+	pfd.events = POLLIN;
+	while (!done) {
+		if (poll(&pfd, 1, 100) <= 0) {
+			oscmatch_reclaim(match);
+			continue;
+		}
+
+		// Everything waiting goes into one publish
+		for (changed = 0; (n = read(ctlpipe[0], &c, CONTROL_HEADER)) > 0; ) {
+			if (n == (ssize_t)CONTROL_HEADER && read(ctlpipe[0], c.buf, c.size) == c.size) {
+				changed |= control(&c);
+			}
+		}
+		if (changed) {
+			publish();
+		}
+		oscmatch_reclaim(match);
+	}
+	return NULL;
+}
+
+// Read the -subs file. Returns the number of subscriptions or -1 on error.
+static int loadsubs(const char* path)
+{
+	FILE* fp;
+	char line[1024], spec[1024];
+	char* tok[5];
+	int n, lineno = 0, count = 0;
+
+	if ((fp = fopen(path, "r")) == NULL) {
+		perror(path);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		lineno++;
+		for (n = 0; n < 5 && (tok[n] = strtok(n ? NULL : line, " \t\r\n")); ++n)
+			;
+		if (n == 0 || tok[0][0] == '#') {
+			continue;
+		}
+		if (n == 2 && oscnet_islocal(tok[1])) {
+			snprintf(spec, sizeof(spec), "%s", tok[1]);
+		}
+		else if (n == 4) {
+			snprintf(spec, sizeof(spec), "%s %s %s", tok[1], tok[2], tok[3]);
+		}
+		else {
+			fprintf(stderr, "%s:%d: bad subscription\n", path, lineno);
+			fclose(fp);
+			return -1;
+		}
+		if (subscribe(tok[0], spec) == -1) {
+			fprintf(stderr, "%s:%d: bad subscription\n", path, lineno);
+			fclose(fp);
+			return -1;
+		}
+		count++;
+	}
+	fclose(fp);
+	return count;
+}
+
+/* ----------------------------------------------------------------------------
+ *	Data thread
+ */
+
+static void flush(void)
+{
+	struct dest* d;
+	int32_t i;
+	int rv;
+
+	for (i = 0; i < ntouched; ++i) {
+		d = touched[i];
+		rv = oscnet_sendv(d->net, d->bufs, d->sizes, d->npkt);
+		if (rv < 0) {
+			rv = 0;
+		}
+		d->forwarded += rv;
+		d->errors += d->npkt - rv;
+		d->npkt = 0;
+	}
+	ntouched = 0;
+}
+
+// Queue a packet on a destination unless it is already queued.
+static void enqueue(struct dest* d, uint8_t* buf, int32_t size, uint32_t stamp)
+{
+	if (d->stamp == stamp) {
+		return;
+	}
+	d->stamp = stamp;
+	if (d->npkt == 0) {
+		touched[ntouched++] = d;
+	}
+	d->bufs[d->npkt] = buf;
+	d->sizes[d->npkt++] = size;
+}
+
+// Queue the packet on every destination with a pattern that matches addr.
+static int matchaddr(const oscmatch_set_t* set, const struct table* t, const char* addr,
+					 int32_t len, uint8_t* buf, int32_t size, uint32_t stamp)
+{
+	int32_t n, i;
+	void* p;
+
+	n = oscmatch_find(set, addr, len, ids, maxids);
+	if (n > maxids) {
+		if ((p = realloc(ids, n * sizeof(*ids))) == NULL) {
+			n = maxids;
+		}
+		else {
+			ids = (int32_t*)p;
+			maxids = n;
+			oscmatch_find(set, addr, len, ids, maxids);
+		}
+	}
+	for (i = 0; i < n; ++i) {
+		enqueue(t->dests[ids[i]], buf, size, stamp);
+	}
+	return n > 0;
+}
+
+static int matchbundle(const oscmatch_set_t* set, const struct table* t,
+					   const uint8_t* bundle, int32_t bsize, uint8_t* buf, int32_t size,
+					   uint32_t stamp, int depth)
+{
+	oscbundle_t b;
+	const uint8_t* elem;
+	const char* addr;
+	int32_t len, alen;
+	int found = 0;
+
+	if (depth > 8 || oscbundle(bundle, bsize, &b) == -1) {
+		return -1;
+	}
+	while ((len = oscbundle_next(&b, &elem)) > 0) {
+		if (oscisbundle(elem, len)) {
+			found |= matchbundle(set, t, elem, len, buf, size, stamp, depth + 1) > 0;
+		}
+		else if ((addr = oscaddress(elem, len, &alen)) != NULL) {
+			found |= matchaddr(set, t, addr, alen, buf, size, stamp);
+		}
+	}
+	return len == -1 ? -1 : found;
+}
+
+// Hand a control message to the control thread, without blocking
+static void tocontrol(const oscnet_msg_t* m)
+{
+	struct control c;
+
+	controls++;
+	if (m->size > CONTROL_SIZE) {
+		dropped++;
+		return;
+	}
+	c.size = m->size;
+	c.fromlen = m->fromlen;
+	memcpy(&c.from, &m->from, sizeof(c.from));
+	memcpy(c.buf, m->buf, m->size);
+	if (write(ctlpipe[1], &c, CONTROL_HEADER + c.size) != (ssize_t)(CONTROL_HEADER + c.size)) {
+		dropped++;
+	}
+}
+
+static void route(const oscmatch_set_t* set, const struct table* t, const oscnet_msg_t* m,
+				  uint32_t stamp)
+{
+	const char* addr;
+	int32_t alen;
+	int found;
+
+	if (oscisbundle(m->buf, m->size)) {
+		found = matchbundle(set, t, m->buf, m->size, m->buf, m->size, stamp, 0);
+	}
+	else if ((addr = oscaddress(m->buf, m->size, &alen)) != NULL) {
+		if (alen > (int32_t)strlen(PREFIX) && memcmp(addr, PREFIX, strlen(PREFIX)) == 0) {
+			tocontrol(m);
+			return;
+		}
+		found = matchaddr(set, t, addr, alen, m->buf, m->size, stamp);
+	}
+	else {
+		found = -1;
+	}
+
+	if (found == -1) {
+		malformed++;
+	}
+	else if (found == 0) {
+		unmatched++;
+	}
+}
+
+static void stop(int sig)
+{
+	(void)sig;
+	done = 1;
+}
+
+int main (int argc, char* const argv[])
+{
+	oscnet_t* in;
+	oscnet_msg_t msgs[BATCH];
+	const oscmatch_set_t* set;
+	const struct table* t;
+	const char* subs = NULL;
+	pthread_t thread;
+	uint32_t stamp = 0;
+	int i, n, rv;
+	void* p;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; ++i) {
+		if (strcmp(argv[i], "-subs") == 0 && i + 1 < argc) {
+			subs = argv[++i];
+		}
+		else {
+			printf(usage);
+			return 0;
+		}
+	}
+
+	if (argc - i == 1 && oscnet_islocal(argv[i])) {
+		in = oscnet_listen(argv[i], NULL, NULL);
+	}
+	else if (argc - i == 2) {
+		in = oscnet_listen(NULL, argv[i], argv[i+1]);
+	}
+	else {
+		printf(usage);
+		return 0;
+	}
+	if (in == NULL) {
+		return 1;
+	}
+	datagram = oscnet_type(in) == OSCNET_UDP || oscnet_type(in) == OSCNET_UNIXDGRAM;
+
+	// The data thread is the only reader
+	if ((match = oscmatch_new(1)) == NULL ||
+		(ids = (int32_t*)malloc(maxids * sizeof(*ids))) == NULL) {
+		return 1;
+	}
+	if (pipe(ctlpipe) == -1 || fcntl(ctlpipe[0], F_SETFL, O_NONBLOCK) == -1 ||
+		fcntl(ctlpipe[1], F_SETFL, O_NONBLOCK) == -1) {
+		perror("pipe");
+		return 1;
+	}
+#ifdef F_SETPIPE_SZ
+	// Room for a crowd of clients subscribing at once
+	fcntl(ctlpipe[1], F_SETPIPE_SZ, 1024 * 1024);
+#endif
+	if ((subs && loadsubs(subs) == -1) || publish() == -1) {
+		return 1;
+	}
+
+	for (i = 0; i < BATCH; ++i) {
+		msgs[i].bufsize = OSCNET_MAX_PACKET;
+		if ((msgs[i].buf = (uint8_t*)malloc(OSCNET_MAX_PACKET)) == NULL) {
+			fprintf(stderr, "%s: Critical memory error...\n", OSCBROKER);
+			return 1;
+		}
+	}
+
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+	if (pthread_create(&thread, NULL, controlloop, NULL) != 0) {
+		fprintf(stderr, "%s: cannot start the control thread\n", OSCBROKER);
+		return 1;
+	}
+
+	while (!done) {
+		n = oscnet_recvmsgs(in, msgs, BATCH, 100);
+		if (n < 0) {
+			perror("recv");
+			break;
+		}
+
+		// Streams and the shm ring return one packet per call; keep
+		// collecting what is already waiting so sends are still batched.
+		while (!datagram && n > 0 && n < BATCH) {
+			rv = oscnet_recvmsgs(in, msgs + n, BATCH - n, 0);
+			if (rv <= 0) {
+				break;
+			}
+			n += rv;
+		}
+		if (n == 0) {
+			continue;
+		}
+
+		// Outside the set while blocked, inside while routing the batch
+		set = oscmatch_enter(match, 0);
+		t = (const struct table*)oscmatch_data(set);
+		if (t->n > maxtouched) {
+			if ((p = realloc(touched, t->n * sizeof(*touched))) == NULL) {
+				// Nowhere to queue the sends; the batch is dropped
+				oscmatch_leave(match, 0);
+				received += n;
+				lost += n;
+				continue;
+			}
+			touched = (struct dest**)p;
+			maxtouched = t->n;
+		}
+		for (i = 0; i < n; ++i) {
+			route(set, t, &msgs[i], ++stamp);
+		}
+		flush();
+		oscmatch_leave(match, 0);
+		received += n;
+	}
+
+	pthread_join(thread, NULL);
+	fprintf(stderr, "%s: %llu received, %llu dropped, %llu unmatched, %llu malformed, "
+			"%llu control (%llu dropped)\n", OSCBROKER, (unsigned long long)received,
+			(unsigned long long)lost, (unsigned long long)unmatched, (unsigned long long)malformed,
+			(unsigned long long)controls, (unsigned long long)dropped);
+	fprintf(stderr, "    %llu subscribed, %llu unsubscribed, %d left, %llu bad, "
+			"%llu publishes\n", (unsigned long long)subscribes,
+			(unsigned long long)unsubscribes, oscmatch_count(match),
+			(unsigned long long)badcontrols, (unsigned long long)publishes);
+	for (i = 0; i < ndests; ++i) {
+		if (dests[i]) {
+			fprintf(stderr, "    %s: %d patterns, %llu forwarded, %llu failed\n",
+					dests[i]->spec, dests[i]->patterns,
+					(unsigned long long)dests[i]->forwarded,
+					(unsigned long long)dests[i]->errors);
+		}
+	}
+
+	// Frees the last table and closes the destinations that left
+	oscmatch_free(match);
+	free(table);
+	for (i = 0; i < ndests; ++i) {
+		if (dests[i]) {
+			closedest(dests[i]);
+		}
+	}
+	fprintf(stderr, "    %llu forwarded in all\n", (unsigned long long)forwarded);
+	for (i = 0; i < BATCH; ++i) {
+		free(msgs[i].buf);
+	}
+	free(dests);
+	free(touched);
+	free(ids);
+	oscnet_close(in);
+	return 0;
+}
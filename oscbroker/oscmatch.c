@@ -0,0 +1,850 @@
+/******************************************************************************
+ *  oscmatch
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#include "oscmatch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Most parts of an address or pattern
+#define MAX_DEPTH 64
+
+// Smallest block of a set's memory
+#define BLOCK (64 * 1024)
+
+struct part {
+	const char* s;
+	int32_t len;
+	uint32_t hash;
+	int deep;				// preceded by "//"
+	int wild;				// has wildcards
+};
+
+struct child {
+	const char* part;		// NULL for an empty slot
+	int32_t len;
+	uint32_t hash;
+	struct node* node;
+};
+
+struct node {
+	struct child* lit;		// literal parts, open addressing with mask + 1 slots
+	uint32_t mask;
+	struct child* wild;		// parts with wildcards, tried one by one
+	int32_t nwild;
+	struct node* deep;		// what follows "//"
+	int32_t* ids;			// subscriptions that end here
+	int32_t nids;
+
+	// Only while compiling
+	struct kid* kids;
+	int32_t nlit;
+	struct idl* idl;
+	struct node* all;
+};
+
+struct kid {
+	struct child c;
+	int wild;
+	struct node* parent;
+	struct kid* next;		// of the same parent
+};
+
+struct idl {
+	int32_t id;
+	struct idl* next;
+};
+
+struct block {
+	struct block* next;
+	size_t used;
+	size_t size;
+	uint8_t data[];
+};
+
+struct oscmatch_set {
+	struct node* root;
+	uint64_t version;
+	void* data;
+	struct block* blocks;
+};
+
+struct entry {
+	struct entry* next;
+	uint32_t hash;
+	int32_t id;
+	char pattern[];
+};
+
+// A set or a deferred call, waiting for the readers
+struct retired {
+	uint64_t gen;			// published when it became unreachable
+	oscmatch_set_t* set;
+	void (*fn)(void*);
+	void* arg;
+	struct retired* next;
+};
+
+// One cache line each, so readers do not slow each other down
+struct reader {
+	uint64_t seen;			// version entered, 0 when outside
+	uint8_t pad[56];
+};
+
+struct oscmatch {
+	oscmatch_set_t* current;
+	uint64_t gen;			// version of current
+	struct reader* readers;
+	int nreaders;
+	struct retired* retired;
+	struct entry** buckets;
+	uint32_t mask;
+	int32_t count;
+};
+
+static uint32_t fnv(const char* s, int32_t len)
+{
+	uint32_t h = 2166136261u;
+	int32_t i;
+
+	for (i = 0; i < len; ++i) {
+		h = (h ^ (uint8_t)s[i]) * 16777619u;
+	}
+	return h;
+}
+
+/* ----------------------------------------------------------------------------
+ *	Patterns
+ */
+
+// Checks the brackets of one part of a pattern; returns 1 if it has wildcards
+static int checkpart(const char* p, int32_t len)
+{
+	const char* end = p + len;
+	int wild = 0;
+
+	for (; p < end; ++p) {
+		switch (*p) {
+			case '*':
+			case '?':
+				wild = 1;
+				break;
+			case '[':
+				if ((p = (const char*)memchr(p, ']', end - p)) == NULL) {
+					return -1;
+				}
+				wild = 1;
+				break;
+			case '{':
+				for (++p; p < end && *p != '}'; ++p) {
+					if (*p == '{' || *p == '[' || *p == '*' || *p == '?') {
+						return -1;
+					}
+				}
+				if (p == end) {
+					return -1;
+				}
+				wild = 1;
+				break;
+			case ']':
+			case '}':
+			case '#':
+			case ' ':
+				return -1;
+		}
+	}
+	return wild;
+}
+
+// Splits a pattern or an address into parts. Returns the number of parts,
+// or -1 if it is malformed.
+static int32_t split(const char* s, int32_t len, struct part* parts, int pattern)
+{
+	const char* end = s + len;
+	const char* e;
+	int32_t n = 0;
+	int deep;
+
+	if (len < 2 || s[0] != '/') {
+		return -1;
+	}
+	for (++s; s <= end; s = e + 1) {
+		deep = 0;
+		if (pattern && s < end && *s == '/') {
+			deep = 1;
+			s++;
+		}
+		if ((e = (const char*)memchr(s, '/', end - s)) == NULL) {
+			e = end;
+		}
+		if (e == s || n == MAX_DEPTH) {
+			return -1;
+		}
+		parts[n].s = s;
+		parts[n].len = (int32_t)(e - s);
+		parts[n].deep = deep;
+		parts[n].wild = 0;
+		if (pattern && (parts[n].wild = checkpart(s, parts[n].len)) == -1) {
+			return -1;
+		}
+		parts[n].hash = parts[n].wild ? 0 : fnv(s, parts[n].len);
+		n++;
+	}
+	return n;
+}
+
+// Matches one part of an address against one part of a pattern
+static int partmatch(const char* p, const char* pend, const char* s, const char* send)
+{
+	const char* q;
+	const char* close;
+	int neg, hit;
+
+	while (p < pend) {
+		switch (*p) {
+			case '*':
+				while (p < pend && *p == '*') {
+					p++;
+				}
+				if (p == pend) {
+					return 1;
+				}
+				for (; s < send; ++s) {
+					if (partmatch(p, pend, s, send)) {
+						return 1;
+					}
+				}
+				return 0;
+			case '?':
+				if (s == send) {
+					return 0;
+				}
+				p++;
+				s++;
+				break;
+			case '[':
+				if (s == send) {
+					return 0;
+				}
+				q = p + 1;
+				neg = q < pend && *q == '!';
+				q += neg;
+				for (hit = 0; q < pend && *q != ']'; ) {
+					if (q + 2 < pend && q[1] == '-' && q[2] != ']') {
+						hit |= *s >= q[0] && *s <= q[2];
+						q += 3;
+					}
+					else {
+						hit |= *s == *q++;
+					}
+				}
+				if (hit == neg) {
+					return 0;
+				}
+				p = q + 1;
+				s++;
+				break;
+			case '{':
+				close = (const char*)memchr(p, '}', pend - p);
+				for (q = p + 1; q <= close; q = p + 1) {
+					for (p = q; p < close && *p != ','; ++p)
+						;
+					if (send - s >= p - q && memcmp(q, s, p - q) == 0 &&
+						partmatch(close + 1, pend, s + (p - q), send)) {
+						return 1;
+					}
+				}
+				return 0;
+			default:
+				if (s == send || *p != *s) {
+					return 0;
+				}
+				p++;
+				s++;
+		}
+	}
+	return s == send;
+}
+
+static int partsmatch(const struct part* pp, int32_t np, const struct part* ap, int32_t na)
+{
+	int32_t k;
+
+	if (np == 0) {
+		return na == 0;
+	}
+	if (pp->deep) {
+		for (k = 0; k < na; ++k) {
+			if (partmatch(pp->s, pp->s + pp->len, ap[k].s, ap[k].s + ap[k].len) &&
+				partsmatch(pp + 1, np - 1, ap + k + 1, na - k - 1)) {
+				return 1;
+			}
+		}
+		return 0;
+	}
+	return na > 0 && partmatch(pp->s, pp->s + pp->len, ap->s, ap->s + ap->len) &&
+		   partsmatch(pp + 1, np - 1, ap + 1, na - 1);
+}
+
+int oscmatch_pattern(const char* pattern, const char* addr)
+{
+	struct part pp[MAX_DEPTH], ap[MAX_DEPTH];
+	int32_t np, na;
+
+	if ((np = split(pattern, (int32_t)strlen(pattern), pp, 1)) == -1) {
+		return -1;
+	}
+	if ((na = split(addr, (int32_t)strlen(addr), ap, 0)) == -1) {
+		return 0;
+	}
+	return partsmatch(pp, np, ap, na);
+}
+
+/* ----------------------------------------------------------------------------
+ *	Compiled sets
+ */
+
+static void* alloc(oscmatch_set_t* set, size_t size)
+{
+	struct block* b = set->blocks;
+	void* p;
+
+	size = (size + 7) & ~(size_t)7;
+	if (b == NULL || b->used + size > b->size) {
+		size_t bsize = size > BLOCK ? size : BLOCK;
+		if ((b = (struct block*)malloc(sizeof(struct block) + bsize)) == NULL) {
+			return NULL;
+		}
+		b->next = set->blocks;
+		b->used = 0;
+		b->size = bsize;
+		set->blocks = b;
+	}
+	p = b->data + b->used;
+	b->used += size;
+	memset(p, 0, size);
+	return p;
+}
+
+static void set_free(oscmatch_set_t* set)
+{
+	struct block* b;
+
+	while ((b = set->blocks) != NULL) {
+		set->blocks = b->next;
+		free(b);
+	}
+	free(set);
+}
+
+struct compiler {
+	oscmatch_set_t* set;
+	struct kid** map;		// children by parent and part, to share them
+	uint32_t mask;
+	struct node* all;
+};
+
+static struct node* newnode(struct compiler* c)
+{
+	struct node* n = (struct node*)alloc(c->set, sizeof(struct node));
+
+	if (n) {
+		n->all = c->all;
+		c->all = n;
+	}
+	return n;
+}
+
+// The child of parent for a part, created on first use
+static struct node* child(struct compiler* c, struct node* parent, const struct part* p)
+{
+	uint32_t h = (fnv(p->s, p->len) ^ (uint32_t)(uintptr_t)parent) * 2654435761u;
+	uint32_t i;
+	struct kid* k;
+	char* s;
+
+	for (i = h & c->mask; (k = c->map[i]) != NULL; i = (i + 1) & c->mask) {
+		if (k->parent == parent && k->c.len == p->len && memcmp(k->c.part, p->s, p->len) == 0) {
+			return k->c.node;
+		}
+	}
+	if ((k = (struct kid*)alloc(c->set, sizeof(struct kid))) == NULL ||
+		(s = (char*)alloc(c->set, p->len + 1)) == NULL ||
+		(k->c.node = newnode(c)) == NULL) {
+		return NULL;
+	}
+	memcpy(s, p->s, p->len);
+	k->c.part = s;
+	k->c.len = p->len;
+	k->c.hash = p->hash;
+	k->wild = p->wild;
+	k->parent = parent;
+	k->next = parent->kids;
+	parent->kids = k;
+	parent->nlit += !p->wild;
+	parent->nwild += p->wild;
+	c->map[i] = k;
+	return k->c.node;
+}
+
+static int insert(struct compiler* c, const struct entry* e)
+{
+	struct part parts[MAX_DEPTH];
+	struct node* n = c->set->root;
+	struct idl* l;
+	int32_t np, i;
+
+	np = split(e->pattern, (int32_t)strlen(e->pattern), parts, 1);
+	for (i = 0; i < np && n != NULL; ++i) {
+		if (parts[i].deep) {
+			if (n->deep == NULL) {
+				n->deep = newnode(c);
+			}
+			n = n->deep;
+		}
+		n = n ? child(c, n, &parts[i]) : NULL;
+	}
+	if (n == NULL || (l = (struct idl*)alloc(c->set, sizeof(struct idl))) == NULL) {
+		return -1;
+	}
+	l->id = e->id;
+	l->next = n->idl;
+	n->idl = l;
+	n->nids++;
+	return 0;
+}
+
+// Turns the lists built while inserting into tables and arrays
+static int finish(struct compiler* c)
+{
+	struct node* n;
+	struct kid* k;
+	struct idl* l;
+	uint32_t i;
+	int32_t w;
+
+	for (n = c->all; n != NULL; n = n->all) {
+		if (n->nlit > 0) {
+			for (n->mask = 1; n->mask + 1 < (uint32_t)n->nlit * 2; n->mask = n->mask * 2 + 1)
+				;
+			if ((n->lit = (struct child*)alloc(c->set, (n->mask + 1) * sizeof(struct child)))
+				== NULL) {
+				return -1;
+			}
+		}
+		if (n->nwild > 0 &&
+			(n->wild = (struct child*)alloc(c->set, n->nwild * sizeof(struct child))) == NULL) {
+			return -1;
+		}
+		for (w = 0, k = n->kids; k != NULL; k = k->next) {
+			if (k->wild) {
+				n->wild[w++] = k->c;
+				continue;
+			}
+			for (i = k->c.hash & n->mask; n->lit[i].part != NULL; i = (i + 1) & n->mask)
+				;
+			n->lit[i] = k->c;
+		}
+		if (n->nids > 0 &&
+			(n->ids = (int32_t*)alloc(c->set, n->nids * sizeof(int32_t))) == NULL) {
+			return -1;
+		}
+		for (w = n->nids, l = n->idl; l != NULL; l = l->next) {
+			n->ids[--w] = l->id;
+		}
+	}
+	return 0;
+}
+
+static oscmatch_set_t* compile(oscmatch_t* m, uint64_t version, void* data)
+{
+	struct compiler c;
+	struct entry* e;
+	const char* p;
+	size_t parts = 0;
+	uint32_t i, slots;
+	int rv = 0;
+
+	memset(&c, 0, sizeof(c));
+	if ((c.set = (oscmatch_set_t*)calloc(1, sizeof(oscmatch_set_t))) == NULL) {
+		fprintf(stderr, "oscmatch: Critical memory error...\n");
+		return NULL;
+	}
+	c.set->version = version;
+	c.set->data = data;
+
+	// Every part of every pattern can be a child; keep the map half empty
+	for (i = 0; i <= m->mask; ++i) {
+		for (e = m->buckets[i]; e != NULL; e = e->next) {
+			for (p = e->pattern; *p; ++p) {
+				parts += *p == '/';
+			}
+		}
+	}
+	for (slots = 1024; slots < parts * 2; slots *= 2)
+		;
+	c.mask = slots - 1;
+	if ((c.map = (struct kid**)calloc(slots, sizeof(struct kid*))) == NULL ||
+		(c.set->root = newnode(&c)) == NULL) {
+		rv = -1;
+	}
+	for (i = 0; rv == 0 && i <= m->mask; ++i) {
+		for (e = m->buckets[i]; e != NULL && rv == 0; e = e->next) {
+			rv = insert(&c, e);
+		}
+	}
+	if (rv == 0) {
+		rv = finish(&c);
+	}
+	free(c.map);
+	if (rv == -1) {
+		fprintf(stderr, "oscmatch: Critical memory error...\n");
+		set_free(c.set);
+		return NULL;
+	}
+	return c.set;
+}
+
+struct walk {
+	struct part parts[MAX_DEPTH];
+	int32_t nparts;
+	int32_t* ids;
+	int32_t max;
+	int32_t found;
+};
+
+static void visit(const struct node* n, struct walk* w, int32_t d)
+{
+	const struct part* p;
+	const struct child* c;
+	uint32_t i;
+	int32_t k;
+
+	if (d == w->nparts) {
+		for (k = 0; k < n->nids; ++k, ++w->found) {
+			if (w->found < w->max) {
+				w->ids[w->found] = n->ids[k];
+			}
+		}
+		return;
+	}
+	p = &w->parts[d];
+	if (n->lit) {
+		for (i = p->hash & n->mask; (c = &n->lit[i])->part != NULL; i = (i + 1) & n->mask) {
+			if (c->hash == p->hash && c->len == p->len && memcmp(c->part, p->s, p->len) == 0) {
+				visit(c->node, w, d + 1);
+				break;
+			}
+		}
+	}
+	for (k = 0; k < n->nwild; ++k) {
+		c = &n->wild[k];
+		if (partmatch(c->part, c->part + c->len, p->s, p->s + p->len)) {
+			visit(c->node, w, d + 1);
+		}
+	}
+	if (n->deep) {
+		for (k = d; k < w->nparts; ++k) {
+			visit(n->deep, w, k);
+		}
+	}
+}
+
+int32_t oscmatch_find(const oscmatch_set_t* set, const char* addr, int32_t len,
+					  int32_t* ids, int32_t max)
+{
+	struct walk w;
+
+	if ((w.nparts = split(addr, len, w.parts, 0)) == -1) {
+		return 0;
+	}
+	w.ids = ids;
+	w.max = max;
+	w.found = 0;
+	visit(set->root, &w, 0);
+	return w.found;
+}
+
+uint64_t oscmatch_version(const oscmatch_set_t* set)
+{
+	return set->version;
+}
+
+void* oscmatch_data(const oscmatch_set_t* set)
+{
+	return set->data;
+}
+
+/* ----------------------------------------------------------------------------
+ *	Subscriptions
+ */
+
+oscmatch_t* oscmatch_new(int readers)
+{
+	oscmatch_t* m;
+
+	if ((m = (oscmatch_t*)calloc(1, sizeof(oscmatch_t))) == NULL ||
+		(m->readers = (struct reader*)calloc(readers > 0 ? readers : 1,
+											 sizeof(struct reader))) == NULL ||
+		(m->buckets = (struct entry**)calloc(1024, sizeof(struct entry*))) == NULL) {
+		fprintf(stderr, "oscmatch: Critical memory error...\n");
+		if (m) {
+			free(m->readers);
+			free(m);
+		}
+		return NULL;
+	}
+	m->nreaders = readers;
+	m->mask = 1023;
+	if ((m->current = compile(m, 1, NULL)) == NULL) {
+		oscmatch_free(m);
+		return NULL;
+	}
+	m->gen = 1;
+	return m;
+}
+
+void oscmatch_free(oscmatch_t* m)
+{
+	struct entry* e;
+	struct retired* r;
+	uint32_t i;
+
+	while ((r = m->retired) != NULL) {
+		m->retired = r->next;
+		if (r->set) {
+			set_free(r->set);
+		}
+		else {
+			r->fn(r->arg);
+		}
+		free(r);
+	}
+	for (i = 0; i <= m->mask; ++i) {
+		while ((e = m->buckets[i]) != NULL) {
+			m->buckets[i] = e->next;
+			free(e);
+		}
+	}
+	if (m->current) {
+		set_free(m->current);
+	}
+	free(m->buckets);
+	free(m->readers);
+	free(m);
+}
+
+static struct entry** slot(oscmatch_t* m, const char* pattern, int32_t id, uint32_t* hash)
+{
+	struct entry** e;
+
+	*hash = fnv(pattern, (int32_t)strlen(pattern)) ^ ((uint32_t)id * 2654435761u);
+	for (e = &m->buckets[*hash & m->mask]; *e != NULL; e = &(*e)->next) {
+		if ((*e)->hash == *hash && (*e)->id == id && strcmp((*e)->pattern, pattern) == 0) {
+			break;
+		}
+	}
+	return e;
+}
+
+static void grow(oscmatch_t* m)
+{
+	struct entry** buckets;
+	struct entry* e;
+	uint32_t i, mask = m->mask * 2 + 1;
+
+	if ((buckets = (struct entry**)calloc(mask + 1, sizeof(struct entry*))) == NULL) {
+		return;
+	}
+	for (i = 0; i <= m->mask; ++i) {
+		while ((e = m->buckets[i]) != NULL) {
+			m->buckets[i] = e->next;
+			e->next = buckets[e->hash & mask];
+			buckets[e->hash & mask] = e;
+		}
+	}
+	free(m->buckets);
+	m->buckets = buckets;
+	m->mask = mask;
+}
+
+int oscmatch_add(oscmatch_t* m, const char* pattern, int32_t id)
+{
+	struct part parts[MAX_DEPTH];
+	struct entry** p;
+	struct entry* e;
+	uint32_t hash;
+	size_t len = strlen(pattern);
+
+	if (split(pattern, (int32_t)len, parts, 1) == -1) {
+		return -1;
+	}
+	if (*(p = slot(m, pattern, id, &hash)) != NULL) {
+		return 1;
+	}
+	if ((e = (struct entry*)malloc(sizeof(struct entry) + len + 1)) == NULL) {
+		fprintf(stderr, "oscmatch: Critical memory error...\n");
+		return -1;
+	}
+	e->hash = hash;
+	e->id = id;
+	memcpy(e->pattern, pattern, len + 1);
+	e->next = NULL;
+	*p = e;
+	if ((uint32_t)++m->count > m->mask) {
+		grow(m);
+	}
+	return 0;
+}
+
+int oscmatch_remove(oscmatch_t* m, const char* pattern, int32_t id)
+{
+	struct entry** p;
+	struct entry* e;
+	uint32_t hash;
+
+	if ((e = *(p = slot(m, pattern, id, &hash))) == NULL) {
+		return 1;
+	}
+	*p = e->next;
+	free(e);
+	m->count--;
+	return 0;
+}
+
+int32_t oscmatch_remove_id(oscmatch_t* m, int32_t id)
+{
+	struct entry** p;
+	struct entry* e;
+	int32_t n = 0;
+	uint32_t i;
+
+	for (i = 0; i <= m->mask; ++i) {
+		for (p = &m->buckets[i]; (e = *p) != NULL; ) {
+			if (e->id == id) {
+				*p = e->next;
+				free(e);
+				n++;
+			}
+			else {
+				p = &e->next;
+			}
+		}
+	}
+	m->count -= n;
+	return n;
+}
+
+int32_t oscmatch_count(oscmatch_t* m)
+{
+	return m->count;
+}
+
+/* ----------------------------------------------------------------------------
+ *	Readers
+ */
+
+static int retire(oscmatch_t* m, uint64_t gen, oscmatch_set_t* set, void (*fn)(void*),
+				  void* arg)
+{
+	struct retired* r;
+
+	if ((r = (struct retired*)malloc(sizeof(struct retired))) == NULL) {
+		fprintf(stderr, "oscmatch: Critical memory error...\n");
+		return -1;
+	}
+	r->gen = gen;
+	r->set = set;
+	r->fn = fn;
+	r->arg = arg;
+	r->next = m->retired;
+	m->retired = r;
+	return 0;
+}
+
+int oscmatch_publish(oscmatch_t* m, void* data)
+{
+	oscmatch_set_t* old = m->current;
+	oscmatch_set_t* set;
+
+	if ((set = compile(m, m->gen + 1, data)) == NULL) {
+		return -1;
+	}
+	// A reader that sees the new version also sees the new set
+	__atomic_store_n(&m->current, set, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&m->gen, m->gen + 1, __ATOMIC_SEQ_CST);
+	if (retire(m, m->gen, old, NULL, NULL) == -1) {
+		// Better to leak it than to free it under a reader
+		return 0;
+	}
+	oscmatch_reclaim(m);
+	return 0;
+}
+
+int oscmatch_defer(oscmatch_t* m, void (*fn)(void*), void* arg)
+{
+	// Unreachable once the next publish replaces the current set
+	return retire(m, m->gen + 1, NULL, fn, arg);
+}
+
+int32_t oscmatch_reclaim(oscmatch_t* m)
+{
+	struct retired** p;
+	struct retired* r;
+	uint64_t oldest = UINT64_MAX, seen;
+	int32_t waiting = 0;
+	int i;
+
+	for (i = 0; i < m->nreaders; ++i) {
+		seen = __atomic_load_n(&m->readers[i].seen, __ATOMIC_SEQ_CST);
+		if (seen != 0 && seen < oldest) {
+			oldest = seen;
+		}
+	}
+	for (p = &m->retired; (r = *p) != NULL; ) {
+		if (r->gen > m->gen || r->gen > oldest) {
+			waiting++;
+			p = &r->next;
+			continue;
+		}
+		*p = r->next;
+		if (r->set) {
+			set_free(r->set);
+		}
+		else {
+			r->fn(r->arg);
+		}
+		free(r);
+	}
+	return waiting;
+}
+
+const oscmatch_set_t* oscmatch_enter(oscmatch_t* m, int reader)
+{
+	__atomic_store_n(&m->readers[reader].seen, __atomic_load_n(&m->gen, __ATOMIC_SEQ_CST),
+					 __ATOMIC_SEQ_CST);
+	return __atomic_load_n(&m->current, __ATOMIC_SEQ_CST);
+}
+
+void oscmatch_leave(oscmatch_t* m, int reader)
+{
+	__atomic_store_n(&m->readers[reader].seen, 0, __ATOMIC_RELEASE);
+}
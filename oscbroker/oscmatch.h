@@ -0,0 +1,173 @@
+/******************************************************************************
+ *  oscmatch
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#ifndef __OSC_MATCH_H__
+#define __OSC_MATCH_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ *	oscmatch finds the subscriptions whose OSC address pattern matches an
+ *	address. Each subscription is a pattern and an integer ID chosen by the
+ *	caller, such as the index of a client.
+ *
+ *	Patterns use the OSC wildcards within a part of the address: '?' for any
+ *	character, '*' for any run of characters, "[a-z]" and "[!0-9]" for a
+ *	character in or out of a set, and "{gain,pan}" for one of several
+ *	strings. "//" matches any number of parts, as in OSC 1.1, so
+ *	"/mixer//gain" matches /mixer/gain and /mixer/ch/1/gain.
+ *
+ *	The subscriptions are compiled into a tree of address parts. Literal
+ *	parts are found by hash and only parts with wildcards are tried one by
+ *	one, so a lookup costs the depth of the address and the matches it has,
+ *	not the number of subscriptions.
+ *
+ *	One thread changes the subscriptions and publishes them as a new
+ *	compiled set; any number of reader threads look up addresses in the set
+ *	they entered, without a lock and without waiting for a publish. A set
+ *	that was replaced is freed once every reader has left it, as with RCU.
+ *	Readers should enter and leave around each batch of lookups, and be
+ *	outside while they block.
+ *
+ *	Usage example:
+ *		oscmatch_t* m = oscmatch_new(1);		// one reader
+ *		oscmatch_add(m, "/mixer/ch/[1-8]/gain", 3);
+ *		oscmatch_publish(m, NULL);
+ *		...
+ *		const oscmatch_set_t* set = oscmatch_enter(m, 0);	// reader 0
+ *		n = oscmatch_find(set, addr, len, ids, 64);
+ *		oscmatch_leave(m, 0);
+ */
+
+typedef struct oscmatch oscmatch_t;
+typedef struct oscmatch_set oscmatch_set_t;
+
+/*
+ *	oscmatch_new() creates an empty subscription list with an empty set
+ *	published.
+ *
+ *	Arguments:
+ *		int readers: Reader threads, numbered from 0.
+ *
+ *	Return:
+ *		State, or NULL on error.
+ */
+oscmatch_t* oscmatch_new(int readers);
+
+/* Frees everything; no reader may be inside a set. */
+void oscmatch_free(oscmatch_t* m);
+
+/*
+ *	oscmatch_add() and oscmatch_remove() change the subscription list. The
+ *	readers see the change after the next oscmatch_publish().
+ *
+ *	Return:
+ *		0 on success, 1 if there was nothing to do (the subscription was
+ *		already there, or was not there to remove), -1 if the pattern is
+ *		malformed or memory ran out.
+ */
+int oscmatch_add(oscmatch_t* m, const char* pattern, int32_t id);
+int oscmatch_remove(oscmatch_t* m, const char* pattern, int32_t id);
+
+/* Removes every subscription of id and returns how many there were. */
+int32_t oscmatch_remove_id(oscmatch_t* m, int32_t id);
+
+/* Number of subscriptions in the list. */
+int32_t oscmatch_count(oscmatch_t* m);
+
+/*
+ *	oscmatch_publish() compiles the subscription list into a new set and
+ *	hands it to the readers. Sets the readers left are freed.
+ *
+ *	Arguments:
+ *		void* data: Kept with the set for the readers (oscmatch_data()),
+ *					such as the table the IDs index.
+ *
+ *	Return:
+ *		0 on success, or -1 if memory ran out (the old set stays).
+ */
+int oscmatch_publish(oscmatch_t* m, void* data);
+
+/*
+ *	oscmatch_defer() calls fn(arg) once no reader can still see the set
+ *	published last, such as to close a client that was removed from the
+ *	data of the next one. It runs from oscmatch_publish(),
+ *	oscmatch_reclaim() or oscmatch_free().
+ *
+ *	Return:
+ *		0 on success, or -1 if memory ran out.
+ */
+int oscmatch_defer(oscmatch_t* m, void (*fn)(void*), void* arg);
+
+/*
+ *	oscmatch_reclaim() frees the sets and runs the deferred calls that no
+ *	reader can see any more, without waiting.
+ *
+ *	Return:
+ *		Number of them still waiting for a reader.
+ */
+int32_t oscmatch_reclaim(oscmatch_t* m);
+
+/*
+ *	oscmatch_enter() returns the newest set for a reader, which stays valid
+ *	until oscmatch_leave().
+ */
+const oscmatch_set_t* oscmatch_enter(oscmatch_t* m, int reader);
+void oscmatch_leave(oscmatch_t* m, int reader);
+
+/*
+ *	oscmatch_find() looks up the subscriptions that match an address.
+ *
+ *	Arguments:
+ *		const char* addr: Address without wildcards, len bytes.
+ *		int32_t* ids: Set to the IDs of the matching subscriptions. An ID
+ *					  appears more than once if several of its patterns
+ *					  match, or one pattern matches in several ways.
+ *		int32_t max: Entries of ids.
+ *
+ *	Return:
+ *		Number of IDs found, which may be more than max.
+ */
+int32_t oscmatch_find(const oscmatch_set_t* set, const char* addr, int32_t len,
+					  int32_t* ids, int32_t max);
+
+/* Version of a set, counting publishes from 1. */
+uint64_t oscmatch_version(const oscmatch_set_t* set);
+
+/* Data given to oscmatch_publish() with the set. */
+void* oscmatch_data(const oscmatch_set_t* set);
+
+/*
+ *	oscmatch_pattern() matches one pattern against an address directly.
+ *
+ *	Return:
+ *		1 if it matches, 0 if not, -1 if the pattern is malformed.
+ */
+int oscmatch_pattern(const char* pattern, const char* addr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __OSC_MATCH_H__
@@ -0,0 +1,475 @@
+/******************************************************************************
+ *  oscmatchtest
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *  Checks the wildcards of oscmatch, that a compiled set finds the same
+ *  subscriptions as matching every pattern in turn, and that sets and
+ *  deferred calls are only freed once readers have left, with a reader
+ *  thread looking up addresses while the subscriptions keep changing. Then
+ *  prints the cost of a lookup against the number of subscriptions, for the
+ *  compiled set and for a loop over the patterns.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "oscmatch.h"
+#include "../oscpack/osctest.h"
+
+const char usage[] = "usage: oscmatchtest [subscriptions]\n";
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint32_t next(uint32_t* x)
+{
+	*x ^= *x << 13;
+	*x ^= *x >> 17;
+	*x ^= *x << 5;
+	return *x;
+}
+
+static int cmp(const void* a, const void* b)
+{
+	int32_t x = *(const int32_t*)a, y = *(const int32_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+// Sorts ids and removes the repeats
+static int32_t unique(int32_t* ids, int32_t n)
+{
+	int32_t i, k = 0;
+
+	qsort(ids, n, sizeof(int32_t), cmp);
+	for (i = 0; i < n; ++i) {
+		if (k == 0 || ids[k - 1] != ids[i]) {
+			ids[k++] = ids[i];
+		}
+	}
+	return k;
+}
+
+static int32_t find(oscmatch_t* m, const char* addr, int32_t* ids, int32_t max)
+{
+	const oscmatch_set_t* set = oscmatch_enter(m, 0);
+	int32_t n = oscmatch_find(set, addr, (int32_t)strlen(addr), ids, max);
+
+	oscmatch_leave(m, 0);
+	return n;
+}
+
+/* ----------------------------------------------------------------------------
+ *	Checks
+ */
+
+static const struct {
+	const char* pattern;
+	const char* addr;
+	int match;
+} cases[] = {
+	{ "/mixer/gain", "/mixer/gain", 1 },
+	{ "/mixer/gain", "/mixer/gains", 0 },
+	{ "/mixer/gain", "/mixer", 0 },
+	{ "/mixer", "/mixer/gain", 0 },
+	{ "/mixer/*", "/mixer/gain", 1 },
+	{ "/mixer/*", "/mixer/ch/1", 0 },
+	{ "/*/gain", "/mixer/gain", 1 },
+	{ "/mix*", "/mixer", 1 },
+	{ "/mix*r", "/mixer", 1 },
+	{ "/m*x*r", "/mixer", 1 },
+	{ "/*er", "/er", 1 },
+	{ "/*x", "/mixer", 0 },
+	{ "/ch/?", "/ch/1", 1 },
+	{ "/ch/?", "/ch/10", 0 },
+	{ "/ch/??", "/ch/10", 1 },
+	{ "/ch/[1-8]", "/ch/5", 1 },
+	{ "/ch/[1-8]", "/ch/9", 0 },
+	{ "/ch/[!1-8]", "/ch/9", 1 },
+	{ "/ch/[!1-8]", "/ch/3", 0 },
+	{ "/ch/[abc]x", "/ch/bx", 1 },
+	{ "/ch/[a-]", "/ch/-", 1 },
+	{ "/ch/{gain,pan}", "/ch/pan", 1 },
+	{ "/ch/{gain,pan}", "/ch/mute", 0 },
+	{ "/ch/{gain,pan}", "/ch/gainx", 0 },
+	{ "/ch/x{,y}", "/ch/x", 1 },
+	{ "/ch/{a,ab}c", "/ch/abc", 1 },
+	{ "/ch/{a,ab}*", "/ch/ab", 1 },
+	{ "/mixer//gain", "/mixer/gain", 1 },
+	{ "/mixer//gain", "/mixer/ch/1/gain", 1 },
+	{ "/mixer//gain", "/mixer/ch/1/pan", 0 },
+	{ "/mixer//gain", "/other/gain", 0 },
+	{ "//gain", "/gain", 1 },
+	{ "//gain", "/a/b/c/gain", 1 },
+	{ "//ch//gain", "/mixer/ch/3/eq/gain", 1 },
+	{ "//[0-9]", "/a/b/7", 1 },
+	{ "/a//*", "/a/b/c", 1 },
+	{ "/a//*", "/a", 0 },
+};
+
+static const char* const bad[] = {
+	"", "mixer", "/", "/mixer/", "/mixer//", "/a///b", "/ch/[1-8", "/ch/1-8]",
+	"/ch/{a,b", "/ch/{a,{b}}", "/ch/{a/b}", "/ch/a b", "/ch/#1",
+};
+
+static void checkpatterns(void)
+{
+	int32_t i;
+	char what[256];
+
+	for (i = 0; i < (int32_t)(sizeof(cases) / sizeof(cases[0])); ++i) {
+		snprintf(what, sizeof(what), "%s %s %s", cases[i].pattern,
+				 cases[i].match ? "matches" : "does not match", cases[i].addr);
+		expect(oscmatch_pattern(cases[i].pattern, cases[i].addr) == cases[i].match, what);
+	}
+	for (i = 0; i < (int32_t)(sizeof(bad) / sizeof(bad[0])); ++i) {
+		snprintf(what, sizeof(what), "\"%s\" is malformed", bad[i]);
+		expect(oscmatch_pattern(bad[i], "/a") == -1, what);
+	}
+	expect(oscmatch_pattern("/a", "a") == 0 && oscmatch_pattern("/a", "/a/") == 0,
+		   "malformed addresses do not match");
+}
+
+static void checkset(void)
+{
+	oscmatch_t* m = oscmatch_new(1);
+	int32_t ids[64], n, i;
+	char what[256];
+
+	// Every case as its own subscription, found through the set
+	for (i = 0; i < (int32_t)(sizeof(cases) / sizeof(cases[0])); ++i) {
+		oscmatch_add(m, cases[i].pattern, i);
+	}
+	oscmatch_publish(m, NULL);
+	for (i = 0; i < (int32_t)(sizeof(cases) / sizeof(cases[0])); ++i) {
+		n = unique(ids, find(m, cases[i].addr, ids, 64));
+		snprintf(what, sizeof(what), "set agrees on %s %s", cases[i].pattern, cases[i].addr);
+		expect((bsearch(&i, ids, n, sizeof(int32_t), cmp) != NULL) == cases[i].match, what);
+	}
+	oscmatch_free(m);
+
+	m = oscmatch_new(1);
+	expect(oscmatch_version(oscmatch_enter(m, 0)) == 1 && find(m, "/a", ids, 64) == 0,
+		   "a new set is empty");
+	oscmatch_leave(m, 0);
+	expect(oscmatch_add(m, "/a/*", 1) == 0 && oscmatch_add(m, "/a/*", 1) == 1,
+		   "adding twice does nothing");
+	expect(oscmatch_add(m, "/a/*", 2) == 0 && oscmatch_add(m, "/a/b", 2) == 0 &&
+		   oscmatch_add(m, "//b", 2) == 0 && oscmatch_count(m) == 4, "adds");
+	expect(oscmatch_add(m, "/a/[b", 3) == -1 && oscmatch_count(m) == 4,
+		   "malformed patterns are refused");
+	expect(find(m, "/a/b", ids, 64) == 0, "changes wait for a publish");
+	oscmatch_publish(m, NULL);
+	n = find(m, "/a/b", ids, 64);
+	expect(n == 4, "an id is found once for each way it matches");
+	expect(find(m, "/a/b", ids, 2) == 4 && ids[0] > 0 && ids[1] > 0,
+		   "find counts past max");
+	expect(oscmatch_remove(m, "/a/b", 1) == 1 && oscmatch_remove(m, "/a/b", 2) == 0,
+		   "removes");
+	expect(oscmatch_remove_id(m, 2) == 2 && oscmatch_count(m) == 1, "removes by id");
+	oscmatch_publish(m, NULL);
+	n = find(m, "/a/b", ids, 64);
+	expect(n == 1 && ids[0] == 1, "removed subscriptions are gone");
+	expect(oscmatch_version(oscmatch_enter(m, 0)) == 3, "versions count publishes");
+	oscmatch_leave(m, 0);
+	oscmatch_free(m);
+}
+
+// Random patterns, compared with matching each one in turn
+static void checkrandom(void)
+{
+	static const char* const parts[] = { "a", "b", "ab", "c1", "c2" };
+	static const char* const wild[] = {
+		"a", "b", "ab", "c1", "c2", "*", "?", "a*", "[ab]", "[!a]", "c[1-2]", "{a,ab}",
+		"*b", "?2",
+	};
+	char patterns[500][64], addr[64];
+	int32_t ids[2048], want[500], n, k, i, j, depth, bad = 0;
+	uint32_t x = 2463534242u;
+	oscmatch_t* m = oscmatch_new(1);
+
+	for (i = 0; i < 500; ++i) {
+		depth = 1 + next(&x) % 4;
+		for (n = 0, j = 0; j < depth; ++j) {
+			n += snprintf(patterns[i] + n, 64 - n, "%s%s",
+						  next(&x) % 5 == 0 ? "//" : "/",
+						  wild[next(&x) % (sizeof(wild) / sizeof(wild[0]))]);
+		}
+		expect(oscmatch_add(m, patterns[i], i) == 0, patterns[i]);
+	}
+	oscmatch_publish(m, NULL);
+	for (i = 0; i < 5000; ++i) {
+		depth = 1 + next(&x) % 5;
+		for (n = 0, j = 0; j < depth; ++j) {
+			n += snprintf(addr + n, 64 - n, "/%s",
+						  parts[next(&x) % (sizeof(parts) / sizeof(parts[0]))]);
+		}
+		for (k = 0, j = 0; j < 500; ++j) {
+			if (oscmatch_pattern(patterns[j], addr) == 1) {
+				want[k++] = j;
+			}
+		}
+		n = unique(ids, find(m, addr, ids, 2048));
+		bad |= n != k || memcmp(ids, want, k * sizeof(int32_t)) != 0;
+	}
+	expect(!bad, "set finds what matching each pattern finds");
+	oscmatch_free(m);
+}
+
+static int calls;
+
+static void count(void* arg)
+{
+	(void)arg;
+	calls++;
+}
+
+static void checkreclaim(void)
+{
+	oscmatch_t* m = oscmatch_new(2);
+	const oscmatch_set_t* old;
+	int32_t ids[4];
+
+	oscmatch_add(m, "/a", 7);
+	oscmatch_publish(m, NULL);
+	old = oscmatch_enter(m, 1);
+	oscmatch_remove(m, "/a", 7);
+	oscmatch_defer(m, count, NULL);
+	oscmatch_publish(m, NULL);
+	expect(calls == 0 && oscmatch_reclaim(m) == 2, "nothing is freed under a reader");
+	expect(oscmatch_find(old, "/a", 2, ids, 4) == 1 && ids[0] == 7,
+		   "a reader keeps the set it entered");
+	expect(find(m, "/a", ids, 4) == 0, "other readers see the new set");
+	oscmatch_leave(m, 1);
+	expect(oscmatch_reclaim(m) == 0 && calls == 1, "freed once the reader left");
+
+	// A deferred call waits for the set after it
+	oscmatch_defer(m, count, NULL);
+	expect(oscmatch_reclaim(m) == 1 && calls == 1, "deferred calls wait for a publish");
+	oscmatch_publish(m, NULL);
+	expect(calls == 2, "and run after it");
+	oscmatch_defer(m, count, NULL);
+	oscmatch_free(m);
+	expect(calls == 3, "free runs what is left");
+}
+
+// Each set carries data that is freed with a deferred call; the reader
+// checks it, so a use after free shows as a wrong magic (or under ASan).
+struct data {
+	uint64_t version;
+	uint32_t magic;
+};
+
+static oscmatch_t* shared;
+static volatile int running;
+
+struct reader {
+	uint64_t lookups;
+	uint64_t errors;
+	uint64_t last;
+};
+
+static void* readloop(void* arg)
+{
+	struct reader* r = (struct reader*)arg;
+	const oscmatch_set_t* set;
+	const struct data* d;
+	int32_t ids[64], n;
+
+	while (running) {
+		set = oscmatch_enter(shared, 0);
+		d = (const struct data*)oscmatch_data(set);
+		n = oscmatch_find(set, "/mixer/ch/3/gain", 16, ids, 64);
+		if (oscmatch_version(set) < r->last || (d && (d->magic != 0x05c0ffee ||
+			d->version != oscmatch_version(set))) || n < 1 || ids[0] != 0) {
+			r->errors++;
+		}
+		r->last = oscmatch_version(set);
+		oscmatch_leave(shared, 0);
+		r->lookups++;
+	}
+	return NULL;
+}
+
+static void release(void* arg)
+{
+	((struct data*)arg)->magic = 0;
+	free(arg);
+}
+
+static void checkconcurrent(void)
+{
+	struct reader r;
+	struct data* d = NULL;
+	pthread_t thread;
+	char pattern[64];
+	int32_t i, waiting;
+
+	memset(&r, 0, sizeof(r));
+	shared = oscmatch_new(1);
+	oscmatch_add(shared, "/mixer/ch/[1-8]/gain", 0);
+	oscmatch_publish(shared, NULL);
+	running = 1;
+	pthread_create(&thread, NULL, readloop, &r);
+	for (i = 0; i < 2000; ++i) {
+		snprintf(pattern, sizeof(pattern), "/client/%d/*", i % 100);
+		if (i < 1000) {
+			oscmatch_add(shared, pattern, i);
+		}
+		else {
+			oscmatch_remove(shared, pattern, i - 1000);
+		}
+		if (d) {
+			oscmatch_defer(shared, release, d);
+		}
+		d = (struct data*)malloc(sizeof(struct data));
+		d->version = (uint64_t)i + 3;
+		d->magic = 0x05c0ffee;
+		oscmatch_publish(shared, d);
+	}
+	running = 0;
+	pthread_join(thread, NULL);
+	waiting = oscmatch_reclaim(shared);
+	expect(r.errors == 0, "a reader sees whole sets while they change");
+	expect(r.lookups > 0 && waiting == 0, "everything is freed after the reader");
+	expect(oscmatch_count(shared) == 1, "the subscriptions add up");
+	oscmatch_defer(shared, release, d);
+	oscmatch_free(shared);
+	printf("    %d publishes during %llu lookups\n", i, (unsigned long long)r.lookups);
+}
+
+/* ----------------------------------------------------------------------------
+ *	Benchmark
+ */
+
+static void pattern(char* buf, size_t size, int32_t i, int32_t n)
+{
+	switch (i % 10) {
+		case 0:
+		case 1:
+		case 2:
+			snprintf(buf, size, "/client/%d/ch/[1-8]/*", i % (n / 10 + 1));
+			break;
+		case 3:
+			snprintf(buf, size, "/fx/%d/*", i);
+			break;
+		default:
+			snprintf(buf, size, "/mixer/ch/%d/gain", i);
+	}
+}
+
+static void bench(int32_t max)
+{
+	static const char* const kinds[] = { "/mixer/ch/%d/gain", "/client/%d/ch/3/level",
+										 "/fx/%d/mix" };
+	char (*patterns)[64];
+	char (*addrs)[64];
+	int32_t ids[4096], n, i, k, sizes[4], found;
+	oscmatch_t* m;
+	uint64_t t, tpub, matches, sink = 0;
+	double trie, naive;
+	uint32_t x = 88675123u;
+	const oscmatch_set_t* set;
+	int s;
+
+	patterns = (char(*)[64])malloc((size_t)max * 64);
+	addrs = (char(*)[64])malloc(4096 * 64);
+	printf("%14s %12s %12s %12s %10s\n", "subscriptions", "publish", "trie", "naive",
+		   "matches");
+	printf("%14s %12s %12s %12s %10s\n", "", "(ms)", "(ns/lookup)", "(ns/lookup)",
+		   "(each)");
+	sizes[0] = 100;
+	sizes[1] = 1000;
+	sizes[2] = 10000;
+	sizes[3] = max;
+	for (s = 0; s < 4; ++s) {
+		n = sizes[s];
+		if (n > max || (s > 0 && n <= sizes[s - 1])) {
+			continue;
+		}
+		m = oscmatch_new(1);
+		for (i = 0; i < n; ++i) {
+			pattern(patterns[i], 64, i, n);
+			oscmatch_add(m, patterns[i], i);
+		}
+		t = now_ns();
+		oscmatch_publish(m, NULL);
+		tpub = now_ns() - t;
+		for (i = 0; i < 4096; ++i) {
+			snprintf(addrs[i], 64, kinds[next(&x) % 3], (int32_t)(next(&x) % (n / 10 + 1)) *
+					 (i % 3 == 1 ? 1 : 10));
+		}
+
+		set = oscmatch_enter(m, 0);
+		matches = 0;
+		t = now_ns();
+		for (k = 0; k < 100; ++k) {
+			for (i = 0; i < 4096; ++i) {
+				found = oscmatch_find(set, addrs[i], (int32_t)strlen(addrs[i]), ids, 4096);
+				matches += found;
+				sink += found ? ids[0] : 0;
+			}
+		}
+		trie = (double)(now_ns() - t) / (100 * 4096);
+		oscmatch_leave(m, 0);
+
+		// The loop is slow; fewer lookups are enough
+		t = now_ns();
+		for (i = 0; i < 4096 * 10 / (n / 100) + 1 && i < 4096; ++i) {
+			for (k = 0; k < n; ++k) {
+				sink += oscmatch_pattern(patterns[k], addrs[i]) == 1;
+			}
+		}
+		naive = (double)(now_ns() - t) / i;
+
+		printf("%14d %12.2f %12.1f %12.0f %10.1f\n", n, tpub / 1e6, trie, naive,
+			   (double)matches / (100 * 4096));
+		oscmatch_free(m);
+	}
+	if (sink == 42) {
+		printf("\n");
+	}
+	free(patterns);
+	free(addrs);
+}
+
+int main (int argc, char* const argv[])
+{
+	int32_t n = argc > 1 ? atoi(argv[1]) : 100000;
+
+	if (n <= 0) {
+		printf(usage);
+		return 1;
+	}
+	printf("checks:\n");
+	checkpatterns();
+	checkset();
+	checkrandom();
+	checkreclaim();
+	checkconcurrent();
+	osctest_report();
+	printf("\n");
+	bench(n);
+	return osctest_errors != 0;
+}
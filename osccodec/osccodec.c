@@ -0,0 +1,149 @@
+/******************************************************************************
+ *  osccodec
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#include "osccodec.h"
+
+#if defined(__SSE2__) && !OSCCODEC_BIG_ENDIAN
+#include <emmintrin.h>
+
+// SSE2 has no byte shuffle: swap the bytes of each 16-bit word, then the
+// words of each value.
+static inline __m128i swap16x8(__m128i x)
+{
+	return _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+}
+
+static inline __m128i swap32x4(__m128i x)
+{
+	x = swap16x8(x);
+	x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+	return _mm_shufflehi_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+}
+
+static inline __m128i swap64x2(__m128i x)
+{
+	x = swap16x8(x);
+	x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+	return _mm_shufflehi_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+}
+#endif
+
+// Values are only bits here, so one loop per width serves integers and
+// floats alike.
+
+static void swap32v(void* dst, const void* src, int32_t n)
+{
+	uint8_t* d = (uint8_t*)dst;
+	const uint8_t* s = (const uint8_t*)src;
+	uint32_t v;
+	int32_t i = 0;
+
+#if OSCCODEC_BIG_ENDIAN
+	if (d != s) {
+		memcpy(d, s, (size_t)n * 4);
+	}
+	(void)v;
+	(void)i;
+#else
+#ifdef __SSE2__
+	for (; i + 8 <= n; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i*)(s + (size_t)i * 4));
+		__m128i b = _mm_loadu_si128((const __m128i*)(s + (size_t)i * 4 + 16));
+		_mm_storeu_si128((__m128i*)(d + (size_t)i * 4), swap32x4(a));
+		_mm_storeu_si128((__m128i*)(d + (size_t)i * 4 + 16), swap32x4(b));
+	}
+#endif
+	for (; i < n; ++i) {
+		memcpy(&v, s + (size_t)i * 4, 4);
+		v = oscswap32(v);
+		memcpy(d + (size_t)i * 4, &v, 4);
+	}
+#endif
+}
+
+static void swap64v(void* dst, const void* src, int32_t n)
+{
+	uint8_t* d = (uint8_t*)dst;
+	const uint8_t* s = (const uint8_t*)src;
+	uint64_t v;
+	int32_t i = 0;
+
+#if OSCCODEC_BIG_ENDIAN
+	if (d != s) {
+		memcpy(d, s, (size_t)n * 8);
+	}
+	(void)v;
+	(void)i;
+#else
+#ifdef __SSE2__
+	for (; i + 4 <= n; i += 4) {
+		__m128i a = _mm_loadu_si128((const __m128i*)(s + (size_t)i * 8));
+		__m128i b = _mm_loadu_si128((const __m128i*)(s + (size_t)i * 8 + 16));
+		_mm_storeu_si128((__m128i*)(d + (size_t)i * 8), swap64x2(a));
+		_mm_storeu_si128((__m128i*)(d + (size_t)i * 8 + 16), swap64x2(b));
+	}
+#endif
+	for (; i < n; ++i) {
+		memcpy(&v, s + (size_t)i * 8, 8);
+		v = oscswap64(v);
+		memcpy(d + (size_t)i * 8, &v, 8);
+	}
+#endif
+}
+
+void oscload32v(uint32_t* dst, const void* src, int32_t n)
+{
+	swap32v(dst, src, n);
+}
+
+void oscload64v(uint64_t* dst, const void* src, int32_t n)
+{
+	swap64v(dst, src, n);
+}
+
+void oscstore32v(void* dst, const uint32_t* src, int32_t n)
+{
+	swap32v(dst, src, n);
+}
+
+void oscstore64v(void* dst, const uint64_t* src, int32_t n)
+{
+	swap64v(dst, src, n);
+}
+
+void oscloadfv(float* dst, const void* src, int32_t n)
+{
+	swap32v(dst, src, n);
+}
+
+void oscloaddv(double* dst, const void* src, int32_t n)
+{
+	swap64v(dst, src, n);
+}
+
+void oscstorefv(void* dst, const float* src, int32_t n)
+{
+	swap32v(dst, src, n);
+}
+
+void oscstoredv(void* dst, const double* src, int32_t n)
+{
+	swap64v(dst, src, n);
+}
@@ -0,0 +1,158 @@
+/******************************************************************************
+ *  osccodec
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#ifndef __OSC_CODEC_H__
+#define __OSC_CODEC_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ *	osccodec reads and writes the big-endian numbers of OSC. The loads and
+ *	stores take any byte pointer, aligned or not, and copy the bits of floats
+ *	and doubles unchanged, NaN payloads included. They are inline, so code
+ *	that only uses them needs nothing more than this header; the bulk
+ *	conversions are in osccodec.c.
+ *
+ *	The byte order of the host is chosen when compiling: on a big-endian host
+ *	the swaps are no-ops.
+ *
+ *	Usage example:
+ *		oscstore32(buf, (uint32_t)size);
+ *		oscstoref(buf + 4, 0.5f);
+ *		float gain = oscloadf(buf + 4);
+ */
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define OSCCODEC_BIG_ENDIAN 1
+#elif (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || \
+	  defined(_WIN32)
+#define OSCCODEC_BIG_ENDIAN 0
+#else
+#error "osccodec: Unknown byte order"
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define oscswap32(x) __builtin_bswap32(x)
+#define oscswap64(x) __builtin_bswap64(x)
+#elif defined(_MSC_VER)
+#include <stdlib.h>
+#define oscswap32(x) _byteswap_ulong(x)
+#define oscswap64(x) _byteswap_uint64(x)
+#else
+static inline uint32_t oscswap32(uint32_t x)
+{
+	return (x >> 24) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) | (x << 24);
+}
+
+static inline uint64_t oscswap64(uint64_t x)
+{
+	return ((uint64_t)oscswap32((uint32_t)x) << 32) | oscswap32((uint32_t)(x >> 32));
+}
+#endif
+
+/* Host to big-endian and back (the same swap both ways). */
+#if OSCCODEC_BIG_ENDIAN
+#define oscbe32(x) ((uint32_t)(x))
+#define oscbe64(x) ((uint64_t)(x))
+#else
+#define oscbe32(x) oscswap32((uint32_t)(x))
+#define oscbe64(x) oscswap64((uint64_t)(x))
+#endif
+
+static inline uint32_t oscload32(const void* p)
+{
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return oscbe32(v);
+}
+
+static inline uint64_t oscload64(const void* p)
+{
+	uint64_t v;
+	memcpy(&v, p, 8);
+	return oscbe64(v);
+}
+
+static inline void oscstore32(void* p, uint32_t v)
+{
+	v = oscbe32(v);
+	memcpy(p, &v, 4);
+}
+
+static inline void oscstore64(void* p, uint64_t v)
+{
+	v = oscbe64(v);
+	memcpy(p, &v, 8);
+}
+
+static inline float oscloadf(const void* p)
+{
+	uint32_t v = oscload32(p);
+	float f;
+	memcpy(&f, &v, 4);
+	return f;
+}
+
+static inline double oscloadd(const void* p)
+{
+	uint64_t v = oscload64(p);
+	double d;
+	memcpy(&d, &v, 8);
+	return d;
+}
+
+static inline void oscstoref(void* p, float f)
+{
+	uint32_t v;
+	memcpy(&v, &f, 4);
+	oscstore32(p, v);
+}
+
+static inline void oscstored(void* p, double d)
+{
+	uint64_t v;
+	memcpy(&v, &d, 8);
+	oscstore64(p, v);
+}
+
+/*
+ *	Bulk conversions of n values between host arrays and big-endian bytes,
+ *	such as the arguments of a long message or a blob of samples. src and dst
+ *	may be unaligned but must not overlap, except that dst may equal src.
+ */
+void oscload32v(uint32_t* dst, const void* src, int32_t n);
+void oscload64v(uint64_t* dst, const void* src, int32_t n);
+void oscstore32v(void* dst, const uint32_t* src, int32_t n);
+void oscstore64v(void* dst, const uint64_t* src, int32_t n);
+void oscloadfv(float* dst, const void* src, int32_t n);
+void oscloaddv(double* dst, const void* src, int32_t n);
+void oscstorefv(void* dst, const float* src, int32_t n);
+void oscstoredv(void* dst, const double* src, int32_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __OSC_CODEC_H__
@@ -0,0 +1,318 @@
+/******************************************************************************
+ *  osccodectest
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *  Checks the byte layout of osccodec, that every float and a sample of
+ *  doubles (NaN payloads, denormals and infinities included) come back bit
+ *  for bit at every alignment, that the bulk conversions match the single
+ *  ones, and that oscpack and oscunpack keep 64-bit values intact. Then
+ *  prints nanoseconds per value for the shift and ntohl() code the tools
+ *  used before, the inline stores and the bulk conversions.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <float.h>
+#include <math.h>
+#include <arpa/inet.h>
+
+#include "osccodec.h"
+#include "../oscpack/oscpack.h"
+#include "../oscpack/oscunpack.h"
+#include "../oscpack/osctest.h"
+
+const char usage[] = "usage: osccodectest [values]\n";
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t next(uint64_t* x)
+{
+	*x ^= *x << 13;
+	*x ^= *x >> 7;
+	*x ^= *x << 17;
+	return *x;
+}
+
+static uint64_t bits(double d)
+{
+	uint64_t v;
+	memcpy(&v, &d, 8);
+	return v;
+}
+
+static double real(uint64_t v)
+{
+	double d;
+	memcpy(&d, &v, 8);
+	return d;
+}
+
+/* ----------------------------------------------------------------------------
+ *	Checks
+ */
+
+static void check(void)
+{
+	static const uint64_t specials[] = {
+		0x0000000000000000ull, 0x8000000000000000ull,	// +0, -0
+		0x7ff0000000000000ull, 0xfff0000000000000ull,	// inf
+		0x7ff8000000000000ull, 0xfff8000000000001ull,	// quiet NaN
+		0x7ff0000000000001ull, 0x7ff4000000000000ull,	// signalling NaN
+		0x000fffffffffffffull, 0x0000000000000001ull,	// denormals
+		0x0010000000000000ull, 0x7fefffffffffffffull,	// DBL_MIN, DBL_MAX
+		0x3ff0000000000000ull, 0x0123456789abcdefull,
+	};
+	uint8_t buf[64], packet[64];
+	uint32_t u32[67], w32[67];
+	uint64_t u64[67], w64[67], x = 88172645463325252ull, v;
+	float f, fs[67];
+	double d, ds[67];
+	oscmsg_t msg;
+	oscargs_t it;
+	oscarg_t arg;
+	int32_t n, i, off, bad;
+
+	printf("checks:\n");
+
+	// Byte layout
+	oscstore32(buf, 0x01020304);
+	expect(memcmp(buf, "\1\2\3\4", 4) == 0, "int32 is big-endian");
+	oscstore64(buf, 0x0102030405060708ull);
+	expect(memcmp(buf, "\1\2\3\4\5\6\7\10", 8) == 0, "int64 is big-endian");
+	oscstoref(buf, 1.0f);
+	expect(memcmp(buf, "\77\200\0\0", 4) == 0, "float is IEEE big-endian");
+	oscstored(buf, -2.0);
+	expect(memcmp(buf, "\300\0\0\0\0\0\0\0", 8) == 0, "double is IEEE big-endian");
+	expect(oscload32("\377\376\375\374") == 0xfffefdfc, "int32 loads");
+	expect(oscswap64(oscswap64(0x0123456789abcdefull)) == 0x0123456789abcdefull,
+		   "swap twice is the same");
+
+	// Every float, at every alignment of the buffer
+	bad = 0;
+	v = 0;
+	do {
+		memcpy(&f, &v, 4);
+		off = (int32_t)(v & 3);
+		oscstoref(buf + off, f);
+		f = oscloadf(buf + off);
+		bad |= memcmp(&f, &v, 4) != 0 || oscload32(buf + off) != (uint32_t)v;
+	} while (++v <= 0xffffffffull);
+	expect(!bad, "every float comes back bit for bit");
+
+	// Doubles: the specials and random patterns
+	bad = 0;
+	for (i = 0; i < (int32_t)(sizeof(specials) / sizeof(specials[0])); ++i) {
+		for (off = 0; off < 8; ++off) {
+			oscstored(buf + off, real(specials[i]));
+			bad |= bits(oscloadd(buf + off)) != specials[i];
+			oscstored(buf + off, -real(specials[i]));
+			bad |= bits(oscloadd(buf + off)) != (specials[i] ^ 0x8000000000000000ull);
+		}
+	}
+	for (i = 0; i < 10000000; ++i) {
+		v = next(&x);
+		off = i & 7;
+		oscstored(buf + off, real(v));
+		bad |= bits(oscloadd(buf + off)) != v || oscload64(buf + off) != v;
+	}
+	expect(!bad, "doubles come back bit for bit");
+
+	// Bulk conversions match the single ones, at odd sizes and offsets
+	bad = 0;
+	for (n = 0; n <= 64; n += 7) {
+		for (off = 0; off < 4; ++off) {
+			uint8_t raw[67 * 8 + 8];
+			for (i = 0; i < n; ++i) {
+				u32[i] = (uint32_t)next(&x);
+				u64[i] = next(&x);
+			}
+			oscstore32v(raw + off, u32, n);
+			for (i = 0; i < n; ++i) {
+				bad |= oscload32(raw + off + i * 4) != u32[i];
+			}
+			oscload32v(w32, raw + off, n);
+			oscloadfv(fs, raw + off, n);
+			bad |= memcmp(w32, u32, n * 4) != 0 || memcmp(fs, u32, n * 4) != 0;
+			oscstorefv(raw + off, fs, n);
+			oscload32v(w32, raw + off, n);
+			bad |= memcmp(w32, u32, n * 4) != 0;
+
+			oscstore64v(raw + off, u64, n);
+			for (i = 0; i < n; ++i) {
+				bad |= oscload64(raw + off + i * 8) != u64[i];
+			}
+			oscload64v(w64, raw + off, n);
+			oscloaddv(ds, raw + off, n);
+			bad |= memcmp(w64, u64, n * 8) != 0 || memcmp(ds, u64, n * 8) != 0;
+			oscstoredv(raw + off, ds, n);
+			oscload64v(w64, raw + off, n);
+			bad |= memcmp(w64, u64, n * 8) != 0;
+
+			// In place
+			memcpy(w64, u64, n * 8);
+			oscstore64v(w64, w64, n);
+			oscload64v(w64, w64, n);
+			bad |= memcmp(w64, u64, n * 8) != 0;
+		}
+	}
+	expect(!bad, "bulk conversions match");
+
+	// Through oscpack and oscunpack, with a negative int64 and a NaN payload
+	d = real(0xfff8000000000001ull);
+	n = oscpack(packet, "/v", "hdfi", (int64_t)-2, d, -0.0f, INT32_MIN);
+	expect(n > 0 && oscunpack(packet, n, &msg) == 0, "packs and unpacks");
+	oscargs(&msg, &it);
+	expect(oscargs_next(&it, &arg) && arg.h == -2, "negative int64 round trip");
+	expect(oscargs_next(&it, &arg) && bits(arg.d) == 0xfff8000000000001ull,
+		   "double round trip is bit exact");
+	expect(oscargs_next(&it, &arg) && signbit(arg.f) && arg.f == 0.0f, "-0 float round trip");
+	expect(oscargs_next(&it, &arg) && arg.i == INT32_MIN, "int32 round trip");
+	n = oscpack(packet, "/v", "hd", (int64_t)0x0123456789abcdefll, DBL_MAX);
+	oscunpack(packet, n, &msg);
+	oscargs(&msg, &it);
+	expect(oscargs_next(&it, &arg) && arg.h == 0x0123456789abcdefll, "int64 round trip");
+	expect(oscargs_next(&it, &arg) && arg.d == DBL_MAX, "DBL_MAX round trip");
+
+	osctest_report();
+	printf("\n");
+}
+
+/* ----------------------------------------------------------------------------
+ *	Benchmark
+ */
+
+// The shift and ntohl() composition oscpack, oscsend and oscraw carried
+// before, with its signed shifts made unsigned and the bits read with
+// memcpy() rather than through a cast pointer, so that it is defined
+static inline int32_t legacy_htonf(float x)
+{
+	uint32_t v;
+
+	memcpy(&v, &x, 4);
+	return (int32_t)htonl(v);
+}
+
+static inline int64_t legacy_htond(double x)
+{
+	uint64_t v;
+
+	memcpy(&v, &x, 8);
+	return (int64_t)(((uint64_t)ntohl((uint32_t)((v << 32) >> 32)) << 32) |
+					 ntohl((uint32_t)(v >> 32)));
+}
+
+static volatile uint64_t sink;
+
+static void bench(int32_t n)
+{
+	double* src = (double*)malloc(n * sizeof(double));
+	float* srcf = (float*)malloc(n * sizeof(float));
+	uint8_t* raw = (uint8_t*)malloc(n * 8 + 8);
+	uint64_t t, x = 2463534242ull, sum, total;
+	int64_t bit64;
+	int32_t bit32, i, r, rounds = (1 << 24) / n + 1;
+	double ns[6];
+	int k;
+
+	total = (uint64_t)rounds * n;
+	for (i = 0; i < n; ++i) {
+		src[i] = (double)next(&x) / 3.0;
+		srcf[i] = (float)src[i];
+	}
+
+	for (k = 0; k < 2; ++k) {	// the first round warms up
+		t = now_ns();
+		for (r = 0; r < rounds; ++r) {
+			for (i = 0; i < n; ++i) {
+				bit64 = legacy_htond(src[i]);
+				memcpy(raw + i * 8, &bit64, 8);
+			}
+		}
+		ns[0] = (double)(now_ns() - t) / total;
+
+		t = now_ns();
+		for (r = 0; r < rounds; ++r) {
+			for (i = 0; i < n; ++i) {
+				oscstored(raw + i * 8, src[i]);
+			}
+		}
+		ns[1] = (double)(now_ns() - t) / total;
+
+		t = now_ns();
+		for (r = 0; r < rounds; ++r) {
+			oscstoredv(raw, src, n);
+		}
+		ns[2] = (double)(now_ns() - t) / total;
+
+		t = now_ns();
+		for (r = 0; r < rounds; ++r) {
+			for (i = 0; i < n; ++i) {
+				bit32 = legacy_htonf(srcf[i]);
+				memcpy(raw + i * 4, &bit32, 4);
+			}
+		}
+		ns[3] = (double)(now_ns() - t) / total;
+
+		t = now_ns();
+		for (r = 0; r < rounds; ++r) {
+			for (i = 0; i < n; ++i) {
+				oscstoref(raw + i * 4, srcf[i]);
+			}
+		}
+		ns[4] = (double)(now_ns() - t) / total;
+
+		t = now_ns();
+		for (r = 0; r < rounds; ++r) {
+			oscstorefv(raw, srcf, n);
+		}
+		ns[5] = (double)(now_ns() - t) / total;
+	}
+	for (sum = 0, i = 0; i < n * 4; i += 4096) {
+		sum += raw[i];
+	}
+	sink = sum;
+
+	printf("%d values converted %d times, nanoseconds per value\n", n, rounds);
+	printf("%-8s %10s %10s %10s\n", "", "legacy", "inline", "bulk");
+	printf("%-8s %10.3f %10.3f %10.3f\n", "double", ns[0], ns[1], ns[2]);
+	printf("%-8s %10.3f %10.3f %10.3f\n", "float", ns[3], ns[4], ns[5]);
+
+	free(src);
+	free(srcf);
+	free(raw);
+}
+
+int main (int argc, char* const argv[])
+{
+	int32_t n = argc > 1 ? atoi(argv[1]) : 4096;
+
+	if (n <= 0) {
+		printf(usage);
+		return 1;
+	}
+	check();
+	bench(n);
+	return osctest_errors != 0;
+}
@@ -0,0 +1,603 @@
+/******************************************************************************
+ *  oscdelta
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#include "oscdelta.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+enum { OP_DEFINE = 1, OP_ARGS, OP_DELTA, OP_RAW, OP_BUNDLE };
+
+// A peer may not make us allocate more than this many entries
+#define MAX_ENTRIES 65536
+
+// Deepest nested bundle encoded element by element
+#define MAX_DEPTH 8
+
+struct entry {
+	uint32_t hash;
+	int32_t next;		// next entry in the same bucket, or -1
+	int32_t hlen;		// header (address and type tag) size; 0 if unused
+	int32_t alen;		// argument size
+	int32_t cap;
+	int ref;			// used since the clock hand last passed
+	uint8_t* data;		// header followed by the last arguments
+};
+
+struct oscdelta {
+	int32_t entries;
+	int32_t used;
+	int32_t hand;
+	uint32_t mask;
+	int32_t* buckets;
+	struct entry* entry;
+	uint64_t timetag;		// of the last bundle
+	uint64_t packets;
+	uint64_t bytes;
+	uint64_t coded;
+};
+
+oscdelta_t* oscdelta_new(int32_t entries)
+{
+	oscdelta_t* d;
+	uint32_t nbuckets = 1;
+
+	if (entries < 1 || entries > MAX_ENTRIES) {
+		fprintf(stderr, "oscdelta: Invalid number of entries %d\n", entries);
+		return NULL;
+	}
+	while (nbuckets < (uint32_t)entries * 2) {
+		nbuckets <<= 1;
+	}
+	d = (oscdelta_t*)calloc(1, sizeof(oscdelta_t));
+	if (d) {
+		d->buckets = (int32_t*)malloc(nbuckets * sizeof(int32_t));
+		d->entry = (struct entry*)calloc(entries, sizeof(struct entry));
+	}
+	if (!d || !d->buckets || !d->entry) {
+		fprintf(stderr, "oscdelta: Critical memory error...\n");
+		oscdelta_free(d);
+		return NULL;
+	}
+	memset(d->buckets, 0xff, nbuckets * sizeof(int32_t));
+	d->entries = entries;
+	d->mask = nbuckets - 1;
+	return d;
+}
+
+void oscdelta_free(oscdelta_t* d)
+{
+	int32_t i;
+
+	if (!d) {
+		return;
+	}
+	if (d->entry) {
+		for (i = 0; i < d->entries; ++i) {
+			free(d->entry[i].data);
+		}
+	}
+	free(d->entry);
+	free(d->buckets);
+	free(d);
+}
+
+void oscdelta_stats(const oscdelta_t* d, uint64_t* packets, uint64_t* bytes,
+					uint64_t* coded)
+{
+	if (packets) *packets = d->packets;
+	if (bytes) *bytes = d->bytes;
+	if (coded) *coded = d->coded;
+}
+
+// Size of the address and type tag of a message, or -1 for bundles and
+// anything that is not a well-formed message.
+static int32_t header(const uint8_t* buf, int32_t size)
+{
+	const uint8_t* end;
+	int32_t alen, tlen;
+
+	if (size < 8 || size % 4 != 0 || buf[0] != '/') {
+		return -1;
+	}
+	if (!(end = (const uint8_t*)memchr(buf, '\0', size))) {
+		return -1;
+	}
+	alen = (int32_t)(end - buf + 4) & ~3;
+	if (alen >= size || buf[alen] != ',') {
+		return -1;
+	}
+	if (!(end = (const uint8_t*)memchr(buf + alen, '\0', size - alen))) {
+		return -1;
+	}
+	tlen = (int32_t)(end - (buf + alen) + 4) & ~3;
+	return alen + tlen <= size ? alen + tlen : -1;
+}
+
+static uint32_t hash(const uint8_t* buf, int32_t len)
+{
+	uint32_t h = 2166136261u;
+	int32_t i;
+
+	for (i = 0; i < len; ++i) {
+		h = (h ^ buf[i]) * 16777619u;
+	}
+	return h;
+}
+
+static int32_t putvar(uint8_t* out, uint64_t v)
+{
+	int32_t n = 0;
+
+	while (v >= 0x80) {
+		out[n++] = (uint8_t)(v | 0x80);
+		v >>= 7;
+	}
+	out[n++] = (uint8_t)v;
+	return n;
+}
+
+static int32_t varsize(uint64_t v)
+{
+	int32_t n = 1;
+
+	while (v >= 0x80) {
+		v >>= 7;
+		++n;
+	}
+	return n;
+}
+
+static int32_t getvar(const uint8_t* in, int32_t size, uint64_t* v)
+{
+	int32_t n;
+
+	*v = 0;
+	for (n = 0; n < size && n < 10; ++n) {
+		*v |= (uint64_t)(in[n] & 0x7f) << (7 * n);
+		if (!(in[n] & 0x80)) {
+			return n + 1;
+		}
+	}
+	return -1;
+}
+
+// Bundle element size, or -1 if it runs past the end of the bundle
+static int32_t element(const uint8_t* buf, int32_t size)
+{
+	uint32_t len;
+
+	if (size < 4) {
+		return -1;
+	}
+	memcpy(&len, buf, 4);
+	len = ntohl(len);
+	return len % 4 == 0 && len <= (uint32_t)(size - 4) ? (int32_t)len : -1;
+}
+
+// Makes room for len bytes in e; leaves e untouched on failure
+static int reserve(struct entry* e, int32_t len)
+{
+	uint8_t* data;
+	int32_t cap;
+
+	if (len <= e->cap) {
+		return 0;
+	}
+	cap = e->cap ? e->cap : 64;
+	while (cap < len) {
+		cap *= 2;
+	}
+	if (!(data = (uint8_t*)realloc(e->data, cap))) {
+		fprintf(stderr, "oscdelta: Critical memory error...\n");
+		return -1;
+	}
+	e->data = data;
+	e->cap = cap;
+	return 0;
+}
+
+static int32_t lookup(const oscdelta_t* d, uint32_t h, const uint8_t* hdr, int32_t hlen)
+{
+	int32_t id;
+
+	for (id = d->buckets[h & d->mask]; id >= 0; id = d->entry[id].next) {
+		const struct entry* e = &d->entry[id];
+		if (e->hash == h && e->hlen == hlen && memcmp(e->data, hdr, hlen) == 0) {
+			return id;
+		}
+	}
+	return -1;
+}
+
+// Entry to define the next header in: a free one or, once the dictionary is
+// full, the first the clock hand finds unused since its last pass.
+static int32_t victim(oscdelta_t* d)
+{
+	int32_t id;
+
+	if (d->used < d->entries) {
+		return d->used;
+	}
+	for (;;) {
+		id = d->hand;
+		d->hand = (d->hand + 1) % d->entries;
+		if (!d->entry[id].ref) {
+			return id;
+		}
+		d->entry[id].ref = 0;
+	}
+}
+
+static void detach(oscdelta_t* d, int32_t id)
+{
+	int32_t* p = &d->buckets[d->entry[id].hash & d->mask];
+
+	while (*p != id) {
+		p = &d->entry[*p].next;
+	}
+	*p = d->entry[id].next;
+}
+
+static int32_t raw(const uint8_t* packet, int32_t size, uint8_t* out, int32_t outsize)
+{
+	int32_t n = 1 + varsize(size) + size;
+
+	if (n > outsize) {
+		return -1;
+	}
+	out[0] = OP_RAW;
+	n = 1 + putvar(out + 1, size);
+	memcpy(out + n, packet, size);
+	return n + size;
+}
+
+static int32_t message(oscdelta_t* d, const uint8_t* packet, int32_t size, int32_t hlen,
+					   uint8_t* out, int32_t outsize)
+{
+	struct entry* e;
+	uint32_t h, a;
+	int32_t alen = size - hlen, id, n, i, words, nb, bitmap, changed = 0;
+
+	h = hash(packet, hlen);
+	if ((id = lookup(d, h, packet, hlen)) < 0) {
+		if (1 + varsize(d->entries) + varsize(size) + size > outsize) {
+			return -1;
+		}
+		id = victim(d);
+		e = &d->entry[id];
+		if (reserve(e, size) < 0) {
+			return raw(packet, size, out, outsize);
+		}
+		if (id == d->used) {
+			d->used++;
+		}
+		else {
+			detach(d, id);
+		}
+		e->hash = h;
+		e->hlen = hlen;
+		e->alen = alen;
+		e->ref = 0;
+		e->next = d->buckets[h & d->mask];
+		d->buckets[h & d->mask] = id;
+		memcpy(e->data, packet, size);
+
+		out[0] = OP_DEFINE;
+		n = 1 + putvar(out + 1, id);
+		n += putvar(out + n, size);
+		memcpy(out + n, packet, size);
+		return n + size;
+	}
+
+	e = &d->entry[id];
+	words = alen / 4;
+	nb = (words + 7) / 8;
+	if (e->alen == alen) {
+		for (i = 0; i < words; ++i) {
+			changed += memcmp(e->data + hlen + i * 4, packet + hlen + i * 4, 4) != 0;
+		}
+	}
+
+	// A delta only pays while most words are unchanged
+	if (e->alen != alen || nb + 4 * changed > varsize(alen) + alen) {
+		n = 1 + varsize(id) + varsize(alen) + alen;
+		if (n > outsize) {
+			return -1;
+		}
+		if (reserve(e, size) < 0) {
+			return raw(packet, size, out, outsize);
+		}
+		out[0] = OP_ARGS;
+		n = 1 + putvar(out + 1, id);
+		n += putvar(out + n, alen);
+		memcpy(out + n, packet + hlen, alen);
+		memcpy(e->data + hlen, packet + hlen, alen);
+		e->alen = alen;
+		e->ref = 1;
+		return n + alen;
+	}
+
+	n = 1 + varsize(id) + nb + 4 * changed;
+	if (n > outsize) {
+		return -1;
+	}
+	out[0] = OP_DELTA;
+	n = 1 + putvar(out + 1, id);
+	memset(out + n, 0, nb);
+	bitmap = n;
+	n += nb;
+	for (i = 0; i < words; ++i) {
+		uint8_t* word = e->data + hlen + i * 4;
+		memcpy(&a, packet + hlen + i * 4, 4);
+		if (memcmp(word, &a, 4) != 0) {
+			out[bitmap + i / 8] |= (uint8_t)(1 << (i % 8));
+			memcpy(out + n, &a, 4);
+			memcpy(word, &a, 4);
+			n += 4;
+		}
+	}
+	e->ref = 1;
+	return n;
+}
+
+// 1 if packet is a bundle whose elements, and theirs, are well formed
+static int wellformed(const uint8_t* packet, int32_t size, int depth)
+{
+	int32_t off, len;
+
+	if (size < 16 || memcmp(packet, "#bundle\0", 8) != 0 || depth > MAX_DEPTH) {
+		return 0;
+	}
+	for (off = 16; off < size; off += 4 + len) {
+		if ((len = element(packet + off, size - off)) < 0) {
+			return 0;
+		}
+		if (len >= 16 && packet[off + 4] == '#' &&
+			!wellformed(packet + off + 4, len, depth + 1)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static int32_t record(oscdelta_t* d, const uint8_t* packet, int32_t size,
+					  uint8_t* out, int32_t outsize)
+{
+	uint64_t timetag, diff;
+	uint32_t be;
+	int32_t hlen, off, len, n, m, count = 0;
+
+	if ((hlen = header(packet, size)) >= 0) {
+		return message(d, packet, size, hlen, out, outsize);
+	}
+	// Elements may each grow by a record header, so a bundle that could
+	// overflow out is sent as it is rather than leave the dictionary half
+	// updated.
+	if (!wellformed(packet, size, 0) || 2 * size + 2 * OSCDELTA_OVERHEAD > outsize) {
+		return raw(packet, size, out, outsize);
+	}
+
+	// Timetags mostly move forward by a little, so send the difference
+	memcpy(&be, packet + 8, 4);
+	timetag = (uint64_t)ntohl(be) << 32;
+	memcpy(&be, packet + 12, 4);
+	timetag |= ntohl(be);
+	diff = timetag - d->timetag;
+	d->timetag = timetag;
+	for (off = 16; off < size; off += 4 + element(packet + off, size - off)) {
+		count++;
+	}
+
+	out[0] = OP_BUNDLE;
+	n = 1 + putvar(out + 1, (diff << 1) ^ (uint64_t)((int64_t)diff >> 63));
+	n += putvar(out + n, count);
+	for (off = 16; off < size; off += 4 + len) {
+		len = element(packet + off, size - off);
+		if ((m = record(d, packet + off + 4, len, out + n, outsize - n)) < 0) {
+			return -1;
+		}
+		n += m;
+	}
+	return n;
+}
+
+int32_t oscdelta_encode(oscdelta_t* d, const uint8_t* packet, int32_t size,
+						uint8_t* out, int32_t outsize)
+{
+	int32_t n = record(d, packet, size, out, outsize);
+
+	if (n > 0) {
+		d->packets++;
+		d->bytes += size;
+		d->coded += n;
+	}
+	return n;
+}
+
+static int32_t unrecord(oscdelta_t* d, const uint8_t* in, int32_t size,
+						uint8_t* out, int32_t outsize, int32_t* packetsize, int depth)
+{
+	struct entry* e;
+	uint64_t id, len, diff, count;
+	uint32_t be;
+	int32_t n, m, i, words, nb, psize;
+
+	if (size < 2) {
+		return -1;
+	}
+	if ((m = getvar(in + 1, size - 1, &id)) < 0) {
+		return -1;
+	}
+	n = 1 + m;
+
+	switch (in[0]) {
+	case OP_RAW:
+		len = id;
+		if (len > (uint64_t)(size - n) || len > (uint64_t)outsize) {
+			return -1;
+		}
+		memcpy(out, in + n, len);
+		*packetsize = (int32_t)len;
+		return n + (int32_t)len;
+
+	case OP_DEFINE:
+		if (id >= (uint64_t)d->entries || (m = getvar(in + n, size - n, &len)) < 0) {
+			return -1;
+		}
+		n += m;
+		if (len > (uint64_t)(size - n) || len > (uint64_t)outsize) {
+			return -1;
+		}
+		e = &d->entry[id];
+		if ((psize = header(in + n, (int32_t)len)) < 0 || reserve(e, (int32_t)len) < 0) {
+			return -1;
+		}
+		memcpy(e->data, in + n, len);
+		e->hlen = psize;
+		e->alen = (int32_t)len - psize;
+		memcpy(out, in + n, len);
+		*packetsize = (int32_t)len;
+		return n + (int32_t)len;
+
+	case OP_ARGS:
+		if (id >= (uint64_t)d->entries || (m = getvar(in + n, size - n, &len)) < 0) {
+			return -1;
+		}
+		n += m;
+		e = &d->entry[id];
+		if (!e->hlen || len % 4 != 0 || len > (uint64_t)(size - n) ||
+			len > (uint64_t)(outsize - e->hlen)) {
+			return -1;
+		}
+		psize = e->hlen + (int32_t)len;
+		if (reserve(e, psize) < 0) {
+			return -1;
+		}
+		memcpy(e->data + e->hlen, in + n, len);
+		e->alen = (int32_t)len;
+		memcpy(out, e->data, psize);
+		*packetsize = psize;
+		return n + (int32_t)len;
+
+	case OP_DELTA:
+		if (id >= (uint64_t)d->entries || !d->entry[id].hlen) {
+			return -1;
+		}
+		e = &d->entry[id];
+		words = e->alen / 4;
+		nb = (words + 7) / 8;
+		psize = e->hlen + e->alen;
+		if (nb > size - n || psize > outsize) {
+			return -1;
+		}
+		m = n + nb;
+		for (i = 0; i < words; ++i) {
+			if (in[n + i / 8] & (1 << (i % 8))) {
+				if (m + 4 > size) {
+					return -1;
+				}
+				memcpy(e->data + e->hlen + i * 4, in + m, 4);
+				m += 4;
+			}
+		}
+		memcpy(out, e->data, psize);
+		*packetsize = psize;
+		return m;
+
+	case OP_BUNDLE:
+		diff = id;
+		if (depth > MAX_DEPTH || outsize < 16 ||
+			(m = getvar(in + n, size - n, &count)) < 0) {
+			return -1;
+		}
+		n += m;
+		d->timetag += (diff >> 1) ^ (uint64_t)(-(int64_t)(diff & 1));
+		memcpy(out, "#bundle\0", 8);
+		be = htonl((uint32_t)(d->timetag >> 32));
+		memcpy(out + 8, &be, 4);
+		be = htonl((uint32_t)d->timetag);
+		memcpy(out + 12, &be, 4);
+		psize = 16;
+		for (; count > 0; --count) {
+			if (outsize - psize < 4 ||
+				(m = unrecord(d, in + n, size - n, out + psize + 4, outsize - psize - 4,
+							  &i, depth + 1)) < 0) {
+				return -1;
+			}
+			be = htonl((uint32_t)i);
+			memcpy(out + psize, &be, 4);
+			psize += 4 + i;
+			n += m;
+		}
+		*packetsize = psize;
+		return n;
+	}
+	return -1;
+}
+
+int32_t oscdelta_decode(oscdelta_t* d, const uint8_t* in, int32_t size,
+						uint8_t* out, int32_t outsize, int32_t* packetsize)
+{
+	int32_t n = unrecord(d, in, size, out, outsize, packetsize, 0);
+
+	if (n > 0) {
+		d->packets++;
+		d->bytes += *packetsize;
+		d->coded += n;
+	}
+	return n;
+}
+
+int32_t oscdelta_handshake(uint8_t* buf, const char* addr, int32_t entries)
+{
+	int32_t len = (int32_t)strlen(addr), size = (len + 4) & ~3;
+	uint32_t be;
+
+	memset(buf, 0, size);
+	memcpy(buf, addr, len);
+	memcpy(buf + size, ",ii\0", 4);
+	be = htonl(OSCDELTA_VERSION);
+	memcpy(buf + size + 4, &be, 4);
+	be = htonl((uint32_t)entries);
+	memcpy(buf + size + 8, &be, 4);
+	return size + 12;
+}
+
+int oscdelta_parse_handshake(const uint8_t* buf, int32_t size, const char* addr,
+							 int32_t* entries)
+{
+	uint8_t expect[64];
+	int32_t n;
+	uint32_t be;
+
+	if (strlen(addr) > 48) {
+		return -1;
+	}
+	n = oscdelta_handshake(expect, addr, 0);
+	if (size != n || memcmp(buf, expect, n - 4) != 0) {
+		return -1;
+	}
+	memcpy(&be, buf + n - 4, 4);
+	*entries = (int32_t)ntohl(be);
+	return *entries >= 1 && *entries <= MAX_ENTRIES ? 0 : -1;
+}
@@ -0,0 +1,132 @@
+/******************************************************************************
+ *  oscdelta
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#ifndef __OSC_DELTA_H__
+#define __OSC_DELTA_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ *	oscdelta compresses a stream of OSC packets that repeats the same
+ *	addresses and type tags with a few argument bytes changing, as control
+ *	surfaces do.
+ *
+ *	Both ends keep a dictionary of recent headers (address and type tag).
+ *	The first message with a header defines it under an ID; later messages
+ *	with that header send the ID and only the 32-bit argument words that
+ *	changed since the last message with the same header. Bundles send the
+ *	change of their timetag and a record for each element. The decoder
+ *	rebuilds the standard OSC packet.
+ *
+ *	The encoder and decoder must see the records in the same order, as on a
+ *	TCP connection, and use the same number of dictionary entries; the
+ *	session is negotiated with oscdelta_handshake() (see oscnet_delta()).
+ *
+ *	Record layout, after a frame marker byte (OSCDELTA_FRAME):
+ *
+ *		DEFINE	op id len message		new or replaced header
+ *		ARGS	op id len arguments		same header, different argument size
+ *		DELTA	op id bitmap words		same header and size; one bitmap bit
+ *										per argument word, then the changed
+ *										words
+ *		BUNDLE	op diff count records	timetag minus the last bundle's
+ *										(zigzag), then one record per element
+ *		RAW		op len packet			anything else
+ *
+ *	op is a byte; id, len, diff and count are unsigned LEB128 varints.
+ *
+ *	Usage example:
+ *		oscdelta_t* enc = oscdelta_new(1024);
+ *		uint8_t frame[65536];
+ *		int32_t len = 1, n;
+ *
+ *		frame[0] = OSCDELTA_FRAME;
+ *		n = oscdelta_encode(enc, packet, size, frame + len, sizeof(frame) - len);
+ *		len += n;
+ */
+
+#define OSCDELTA_VERSION 1
+
+// First byte of a delta frame; OSC packets start with '/' or '#'
+#define OSCDELTA_FRAME 0x01
+
+// Handshake addresses
+#define OSCDELTA_HELLO "/_delta/hello"
+#define OSCDELTA_OK "/_delta/ok"
+
+// A record always fits in the size of its packet plus this many bytes
+#define OSCDELTA_OVERHEAD 11
+
+typedef struct oscdelta oscdelta_t;
+
+/* Creates an encoder or decoder with a dictionary of entries headers. */
+oscdelta_t* oscdelta_new(int32_t entries);
+void oscdelta_free(oscdelta_t* d);
+
+/*
+ *	oscdelta_encode() appends the record for one packet.
+ *
+ *	Return:
+ *		Size of the record, or -1 if it does not fit in outsize bytes. The
+ *		dictionary is only changed when the record was written.
+ */
+int32_t oscdelta_encode(oscdelta_t* d, const uint8_t* packet, int32_t size,
+						uint8_t* out, int32_t outsize);
+
+/*
+ *	oscdelta_decode() rebuilds the packet of the record at the start of in.
+ *
+ *	Arguments:
+ *		int32_t* packetsize: Set to the size of the packet written to out.
+ *
+ *	Return:
+ *		Bytes of in used by the record, or -1 if the record is malformed or
+ *		the packet does not fit in outsize bytes.
+ */
+int32_t oscdelta_decode(oscdelta_t* d, const uint8_t* in, int32_t size,
+						uint8_t* out, int32_t outsize, int32_t* packetsize);
+
+/* Size of the packets encoded or decoded so far, and of their records. */
+void oscdelta_stats(const oscdelta_t* d, uint64_t* packets, uint64_t* bytes,
+					uint64_t* coded);
+
+/*
+ *	oscdelta_handshake() writes "addr ,ii version entries", the message that
+ *	asks for (OSCDELTA_HELLO) or accepts (OSCDELTA_OK) a session. buf must
+ *	hold 32 bytes. Returns the size of the message.
+ */
+int32_t oscdelta_handshake(uint8_t* buf, const char* addr, int32_t entries);
+
+/*
+ *	oscdelta_parse_handshake() checks that buf is an addr message of a
+ *	version this code speaks. Returns 0 and the number of entries, or -1.
+ */
+int oscdelta_parse_handshake(const uint8_t* buf, int32_t size, const char* addr,
+							 int32_t* entries);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __OSC_DELTA_H__
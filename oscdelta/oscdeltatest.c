@@ -0,0 +1,178 @@
+/******************************************************************************
+ *  oscdeltatest
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *
+ *  Encodes a simulated control surface stream (faders, buttons and meter
+ *  bundles) with oscdelta, decodes it again and checks every packet comes
+ *  back unchanged. Prints the TCP bytes with and without delta frames for a
+ *  packet per frame and for batches, and the encode and decode time.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "oscdelta.h"
+#include "../oscpack/oscpack.h"
+
+const char usage[] = "usage: oscdeltatest [packets] [entries]\n";
+
+#define CHANNELS 64
+#define MAX_PACKET 1024
+
+static uint32_t x = 2463534242u;
+
+static uint32_t xorshift(void)
+{
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x;
+}
+
+// One packet of the surface: mostly fader moves on a few channels, some
+// button presses and now and then a bundle of meter levels
+static int32_t next(uint8_t* buf, float* gain, uint64_t t)
+{
+	char addr[64];
+	uint32_t r = xorshift(), be;
+	int32_t size;
+	int ch = (r >> 8) % 8;
+
+	if (r % 100 < 80) {
+		gain[ch] += ((r >> 16) % 3 - 1) * 0.01f;
+		snprintf(addr, sizeof(addr), "/mixer/ch/%d/gain", ch + 1);
+		return oscpack(buf, addr, "f", gain[ch]);
+	}
+	if (r % 100 < 95) {
+		snprintf(addr, sizeof(addr), "/mixer/ch/%d/mute", (r >> 8) % CHANNELS + 1);
+		return oscpack(buf, addr, "i", (r >> 20) & 1);
+	}
+	size = oscpack(buf + 20, "/meter", "ffff", gain[0], gain[1], gain[2], gain[3]);
+	memcpy(buf, "#bundle\0", 8);
+	be = htonl((uint32_t)(t >> 32));
+	memcpy(buf + 8, &be, 4);
+	be = htonl((uint32_t)t);
+	memcpy(buf + 12, &be, 4);
+	be = htonl((uint32_t)size);
+	memcpy(buf + 16, &be, 4);
+	return 20 + size;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main (int argc, char* const argv[])
+{
+	oscdelta_t* enc;
+	oscdelta_t* dec;
+	uint8_t* packets;
+	int32_t* sizes;
+	uint8_t* records;
+	int32_t* lens;
+	uint8_t out[MAX_PACKET];
+	float gain[CHANNELS];
+	uint64_t plain = 0, single = 0, batched = 0, batch = 0;
+	double t, tenc, tdec;
+	int32_t n, len, off, entries = 256;
+	int i, count = 200000, errors = 0;
+
+	if (argc > 1 && argv[1][0] == '-') {
+		printf(usage);
+		return 0;
+	}
+	if (argc > 1) count = atoi(argv[1]);
+	if (argc > 2) entries = atoi(argv[2]);
+	if (count < 1) {
+		printf(usage);
+		return 0;
+	}
+
+	packets = (uint8_t*)malloc((size_t)count * MAX_PACKET);
+	sizes = (int32_t*)malloc(count * sizeof(int32_t));
+	records = (uint8_t*)malloc((size_t)count * (MAX_PACKET + OSCDELTA_OVERHEAD));
+	lens = (int32_t*)malloc(count * sizeof(int32_t));
+	enc = oscdelta_new(entries);
+	dec = oscdelta_new(entries);
+	if (!packets || !sizes || !records || !lens || !enc || !dec) {
+		fprintf(stderr, "oscdeltatest: Critical memory error...\n");
+		return 1;
+	}
+	for (i = 0; i < CHANNELS; ++i) {
+		gain[i] = 0.5f;
+	}
+	for (i = 0; i < count; ++i) {
+		sizes[i] = next(packets + (size_t)i * MAX_PACKET, gain, (uint64_t)i << 20);
+		plain += 4 + sizes[i];
+	}
+
+	t = now();
+	for (i = 0, off = 0; i < count; ++i) {
+		lens[i] = oscdelta_encode(enc, packets + (size_t)i * MAX_PACKET, sizes[i],
+								  records + off, MAX_PACKET + OSCDELTA_OVERHEAD);
+		off += lens[i];
+	}
+	tenc = now() - t;
+
+	t = now();
+	for (i = 0, off = 0; i < count; ++i) {
+		n = oscdelta_decode(dec, records + off, lens[i], out, sizeof(out), &len);
+		if (n != lens[i] || len != sizes[i] ||
+			memcmp(out, packets + (size_t)i * MAX_PACKET, len) != 0) {
+			errors++;
+		}
+		off += lens[i];
+	}
+	tdec = now() - t;
+
+	// A frame is a size prefix and a marker byte in front of its records
+	for (i = 0; i < count; ++i) {
+		single += 5 + lens[i];
+		if (i % 32 == 0) {
+			batched += 5;
+		}
+		batched += lens[i];
+		batch += sizes[i];
+	}
+
+	printf("oscdeltatest: %d packets, %d entries, %llu bytes of packets\n", count,
+		   entries, (unsigned long long)batch);
+	printf("    plain tcp:          %10llu bytes\n", (unsigned long long)plain);
+	printf("    delta, 1 per frame: %10llu bytes (%.1fx)\n", (unsigned long long)single,
+		   (double)plain / single);
+	printf("    delta, 32 per frame:%10llu bytes (%.1fx)\n", (unsigned long long)batched,
+		   (double)plain / batched);
+	printf("    encode: %.1f ns per packet, decode: %.1f ns per packet\n",
+		   tenc / count * 1e9, tdec / count * 1e9);
+	printf("    round trip: %s\n", errors ? "MISMATCH" : "match");
+
+	oscdelta_free(enc);
+	oscdelta_free(dec);
+	free(packets);
+	free(sizes);
+	free(records);
+	free(lens);
+	return errors ? 1 : 0;
+}
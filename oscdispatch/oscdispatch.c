@@ -0,0 +1,493 @@
+/******************************************************************************
+ *  oscdispatch
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#include "oscdispatch.h"
+#include "../oscpack/oscintern.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+
+// Seconds from 1900 (NTP) to 1970 (Unix)
+#define NTP_EPOCH 2208988800ull
+
+// Times with fewer tasks than this run on the calling thread alone; waking
+// the pool costs more than it saves
+#define SERIAL 64
+
+// Most tasks a thread takes from its own range at once
+#define GRAB 32
+
+// Checks for new work before a pool thread sleeps
+#define SPINS 4000
+
+// One message of the packet being dispatched
+struct elem {
+	oscmsg_t msg;
+	uint64_t timetag;
+	int32_t next;			// next message to the same address (ORDERED)
+};
+
+// Sort key: time first, then position in the packet
+struct key {
+	uint64_t timetag;
+	int32_t i;
+};
+
+// Last message seen for an address hash while building chains
+struct slot {
+	uint32_t hash;
+	int32_t tail;
+};
+
+// Tasks [range >> 32, range & 0xffffffff) are left to this thread. The owner
+// takes from the front and thieves take the back half, both with a CAS.
+struct worker {
+	uint64_t range __attribute__((aligned(64)));
+	pthread_t thread;
+	int id;
+	oscdispatch_t* d;
+};
+
+struct oscdispatch {
+	oscdispatch_fn fn;
+	void* user;
+	int threads;
+	struct worker* workers;
+
+	struct elem* elems;
+	struct key* keys;
+	int32_t* tasks;
+	int32_t count;
+	int32_t cap;
+	struct slot* slots;
+	int32_t nslots;
+
+	// The time being run; set before closed is cleared
+	const int32_t* run;		// element of each task (head of a chain if chained)
+	int32_t ntasks;
+	int chained;
+
+	uint64_t done __attribute__((aligned(64)));		// tasks finished
+	int busy __attribute__((aligned(64)));			// pool threads in work()
+	int closed;				// 1 between times; pool threads stay out
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	uint64_t gen;			// bumped for every time handed to the pool
+	int stop;
+};
+
+static void execute(oscdispatch_t* d, int w, int32_t lo, int32_t hi)
+{
+	int32_t t, e;
+
+	for (t = lo; t < hi; ++t) {
+		e = d->run[t];
+		if (!d->chained) {
+			d->fn(&d->elems[e].msg, d->elems[e].timetag, w, d->user);
+			continue;
+		}
+		for (; e != -1; e = d->elems[e].next) {
+			d->fn(&d->elems[e].msg, d->elems[e].timetag, w, d->user);
+		}
+	}
+	__atomic_add_fetch(&d->done, hi - lo, __ATOMIC_RELEASE);
+}
+
+static int take(struct worker* self, int32_t* lo, int32_t* hi)
+{
+	uint64_t r = __atomic_load_n(&self->range, __ATOMIC_ACQUIRE);
+	uint32_t l, h, k;
+
+	for (;;) {
+		l = (uint32_t)(r >> 32);
+		h = (uint32_t)r;
+		if (l >= h) {
+			return 0;
+		}
+		// Smaller bites as the range shrinks so thieves find something left
+		k = (h - l + 7) / 8;
+		k = k > GRAB ? GRAB : k;
+		if (__atomic_compare_exchange_n(&self->range, &r, ((uint64_t)(l + k) << 32) | h,
+										1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			*lo = (int32_t)l;
+			*hi = (int32_t)(l + k);
+			return 1;
+		}
+	}
+}
+
+// Moves the back half of another thread's range to w, which is empty
+static int steal(oscdispatch_t* d, int w)
+{
+	struct worker* v;
+	uint64_t r;
+	uint32_t l, h, mid;
+	int i;
+
+	for (i = 1; i < d->threads; ++i) {
+		v = &d->workers[(w + i) % d->threads];
+		r = __atomic_load_n(&v->range, __ATOMIC_ACQUIRE);
+		for (;;) {
+			l = (uint32_t)(r >> 32);
+			h = (uint32_t)r;
+			if (l >= h) {
+				break;
+			}
+			mid = h - l == 1 ? l : l + (h - l) / 2;
+			if (__atomic_compare_exchange_n(&v->range, &r, ((uint64_t)l << 32) | mid, 1,
+											__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				__atomic_store_n(&d->workers[w].range, ((uint64_t)mid << 32) | h,
+								 __ATOMIC_RELEASE);
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+static void work(oscdispatch_t* d, int w)
+{
+	int32_t lo, hi;
+
+	for (;;) {
+		if (take(&d->workers[w], &lo, &hi)) {
+			execute(d, w, lo, hi);
+		}
+		else if (!steal(d, w)) {
+			return;
+		}
+	}
+}
+
+static void* pool(void* arg)
+{
+	struct worker* self = (struct worker*)arg;
+	oscdispatch_t* d = self->d;
+	uint64_t seen = 0;
+	int spins;
+
+	for (;;) {
+		for (spins = 0; __atomic_load_n(&d->gen, __ATOMIC_ACQUIRE) == seen &&
+			 spins < SPINS; ++spins) {
+			sched_yield();
+		}
+		pthread_mutex_lock(&d->lock);
+		while (d->gen == seen && !d->stop) {
+			pthread_cond_wait(&d->cond, &d->lock);
+		}
+		seen = d->gen;
+		pthread_mutex_unlock(&d->lock);
+		if (__atomic_load_n(&d->stop, __ATOMIC_ACQUIRE)) {
+			return NULL;
+		}
+
+		// The caller waits for busy to drop before it reuses the ranges, and
+		// sets closed before it looks; whichever comes second sees the other
+		__atomic_add_fetch(&d->busy, 1, __ATOMIC_SEQ_CST);
+		if (!__atomic_load_n(&d->closed, __ATOMIC_SEQ_CST)) {
+			work(d, self->id);
+		}
+		__atomic_sub_fetch(&d->busy, 1, __ATOMIC_RELEASE);
+	}
+}
+
+// Runs the tasks of one time and returns when all of them are done
+static void group(oscdispatch_t* d, const int32_t* run, int32_t ntasks, int chained)
+{
+	int w;
+
+	d->run = run;
+	d->ntasks = ntasks;
+	d->chained = chained;
+	if (d->threads == 1 || ntasks < SERIAL) {
+		execute(d, 0, 0, ntasks);
+		return;
+	}
+
+	d->done = 0;
+	for (w = 0; w < d->threads; ++w) {
+		__atomic_store_n(&d->workers[w].range,
+						 ((uint64_t)((int64_t)ntasks * w / d->threads) << 32) |
+						 (uint64_t)((int64_t)ntasks * (w + 1) / d->threads),
+						 __ATOMIC_RELAXED);
+	}
+	pthread_mutex_lock(&d->lock);
+	__atomic_store_n(&d->closed, 0, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&d->gen, d->gen + 1, __ATOMIC_RELEASE);
+	pthread_cond_broadcast(&d->cond);
+	pthread_mutex_unlock(&d->lock);
+
+	work(d, 0);
+	while (__atomic_load_n(&d->done, __ATOMIC_ACQUIRE) < (uint64_t)ntasks) {
+		sched_yield();
+	}
+	__atomic_store_n(&d->closed, 1, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&d->busy, __ATOMIC_SEQ_CST) != 0) {
+		sched_yield();
+	}
+}
+
+static int grow(oscdispatch_t* d)
+{
+	int32_t cap = d->cap ? d->cap * 2 : 1024;
+	struct elem* elems = (struct elem*)realloc(d->elems, cap * sizeof(struct elem));
+	struct key* keys;
+	int32_t* tasks;
+
+	if (elems) {
+		d->elems = elems;
+	}
+	keys = (struct key*)realloc(d->keys, cap * sizeof(struct key));
+	if (keys) {
+		d->keys = keys;
+	}
+	tasks = (int32_t*)realloc(d->tasks, cap * sizeof(int32_t));
+	if (tasks) {
+		d->tasks = tasks;
+	}
+	if (!elems || !keys || !tasks) {
+		fprintf(stderr, "oscdispatch: Critical memory error...\n");
+		return -1;
+	}
+	d->cap = cap;
+	return 0;
+}
+
+// The validation pass: records every message with the time it runs at, or
+// fails without running anything
+static int32_t add(oscdispatch_t* d, const uint8_t* buf, int32_t size, uint64_t timetag,
+				   int depth)
+{
+	oscbundle_t b;
+	const uint8_t* elem;
+	struct elem* e;
+	int32_t len;
+
+	if (!oscisbundle(buf, size)) {
+		if (d->count == d->cap && grow(d) == -1) {
+			return -1;
+		}
+		e = &d->elems[d->count];
+		if (oscunpack(buf, size, &e->msg) == -1) {
+			return -1;
+		}
+		e->timetag = timetag;
+		d->count++;
+		return 0;
+	}
+
+	if (depth == OSCDISPATCH_MAX_DEPTH || oscbundle(buf, size, &b) == -1) {
+		return -1;
+	}
+	if (b.timetag == 1 || b.timetag < timetag) {
+		b.timetag = timetag;
+	}
+	while ((len = oscbundle_next(&b, &elem)) > 0) {
+		if (add(d, elem, len, b.timetag, depth + 1) == -1) {
+			return -1;
+		}
+	}
+	return len;
+}
+
+static int bytime(const void* a, const void* b)
+{
+	const struct key* x = (const struct key*)a;
+	const struct key* y = (const struct key*)b;
+
+	if (x->timetag != y->timetag) {
+		return x->timetag < y->timetag ? -1 : 1;
+	}
+	return x->i - y->i;
+}
+
+// Links the messages of order[0, n) to the same address into chains and
+// returns the number of chains; their heads go to d->tasks
+static int32_t chains(oscdispatch_t* d, const struct key* order, int32_t n)
+{
+	struct slot* slots;
+	struct elem* e;
+	uint32_t h, mask;
+	int32_t i, k, count = 0, nslots = 64;
+
+	while (nslots < 2 * n) {
+		nslots *= 2;
+	}
+	if (nslots > d->nslots) {
+		if ((slots = (struct slot*)realloc(d->slots, nslots * sizeof(struct slot))) == NULL) {
+			fprintf(stderr, "oscdispatch: Critical memory error...\n");
+			return -1;
+		}
+		d->slots = slots;
+		d->nslots = nslots;
+	}
+	slots = d->slots;
+	mask = nslots - 1;
+	memset(slots, 0xff, nslots * sizeof(struct slot));
+
+	for (k = 0; k < n; ++k) {
+		e = &d->elems[order[k].i];
+		e->next = -1;
+		h = oscintern_hash(e->msg.address, e->msg.addrlen);
+		// Addresses with the same hash share a chain, which only orders more
+		for (i = h & mask; slots[i].tail != -1 && slots[i].hash != h; i = (i + 1) & mask)
+			;
+		if (slots[i].tail == -1) {
+			d->tasks[count++] = order[k].i;
+		}
+		else {
+			d->elems[slots[i].tail].next = order[k].i;
+		}
+		slots[i].hash = h;
+		slots[i].tail = order[k].i;
+	}
+	return count;
+}
+
+static void due(uint64_t timetag)
+{
+	struct timespec ts;
+
+	if ((timetag >> 32) < NTP_EPOCH) {
+		return;
+	}
+	ts.tv_sec = (time_t)((timetag >> 32) - NTP_EPOCH);
+	// Rounded up so nothing runs a fraction of a nanosecond early
+	ts.tv_nsec = (long)(((timetag & 0xffffffffull) * 1000000000ull + 0xffffffffull) >> 32);
+	while (clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+int32_t oscdispatch(oscdispatch_t* d, const uint8_t* packet, int32_t size, int flags)
+{
+	int32_t i, a, n, sorted = 1;
+
+	d->count = 0;
+	if (add(d, packet, size, 1, 0) == -1) {
+		return -1;
+	}
+
+	for (i = 0; i < d->count; ++i) {
+		d->keys[i].timetag = d->elems[i].timetag;
+		d->keys[i].i = i;
+		if (i > 0 && d->keys[i].timetag < d->keys[i-1].timetag) {
+			sorted = 0;
+		}
+	}
+	if (!sorted) {
+		qsort(d->keys, d->count, sizeof(struct key), bytime);
+	}
+
+	for (a = 0; a < d->count; a = i) {
+		for (i = a + 1; i < d->count && d->keys[i].timetag == d->keys[a].timetag; ++i)
+			;
+		if (!(flags & OSCDISPATCH_NOWAIT)) {
+			due(d->keys[a].timetag);
+		}
+		if (flags & OSCDISPATCH_ORDERED) {
+			if ((n = chains(d, d->keys + a, i - a)) == -1) {
+				return -1;
+			}
+			group(d, d->tasks, n, 1);
+		}
+		else {
+			for (n = a; n < i; ++n) {
+				d->tasks[n - a] = d->keys[n].i;
+			}
+			group(d, d->tasks, i - a, 0);
+		}
+	}
+	return d->count;
+}
+
+oscdispatch_t* oscdispatch_new(int threads, oscdispatch_fn fn, void* user)
+{
+	oscdispatch_t* d;
+	void* p;
+	int i;
+
+	if (threads < 1 || fn == NULL) {
+		fprintf(stderr, "oscdispatch: need a handler and at least 1 thread\n");
+		return NULL;
+	}
+	if (posix_memalign(&p, 64, sizeof(oscdispatch_t)) != 0) {
+		fprintf(stderr, "oscdispatch: Critical memory error...\n");
+		return NULL;
+	}
+	d = (oscdispatch_t*)p;
+	memset(d, 0, sizeof(*d));
+	if (posix_memalign(&p, 64, threads * sizeof(struct worker)) != 0 || grow(d) == -1) {
+		fprintf(stderr, "oscdispatch: Critical memory error...\n");
+		free(d->elems);
+		free(d->keys);
+		free(d->tasks);
+		free(d);
+		return NULL;
+	}
+	d->workers = (struct worker*)p;
+	memset(d->workers, 0, threads * sizeof(struct worker));
+	d->fn = fn;
+	d->user = user;
+	d->closed = 1;
+	pthread_mutex_init(&d->lock, NULL);
+	pthread_cond_init(&d->cond, NULL);
+
+	d->threads = 1;
+	for (i = 1; i < threads; ++i) {
+		d->workers[i].id = i;
+		d->workers[i].d = d;
+		if (pthread_create(&d->workers[i].thread, NULL, pool, &d->workers[i]) != 0) {
+			fprintf(stderr, "oscdispatch: started %d of %d threads\n", i, threads);
+			break;
+		}
+		d->threads++;
+	}
+	return d;
+}
+
+void oscdispatch_free(oscdispatch_t* d)
+{
+	int i;
+
+	if (d == NULL) {
+		return;
+	}
+	pthread_mutex_lock(&d->lock);
+	__atomic_store_n(&d->stop, 1, __ATOMIC_RELEASE);
+	pthread_cond_broadcast(&d->cond);
+	pthread_mutex_unlock(&d->lock);
+	for (i = 1; i < d->threads; ++i) {
+		pthread_join(d->workers[i].thread, NULL);
+	}
+	pthread_mutex_destroy(&d->lock);
+	pthread_cond_destroy(&d->cond);
+	free(d->workers);
+	free(d->elems);
+	free(d->keys);
+	free(d->tasks);
+	free(d->slots);
+	free(d);
+}
@@ -0,0 +1,120 @@
+/******************************************************************************
+ *  oscdispatch
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#ifndef __OSC_DISPATCH_H__
+#define __OSC_DISPATCH_H__
+
+#include <stdint.h>
+
+#include "../oscpack/oscunpack.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ *	oscdispatch hands the messages of a packet to a handler on a pool of
+ *	threads, so a bundle of thousands of messages does not run one message at
+ *	a time on the thread that received it.
+ *
+ *	A packet is first indexed in one pass: every bundle and message is
+ *	validated with oscunpack() and each message is recorded with its offset
+ *	and the timetag it runs at. A malformed packet is refused before any of
+ *	it is dispatched. The messages are then run by the calling thread and
+ *	the pool together; a thread that runs out of messages steals half of what
+ *	another thread has left.
+ *
+ *	Timetags are respected: a message runs at the timetag of the innermost
+ *	bundle around it (a nested bundle that is "immediately" or earlier than
+ *	its parent runs at the parent's time), no message runs before its time,
+ *	and all messages of one time finish before any of a later time start.
+ *	Messages of the same time run in any order and at once, unless
+ *	OSCDISPATCH_ORDERED is given, in which case messages to the same address
+ *	run one after the other in the order they appear in the packet.
+ *
+ *	The handler is called from several threads at once and must not keep
+ *	pointers into the message after it returns.
+ *
+ *
+ *	Usage example:
+ *		static void apply(const oscmsg_t* msg, uint64_t timetag, int worker,
+ *						  void* user)
+ *		{
+ *			...
+ *		}
+ *
+ *		oscdispatch_t* d = oscdispatch_new(8, apply, NULL);
+ *		n = oscdispatch(d, packet, size, OSCDISPATCH_ORDERED);
+ *		oscdispatch_free(d);
+ */
+
+// Deepest nesting of bundles accepted
+#define OSCDISPATCH_MAX_DEPTH 8
+
+// Run messages to the same address in the order of the packet
+#define OSCDISPATCH_ORDERED		1
+
+// Do not wait for timetags in the future; times still run in order
+#define OSCDISPATCH_NOWAIT		2
+
+typedef struct oscdispatch oscdispatch_t;
+
+/*
+ *	Handler of one message. timetag is the time it was due (1 for
+ *	"immediately") and worker is 0 for the calling thread and 1 to threads-1
+ *	for the pool, for handlers that keep per-thread state.
+ */
+typedef void (*oscdispatch_fn)(const oscmsg_t* msg, uint64_t timetag, int worker,
+							   void* user);
+
+/*
+ *	oscdispatch_new() starts threads-1 pool threads; the thread calling
+ *	oscdispatch() is the other one. With threads 1 every message runs on
+ *	the calling thread.
+ *
+ *	Return:
+ *		Dispatcher, or NULL on error (printed to stderr).
+ */
+oscdispatch_t* oscdispatch_new(int threads, oscdispatch_fn fn, void* user);
+
+/*
+ *	oscdispatch() runs every message of a packet (a message or a bundle) and
+ *	returns when they have all run. It is not meant to be called from more
+ *	than one thread at a time.
+ *
+ *	Arguments:
+ *		const uint8_t* packet: OSC packet; must stay valid during the call.
+ *		int32_t size: Size of the packet.
+ *		int flags: OSCDISPATCH_ORDERED and/or OSCDISPATCH_NOWAIT.
+ *
+ *	Return:
+ *		Number of messages run, or -1 if the packet is malformed or nested
+ *		deeper than OSCDISPATCH_MAX_DEPTH (nothing is run).
+ */
+int32_t oscdispatch(oscdispatch_t* d, const uint8_t* packet, int32_t size, int flags);
+
+/* Stops the pool threads and frees the dispatcher. */
+void oscdispatch_free(oscdispatch_t* d);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __OSC_DISPATCH_H__
@@ -0,0 +1,332 @@
+/******************************************************************************
+ *  oscdispatchtest
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *
+ *  Builds snapshot bundles of 1k, 10k and 100k messages (in nested bundles
+ *  of 100, four messages per parameter) and restores them by walking the
+ *  bundle on one thread and with oscdispatch, with and without per-address
+ *  order. Checks every message runs once and in order where asked, that
+ *  times run in order and not early, and that a malformed bundle runs
+ *  nothing. Prints the time of each and the speedup.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "oscdispatch.h"
+#include "../oscpack/oscpack.h"
+
+const char usage[] = "usage: oscdispatchtest [threads] [work]\n";
+
+#define NESTED 100
+#define REPEAT 4
+#define MAX_MESSAGES 100000
+
+// Seconds from 1900 (NTP) to 1970 (Unix)
+#define NTP_EPOCH 2208988800ull
+
+struct param {
+	int32_t runs;
+	int32_t last;			// sequence number of the last message run
+	float value;
+	int32_t pad[13];		// one cache line each
+};
+
+static struct param params[MAX_MESSAGES / REPEAT];
+static int work = 200;
+static int ordered;
+static int errors;
+
+// Stands in for restoring a parameter: read the arguments, do some
+// arithmetic and store the result
+static void restore(const oscmsg_t* msg, uint64_t timetag, int worker, void* user)
+{
+	oscargs_t it;
+	oscarg_t arg;
+	struct param* p;
+	int32_t seq = 0;
+	float v = 0;
+	int i;
+
+	(void)timetag;
+	(void)worker;
+	(void)user;
+	p = &params[atoi(msg->address + 6)];
+	oscargs(msg, &it);
+	while (oscargs_next(&it, &arg)) {
+		if (arg.type == 'i') seq = arg.i;
+		if (arg.type == 'f') v = arg.f;
+	}
+	for (i = 0; i < work; ++i) {
+		v = v * 0.999f + 0.001f;
+	}
+	// Without OSCDISPATCH_ORDERED two messages of a parameter may run at once
+	if (ordered && seq <= p->last) {
+		__sync_fetch_and_add(&errors, 1);
+	}
+	__atomic_store_n(&p->last, seq, __ATOMIC_RELAXED);
+	__atomic_store(&p->value, &v, __ATOMIC_RELAXED);
+	__sync_fetch_and_add(&p->runs, 1);
+}
+
+// The serial baseline: walk the bundle and run each message as it is found
+static int32_t walk(const uint8_t* buf, int32_t size, int depth)
+{
+	oscbundle_t b;
+	oscmsg_t msg;
+	const uint8_t* elem;
+	int32_t len, n, count = 0;
+
+	if (!oscisbundle(buf, size)) {
+		if (oscunpack(buf, size, &msg) == -1) {
+			return -1;
+		}
+		restore(&msg, 1, 0, NULL);
+		return 1;
+	}
+	if (depth == OSCDISPATCH_MAX_DEPTH || oscbundle(buf, size, &b) == -1) {
+		return -1;
+	}
+	while ((len = oscbundle_next(&b, &elem)) > 0) {
+		if ((n = walk(elem, len, depth + 1)) == -1) {
+			return -1;
+		}
+		count += n;
+	}
+	return len == -1 ? -1 : count;
+}
+
+static int32_t header(uint8_t* buf, uint64_t timetag)
+{
+	uint32_t be;
+
+	memcpy(buf, "#bundle\0", 8);
+	be = htonl((uint32_t)(timetag >> 32));
+	memcpy(buf + 8, &be, 4);
+	be = htonl((uint32_t)timetag);
+	memcpy(buf + 12, &be, 4);
+	return 16;
+}
+
+// Writes one element: its size followed by a message
+static int32_t put(uint8_t* at, const char* addr, const char* format, int32_t seq,
+				   float value)
+{
+	int32_t size = oscpack(at + 4, addr, format, seq, value);
+	uint32_t be = htonl((uint32_t)size);
+
+	memcpy(at, &be, 4);
+	return 4 + size;
+}
+
+// Fills in the size of an element written after at
+static void patch(uint8_t* at, int32_t size)
+{
+	uint32_t be = htonl((uint32_t)size);
+	memcpy(at, &be, 4);
+}
+
+// A snapshot of n messages in nested bundles of NESTED; message k sets
+// parameter k % (n / REPEAT) to a new value
+static int32_t snapshot(uint8_t* buf, int n)
+{
+	char addr[32];
+	int32_t size, at;
+	int k, j;
+
+	size = header(buf, 1);
+	for (k = 0; k < n; k += NESTED) {
+		at = size;
+		size += 4;
+		size += header(buf + size, 1);
+		for (j = k; j < k + NESTED && j < n; ++j) {
+			snprintf(addr, sizeof(addr), "/snap/%d/value", j % (n / REPEAT));
+			size += put(buf + size, addr, "if", j, j * 0.25f);
+		}
+		patch(buf + at, size - at - 4);
+	}
+	return size;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Every parameter must have run REPEAT times per round; clears them after
+static int check_runs(int n, int rounds)
+{
+	int k, bad = 0;
+
+	for (k = 0; k < n / REPEAT; ++k) {
+		if (params[k].runs != REPEAT * rounds) {
+			bad++;
+		}
+	}
+	memset(params, 0, sizeof(params));
+	for (k = 0; k < MAX_MESSAGES / REPEAT; ++k) {
+		params[k].last = -1;
+	}
+	return bad;
+}
+
+static uint64_t realtime_ntp(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (((uint64_t)ts.tv_sec + NTP_EPOCH) << 32) |
+		   (((uint64_t)ts.tv_nsec << 32) / 1000000000ull);
+}
+
+// Order in which the timed messages ran, and whether any ran early
+static int32_t ran[4];
+static int nran, early;
+
+static void timed(const oscmsg_t* msg, uint64_t timetag, int worker, void* user)
+{
+	(void)worker;
+	(void)user;
+	if (timetag > 1 && realtime_ntp() < timetag) {
+		early++;
+	}
+	ran[nran++] = msg->address[1] - '0';
+}
+
+// Bundles at +40 ms and +20 ms, in that order, around one immediate message
+static int check_times(void)
+{
+	oscdispatch_t* d = oscdispatch_new(4, timed, NULL);
+	uint8_t buf[512];
+	uint64_t t0 = realtime_ntp(), ms = (1ull << 32) / 1000;
+	int32_t size, at;
+	double t = now();
+	int bad = 0;
+
+	size = header(buf, 1);
+	at = size;
+	size += 4;
+	size += header(buf + size, t0 + 40 * ms);
+	size += put(buf + size, "/3", "", 0, 0);
+	patch(buf + at, size - at - 4);
+	size += put(buf + size, "/1", "", 0, 0);
+	at = size;
+	size += 4;
+	size += header(buf + size, t0 + 20 * ms);
+	size += put(buf + size, "/2", "", 0, 0);
+	patch(buf + at, size - at - 4);
+
+	if (!d || oscdispatch(d, buf, size, 0) != 3 || now() - t < 0.039 || early ||
+		nran != 3 || ran[0] != 1 || ran[1] != 2 || ran[2] != 3) {
+		bad++;
+	}
+	// A size that runs past the end refuses the whole packet
+	patch(buf + 16, 0x7f000000);
+	nran = 0;
+	if (oscdispatch(d, buf, size, 0) != -1 || nran != 0) {
+		bad++;
+	}
+	oscdispatch_free(d);
+	return bad;
+}
+
+int main (int argc, char* const argv[])
+{
+	static const int sizes[] = {1000, 10000, 100000};
+	oscdispatch_t* d;
+	uint8_t* buf;
+	int32_t size;
+	double tserial, tpar, tord;
+	int i, k, threads = (int)sysconf(_SC_NPROCESSORS_ONLN), rounds;
+
+	if (argc > 1 && argv[1][0] == '-') {
+		printf(usage);
+		return 0;
+	}
+	if (argc > 1) threads = atoi(argv[1]);
+	if (argc > 2) work = atoi(argv[2]);
+	if (threads < 1 || work < 0) {
+		printf(usage);
+		return 0;
+	}
+	buf = (uint8_t*)malloc(MAX_MESSAGES * 64);
+	d = oscdispatch_new(threads, restore, NULL);
+	if (!buf || !d) {
+		fprintf(stderr, "oscdispatchtest: Critical memory error...\n");
+		return 1;
+	}
+	check_runs(0, 0);
+	errors += check_times();
+
+	printf("oscdispatchtest: %d threads, %d iterations of work per message\n",
+		   threads, work);
+	printf("    messages  serial ms  dispatch ms  speedup  ordered ms  speedup\n");
+	for (i = 0; i < 3; ++i) {
+		size = snapshot(buf, sizes[i]);
+		rounds = 1000000 / sizes[i];
+
+		ordered = 0;
+		tserial = now();
+		for (k = 0; k < rounds; ++k) {
+			if (walk(buf, size, 0) != sizes[i]) {
+				errors++;
+			}
+		}
+		tserial = (now() - tserial) / rounds;
+		errors += check_runs(sizes[i], rounds);
+
+		tpar = now();
+		for (k = 0; k < rounds; ++k) {
+			if (oscdispatch(d, buf, size, 0) != sizes[i]) {
+				errors++;
+			}
+		}
+		tpar = (now() - tpar) / rounds;
+		errors += check_runs(sizes[i], rounds);
+
+		// One round alone first to check each parameter's messages ran in order
+		ordered = 1;
+		if (oscdispatch(d, buf, size, OSCDISPATCH_ORDERED) != sizes[i]) {
+			errors++;
+		}
+		errors += check_runs(sizes[i], 1);
+		ordered = 0;
+		tord = now();
+		for (k = 0; k < rounds; ++k) {
+			if (oscdispatch(d, buf, size, OSCDISPATCH_ORDERED) != sizes[i]) {
+				errors++;
+			}
+		}
+		tord = (now() - tord) / rounds;
+		errors += check_runs(sizes[i], rounds);
+
+		printf("    %8d  %9.2f  %11.2f  %6.2fx  %10.2f  %6.2fx\n", sizes[i],
+			   tserial * 1e3, tpar * 1e3, tserial / tpar, tord * 1e3, tserial / tord);
+	}
+	printf("    checks: %s\n", errors ? "MISMATCH" : "match");
+
+	oscdispatch_free(d);
+	free(buf);
+	return errors ? 1 : 0;
+}
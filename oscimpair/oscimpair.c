@@ -0,0 +1,949 @@
+/******************************************************************************
+ *  oscimpair
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *
+ *  This is a proxy that stands in for a real network between a sender and a
+ *  receiver on one machine. It forwards UDP datagrams or TCP streams to a
+ *  destination, and on the way loses, delays, reorders and duplicates
+ *  packets and caps the bandwidth, in both directions. Packets wait in a
+ *  timer wheel and live in pools that grow in slabs, up to -packets, as
+ *  more are in flight; once they are big enough a packet costs no
+ *  allocation.
+ *
+ ******************************************************************************/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE		// ppoll
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+#define OSCIMPAIR "oscimpair"
+
+// Datagrams or stream chunks read from one socket per wakeup
+#define BATCH 64
+
+// UDP clients or TCP connections at a time
+#define FLOWS 64
+
+// Resolution of the timer wheel (about 66 us) and ticks in one turn of it
+// (about 4.3 s); packets due later wait for more turns
+#define TICK_NS 65536ull
+#define SLOTS 65536
+
+// Bytes of a TCP stream scheduled as one packet, and unwritten bytes each way
+// of a connection before the proxy stops reading (the receive window)
+#define CHUNK 2048
+#define WINDOW (1024 * 1024)
+
+// Socket receive buffer, so bursts wait in the kernel rather than being lost
+#define RCVBUF (8 * 1024 * 1024)
+
+// A TCP chunk the link loses arrives this much later than a round trip
+#define MIN_STALL_NS 10000000ull
+
+#define NONE 0xffffffffu
+
+const char usage[] =
+"usage: oscimpair [options] port ip port tcp|udp\n" \
+"    Listens on the first port and forwards to ip port, impairing both\n" \
+"    directions.\n" \
+"    Options:\n" \
+"        -loss pct       lose pct percent of the packets\n" \
+"        -burst n        mean number of packets lost in a row (default 1)\n" \
+"        -delay ms       one-way delay\n" \
+"        -jitter ms      add between -ms and +ms to the delay of each packet\n" \
+"        -reorder pct    hold pct percent of the packets back by -gap ms so\n" \
+"                        that later ones overtake them\n" \
+"        -gap ms         (default 2)\n" \
+"        -dup pct        send pct percent of the packets twice\n" \
+"        -rate bytes     cap each direction at bytes per second\n" \
+"        -queue bytes    bytes that wait for the capped link before packets\n" \
+"                        are dropped (default 65536)\n" \
+"        -oneway         impair only the direction toward ip port\n" \
+"        -seed n         random seed (default 1): the same seed and traffic\n" \
+"                        give the same losses\n" \
+"        -packets n      packets in flight at most (default 1048576)\n" \
+"\n" \
+"A TCP stream is never lost, duplicated or reordered: a chunk the link\n" \
+"loses arrives a round trip late (2 x delay, at least 10 ms), and the\n" \
+"rest of the stream waits behind it, as after a retransmission. Counters\n" \
+"of each direction are printed on exit.\n" \
+"\n";
+
+// Impairment of one direction
+struct impair {
+	double loss;
+	double burst;
+	uint64_t delay_ns;
+	uint64_t jitter_ns;
+	double reorder;
+	uint64_t gap_ns;
+	double dup;
+	double rate;			// bytes per second, 0 for no cap
+	double queue;			// bytes
+};
+
+// State and counters of one direction
+struct link {
+	int bad;				// in a run of losses
+	uint64_t free_ns;		// the capped link is busy until then
+	uint64_t in;
+	uint64_t out;
+	uint64_t lost;
+	uint64_t duplicated;
+	uint64_t reordered;
+	uint64_t overflow;		// dropped at the queue of the capped link
+	uint64_t nospace;		// dropped for lack of free packets
+	uint64_t errors;		// the send failed
+};
+
+// A packet in flight: in the wheel or, for TCP, waiting to be written
+struct pkt {
+	uint32_t next;
+	uint32_t rounds;		// turns of the wheel left
+	uint8_t* data;
+	int32_t size;
+	int32_t off;			// bytes already written
+	uint16_t flow;
+	uint16_t gen;
+	uint8_t dir;
+	uint8_t cls;
+};
+
+// Buffers of one size, allocated a slab at a time
+struct pool {
+	int32_t size;
+	uint32_t count;			// buffers allocated
+	uint32_t limit;
+	uint32_t first;			// buffers in the first slab
+	uint8_t** free;
+	uint32_t nfree;
+};
+
+struct flow {
+	int used;
+	uint16_t gen;
+	int down;				// tcp: the client
+	int up;					// to the destination
+	struct sockaddr_storage addr;	// udp: the client
+	socklen_t addrlen;
+	uint64_t last_ns;		// udp: last datagram from the client
+	uint64_t order[2];		// tcp: due time of the last chunk each way
+	uint32_t head[2];		// tcp: chunks due but not written yet
+	uint32_t tail[2];
+	uint32_t queued[2];		// tcp: chunks in the wheel
+	int32_t pending[2];		// tcp: bytes read but not written
+	int eof[2];				// tcp: the sending side closed
+};
+
+static struct impair cfg[2];	// 0: toward the destination, 1: back
+static struct link links[2];
+static struct pkt* pkts;
+static uint32_t* freepkt;
+static uint32_t nfree, npkts, maxpkts;
+static struct pool pools[3];
+static struct flow flows[FLOWS];
+static int tcp;
+static int lfd;				// listening socket
+static struct addrinfo* dest;
+
+static uint32_t whead[SLOTS];
+static uint32_t wtail[SLOTS];
+static uint64_t wbits[SLOTS / 64];
+static uint64_t wtick;		// next tick to run
+static uint32_t inflight, maxinflight;
+
+static uint64_t seed = 1;
+static volatile sig_atomic_t done;
+
+static uint64_t mono_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// xorshift64*, uniform in [0, 1)
+static double uniform(void)
+{
+	seed ^= seed >> 12;
+	seed ^= seed << 25;
+	seed ^= seed >> 27;
+	return ((seed * 2685821657736338717ull) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Losses come in runs of -burst packets on average (Gilbert model)
+static int lose(int d)
+{
+	struct impair* c = &cfg[d];
+	struct link* l = &links[d];
+	double to_good, to_bad;
+
+	if (c->loss <= 0) {
+		return 0;
+	}
+	if (c->burst <= 1) {
+		return uniform() < c->loss;
+	}
+	to_good = 1 / c->burst;
+	to_bad = c->loss < 1 ? c->loss * to_good / (1 - c->loss) : 1;
+	l->bad = l->bad ? uniform() >= to_good : uniform() < to_bad;
+	return l->bad;
+}
+
+/* ----------------------------------------------------------------------------
+ *	Packets
+ */
+
+// Packets and buffers start with a slab this size and double up to the limit
+#define FIRST_PACKETS 1024
+
+static void pools_init(uint32_t packets)
+{
+	static const int32_t sizes[3] = { 256, CHUNK, 65536 };
+	static const uint32_t firsts[3] = { FIRST_PACKETS, 64, 4 };
+	uint32_t i;
+	int k;
+
+	maxpkts = packets;
+	for (k = 0; k < 3; ++k) {
+		pools[k].size = sizes[k];
+		pools[k].first = firsts[k];
+	}
+	pools[0].limit = packets;
+	pools[1].limit = packets / 16 > 64 ? packets / 16 : 64;
+	pools[2].limit = 64;
+	for (i = 0; i < SLOTS; ++i) {
+		whead[i] = wtail[i] = NONE;
+	}
+}
+
+// Adds a slab of buffers as big as what the pool has, or -1 at its limit
+static int pool_grow(struct pool* p)
+{
+	uint32_t n = p->count ? p->count : p->first, k;
+	uint8_t** list;
+	uint8_t* mem;
+
+	if (n > p->limit - p->count) {
+		n = p->limit - p->count;
+	}
+	if (n == 0 || (mem = (uint8_t*)malloc((size_t)n * p->size)) == NULL) {
+		return -1;
+	}
+	if ((list = (uint8_t**)realloc(p->free, (p->count + n) * sizeof(*list))) == NULL) {
+		free(mem);
+		return -1;
+	}
+	p->free = list;
+	for (k = 0; k < n; ++k) {
+		p->free[p->nfree++] = mem + (size_t)k * p->size;
+	}
+	p->count += n;
+	return 0;
+}
+
+// Doubles the packets, or -1 at the limit
+static int pkts_grow(void)
+{
+	uint32_t n = npkts ? npkts : FIRST_PACKETS, i;
+	struct pkt* p;
+	uint32_t* list;
+
+	if (n > maxpkts - npkts) {
+		n = maxpkts - npkts;
+	}
+	if (n == 0) {
+		return -1;
+	}
+	if ((p = (struct pkt*)realloc(pkts, (npkts + n) * sizeof(*p))) == NULL) {
+		return -1;
+	}
+	pkts = p;
+	if ((list = (uint32_t*)realloc(freepkt, (npkts + n) * sizeof(*list))) == NULL) {
+		return -1;
+	}
+	freepkt = list;
+	for (i = npkts + n; i > npkts; --i) {
+		freepkt[nfree++] = i - 1;
+	}
+	npkts += n;
+	return 0;
+}
+
+// A packet with room for size bytes, or NONE
+static uint32_t alloc(int32_t size)
+{
+	struct pool* p;
+	uint32_t i;
+	int k;
+
+	// The smallest buffer that fits, growing its pool before taking a bigger one
+	for (k = 0; k < 3; ++k) {
+		if (pools[k].size >= size && (pools[k].nfree || pool_grow(&pools[k]) == 0)) {
+			break;
+		}
+	}
+	if (k == 3 || (!nfree && pkts_grow() == -1)) {
+		return NONE;
+	}
+	p = &pools[k];
+	i = freepkt[--nfree];
+	pkts[i].data = p->free[--p->nfree];
+	pkts[i].cls = (uint8_t)k;
+	pkts[i].size = size;
+	pkts[i].off = 0;
+	pkts[i].next = NONE;
+	if (++inflight > maxinflight) {
+		maxinflight = inflight;
+	}
+	return i;
+}
+
+static void release(uint32_t i)
+{
+	struct pool* p = &pools[pkts[i].cls];
+
+	p->free[p->nfree++] = pkts[i].data;
+	freepkt[nfree++] = i;
+	inflight--;
+}
+
+/* ----------------------------------------------------------------------------
+ *	Timer wheel: a list of packets per tick, in the order they were added,
+ *	and a bit per slot that has any
+ */
+
+static void schedule(uint32_t i, uint64_t due)
+{
+	uint64_t tick = due / TICK_NS;
+	uint32_t slot;
+
+	if (tick < wtick) {
+		tick = wtick;
+	}
+	slot = (uint32_t)(tick & (SLOTS - 1));
+	pkts[i].rounds = (uint32_t)((tick - wtick) / SLOTS);
+	pkts[i].next = NONE;
+	if (whead[slot] == NONE) {
+		whead[slot] = i;
+		wbits[slot >> 6] |= 1ull << (slot & 63);
+	}
+	else {
+		pkts[wtail[slot]].next = i;
+	}
+	wtail[slot] = i;
+}
+
+// First tick from from on that has packets, or limit (at most a turn away)
+static uint64_t next_tick(uint64_t from, uint64_t limit)
+{
+	uint64_t t = from, word;
+	uint32_t slot;
+
+	if (limit - from > SLOTS) {
+		limit = from + SLOTS;
+	}
+	while (t < limit) {
+		slot = (uint32_t)(t & (SLOTS - 1));
+		word = wbits[slot >> 6] >> (slot & 63);
+		if (word) {
+			t += __builtin_ctzll(word);
+			return t < limit ? t : limit;
+		}
+		t += 64 - (slot & 63);
+	}
+	return limit;
+}
+
+/* ----------------------------------------------------------------------------
+ *	Flows
+ */
+
+static void flow_close(int f)
+{
+	struct flow* fl = &flows[f];
+	uint32_t i, next;
+	int d;
+
+	for (d = 0; d < 2; ++d) {
+		for (i = fl->head[d]; i != NONE; i = next) {
+			next = pkts[i].next;
+			release(i);
+		}
+	}
+	if (tcp) {
+		close(fl->down);
+	}
+	close(fl->up);
+	fl->used = 0;
+	fl->gen++;		// what is still in the wheel is dropped
+}
+
+// Opens the socket to the destination for a new flow
+static int flow_open(int down)
+{
+	struct flow* fl;
+	int f, lru = 0, fd;
+
+	for (f = 0; f < FLOWS && flows[f].used; ++f) {
+		if (flows[f].last_ns < flows[lru].last_ns) {
+			lru = f;
+		}
+	}
+	if (f == FLOWS) {
+		if (tcp) {
+			fprintf(stderr, "%s: too many connections\n", OSCIMPAIR);
+			return -1;
+		}
+		flow_close(f = lru);	// the client that was quiet longest
+	}
+	if ((fd = socket(dest->ai_family, dest->ai_socktype, dest->ai_protocol)) == -1 ||
+		connect(fd, dest->ai_addr, dest->ai_addrlen) == -1) {
+		perror(OSCIMPAIR ": connect");
+		if (fd != -1) {
+			close(fd);
+		}
+		return -1;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	if (down != -1) {
+		fcntl(down, F_SETFL, fcntl(down, F_GETFL) | O_NONBLOCK);
+	}
+	fl = &flows[f];
+	memset(fl->order, 0, sizeof(fl->order));
+	memset(fl->queued, 0, sizeof(fl->queued));
+	memset(fl->pending, 0, sizeof(fl->pending));
+	memset(fl->eof, 0, sizeof(fl->eof));
+	fl->head[0] = fl->head[1] = fl->tail[0] = fl->tail[1] = NONE;
+	fl->used = 1;
+	fl->down = down;
+	fl->up = fd;
+	fl->last_ns = mono_ns();
+	return f;
+}
+
+// The flow of a UDP client
+static int udp_flow(const struct sockaddr_storage* addr, socklen_t len)
+{
+	int f;
+
+	for (f = 0; f < FLOWS; ++f) {
+		if (flows[f].used && flows[f].addrlen == len && memcmp(&flows[f].addr, addr, len) == 0) {
+			return f;
+		}
+	}
+	if ((f = flow_open(-1)) != -1) {
+		memcpy(&flows[f].addr, addr, len);
+		flows[f].addrlen = len;
+	}
+	return f;
+}
+
+// Closes a TCP connection once both sides closed and everything was written
+static void tcp_check(int f)
+{
+	struct flow* fl = &flows[f];
+	int d;
+
+	for (d = 0; d < 2; ++d) {
+		if (fl->eof[d] == 1 && fl->pending[d] == 0) {
+			shutdown(d == 0 ? fl->up : fl->down, SHUT_WR);
+			fl->eof[d] = 2;
+		}
+	}
+	if (fl->eof[0] == 2 && fl->eof[1] == 2) {
+		flow_close(f);
+	}
+}
+
+// Writes the chunks of a TCP connection that are due
+static void tcp_flush(int f, int d)
+{
+	struct flow* fl = &flows[f];
+	struct pkt* p;
+	uint32_t i;
+	ssize_t n;
+	int fd = d == 0 ? fl->up : fl->down;
+
+	while ((i = fl->head[d]) != NONE) {
+		p = &pkts[i];
+		if ((n = write(fd, p->data + p->off, p->size - p->off)) < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+				return;
+			}
+			links[d].errors++;
+			flow_close(f);
+			return;
+		}
+		if ((p->off += (int32_t)n) < p->size) {
+			return;
+		}
+		fl->head[d] = p->next;
+		fl->pending[d] -= p->size;
+		links[d].out++;
+		release(i);
+	}
+	fl->tail[d] = NONE;
+	tcp_check(f);
+}
+
+// Sends a packet whose time has come
+static void deliver(uint32_t i)
+{
+	struct pkt* p = &pkts[i];
+	struct flow* fl = &flows[p->flow];
+	int d = p->dir;
+	ssize_t n;
+
+	if (!fl->used || fl->gen != p->gen) {
+		release(i);
+		return;
+	}
+	if (tcp) {
+		p->next = NONE;
+		if (fl->head[d] == NONE) {
+			fl->head[d] = i;
+		}
+		else {
+			pkts[fl->tail[d]].next = i;
+		}
+		fl->tail[d] = i;
+		if (fl->head[d] == i) {
+			tcp_flush(p->flow, d);
+		}
+		return;
+	}
+	if (d == 0) {
+		n = send(fl->up, p->data, p->size, 0);
+	}
+	else {
+		n = sendto(lfd, p->data, p->size, 0, (struct sockaddr*)&fl->addr, fl->addrlen);
+	}
+	if (n < 0) {
+		links[d].errors++;
+	}
+	else {
+		links[d].out++;
+	}
+	release(i);
+}
+
+// Sends what is due by now
+static void run(uint64_t now)
+{
+	uint64_t end = now / TICK_NS;	// ticks before this one are over
+	uint32_t slot, i, prev, next;
+
+	while (wtick < end) {
+		if ((wtick = next_tick(wtick, end)) == end) {
+			break;
+		}
+		slot = (uint32_t)(wtick & (SLOTS - 1));
+		for (prev = NONE, i = whead[slot]; i != NONE; i = next) {
+			next = pkts[i].next;
+			if (pkts[i].rounds) {
+				pkts[i].rounds--;
+				prev = i;
+				continue;
+			}
+			if (prev == NONE) {
+				whead[slot] = next;
+			}
+			else {
+				pkts[prev].next = next;
+			}
+			if (wtail[slot] == i) {
+				wtail[slot] = prev;
+			}
+			if (tcp && flows[pkts[i].flow].gen == pkts[i].gen) {
+				flows[pkts[i].flow].queued[pkts[i].dir]--;
+			}
+			deliver(i);
+		}
+		if (whead[slot] == NONE) {
+			wbits[slot >> 6] &= ~(1ull << (slot & 63));
+		}
+		wtick++;
+	}
+}
+
+// Puts what was read on the link
+static void impair(int f, int d, const uint8_t* data, int32_t size, uint64_t now)
+{
+	struct impair* c = &cfg[d];
+	struct link* l = &links[d];
+	struct flow* fl = &flows[f];
+	uint64_t due = now, stall = 0;
+	double jitter;
+	uint32_t i;
+	int copies = 1, k;
+
+	l->in++;
+	if (lose(d)) {
+		l->lost++;
+		if (!tcp) {
+			return;
+		}
+		stall = 2 * c->delay_ns > MIN_STALL_NS ? 2 * c->delay_ns : MIN_STALL_NS;
+	}
+	if (c->rate > 0) {
+		if (!tcp && l->free_ns > now && (l->free_ns - now) * 1e-9 * c->rate > c->queue) {
+			l->overflow++;
+			return;
+		}
+		l->free_ns = (l->free_ns > now ? l->free_ns : now) + (uint64_t)(size * 1e9 / c->rate);
+		due = l->free_ns;
+	}
+	due += c->delay_ns + stall;
+	if (c->jitter_ns) {
+		jitter = (2 * uniform() - 1) * c->jitter_ns;
+		due = jitter < 0 && (uint64_t)-jitter > due - now ? now : due + (int64_t)jitter;
+	}
+	if (tcp) {
+		// A stream stays in order
+		if (due < fl->order[d]) {
+			due = fl->order[d];
+		}
+		fl->order[d] = due;
+		fl->pending[d] += size;
+	}
+	else {
+		if (c->reorder > 0 && uniform() < c->reorder) {
+			due += c->gap_ns;
+			l->reordered++;
+		}
+		if (c->dup > 0 && uniform() < c->dup) {
+			copies = 2;
+			l->duplicated++;
+		}
+	}
+	for (k = 0; k < copies; ++k) {
+		if ((i = alloc(size)) == NONE) {
+			l->nospace++;
+			if (tcp) {
+				fprintf(stderr, "%s: out of packets, closing a connection\n", OSCIMPAIR);
+				flow_close(f);
+			}
+			return;
+		}
+		memcpy(pkts[i].data, data, size);
+		pkts[i].flow = (uint16_t)f;
+		pkts[i].gen = fl->gen;
+		pkts[i].dir = (uint8_t)d;
+		if (due <= now && (!tcp || fl->queued[d] == 0)) {
+			deliver(i);
+		}
+		else {
+			fl->queued[d] += tcp;
+			schedule(i, due);
+		}
+	}
+}
+
+/* ----------------------------------------------------------------------------
+ *	Sockets
+ */
+
+static int listen_on(const char* port)
+{
+	struct addrinfo hints, *res;
+	int fd, yes = 1, rv, size = RCVBUF;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = dest->ai_family;
+	hints.ai_socktype = dest->ai_socktype;
+	hints.ai_flags = AI_PASSIVE;
+	if ((rv = getaddrinfo(NULL, port, &hints, &res)) != 0) {
+		fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(rv));
+		return -1;
+	}
+	if ((fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol)) == -1 ||
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) == -1 ||
+		bind(fd, res->ai_addr, res->ai_addrlen) == -1 ||
+		(tcp && listen(fd, FLOWS) == -1)) {
+		perror(OSCIMPAIR ": listen");
+		freeaddrinfo(res);
+		return -1;
+	}
+	freeaddrinfo(res);
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	return fd;
+}
+
+static void read_udp(int fd, int f, uint64_t now)
+{
+	static uint8_t buf[65536];
+	struct sockaddr_storage addr;
+	socklen_t len;
+	ssize_t n;
+	int k;
+
+	for (k = 0; k < BATCH; ++k) {
+		len = sizeof(addr);
+		if ((n = recvfrom(fd, buf, sizeof(buf), 0, (struct sockaddr*)&addr, &len)) < 0) {
+			return;
+		}
+		if (f == -1) {
+			int c = udp_flow(&addr, len);
+			if (c != -1) {
+				flows[c].last_ns = now;
+				impair(c, 0, buf, (int32_t)n, now);
+			}
+		}
+		else {
+			impair(f, 1, buf, (int32_t)n, now);
+		}
+	}
+}
+
+static void read_tcp(int f, int d, uint64_t now)
+{
+	uint8_t buf[CHUNK];
+	struct flow* fl = &flows[f];
+	ssize_t n;
+	int k;
+
+	for (k = 0; k < BATCH && fl->used && !fl->eof[d] && fl->pending[d] < WINDOW; ++k) {
+		if ((n = read(d == 0 ? fl->down : fl->up, buf, sizeof(buf))) <= 0) {
+			if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+				return;
+			}
+			fl->eof[d] = 1;
+			tcp_check(f);
+			return;
+		}
+		impair(f, d, buf, (int32_t)n, now);
+	}
+}
+
+static void stop(int sig)
+{
+	(void)sig;
+	done = 1;
+}
+
+static void summary(int d, const char* name)
+{
+	struct link* l = &links[d];
+
+	fprintf(stderr, "    %s: %llu in, %llu out, %llu lost, %llu duplicated, %llu reordered,\n"
+			"        %llu over the queue, %llu without space, %llu send errors\n", name,
+			(unsigned long long)l->in, (unsigned long long)l->out,
+			(unsigned long long)l->lost, (unsigned long long)l->duplicated,
+			(unsigned long long)l->reordered, (unsigned long long)l->overflow,
+			(unsigned long long)l->nospace, (unsigned long long)l->errors);
+}
+
+// Reads a number of milliseconds as nanoseconds
+static uint64_t ms(const char* s)
+{
+	double v = atof(s);
+	return v > 0 ? (uint64_t)(v * 1e6) : 0;
+}
+
+int main (int argc, char* const argv[])
+{
+	struct pollfd pfd[1 + FLOWS * 2];
+	int owner[1 + FLOWS * 2];		// flow * 2 + side of each descriptor
+	struct addrinfo hints;
+	struct timespec ts;
+	uint64_t now, wake;
+	uint32_t packets = 1u << 20;
+	double bytes;
+	int i, k, n, f, d, rv, fd, oneway = 0;
+
+	cfg[0].burst = 1;
+	cfg[0].gap_ns = 2000000;
+	cfg[0].queue = 65536;
+	for (i = 1; i < argc && argv[i][0] == '-'; ++i) {
+		if (strcmp(argv[i], "-loss") == 0 && i + 1 < argc) {
+			cfg[0].loss = atof(argv[++i]) / 100;
+		}
+		else if (strcmp(argv[i], "-burst") == 0 && i + 1 < argc) {
+			cfg[0].burst = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-delay") == 0 && i + 1 < argc) {
+			cfg[0].delay_ns = ms(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-jitter") == 0 && i + 1 < argc) {
+			cfg[0].jitter_ns = ms(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-reorder") == 0 && i + 1 < argc) {
+			cfg[0].reorder = atof(argv[++i]) / 100;
+		}
+		else if (strcmp(argv[i], "-gap") == 0 && i + 1 < argc) {
+			cfg[0].gap_ns = ms(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-dup") == 0 && i + 1 < argc) {
+			cfg[0].dup = atof(argv[++i]) / 100;
+		}
+		else if (strcmp(argv[i], "-rate") == 0 && i + 1 < argc) {
+			cfg[0].rate = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-queue") == 0 && i + 1 < argc) {
+			cfg[0].queue = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-oneway") == 0) {
+			oneway = 1;
+		}
+		else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc) {
+			seed = strtoull(argv[++i], NULL, 10) | 1;
+		}
+		else if (strcmp(argv[i], "-packets") == 0 && i + 1 < argc) {
+			packets = (uint32_t)atol(argv[++i]);
+		}
+		else {
+			printf(usage);
+			return 0;
+		}
+	}
+	if (argc - i != 4 || (strcmp(argv[i+3], "udp") != 0 && strcmp(argv[i+3], "tcp") != 0) ||
+		packets < 64 || packets >= NONE / 2 || cfg[0].loss > 1 || cfg[0].burst < 1) {
+		printf(usage);
+		return 0;
+	}
+	cfg[1] = cfg[0];
+	if (oneway) {
+		memset(&cfg[1], 0, sizeof(cfg[1]));
+	}
+	tcp = strcmp(argv[i+3], "tcp") == 0;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = tcp ? SOCK_STREAM : SOCK_DGRAM;
+	if ((rv = getaddrinfo(argv[i+1], argv[i+2], &hints, &dest)) != 0) {
+		fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(rv));
+		return 1;
+	}
+	if ((lfd = listen_on(argv[i])) == -1) {
+		return 1;
+	}
+	pools_init(packets);
+
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+	signal(SIGPIPE, SIG_IGN);
+	wtick = mono_ns() / TICK_NS;
+
+	while (!done) {
+		// The listening socket, then both sides of every flow
+		pfd[0].fd = lfd;
+		pfd[0].events = POLLIN;
+		owner[0] = -1;
+		for (n = 1, f = 0; f < FLOWS; ++f) {
+			struct flow* fl = &flows[f];
+			if (!fl->used) {
+				continue;
+			}
+			for (d = 0; tcp && d < 2; ++d) {
+				pfd[n].fd = d == 0 ? fl->down : fl->up;
+				pfd[n].events = (!fl->eof[d] && fl->pending[d] < WINDOW ? POLLIN : 0) |
+								(fl->head[1 - d] != NONE ? POLLOUT : 0);
+				if (!pfd[n].events) {
+					pfd[n].fd = -1;		// closed: poll would keep reporting it
+				}
+				owner[n++] = f * 2 + d;
+			}
+			if (!tcp) {
+				pfd[n].fd = fl->up;
+				pfd[n].events = POLLIN;
+				owner[n++] = f * 2 + 1;
+			}
+		}
+
+		// Sleep until the next tick that has packets is over
+		now = mono_ns();
+		wake = next_tick(wtick, wtick + SLOTS);
+		if (wake == wtick + SLOTS) {
+			ts.tv_sec = 0;
+			ts.tv_nsec = 500000000;
+		}
+		else {
+			wake = (wake + 1) * TICK_NS;
+			wake = wake > now ? wake - now : 0;
+			ts.tv_sec = (time_t)(wake / 1000000000ull);
+			ts.tv_nsec = (long)(wake % 1000000000ull);
+		}
+		if ((rv = ppoll(pfd, n, &ts, NULL)) < 0 && errno != EINTR) {
+			perror("poll");
+			break;
+		}
+
+		now = mono_ns();
+		for (i = 0; rv > 0 && i < n; ++i) {
+			if (!pfd[i].revents) {
+				continue;
+			}
+			if (owner[i] == -1) {
+				if (!tcp) {
+					read_udp(lfd, -1, now);
+				}
+				else if ((fd = accept(lfd, NULL, NULL)) != -1 && flow_open(fd) == -1) {
+					close(fd);
+				}
+				continue;
+			}
+			f = owner[i] / 2;
+			d = owner[i] % 2;
+			if (!flows[f].used) {
+				continue;
+			}
+			if (!tcp) {
+				read_udp(pfd[i].fd, f, now);
+				continue;
+			}
+			if (pfd[i].revents & POLLOUT) {
+				tcp_flush(f, 1 - d);
+			}
+			if (flows[f].used && (pfd[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+				read_tcp(f, d, now);
+			}
+		}
+		run(mono_ns());
+	}
+
+	for (k = 0, bytes = 0; k < 3; ++k) {
+		bytes += (double)pools[k].count * pools[k].size;
+	}
+	fprintf(stderr, "%s: %u packets in flight at most, %.1f MB of buffers\n", OSCIMPAIR,
+			maxinflight, bytes / 1048576);
+	summary(0, "toward the destination");
+	summary(1, "back");
+	for (f = 0; f < FLOWS; ++f) {
+		if (flows[f].used) {
+			flow_close(f);
+		}
+	}
+	close(lfd);
+	freeaddrinfo(dest);
+	return 0;
+}
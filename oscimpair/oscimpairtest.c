@@ -0,0 +1,217 @@
+/******************************************************************************
+ *  oscimpairtest
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *  Runs oscimpair between two loopback UDP sockets with loss, loss in
+ *  bursts, duplication and reordering, sends numbered datagrams through it
+ *  and checks that the loss rate, the mean run of losses, the duplicates
+ *  and the datagrams overtaken by later ones match the options.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "../oscpack/osctest.h"
+
+const char usage[] = "usage: oscimpairtest [path to oscimpair] [port]\n";
+
+#define PACKETS 10000
+#define SPACING_US 100		// between datagrams, so 2 ms of -gap is overtaken
+#define PROBE 0xffffffffu
+
+struct result {
+	uint8_t seen[PACKETS];	// copies of each datagram received
+	int received;			// distinct datagrams
+	int duplicates;
+	int overtaken;			// arrived after a higher number
+	int runs;				// runs of lost datagrams
+};
+
+// A UDP socket on loopback
+static int udp(int port)
+{
+	struct sockaddr_in sin;
+	int fd;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sin.sin_port = htons(port);
+	if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) == -1 ||
+		(port && bind(fd, (struct sockaddr*)&sin, sizeof(sin)) == -1)) {
+		perror("oscimpairtest: socket");
+		exit(1);
+	}
+	return fd;
+}
+
+// Reads what arrives within timeout_ms
+static void drain(int fd, struct result* r, uint32_t* highest, int timeout_ms)
+{
+	struct pollfd pfd;
+	uint32_t seq;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while (poll(&pfd, 1, timeout_ms) > 0 && recv(fd, &seq, sizeof(seq), 0) == sizeof(seq)) {
+		if (seq >= PACKETS) {
+			continue;			// a late or duplicated probe
+		}
+		if (r->seen[seq]++) {
+			r->duplicates++;
+			continue;
+		}
+		r->received++;
+		if (*highest != PROBE && seq < *highest) {
+			r->overtaken++;
+		}
+		if (*highest == PROBE || seq > *highest) {
+			*highest = seq;
+		}
+	}
+}
+
+// Runs oscimpair with options and sends PACKETS datagrams through it
+static void run(const char* oscimpair, int port, const char* const* options,
+				struct result* r)
+{
+	struct sockaddr_in sin;
+	struct timespec ts;
+	char* argv[32];
+	char listen[16], forward[16];
+	uint32_t seq, highest = PROBE;
+	int n, status, tx, rx, ready = 0;
+	pid_t pid;
+
+	memset(r, 0, sizeof(*r));
+	snprintf(listen, sizeof(listen), "%d", port);
+	snprintf(forward, sizeof(forward), "%d", port + 1);
+	argv[0] = (char*)oscimpair;
+	for (n = 0; options[n]; ++n) {
+		argv[n + 1] = (char*)options[n];
+	}
+	argv[++n] = listen;
+	argv[++n] = (char*)"127.0.0.1";
+	argv[++n] = forward;
+	argv[++n] = (char*)"udp";
+	argv[++n] = NULL;
+
+	rx = udp(port + 1);
+	tx = udp(0);
+	if ((pid = fork()) == 0) {
+		dup2(open("/dev/null", O_WRONLY), 2);
+		execv(oscimpair, argv);
+		_exit(127);
+	}
+
+	// Probe until the proxy forwards; a probe may be lost like any datagram
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sin.sin_port = htons(port);
+	seq = PROBE;
+	for (n = 0; n < 200 && !ready; ++n) {
+		struct pollfd pfd = { rx, POLLIN, 0 };
+
+		sendto(tx, &seq, sizeof(seq), 0, (struct sockaddr*)&sin, sizeof(sin));
+		ready = poll(&pfd, 1, 20) > 0;
+	}
+	expect(ready, "oscimpair forwards");
+
+	for (seq = 0; ready && seq < PACKETS; ++seq) {
+		sendto(tx, &seq, sizeof(seq), 0, (struct sockaddr*)&sin, sizeof(sin));
+		ts.tv_sec = 0;
+		ts.tv_nsec = SPACING_US * 1000;
+		nanosleep(&ts, NULL);
+		if (seq % 50 == 49) {
+			drain(rx, r, &highest, 0);
+		}
+	}
+	drain(rx, r, &highest, 200);
+
+	for (n = 0; n < PACKETS; ++n) {
+		r->runs += !r->seen[n] && (n == 0 || r->seen[n - 1]);
+	}
+	kill(pid, SIGTERM);
+	waitpid(pid, &status, 0);
+	close(tx);
+	close(rx);
+}
+
+// True if value is within tolerance of expected
+static int near(double value, double expected, double tolerance)
+{
+	return value >= expected - tolerance && value <= expected + tolerance;
+}
+
+int main (int argc, char* const argv[])
+{
+	static const char* const loss[] = { "-loss", "10", "-seed", "3", NULL };
+	static const char* const burst[] = { "-loss", "10", "-burst", "4", "-seed", "5", NULL };
+	static const char* const dup[] = { "-dup", "5", "-seed", "7", NULL };
+	static const char* const reorder[] = {
+		"-reorder", "10", "-gap", "2", "-seed", "9", NULL,
+	};
+	static struct result r;
+	const char* oscimpair = argc > 1 ? argv[1] : "./oscimpair";
+	int port = argc > 2 ? atoi(argv[2]) : 17480;
+	double lost;
+
+	if (argc > 3 || access(oscimpair, X_OK) != 0 || port <= 0) {
+		printf(usage);
+		return 1;
+	}
+	printf("checks:\n");
+
+	run(oscimpair, port, loss, &r);
+	lost = 1 - (double)r.received / PACKETS;
+	printf("    -loss 10: %.1f%% lost in %d runs\n", lost * 100, r.runs);
+	expect(near(lost, 0.10, 0.015), "loss rate");
+	expect(near((double)(PACKETS - r.received) / r.runs, 1.1, 0.2), "independent losses");
+	expect(r.duplicates == 0 && r.overtaken == 0, "nothing duplicated or reordered");
+
+	run(oscimpair, port, burst, &r);
+	lost = 1 - (double)r.received / PACKETS;
+	printf("    -loss 10 -burst 4: %.1f%% lost, %.2f in a row\n", lost * 100,
+		   r.runs ? (double)(PACKETS - r.received) / r.runs : 0.0);
+	expect(near(lost, 0.10, 0.03), "loss rate in bursts");
+	expect(r.runs && near((double)(PACKETS - r.received) / r.runs, 4, 0.8), "mean burst");
+
+	run(oscimpair, port, dup, &r);
+	printf("    -dup 5: %.1f%% duplicated\n", 100.0 * r.duplicates / PACKETS);
+	expect(r.received == PACKETS, "nothing lost");
+	expect(near((double)r.duplicates / PACKETS, 0.05, 0.01), "duplicate rate");
+
+	run(oscimpair, port, reorder, &r);
+	printf("    -reorder 10 -gap 2: %.1f%% overtaken\n", 100.0 * r.overtaken / PACKETS);
+	expect(r.received == PACKETS && r.duplicates == 0, "nothing lost or duplicated");
+	expect(near((double)r.overtaken / PACKETS, 0.10, 0.015), "reorder rate");
+
+	return osctest_report();
+}
@@ -0,0 +1,445 @@
+/******************************************************************************
+ *  oscmetrics
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#ifndef OSC_METRICS
+#define OSC_METRICS
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "oscmetrics.h"
+#include "../oscpack/oscpack.h"
+
+// Addresses remembered per thread, and how far a lookup probes
+#define SLOTS 512
+#define PROBE 8
+
+// One address of one thread; 128 bytes, two cache lines
+struct slot {
+	uint32_t seq;		// odd while the owner replaces the address
+	uint32_t hash;
+	uint64_t messages;
+	uint64_t bytes;
+	char address[OSCMETRICS_ADDRESS_MAX];
+};
+
+// Counters of one thread. Only the owner writes; oscmetrics_snapshot() reads.
+struct block {
+	uint64_t counters[OSCMETRICS_COUNTERS];
+	struct block* next;
+	int active;
+	struct slot slots[SLOTS] __attribute__((aligned(64)));
+};
+
+static const char* names[OSCMETRICS_COUNTERS] = {
+	"encoded",
+	"encoded_bytes",
+	"encode_errors",
+	"sent",
+	"sent_bytes",
+	"send_errors",
+	"drops",
+	"received",
+	"received_bytes"
+};
+
+__thread uint64_t* oscmetrics_counters;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+static struct block* blocks;
+static uint64_t start_ns;
+
+static uint64_t mono_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// The block is kept, counts and all, for the next thread that attaches
+static void detach(void* p)
+{
+	pthread_mutex_lock(&lock);
+	((struct block*)p)->active = 0;
+	pthread_mutex_unlock(&lock);
+}
+
+static void init(void)
+{
+	pthread_key_create(&key, detach);
+	start_ns = mono_ns();
+}
+
+uint64_t* oscmetrics_attach(void)
+{
+	static struct block spare;		// counts something if memory runs out
+	struct block* b;
+	void* p;
+
+	pthread_once(&once, init);
+	pthread_mutex_lock(&lock);
+	for (b = blocks; b != NULL && b->active; b = b->next)
+		;
+	if (b == NULL) {
+		if (posix_memalign(&p, 64, sizeof(struct block)) != 0) {
+			pthread_mutex_unlock(&lock);
+			fprintf(stderr, "oscmetrics: Critical memory error...\n");
+			oscmetrics_counters = spare.counters;
+			return spare.counters;
+		}
+		b = (struct block*)p;
+		memset(b, 0, sizeof(*b));
+		b->next = blocks;
+		blocks = b;
+	}
+	b->active = 1;
+	pthread_mutex_unlock(&lock);
+
+	pthread_setspecific(key, b);
+	oscmetrics_counters = b->counters;
+	return b->counters;
+}
+
+const char* oscmetrics_name(int counter)
+{
+	if (counter < 0 || counter >= OSCMETRICS_COUNTERS) {
+		return NULL;
+	}
+	return names[counter];
+}
+
+static uint32_t hash(const char* s, int32_t len)
+{
+	uint32_t h = 2166136261u;
+	int32_t i;
+
+	for (i = 0; i < len; ++i) {
+		h = (h ^ (uint8_t)s[i]) * 16777619u;
+	}
+	return h;
+}
+
+void oscmetrics_address(const char* addr, int32_t len, int32_t size)
+{
+	oscmetrics_address_hash(addr, len, hash(addr, len), size);
+}
+
+void oscmetrics_address_hash(const char* addr, int32_t len, uint32_t h, int32_t size)
+{
+	struct block* b;
+	struct slot* s;
+	struct slot* victim = NULL;
+	int i;
+
+	if (oscmetrics_counters == NULL) {
+		oscmetrics_attach();
+	}
+	b = (struct block*)oscmetrics_counters;
+
+	// The hash is of the whole address; only the start is kept
+	if (len >= OSCMETRICS_ADDRESS_MAX) {
+		len = OSCMETRICS_ADDRESS_MAX - 1;
+	}
+
+	for (i = 0; i < PROBE; ++i) {
+		s = &b->slots[(h + i) & (SLOTS - 1)];
+		if (s->hash == h && strncmp(s->address, addr, len) == 0 && s->address[len] == '\0') {
+			__atomic_store_n(&s->messages, s->messages + 1, __ATOMIC_RELAXED);
+			__atomic_store_n(&s->bytes, s->bytes + size, __ATOMIC_RELAXED);
+			return;
+		}
+		if (s->address[0] == '\0') {
+			victim = s;
+			break;
+		}
+		if (victim == NULL || s->messages < victim->messages) {
+			victim = s;
+		}
+	}
+
+	// Replace the least used address of the window under the slot's seqlock
+	s = victim;
+	__atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	s->hash = h;
+	memcpy(s->address, addr, len);
+	s->address[len] = '\0';
+	s->messages = 1;
+	s->bytes = size;
+	__atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+}
+
+void oscmetrics_message(const char* addr, int32_t len, int32_t size)
+{
+	oscmetrics_add(OSCMETRICS_ENCODED, 1);
+	oscmetrics_add(OSCMETRICS_ENCODED_BYTES, size);
+	oscmetrics_address(addr, len, size);
+}
+
+void oscmetrics_message_hash(const char* addr, int32_t len, uint32_t hash, int32_t size)
+{
+	oscmetrics_add(OSCMETRICS_ENCODED, 1);
+	oscmetrics_add(OSCMETRICS_ENCODED_BYTES, size);
+	oscmetrics_address_hash(addr, len, hash, size);
+}
+
+// Copies a slot that its owner may be writing; 0 if it is empty
+static int readslot(const struct slot* s, oscmetrics_address_t* a)
+{
+	uint32_t seq;
+
+	do {
+		while ((seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE)) & 1)
+			;
+		a->hash = s->hash;
+		memcpy(a->address, s->address, OSCMETRICS_ADDRESS_MAX);
+		a->messages = __atomic_load_n(&s->messages, __ATOMIC_RELAXED);
+		a->bytes = __atomic_load_n(&s->bytes, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) != seq);
+
+	a->address[OSCMETRICS_ADDRESS_MAX - 1] = '\0';
+	a->rate = a->byterate = 0.0;
+	return a->address[0] != '\0';
+}
+
+static int compare(const void* x, const void* y)
+{
+	const oscmetrics_address_t* a = (const oscmetrics_address_t*)x;
+	const oscmetrics_address_t* b = (const oscmetrics_address_t*)y;
+
+	if (a->hash != b->hash) {
+		return a->hash < b->hash ? -1 : 1;
+	}
+	return strcmp(a->address, b->address);
+}
+
+int oscmetrics_snapshot(oscmetrics_snapshot_t* s)
+{
+	struct block* b;
+	oscmetrics_address_t* p;
+	int32_t i, j, n = 0;
+
+	pthread_once(&once, init);
+	memset(s->counters, 0, sizeof(s->counters));
+
+	pthread_mutex_lock(&lock);
+	for (b = blocks; b != NULL; b = b->next) {
+		n += SLOTS;
+	}
+	if (n > s->capacity) {
+		p = (oscmetrics_address_t*)realloc(s->addresses, n * sizeof(*p));
+		if (p == NULL) {
+			pthread_mutex_unlock(&lock);
+			return -1;
+		}
+		s->addresses = p;
+		s->capacity = n;
+	}
+
+	n = 0;
+	for (b = blocks; b != NULL; b = b->next) {
+		for (i = 0; i < OSCMETRICS_COUNTERS; ++i) {
+			s->counters[i] += __atomic_load_n(&b->counters[i], __ATOMIC_RELAXED);
+		}
+		for (i = 0; i < SLOTS; ++i) {
+			n += readslot(&b->slots[i], &s->addresses[n]);
+		}
+	}
+	pthread_mutex_unlock(&lock);
+	s->time_ns = mono_ns();
+
+	// Merge the threads' counts of the same address
+	qsort(s->addresses, n, sizeof(*s->addresses), compare);
+	for (i = 0, j = -1; i < n; ++i) {
+		if (j >= 0 && compare(&s->addresses[j], &s->addresses[i]) == 0) {
+			s->addresses[j].messages += s->addresses[i].messages;
+			s->addresses[j].bytes += s->addresses[i].bytes;
+		}
+		else if (++j != i) {
+			s->addresses[j] = s->addresses[i];
+		}
+	}
+	s->naddresses = j + 1;
+	return 0;
+}
+
+void oscmetrics_snapshot_free(oscmetrics_snapshot_t* s)
+{
+	free(s->addresses);
+	s->addresses = NULL;
+	s->naddresses = s->capacity = 0;
+}
+
+static double seconds(const oscmetrics_snapshot_t* cur, const oscmetrics_snapshot_t* prev)
+{
+	uint64_t t = prev ? prev->time_ns : start_ns;
+	return cur->time_ns > t ? (cur->time_ns - t) * 1e-9 : 0.0;
+}
+
+// Counters only grow, but an address that was forgotten and seen again
+// starts over; count nothing for it rather than a negative rate.
+static uint64_t delta(uint64_t cur, uint64_t prev)
+{
+	return cur >= prev ? cur - prev : 0;
+}
+
+int oscmetrics_top(const oscmetrics_snapshot_t* cur, const oscmetrics_snapshot_t* prev,
+				   oscmetrics_address_t* top, int n)
+{
+	const oscmetrics_address_t* a;
+	oscmetrics_address_t x;
+	double dt = seconds(cur, prev);
+	int32_t i, j = 0, k, m = 0;
+	int c;
+
+	for (i = 0; i < cur->naddresses; ++i) {
+		x = cur->addresses[i];
+
+		// Both are sorted; walk prev along with cur
+		if (prev != NULL) {
+			c = 1;
+			while (j < prev->naddresses &&
+				   (c = compare(&prev->addresses[j], &x)) < 0) {
+				++j;
+			}
+			if (j < prev->naddresses && c == 0) {
+				a = &prev->addresses[j];
+				x.messages = delta(x.messages, a->messages);
+				x.bytes = delta(x.bytes, a->bytes);
+			}
+		}
+		x.rate = dt > 0 ? x.messages / dt : 0.0;
+		x.byterate = dt > 0 ? x.bytes / dt : 0.0;
+		x.messages = cur->addresses[i].messages;
+		x.bytes = cur->addresses[i].bytes;
+
+		// Insertion into the n busiest so far
+		if (m == n && (n == 0 || x.rate <= top[n-1].rate)) {
+			continue;
+		}
+		for (k = m < n ? m++ : n - 1; k > 0 && top[k-1].rate < x.rate; --k) {
+			top[k] = top[k-1];
+		}
+		top[k] = x;
+	}
+	return m;
+}
+
+int32_t oscmetrics_text(const oscmetrics_snapshot_t* cur, const oscmetrics_snapshot_t* prev,
+						int n, char* buf, int32_t size)
+{
+	oscmetrics_address_t* top = NULL;
+	double dt = seconds(cur, prev);
+	int32_t len;
+	int i, m;
+
+	if (n > 0 && (top = (oscmetrics_address_t*)malloc(n * sizeof(*top))) == NULL) {
+		return -1;
+	}
+	m = n > 0 ? oscmetrics_top(cur, prev, top, n) : 0;
+
+	len = snprintf(buf, size, "%-24s %20s %14s\n", "counter", "total", "per second");
+	for (i = 0; i < OSCMETRICS_COUNTERS && len < size; ++i) {
+		len += snprintf(buf + len, size - len, "%-24s %20llu %14.1f\n", names[i],
+						(unsigned long long)cur->counters[i],
+						dt > 0 ? delta(cur->counters[i], prev ? prev->counters[i] : 0) / dt : 0.0);
+	}
+	if (m > 0 && len < size) {
+		len += snprintf(buf + len, size - len, "\n%-40s %16s %14s %14s\n",
+						"address", "messages", "messages/s", "bytes/s");
+	}
+	for (i = 0; i < m && len < size; ++i) {
+		len += snprintf(buf + len, size - len, "%-40s %16llu %14.1f %14.1f\n", top[i].address,
+						(unsigned long long)top[i].messages, top[i].rate, top[i].byterate);
+	}
+
+	free(top);
+	return len < size ? len : -1;
+}
+
+// oscpack() does not check the space itself, so reserve a bound for one
+// bundle element: the size, the padded strings and at most 32 bytes of
+// numeric arguments.
+static int32_t bound(const char* addr, const char* s)
+{
+	return 4 + (int32_t)strlen(addr) + 4 + 8 + (s ? (int32_t)strlen(s) + 4 : 0) + 32;
+}
+
+// Writes the size of the element that oscpack() put after it
+static int32_t element(uint8_t* buf, int32_t len, int32_t n)
+{
+	uint32_t be = htonl(n);
+	memcpy(buf + len, &be, 4);
+	return len + 4 + n;
+}
+
+int32_t oscmetrics_osc(const oscmetrics_snapshot_t* cur, const oscmetrics_snapshot_t* prev,
+					   int n, uint8_t* buf, int32_t size)
+{
+	oscmetrics_address_t* top = NULL;
+	char addr[32];
+	double dt = seconds(cur, prev);
+	int32_t len = 16, k;
+	int i, m = 0;
+
+	if (size < len) {
+		return -1;
+	}
+	memcpy(buf, "#bundle\0", 8);
+	memset(buf + 8, 0, 8);
+	buf[15] = 1;		// immediately
+
+	for (i = 0; i < OSCMETRICS_COUNTERS; ++i) {
+		snprintf(addr, sizeof(addr), "/_stats/%s", names[i]);
+		if (len + bound(addr, NULL) > size) {
+			return -1;
+		}
+		k = oscpack(buf + len + 4, addr, "hd", (int64_t)cur->counters[i],
+					dt > 0 ? delta(cur->counters[i], prev ? prev->counters[i] : 0) / dt : 0.0);
+		len = element(buf, len, k);
+	}
+
+	if (n > 0) {
+		if ((top = (oscmetrics_address_t*)malloc(n * sizeof(*top))) == NULL) {
+			return -1;
+		}
+		m = oscmetrics_top(cur, prev, top, n);
+	}
+	for (i = 0; i < m; ++i) {
+		if (len + bound("/_stats/address", top[i].address) > size) {
+			free(top);
+			return -1;
+		}
+		k = oscpack(buf + len + 4, "/_stats/address", "shdd", top[i].address,
+					(int64_t)top[i].messages, top[i].rate, top[i].byterate);
+		len = element(buf, len, k);
+	}
+
+	free(top);
+	return len;
+}
@@ -0,0 +1,184 @@
+/******************************************************************************
+ *  oscmetrics
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#ifndef __OSC_METRICS_H__
+#define __OSC_METRICS_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ *	oscmetrics counts what the OSC path does: messages encoded by oscpack(),
+ *	packets sent and received by oscnet, errors, drops, and messages per
+ *	address.
+ *
+ *	Every thread counts into its own cache line aligned block, so counting
+ *	is a plain add with no lock and no shared cache line. The blocks are
+ *	only added up when the counters are read with oscmetrics_snapshot().
+ *
+ *	oscpack and oscnet count only when compiled with -DOSC_METRICS (and
+ *	linked with oscmetrics.c); otherwise the hooks compile to nothing.
+ *
+ *	Usage example:
+ *		oscmetrics_snapshot_t prev = {0}, cur = {0};
+ *		char text[4096];
+ *
+ *		oscmetrics_snapshot(&prev);
+ *		sleep(1);
+ *		oscmetrics_snapshot(&cur);
+ *		oscmetrics_text(&cur, &prev, 10, text, sizeof(text));
+ *		fputs(text, stderr);
+ */
+
+enum {
+	OSCMETRICS_ENCODED,			// messages encoded by oscpack()
+	OSCMETRICS_ENCODED_BYTES,
+	OSCMETRICS_ENCODE_ERRORS,	// voscpack() returned -1
+	OSCMETRICS_SENT,			// packets sent by oscnet and oscfanout
+	OSCMETRICS_SENT_BYTES,
+	OSCMETRICS_SEND_ERRORS,		// send calls that failed
+	OSCMETRICS_DROPS,			// packets that were not sent or not delivered
+	OSCMETRICS_RECEIVED,		// packets received by oscnet
+	OSCMETRICS_RECEIVED_BYTES,
+	OSCMETRICS_COUNTERS
+};
+
+// Addresses longer than this are counted under their first 103 characters
+#define OSCMETRICS_ADDRESS_MAX 104
+
+typedef struct {
+	char address[OSCMETRICS_ADDRESS_MAX];
+	uint32_t hash;
+	uint64_t messages;
+	uint64_t bytes;
+	double rate;			// messages/s, set by oscmetrics_top()
+	double byterate;		// bytes/s, set by oscmetrics_top()
+} oscmetrics_address_t;
+
+typedef struct {
+	uint64_t time_ns;		// CLOCK_MONOTONIC when taken
+	uint64_t counters[OSCMETRICS_COUNTERS];
+	oscmetrics_address_t* addresses;
+	int32_t naddresses;
+	int32_t capacity;
+} oscmetrics_snapshot_t;
+
+/* Name of a counter, such as "sent_bytes" */
+const char* oscmetrics_name(int counter);
+
+/*
+ *	oscmetrics_address() counts one message of size bytes for addr. Each
+ *	thread keeps the busiest addresses it has seen; an address that is
+ *	rarely used may be forgotten to make room for a new one.
+ */
+void oscmetrics_address(const char* addr, int32_t len, int32_t size);
+
+/* oscmetrics_address() with the FNV-1a hash already known (see oscintern) */
+void oscmetrics_address_hash(const char* addr, int32_t len, uint32_t hash,
+							 int32_t size);
+
+/* Counts an encoded message: one add per counter and oscmetrics_address() */
+void oscmetrics_message(const char* addr, int32_t len, int32_t size);
+void oscmetrics_message_hash(const char* addr, int32_t len, uint32_t hash,
+							 int32_t size);
+
+/*
+ *	oscmetrics_snapshot() adds up the counters of all threads.
+ *
+ *	Arguments:
+ *		oscmetrics_snapshot_t* s: Zeroed the first time; the address array is
+ *								  reused on later calls.
+ *
+ *	Return:
+ *		0 on success, -1 if memory for the addresses could not be allocated.
+ */
+int oscmetrics_snapshot(oscmetrics_snapshot_t* s);
+
+void oscmetrics_snapshot_free(oscmetrics_snapshot_t* s);
+
+/*
+ *	oscmetrics_top() fills top with the n addresses with the highest message
+ *	rate between prev and cur, busiest first. prev may be NULL for rates
+ *	since the first thread started counting. Returns the number filled in.
+ */
+int oscmetrics_top(const oscmetrics_snapshot_t* cur, const oscmetrics_snapshot_t* prev,
+				   oscmetrics_address_t* top, int n);
+
+/*
+ *	oscmetrics_text() writes the counters, their rates and the top n
+ *	addresses as a table. Returns the length written, not counting the
+ *	terminating NUL, or -1 if buf is too small.
+ */
+int32_t oscmetrics_text(const oscmetrics_snapshot_t* cur, const oscmetrics_snapshot_t* prev,
+						int n, char* buf, int32_t size);
+
+/*
+ *	oscmetrics_osc() encodes the same report as a bundle of OSC messages:
+ *
+ *		/_stats/<counter> ,hd total per_second
+ *		/_stats/address ,shdd address messages messages/s bytes/s
+ *
+ *	with one /_stats/address message for each of the top n addresses, busiest
+ *	first. Returns the size of the bundle, or -1 if buf is too small.
+ */
+int32_t oscmetrics_osc(const oscmetrics_snapshot_t* cur, const oscmetrics_snapshot_t* prev,
+					   int n, uint8_t* buf, int32_t size);
+
+#ifdef OSC_METRICS
+
+// This thread's counters; NULL until the thread counts for the first time
+extern __thread uint64_t* oscmetrics_counters;
+
+uint64_t* oscmetrics_attach(void);
+
+// Only the owning thread writes its counters; the relaxed store keeps the
+// value whole for readers without a locked instruction.
+static inline void oscmetrics_add(int counter, uint64_t n)
+{
+	uint64_t* c = oscmetrics_counters;
+
+	if (!c) {
+		c = oscmetrics_attach();
+	}
+	__atomic_store_n(&c[counter], c[counter] + n, __ATOMIC_RELAXED);
+}
+
+#define OSCMETRICS_ADD(counter, n) oscmetrics_add((counter), (n))
+#define OSCMETRICS_MESSAGE(addr, len, size) oscmetrics_message((addr), (len), (size))
+#define OSCMETRICS_MESSAGE_HASH(addr, len, hash, size) \
+	oscmetrics_message_hash((addr), (len), (hash), (size))
+
+#else
+
+#define OSCMETRICS_ADD(counter, n) ((void)0)
+#define OSCMETRICS_MESSAGE(addr, len, size) ((void)(addr), (void)(len), (void)(size))
+#define OSCMETRICS_MESSAGE_HASH(addr, len, hash, size) \
+	((void)(addr), (void)(len), (void)(hash), (void)(size))
+
+#endif // OSC_METRICS
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __OSC_METRICS_H__
@@ -0,0 +1,142 @@
+/******************************************************************************
+ *  oscmetricstest
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *
+ *  Encoder threads encode messages with oscpack() for a set of addresses
+ *  while the main thread takes snapshots. Prints the encode rate with
+ *  counting, checks that the merged totals match what the threads encoded,
+ *  and prints the final text report.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "oscmetrics.h"
+#include "../oscpack/oscpack.h"
+
+const char usage[] = "usage: oscmetricstest [threads] [addresses] [seconds]\n";
+
+static int addresses = 1000;
+static volatile int running = 1;
+
+struct encoder {
+	pthread_t thread;
+	int id;
+	uint64_t messages;
+	uint64_t bytes;
+};
+
+static void* encodeloop(void* arg)
+{
+	struct encoder* e = (struct encoder*)arg;
+	uint8_t buf[256];
+	char addr[64];
+	uint32_t x = (uint32_t)e->id * 2654435761u | 1;
+	int32_t size;
+
+	while (running) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		// A few addresses carry most of the traffic
+		snprintf(addr, sizeof(addr), "/mixer/ch/%u/gain",
+				 (x & 3) ? (x >> 8) % 8 : (x >> 8) % addresses);
+		size = oscpack(buf, addr, "if", e->id, 0.5);
+		e->messages++;
+		e->bytes += size;
+	}
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main (int argc, char* const argv[])
+{
+	struct encoder* encoders;
+	oscmetrics_snapshot_t prev, cur;
+	uint64_t messages = 0, bytes = 0, snapshots = 0;
+	double t, seconds = 2.0;
+	char text[8192];
+	int i, nthreads = 4;
+
+	if (argc > 1 && argv[1][0] == '-') {
+		printf(usage);
+		return 0;
+	}
+	if (argc > 1) nthreads = atoi(argv[1]);
+	if (argc > 2) addresses = atoi(argv[2]);
+	if (argc > 3) seconds = atof(argv[3]);
+	if (nthreads < 1 || addresses < 1) {
+		printf(usage);
+		return 0;
+	}
+
+	encoders = (struct encoder*)calloc(nthreads, sizeof(struct encoder));
+	if (!encoders) {
+		fprintf(stderr, "oscmetricstest: Critical memory error...\n");
+		return 1;
+	}
+	memset(&prev, 0, sizeof(prev));
+	memset(&cur, 0, sizeof(cur));
+	oscmetrics_snapshot(&prev);
+
+	t = now();
+	for (i = 0; i < nthreads; ++i) {
+		encoders[i].id = i + 1;
+		pthread_create(&encoders[i].thread, NULL, encodeloop, &encoders[i]);
+	}
+	// Snapshots while the threads count, as a monitoring thread would
+	while (now() - t < seconds) {
+		usleep(10000);
+		oscmetrics_snapshot(&cur);
+		snapshots++;
+	}
+	running = 0;
+	for (i = 0; i < nthreads; ++i) {
+		pthread_join(encoders[i].thread, NULL);
+		messages += encoders[i].messages;
+		bytes += encoders[i].bytes;
+	}
+	t = now() - t;
+	oscmetrics_snapshot(&cur);
+
+	printf("oscmetricstest: %d threads, %d addresses, %llu snapshots\n", nthreads,
+		   addresses, (unsigned long long)snapshots);
+	printf("    encodes: %.2f M/s (%.1f ns per message per thread)\n",
+		   messages / t / 1e6, t * nthreads / messages * 1e9);
+	printf("    totals:  %s\n", cur.counters[OSCMETRICS_ENCODED] == messages &&
+		   cur.counters[OSCMETRICS_ENCODED_BYTES] == bytes ? "match" : "MISMATCH");
+
+	if (oscmetrics_text(&cur, &prev, 10, text, sizeof(text)) > 0) {
+		printf("\n%s", text);
+	}
+	oscmetrics_snapshot_free(&prev);
+	oscmetrics_snapshot_free(&cur);
+	free(encoders);
+	return cur.counters[OSCMETRICS_ENCODED] == messages ? 0 : 1;
+}
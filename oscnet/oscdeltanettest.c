@@ -0,0 +1,132 @@
+/******************************************************************************
+ *  oscdeltanettest
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *  Opens a delta session to a TCP listener by hand and sends a frame with a
+ *  good record followed by a malformed one, and checks that the listener
+ *  delivers the good packet, drops that connection and goes on receiving
+ *  from another.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "oscnet.h"
+#include "../oscdelta/oscdelta.h"
+#include "../oscpack/oscpack.h"
+#include "../oscpack/osctest.h"
+
+const char usage[] = "usage: oscdeltanettest [port]\n";
+
+#define ENTRIES 64
+
+// Writes one length-prefixed frame
+static int sendframe(int fd, const uint8_t* frame, int32_t size)
+{
+	uint32_t prefix = htonl((uint32_t)size);
+
+	return send(fd, &prefix, 4, 0) == 4 && send(fd, frame, size, 0) == size ? 0 : -1;
+}
+
+// True if fd reads end of stream within a second, after any frames
+static int closed(int fd)
+{
+	struct pollfd pfd;
+	uint8_t buf[256];
+	ssize_t n;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while (poll(&pfd, 1, 1000) > 0) {
+		if ((n = recv(fd, buf, sizeof(buf), 0)) <= 0) {
+			return n == 0;
+		}
+	}
+	return 0;
+}
+
+int main (int argc, char* const argv[])
+{
+	struct sockaddr_in sin;
+	uint8_t frame[256], packet[64], buf[256];
+	int32_t len, size, n;
+	oscdelta_t* enc;
+	oscnet_t *net, *plain;
+	const char* port = "7792";
+	int fd;
+
+	if (argc > 2 || (argc > 1 && argv[1][0] == '-')) {
+		printf(usage);
+		return 1;
+	}
+	if (argc > 1) port = argv[1];
+
+	if ((net = oscnet_listen(NULL, port, "tcp")) == NULL ||
+		oscnet_delta(net, ENTRIES, 0) == -1) {
+		return 1;
+	}
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(atoi(port));
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if ((fd = socket(AF_INET, SOCK_STREAM, 0)) == -1 ||
+		connect(fd, (struct sockaddr*)&sin, sizeof(sin)) == -1) {
+		perror("connect");
+		return 1;
+	}
+
+	printf("checks:\n");
+
+	// Ask for a session, then send a good record and a bad one in one frame
+	len = oscdelta_handshake(frame, OSCDELTA_HELLO, ENTRIES);
+	expect(sendframe(fd, frame, len) == 0, "sends the handshake");
+	enc = oscdelta_new(ENTRIES);
+	size = oscpack(packet, "/good", "i", 1);
+	frame[0] = OSCDELTA_FRAME;
+	len = 1 + oscdelta_encode(enc, packet, size, frame + 1, sizeof(frame) - 1);
+	memset(frame + len, 0xff, 8);
+	expect(sendframe(fd, frame, len + 8) == 0, "sends the frame");
+
+	n = oscnet_recv(net, buf, sizeof(buf), 1000);
+	expect(n == size && memcmp(buf, packet, size) == 0, "the good record is delivered");
+
+	// The bad record drops the session; another connection still works
+	if ((plain = oscnet_connect("127.0.0.1", port, "tcp")) == NULL) {
+		return 1;
+	}
+	size = oscpack(packet, "/next", "i", 2);
+	expect(oscnet_send(plain, packet, size) == size, "sends on another connection");
+	n = oscnet_recv(net, buf, sizeof(buf), 1000);
+	expect(n == size && memcmp(buf, packet, size) == 0,
+		   "the next packet comes from the other connection");
+	expect(closed(fd), "the connection with the bad record is dropped");
+
+	osctest_report();
+	oscdelta_free(enc);
+	close(fd);
+	oscnet_close(plain);
+	oscnet_close(net);
+	return osctest_errors != 0;
+}
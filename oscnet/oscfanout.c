@@ -0,0 +1,317 @@
+/******************************************************************************
+ *  oscfanout
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE		// sendmmsg
+#endif
+
+#include "oscfanout.h"
+#include "../oscmetrics/oscmetrics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <net/if.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+// Destinations of one address family share a socket and a message array.
+// Every message points at the same iovec, which oscfanout_send() sets to
+// the packet, so nothing else is touched per send.
+struct oscfanout_family {
+	int fd;
+	struct sockaddr_storage* addrs;
+	socklen_t* addrlens;
+	int* index;				// destination index for error reporting
+#ifdef __linux__
+	struct mmsghdr* msgs;
+#endif
+	int count;
+	int cap;
+};
+
+struct oscfanout {
+	struct oscfanout_family fam[2];		// AF_INET, AF_INET6
+	char** names;
+	int count;
+	struct iovec iov;
+
+	// Multicast options from oscfanout_multicast(), also given to a socket
+	// that is opened after it
+	int mcast;
+	unsigned int ifindex;
+	int ttl;
+	int loop;
+};
+
+oscfanout_t* oscfanout_new(void)
+{
+	oscfanout_t* fan = (oscfanout_t*)calloc(1, sizeof(oscfanout_t));
+	if (!fan) {
+		return NULL;
+	}
+	fan->fam[0].fd = -1;
+	fan->fam[1].fd = -1;
+	return fan;
+}
+
+static int oscfanout_grow(oscfanout_t* fan, struct oscfanout_family* f)
+{
+	int cap = f->cap ? f->cap * 2 : 16;
+	void* p;
+	int i;
+
+	if ((p = realloc(f->addrs, cap * sizeof(*f->addrs))) == NULL) return -1;
+	f->addrs = (struct sockaddr_storage*)p;
+	if ((p = realloc(f->addrlens, cap * sizeof(*f->addrlens))) == NULL) return -1;
+	f->addrlens = (socklen_t*)p;
+	if ((p = realloc(f->index, cap * sizeof(*f->index))) == NULL) return -1;
+	f->index = (int*)p;
+#ifdef __linux__
+	if ((p = realloc(f->msgs, cap * sizeof(*f->msgs))) == NULL) return -1;
+	f->msgs = (struct mmsghdr*)p;
+
+	// addrs may have moved
+	for (i = 0; i < f->count; ++i) {
+		f->msgs[i].msg_hdr.msg_name = &f->addrs[i];
+		f->msgs[i].msg_hdr.msg_iov = &fan->iov;
+	}
+#else
+	(void)fan;
+	(void)i;
+#endif
+	f->cap = cap;
+	return 0;
+}
+
+// Sets the multicast options of the family k socket
+static int oscfanout_options(oscfanout_t* fan, int k)
+{
+	int fd = fan->fam[k].fd;
+	unsigned char c;
+	struct in_addr any;
+	int rv = 0;
+
+	if (k == 0) {
+		c = (unsigned char)fan->ttl;
+		rv |= setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &c, sizeof(c));
+		c = (unsigned char)fan->loop;
+		rv |= setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &c, sizeof(c));
+		if (fan->ifindex) {
+#ifdef __linux__
+			struct ip_mreqn mreq;
+			memset(&mreq, 0, sizeof(mreq));
+			mreq.imr_ifindex = fan->ifindex;
+			rv |= setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &mreq, sizeof(mreq));
+#else
+			(void)any;
+#endif
+		}
+		else {
+			any.s_addr = htonl(INADDR_ANY);
+			rv |= setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &any, sizeof(any));
+		}
+	}
+	else {
+		rv |= setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS,
+						 &fan->ttl, sizeof(fan->ttl));
+		rv |= setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_LOOP,
+						 &fan->loop, sizeof(fan->loop));
+		rv |= setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_IF,
+						 &fan->ifindex, sizeof(fan->ifindex));
+	}
+
+	if (rv != 0) {
+		perror("setsockopt");
+		return -1;
+	}
+	return 0;
+}
+
+int oscfanout_add(oscfanout_t* fan, const char* host, const char* port)
+{
+	struct addrinfo hints, *res;
+	struct oscfanout_family* f;
+	char** names;
+	int rv, n, k;
+
+	memset(&hints, 0, sizeof hints);
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	if ((rv = getaddrinfo(host, port, &hints, &res)) != 0) {
+		fprintf(stderr, "getaddrinfo: %s: %s\n", host, gai_strerror(rv));
+		return -1;
+	}
+
+	k = res->ai_family == AF_INET6 ? 1 : 0;
+	f = &fan->fam[k];
+	if (f->fd == -1) {
+		if ((f->fd = socket(res->ai_family, SOCK_DGRAM, 0)) == -1) {
+			perror("socket");
+			freeaddrinfo(res);
+			return -1;
+		}
+		if (fan->mcast && oscfanout_options(fan, k) == -1) {
+			close(f->fd);
+			f->fd = -1;
+			freeaddrinfo(res);
+			return -1;
+		}
+	}
+
+	names = (char**)realloc(fan->names, (fan->count + 1) * sizeof(char*));
+	if (!names || (f->count == f->cap && oscfanout_grow(fan, f) == -1)) {
+		fan->names = names ? names : fan->names;
+		freeaddrinfo(res);
+		return -1;
+	}
+	fan->names = names;
+	n = strlen(host) + strlen(port) + 2;
+	if ((fan->names[fan->count] = (char*)malloc(n)) == NULL) {
+		freeaddrinfo(res);
+		return -1;
+	}
+	snprintf(fan->names[fan->count], n, "%s:%s", host, port);
+
+	memcpy(&f->addrs[f->count], res->ai_addr, res->ai_addrlen);
+	f->addrlens[f->count] = res->ai_addrlen;
+	f->index[f->count] = fan->count;
+#ifdef __linux__
+	memset(&f->msgs[f->count], 0, sizeof(struct mmsghdr));
+	f->msgs[f->count].msg_hdr.msg_name = &f->addrs[f->count];
+	f->msgs[f->count].msg_hdr.msg_namelen = res->ai_addrlen;
+	f->msgs[f->count].msg_hdr.msg_iov = &fan->iov;
+	f->msgs[f->count].msg_hdr.msg_iovlen = 1;
+#endif
+	f->count++;
+	freeaddrinfo(res);
+
+	return fan->count++;
+}
+
+int oscfanout_multicast(oscfanout_t* fan, const char* iface, int ttl, int loop)
+{
+	unsigned int ifindex = 0;
+	int k, rv = 0;
+
+	if (iface && (ifindex = if_nametoindex(iface)) == 0) {
+		perror("if_nametoindex");
+		return -1;
+	}
+	fan->mcast = 1;
+	fan->ifindex = ifindex;
+	fan->ttl = ttl;
+	fan->loop = loop != 0;
+
+	for (k = 0; k < 2; ++k) {
+		if (fan->fam[k].fd != -1 && oscfanout_options(fan, k) == -1) {
+			rv = -1;
+		}
+	}
+	return rv;
+}
+
+int oscfanout_count(oscfanout_t* fan)
+{
+	return fan->count;
+}
+
+const char* oscfanout_name(oscfanout_t* fan, int index)
+{
+	return index >= 0 && index < fan->count ? fan->names[index] : NULL;
+}
+
+int oscfanout_send(oscfanout_t* fan, const uint8_t* buf, int32_t size, int* errors)
+{
+	struct oscfanout_family* f;
+	int i, k, rv, sent = 0;
+
+	fan->iov.iov_base = (void*)buf;
+	fan->iov.iov_len = size;
+
+	for (k = 0; k < 2; ++k) {
+		f = &fan->fam[k];
+		i = 0;
+		while (i < f->count) {
+#ifdef __linux__
+			// sendmmsg() stops at the first failure; record it and carry on
+			// with the next destination.
+			rv = sendmmsg(f->fd, &f->msgs[i], f->count - i, 0);
+#else
+			rv = sendto(f->fd, buf, size, 0, (struct sockaddr*)&f->addrs[i],
+						f->addrlens[i]) == -1 ? -1 : 1;
+#endif
+			if (rv > 0) {
+				if (errors) {
+					while (rv-- > 0) {
+						errors[f->index[i++]] = 0;
+						sent++;
+					}
+				}
+				else {
+					i += rv;
+					sent += rv;
+				}
+			}
+			else if (errno != EINTR) {
+				if (errors) {
+					errors[f->index[i]] = errno;
+				}
+				OSCMETRICS_ADD(OSCMETRICS_SEND_ERRORS, 1);
+				OSCMETRICS_ADD(OSCMETRICS_DROPS, 1);
+				i++;
+			}
+		}
+	}
+	OSCMETRICS_ADD(OSCMETRICS_SENT, sent);
+	OSCMETRICS_ADD(OSCMETRICS_SENT_BYTES, (uint64_t)sent * size);
+	return sent;
+}
+
+void oscfanout_free(oscfanout_t* fan)
+{
+	int i, k;
+
+	if (!fan) {
+		return;
+	}
+	for (k = 0; k < 2; ++k) {
+		if (fan->fam[k].fd != -1) {
+			close(fan->fam[k].fd);
+		}
+		free(fan->fam[k].addrs);
+		free(fan->fam[k].addrlens);
+		free(fan->fam[k].index);
+#ifdef __linux__
+		free(fan->fam[k].msgs);
+#endif
+	}
+	for (i = 0; i < fan->count; ++i) {
+		free(fan->names[i]);
+	}
+	free(fan->names);
+	free(fan);
+}
@@ -0,0 +1,109 @@
+/******************************************************************************
+ *  oscfanout
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#ifndef __OSC_FANOUT_H__
+#define __OSC_FANOUT_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ *	oscfanout sends the same OSC packet to many UDP destinations. Host names
+ *	are resolved once when a destination is added, and every call to
+ *	oscfanout_send() delivers the packet to all of them with a single
+ *	sendmmsg() per address family. All messages share one iovec, so the
+ *	packet is encoded and referenced once no matter how many destinations
+ *	there are.
+ *
+ *	A destination may be an IP multicast group. Use oscfanout_multicast() to
+ *	set the TTL, loopback and outgoing interface for groups, before or after
+ *	the destinations are added.
+ *
+ *
+ *	Usage example:
+ *		oscfanout_t* fan = oscfanout_new();
+ *		oscfanout_add(fan, "10.0.0.11", "7374");
+ *		oscfanout_add(fan, "10.0.0.12", "7374");
+ *		size = oscpack(packet, "/cue/go", "i", 12);
+ *		sent = oscfanout_send(fan, packet, size, NULL);
+ *		oscfanout_free(fan);
+ */
+
+typedef struct oscfanout oscfanout_t;
+
+/* Creates an empty destination list. Returns NULL on error. */
+oscfanout_t* oscfanout_new(void);
+
+/*
+ *	oscfanout_add() resolves host and port and appends the destination.
+ *
+ *	Return:
+ *		Index of the destination, or -1 on error (printed to stderr).
+ */
+int oscfanout_add(oscfanout_t* fan, const char* host, const char* port);
+
+/*
+ *	oscfanout_multicast() sets the options used when sending to multicast
+ *	groups. It may be called before or after oscfanout_add(): the options
+ *	are kept and given to the socket of every address family, including
+ *	one first opened by a later oscfanout_add(). A later call replaces them.
+ *
+ *	Arguments:
+ *		const char* iface: Interface name to send from, or NULL for the
+ *						   default route.
+ *		int ttl: Multicast TTL (IPv4) or hop limit (IPv6).
+ *		int loop: 1 to deliver to listeners on this host as well.
+ *
+ *	Return:
+ *		0 on success or -1 on error.
+ */
+int oscfanout_multicast(oscfanout_t* fan, const char* iface, int ttl, int loop);
+
+/* Returns the number of destinations. */
+int oscfanout_count(oscfanout_t* fan);
+
+/* Returns the destination as "host:port" for messages. */
+const char* oscfanout_name(oscfanout_t* fan, int index);
+
+/*
+ *	oscfanout_send() sends the packet to every destination. A destination
+ *	that fails does not stop delivery to the ones after it.
+ *
+ *	Arguments:
+ *		int* errors: Optional array of oscfanout_count() entries that is set
+ *					 to 0 for each destination that was sent to, or to the
+ *					 errno of the failure.
+ *
+ *	Return:
+ *		Number of destinations the packet was sent to.
+ */
+int oscfanout_send(oscfanout_t* fan, const uint8_t* buf, int32_t size, int* errors);
+
+/* Closes the sockets and frees the destination list. */
+void oscfanout_free(oscfanout_t* fan);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __OSC_FANOUT_H__
@@ -0,0 +1,175 @@
+/******************************************************************************
+ *  oscfanouttest
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *  Sends through oscfanout to two loopback receivers with a failing
+ *  destination (the broadcast address, refused without SO_BROADCAST) between
+ *  them, and checks that both receive every packet and that the failure is
+ *  reported for that destination only. Then sends to a multicast group on
+ *  the loopback interface, with the options set after and before the group
+ *  is added.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+
+#include <net/if.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "oscfanout.h"
+#include "../oscpack/osctest.h"
+
+const char usage[] = "usage: oscfanouttest\n";
+
+#define GROUP "239.255.0.1"
+#define PACKETS 100
+
+// A UDP socket on loopback; port is set to the one it got
+static int receiver(const char* addr, char* port, size_t size)
+{
+	struct sockaddr_in sin;
+	socklen_t len = sizeof(sin);
+	int fd;
+
+	if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) == -1) {
+		perror("socket");
+		exit(1);
+	}
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = inet_addr(addr);
+	if (bind(fd, (struct sockaddr*)&sin, sizeof(sin)) == -1 ||
+		getsockname(fd, (struct sockaddr*)&sin, &len) == -1) {
+		perror("bind");
+		exit(1);
+	}
+	snprintf(port, size, "%d", ntohs(sin.sin_port));
+	return fd;
+}
+
+// Packets waiting on fd that equal buf
+static int received(int fd, const uint8_t* buf, int32_t size)
+{
+	struct pollfd pfd;
+	uint8_t in[256];
+	ssize_t n;
+	int count = 0;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while (poll(&pfd, 1, 100) > 0 && (n = recv(fd, in, sizeof(in), 0)) > 0) {
+		count += n == size && memcmp(in, buf, size) == 0;
+	}
+	return count;
+}
+
+static void checkunicast(void)
+{
+	static const uint8_t packet[] = "/cue/go\0,i\0\0\0\0\0\14";
+	char p1[16], p2[16], name[64];
+	int fd1 = receiver("127.0.0.1", p1, sizeof(p1));
+	int fd2 = receiver("127.0.0.1", p2, sizeof(p2));
+	int errs[3] = { -1, -1, -1 };
+	int sent, i, all = 1;
+	oscfanout_t* fan = oscfanout_new();
+
+	expect(oscfanout_add(fan, "127.0.0.1", p1) == 0, "adds the first destination");
+	expect(oscfanout_add(fan, "255.255.255.255", p1) == 1, "adds the broadcast address");
+	expect(oscfanout_add(fan, "127.0.0.1", p2) == 2, "adds the second destination");
+	expect(oscfanout_add(fan, "127.0.0.1", "no-such-port") == -1 && oscfanout_count(fan) == 3,
+		   "a destination that does not resolve is refused");
+	snprintf(name, sizeof(name), "127.0.0.1:%s", p2);
+	expect(strcmp(oscfanout_name(fan, 2), name) == 0, "names are host:port");
+
+	sent = oscfanout_send(fan, packet, sizeof(packet) - 1, errs);
+	expect(sent == 2, "sends to the destinations that work");
+	expect(errs[0] == 0 && errs[2] == 0, "no error for the destinations that work");
+	expect(errs[1] == EACCES, "the broadcast address reports EACCES");
+	for (i = 1; i < PACKETS; ++i) {
+		all &= oscfanout_send(fan, packet, sizeof(packet) - 1, NULL) == 2;
+	}
+	expect(all, "every send reaches two destinations");
+	expect(received(fd1, packet, sizeof(packet) - 1) == PACKETS,
+		   "the first destination gets every packet");
+	expect(received(fd2, packet, sizeof(packet) - 1) == PACKETS,
+		   "the destination after the failing one gets every packet");
+
+	oscfanout_free(fan);
+	close(fd1);
+	close(fd2);
+}
+
+static void checkmulticast(void)
+{
+	static const uint8_t packet[] = "/sync\0\0\0,\0\0\0";
+	struct ip_mreqn mreq;
+	char port[16];
+	int fd = receiver("0.0.0.0", port, sizeof(port));
+	oscfanout_t* fan = oscfanout_new();
+
+	memset(&mreq, 0, sizeof(mreq));
+	mreq.imr_multiaddr.s_addr = inet_addr(GROUP);
+	mreq.imr_ifindex = if_nametoindex("lo");
+	if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) == -1) {
+		printf("    no multicast on lo, skipped\n");
+		oscfanout_free(fan);
+		close(fd);
+		return;
+	}
+	oscfanout_add(fan, GROUP, port);
+	expect(oscfanout_multicast(fan, "lo", 1, 1) == 0, "sets multicast options");
+	expect(oscfanout_send(fan, packet, sizeof(packet) - 1, NULL) == 1 &&
+		   received(fd, packet, sizeof(packet) - 1) == 1,
+		   "a group member on this host receives");
+	// Whatever goes out on lo comes back, so turning loopback off cannot be
+	// seen here
+	expect(oscfanout_multicast(fan, "lo", 4, 0) == 0, "changes multicast options");
+	expect(oscfanout_multicast(fan, "no-such-interface", 1, 1) == -1,
+		   "an unknown interface is refused");
+	oscfanout_free(fan);
+
+	// Options set before the first destination reach its socket
+	fan = oscfanout_new();
+	expect(oscfanout_multicast(fan, "lo", 1, 1) == 0, "sets multicast options first");
+	expect(oscfanout_add(fan, GROUP, port) == 0, "adds the group after the options");
+	expect(oscfanout_send(fan, packet, sizeof(packet) - 1, NULL) == 1 &&
+		   received(fd, packet, sizeof(packet) - 1) == 1,
+		   "the options apply to a socket opened after them");
+
+	oscfanout_free(fan);
+	close(fd);
+}
+
+int main (int argc, char* const argv[])
+{
+	(void)argv;
+	if (argc > 1) {
+		printf(usage);
+		return 1;
+	}
+	printf("checks:\n");
+	checkunicast();
+	checkmulticast();
+	return osctest_report();
+}
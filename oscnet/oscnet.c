@@ -0,0 +1,2145 @@
+/******************************************************************************
+ *  oscnet
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE		// sendmmsg, recvmmsg
+#endif
+
+#include "oscnet.h"
+#include "../oscshm/oscshm.h"
+#include "../oscmetrics/oscmetrics.h"
+#include "../oscdelta/oscdelta.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+
+#ifdef __linux__
+#include <linux/sockios.h>	// SIOCOUTQ
+#include <netinet/udp.h>
+#define OSCNET_HAVE_OFFLOAD
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103			// Linux 4.18
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104				// Linux 5.0
+#endif
+#endif
+
+#if defined(__linux__) && defined(SO_TXTIME)
+#include <linux/net_tstamp.h>
+#define OSCNET_HAVE_TXTIME
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// Accepted connections per listening TCP or seqpacket endpoint
+#define OSCNET_MAX_CONN 64
+
+// Packets per sendmmsg()/sendmsg() call
+#define OSCNET_BATCH 256
+
+// iovecs per sendmsg() on a TCP socket (IOV_MAX is 1024 on Linux)
+#define OSCNET_IOV_MAX 1024
+
+// A paced send wakes up for the next packet and also sends the ones due
+// within this many nanoseconds, so high rates still go out in batches.
+#define OSCNET_PACE_SLACK 50000
+
+// Limits of one segmented send: segments the kernel takes (UDP_MAX_SEGMENTS),
+// bytes of the whole run and of a segment, which must fit the path MTU of
+// an Ethernet link so the kernel does not refuse the run.
+#define OSCNET_GSO_SEGMENTS 64
+#define OSCNET_GSO_MAX 65000
+#define OSCNET_GSO_SEGMENT4 1472
+#define OSCNET_GSO_SEGMENT6 1452
+
+// Token buckets of a paced endpoint, kept as the time each bucket is next
+// empty (GCRA): a packet may go once that time is within the burst.
+struct oscnet_pace {
+	uint64_t packet_ns;				// 1/packets per second
+	double byte_ns;					// 1/bytes per second
+	uint64_t burst_ns;
+	uint64_t tatp;					// packet bucket
+	uint64_t tatb;					// byte bucket
+	int txtime;						// let the qdisc release packets
+	oscnet_pacestats_t stats;
+};
+
+struct oscnet_conn {
+	int fd;
+	int id;					// stays the same while the slot moves
+	uint8_t* buf;			// TCP reassembly buffer
+	int32_t off;			// start of unread data in buf
+	int32_t len;			// end of unread data in buf
+	struct sockaddr_storage peer;
+	uint32_t peerlen;
+	oscdelta_t* delta;		// session decoder, NULL for plain packets
+	uint8_t* frame;			// frame being decoded, then room for one packet
+	int32_t foff;			// next record in frame
+	int32_t flen;
+};
+
+// Datagrams the kernel coalesced (UDP_GRO) that are handed out one by one
+struct oscnet_gro {
+	uint8_t buf[OSCNET_MAX_PACKET];
+	int32_t off;			// next segment
+	int32_t len;
+	int32_t segment;		// size of each segment but the last
+	struct sockaddr_storage from;
+	uint32_t fromlen;
+	uint64_t stamp_ns;
+};
+
+// Packets a reliable endpoint reads while it sends are held for the next
+// receive, up to this many bytes
+#define OSCNET_HELD (4 * OSCNET_MAX_PACKET)
+
+// Reliable UDP (see oscrel): the stream to the destination of a connected
+// endpoint, or one stream per sender of a listening one
+struct oscnet_relpeer {
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	oscrel_t* rel;
+	uint64_t used;					// when a datagram last came, to drop the oldest
+};
+
+struct oscnet_rel {
+	int32_t packets;
+	int32_t rtt_us;
+	char* latest[OSCREL_PREFIXES];
+	int nlatest;
+	struct oscnet_relpeer peer[OSCNET_MAX_CONN];
+	int npeers;
+	uint64_t clock;
+	uint8_t* in;					// requests read while sending
+	uint8_t* out;					// retransmissions and requests
+	uint8_t* held;					// packets read while sending (OSCNET_HELD)
+	int32_t heldoff;				// next held packet
+	int32_t heldlen;
+	oscrel_stats_t dropped;			// counters of the peers that were dropped
+};
+
+// Header of a held packet; the next one starts 8-byte aligned after it
+struct oscnet_held {
+	struct sockaddr_storage from;
+	uint32_t fromlen;
+	int32_t size;
+};
+
+struct oscnet {
+	int type;
+	int fd;
+	int listening;
+	struct sockaddr_storage addr;	// UDP destination
+	socklen_t addrlen;
+	oscshm_t* shm;
+	uint8_t* scratch;				// gathers iovecs for the shm ring
+	char path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+	struct oscnet_conn conn[OSCNET_MAX_CONN];
+	int nconn;
+	int last;						// connection of the last packet received
+	int nextid;						// id of the last connection accepted
+	int timestamps;					// SO_TIMESTAMPNS is on
+	struct oscnet_pace* pace;		// NULL unless paced
+	oscdelta_t* delta;				// session encoder of a connected endpoint
+	uint8_t* deltaframe;			// frame being encoded
+	int32_t deltamax;				// entries a listener grants, 0 refuses
+	int gso;						// UDP_SEGMENT sends are on
+	int gro;						// UDP_GRO is on
+	struct oscnet_gro* coalesced;	// NULL until UDP_GRO was first on
+	struct oscnet_rel* rel;			// NULL unless reliable
+};
+
+int oscnet_islocal(const char* dest)
+{
+	return dest && (strncmp(dest, "unix:", 5) == 0 ||
+					strncmp(dest, "unixdgram:", 10) == 0 ||
+					strncmp(dest, "shm://", 6) == 0);
+}
+
+static int oscnet_parse(const char* dest, const char* proto, const char** path)
+{
+	if (dest && strncmp(dest, "unix:", 5) == 0) {
+		*path = dest + 5;
+		return OSCNET_UNIX;
+	}
+	if (dest && strncmp(dest, "unixdgram:", 10) == 0) {
+		*path = dest + 10;
+		return OSCNET_UNIXDGRAM;
+	}
+	if (dest && strncmp(dest, "shm://", 6) == 0) {
+		*path = dest + 6;
+		return OSCNET_SHM;
+	}
+	if (proto && strcmp(proto, "tcp") == 0) {
+		return OSCNET_TCP;
+	}
+	if (proto && strcmp(proto, "udp") == 0) {
+		return OSCNET_UDP;
+	}
+	fprintf(stderr, "oscnet: specify protocol tcp or udp\n");
+	return -1;
+}
+
+static oscnet_t* oscnet_new(int type)
+{
+	oscnet_t* net = (oscnet_t*)calloc(1, sizeof(oscnet_t));
+	if (!net) {
+		fprintf(stderr, "oscnet: Critical memory error...\n");
+		return NULL;
+	}
+	net->type = type;
+	net->fd = -1;
+	return net;
+}
+
+static int oscnet_addconn(oscnet_t* net, int fd)
+{
+	struct oscnet_conn* c;
+	socklen_t len;
+
+	if (net->nconn == OSCNET_MAX_CONN) {
+		fprintf(stderr, "oscnet: refused a connection, %d are open\n", OSCNET_MAX_CONN);
+		close(fd);
+		return -1;
+	}
+	c = &net->conn[net->nconn];
+	c->fd = fd;
+	c->id = net->nextid = net->nextid == INT32_MAX ? 1 : net->nextid + 1;
+	c->off = c->len = 0;
+	c->foff = c->flen = 0;
+	len = sizeof(c->peer);
+	if (getpeername(fd, (struct sockaddr*)&c->peer, &len) == -1) {
+		len = 0;
+	}
+	c->peerlen = len;
+	if (net->type == OSCNET_TCP && !c->buf) {
+		c->buf = (uint8_t*)malloc(OSCNET_MAX_PACKET + 4);
+		if (!c->buf) {
+			close(fd);
+			return -1;
+		}
+	}
+	net->nconn++;
+	return 0;
+}
+
+static void oscnet_dropconn(oscnet_t* net, int i)
+{
+	uint8_t* buf = net->conn[i].buf;
+	uint8_t* frame = net->conn[i].frame;
+
+	close(net->conn[i].fd);
+	oscdelta_free(net->conn[i].delta);
+
+	// Keep the buffers around for the next connection
+	net->conn[i] = net->conn[--net->nconn];
+	net->conn[net->nconn].buf = buf;
+	net->conn[net->nconn].frame = frame;
+	net->conn[net->nconn].delta = NULL;
+	net->conn[net->nconn].fd = -1;
+}
+
+static int oscnet_unix(oscnet_t* net, const char* path, int server)
+{
+	struct sockaddr_un sun;
+	int fd;
+
+	if (strlen(path) >= sizeof(sun.sun_path)) {
+		fprintf(stderr, "oscnet: unix socket path too long\n");
+		return -1;
+	}
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	strcpy(sun.sun_path, path);
+
+	fd = socket(AF_UNIX, net->type == OSCNET_UNIX ? SOCK_SEQPACKET : SOCK_DGRAM, 0);
+	if (fd == -1) {
+		perror("socket");
+		return -1;
+	}
+
+	if (server) {
+		unlink(path);
+		if (bind(fd, (struct sockaddr*)&sun, sizeof(sun)) == -1 ||
+			(net->type == OSCNET_UNIX && listen(fd, 16) == -1)) {
+			perror("bind");
+			close(fd);
+			return -1;
+		}
+		strcpy(net->path, path);
+	}
+	else if (connect(fd, (struct sockaddr*)&sun, sizeof(sun)) == -1) {
+		perror("connect");
+		close(fd);
+		return -1;
+	}
+
+	net->fd = fd;
+	return 0;
+}
+
+static int oscnet_ip(oscnet_t* net, const char* host, const char* port, int server)
+{
+	struct addrinfo hints, *servinfo, *p;
+	int fd = -1, rv, yes = 1;
+	int tcp = net->type == OSCNET_TCP;
+
+	memset(&hints, 0, sizeof hints);
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = tcp ? SOCK_STREAM : SOCK_DGRAM;
+	if (server) {
+		hints.ai_flags = AI_PASSIVE;
+	}
+
+	if ((rv = getaddrinfo(host, port, &hints, &servinfo)) != 0) {
+		fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(rv));
+		return -1;
+	}
+
+	// loop through all the results and use the first we can
+	for (p = servinfo; p != NULL; p = p->ai_next) {
+		if ((fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) == -1) {
+			continue;
+		}
+
+		if (server) {
+			setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+			if (bind(fd, p->ai_addr, p->ai_addrlen) == -1 ||
+				(tcp && listen(fd, 16) == -1)) {
+				close(fd);
+				continue;
+			}
+		}
+		else if (tcp && connect(fd, p->ai_addr, p->ai_addrlen) == -1) {
+			close(fd);
+			continue;
+		}
+
+		memcpy(&net->addr, p->ai_addr, p->ai_addrlen);
+		net->addrlen = p->ai_addrlen;
+		break;
+	}
+	freeaddrinfo(servinfo);
+
+	if (p == NULL) {
+		if (server) {
+			fprintf(stderr, "socket: failed to bind socket\n");
+		}
+		else if (tcp) {
+			fprintf(stderr, "socket: failed to connect\n");
+		}
+		else {
+			fprintf(stderr, "socket: failed to create socket\n");
+		}
+		return -1;
+	}
+
+	net->fd = fd;
+	return 0;
+}
+
+static oscnet_t* oscnet_open(const char* dest, const char* port, const char* proto,
+							 int server)
+{
+	const char* path = NULL;
+	oscnet_t* net;
+	int type, rv;
+
+	if ((type = oscnet_parse(dest, proto, &path)) == -1) {
+		return NULL;
+	}
+	if ((net = oscnet_new(type)) == NULL) {
+		return NULL;
+	}
+	net->listening = server;
+
+	switch (type) {
+		case OSCNET_SHM:
+			net->shm = oscshm_open(path, 0);
+			rv = net->shm ? 0 : -1;
+			if (rv == -1) {
+				perror("oscshm_open");
+			}
+			break;
+		case OSCNET_UNIX:
+		case OSCNET_UNIXDGRAM:
+			rv = oscnet_unix(net, path, server);
+			break;
+		default:
+			rv = oscnet_ip(net, dest, port, server);
+			break;
+	}
+
+	// A connected stream is received from like a single accepted connection
+	if (rv == 0 && !server && (type == OSCNET_TCP || type == OSCNET_UNIX)) {
+		rv = oscnet_addconn(net, dup(net->fd));
+	}
+
+	if (rv == -1) {
+		oscnet_close(net);
+		return NULL;
+	}
+	return net;
+}
+
+oscnet_t* oscnet_connect(const char* dest, const char* port, const char* proto)
+{
+	return oscnet_open(dest, port, proto, 0);
+}
+
+oscnet_t* oscnet_listen(const char* dest, const char* port, const char* proto)
+{
+	return oscnet_open(dest, port, proto, 1);
+}
+
+int oscnet_type(oscnet_t* net)
+{
+	return net->type;
+}
+
+int32_t oscnet_unsent(oscnet_t* net)
+{
+	int n = 0;
+
+	if ((net->type != OSCNET_TCP && net->type != OSCNET_UNIX) || net->listening) {
+		return 0;
+	}
+#ifdef SIOCOUTQ
+	if (ioctl(net->fd, SIOCOUTQ, &n) == -1) {
+		return -1;
+	}
+#endif
+	return n;
+}
+
+// Send all iovecs of a stream socket, resuming after partial writes
+static int oscnet_sendall(int fd, struct iovec* iov, int iovcnt)
+{
+	struct msghdr msg;
+	ssize_t n;
+
+	while (iovcnt > 0) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = iovcnt;
+		n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+		if (n == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+			n -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = (uint8_t*)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+	return 0;
+}
+
+static int oscnet_sendiov_tcp(oscnet_t* net, const struct iovec* iov, const int* iovcnt,
+							  int count)
+{
+	struct iovec out[OSCNET_IOV_MAX];
+	uint32_t prefix[OSCNET_BATCH];
+	size_t len;
+	int k, n, used, sent = 0;
+
+	while (sent < count) {
+		// Gather as many whole packets as fit in one sendmsg()
+		for (n = 0, used = 0; sent + n < count && n < OSCNET_BATCH &&
+			 used + 1 + iovcnt[sent + n] <= OSCNET_IOV_MAX; ++n) {
+			len = 0;
+			for (k = 0; k < iovcnt[sent + n]; ++k) {
+				out[used + 1 + k] = *iov++;
+				len += out[used + 1 + k].iov_len;
+			}
+			prefix[n] = htonl((uint32_t)len);
+			out[used].iov_base = &prefix[n];
+			out[used].iov_len = 4;
+			used += 1 + iovcnt[sent + n];
+		}
+		if (n == 0) {
+			errno = EMSGSIZE;
+			return sent ? sent : -1;
+		}
+		if (oscnet_sendall(net->fd, out, used) == -1) {
+			return sent ? sent : -1;
+		}
+		sent += n;
+	}
+	return sent;
+}
+
+static int oscnet_sendiov_dgram(oscnet_t* net, const struct iovec* iov, const int* iovcnt,
+								int count, const uint64_t* txtime)
+{
+	int i, n, rv, sent = 0;
+#ifdef __linux__
+	struct mmsghdr msgs[OSCNET_BATCH];
+#ifdef OSCNET_HAVE_TXTIME
+	struct cmsghdr* cm;
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(sizeof(uint64_t))];
+	} ctrl[OSCNET_BATCH];
+#endif
+#else
+	struct msghdr msg;
+#endif
+
+	while (sent < count) {
+		n = count - sent < OSCNET_BATCH ? count - sent : OSCNET_BATCH;
+#ifdef __linux__
+		memset(msgs, 0, sizeof(struct mmsghdr) * n);
+		for (i = 0; i < n; ++i) {
+			msgs[i].msg_hdr.msg_iov = (struct iovec*)iov;
+			msgs[i].msg_hdr.msg_iovlen = iovcnt[sent + i];
+			iov += iovcnt[sent + i];
+			if (net->type == OSCNET_UDP) {
+				msgs[i].msg_hdr.msg_name = &net->addr;
+				msgs[i].msg_hdr.msg_namelen = net->addrlen;
+			}
+#ifdef OSCNET_HAVE_TXTIME
+			if (txtime) {
+				msgs[i].msg_hdr.msg_control = ctrl[i].buf;
+				msgs[i].msg_hdr.msg_controllen = sizeof(ctrl[i].buf);
+				cm = CMSG_FIRSTHDR(&msgs[i].msg_hdr);
+				cm->cmsg_level = SOL_SOCKET;
+				cm->cmsg_type = SCM_TXTIME;
+				cm->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+				memcpy(CMSG_DATA(cm), &txtime[sent + i], sizeof(uint64_t));
+			}
+#endif
+		}
+		do {
+			rv = sendmmsg(net->fd, msgs, n, MSG_NOSIGNAL);
+		} while (rv == -1 && errno == EINTR);
+		if (rv > 0 && rv < n) {
+			// Rewind to the first packet that was not sent
+			for (i = n - 1; i >= rv; --i) {
+				iov -= iovcnt[sent + i];
+			}
+		}
+#else
+		for (rv = 0; rv < n; ++rv) {
+			memset(&msg, 0, sizeof(msg));
+			msg.msg_iov = (struct iovec*)iov;
+			msg.msg_iovlen = iovcnt[sent + rv];
+			if (net->type == OSCNET_UDP) {
+				msg.msg_name = &net->addr;
+				msg.msg_namelen = net->addrlen;
+			}
+			if (sendmsg(net->fd, &msg, MSG_NOSIGNAL) == -1) {
+				break;
+			}
+			iov += iovcnt[sent + rv];
+		}
+		(void)i;
+		(void)txtime;
+		if (rv == 0) {
+			rv = -1;
+		}
+#endif
+		if (rv <= 0) {
+			return sent ? sent : -1;
+		}
+		sent += rv;
+	}
+	return sent;
+}
+
+#ifdef OSCNET_HAVE_OFFLOAD
+// Bytes of the packet at iov
+static size_t oscnet_iovlen(const struct iovec* iov, int iovcnt)
+{
+	size_t len = 0;
+
+	while (iovcnt-- > 0) {
+		len += (iov++)->iov_len;
+	}
+	return len;
+}
+
+// Sends runs of packets of the same size as one message each with a
+// UDP_SEGMENT size, and packets that are not part of a run as they are.
+static int oscnet_sendiov_gso(oscnet_t* net, const struct iovec* iov, const int* iovcnt,
+							  int count)
+{
+	struct mmsghdr msgs[OSCNET_BATCH];
+	int packets[OSCNET_BATCH];		// packets in each message
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(sizeof(uint16_t))];
+	} ctrl[OSCNET_BATCH];
+	const struct iovec* next;
+	struct cmsghdr* cm;
+	size_t seg, len, total, maxseg;
+	uint16_t size;
+	int i, j, m, n, rv, niov, runs, sent = 0;
+
+	maxseg = net->addr.ss_family == AF_INET6 ? OSCNET_GSO_SEGMENT6 : OSCNET_GSO_SEGMENT4;
+	while (sent < count) {
+		memset(msgs, 0, sizeof(msgs));
+		next = iov;
+		runs = 0;
+		for (m = 0, i = sent; i < count && m < OSCNET_BATCH; ++m, i = j) {
+			seg = total = oscnet_iovlen(next, iovcnt[i]);
+			msgs[m].msg_hdr.msg_iov = (struct iovec*)next;
+			niov = iovcnt[i];
+			next += iovcnt[i];
+			for (j = i + 1; j < count && j - i < OSCNET_GSO_SEGMENTS && seg <= maxseg; ++j) {
+				len = oscnet_iovlen(next, iovcnt[j]);
+				if (len > seg || total + len > OSCNET_GSO_MAX ||
+					niov + iovcnt[j] > OSCNET_IOV_MAX) {
+					break;
+				}
+				total += len;
+				niov += iovcnt[j];
+				next += iovcnt[j];
+				if (len < seg) {
+					++j;		// a shorter packet ends the run
+					break;
+				}
+			}
+			msgs[m].msg_hdr.msg_iovlen = niov;
+			msgs[m].msg_hdr.msg_name = &net->addr;
+			msgs[m].msg_hdr.msg_namelen = net->addrlen;
+			packets[m] = j - i;
+			if (j - i > 1) {
+				size = (uint16_t)seg;
+				msgs[m].msg_hdr.msg_control = ctrl[m].buf;
+				msgs[m].msg_hdr.msg_controllen = sizeof(ctrl[m].buf);
+				cm = CMSG_FIRSTHDR(&msgs[m].msg_hdr);
+				cm->cmsg_level = SOL_UDP;
+				cm->cmsg_type = UDP_SEGMENT;
+				cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+				memcpy(CMSG_DATA(cm), &size, sizeof(uint16_t));
+				runs++;
+			}
+		}
+		do {
+			rv = sendmmsg(net->fd, msgs, m, MSG_NOSIGNAL);
+		} while (rv == -1 && errno == EINTR);
+
+		if (rv == -1 && runs &&
+			(errno == EIO || errno == EINVAL || errno == ENOPROTOOPT || errno == EOPNOTSUPP)) {
+			// The kernel or the device cannot segment: send this batch as
+			// plain datagrams, and stop segmenting unless it was this batch
+			if (errno != EINVAL) {
+				net->gso = 0;
+			}
+			for (n = 0, j = 0; j < m; ++j) {
+				n += packets[j];
+			}
+			rv = oscnet_sendiov_dgram(net, iov, iovcnt + sent, n, NULL);
+			if (rv <= 0) {
+				return sent ? sent : -1;
+			}
+			for (j = 0; j < rv; ++j) {
+				iov += iovcnt[sent + j];
+			}
+			sent += rv;
+			if (rv < n) {
+				return sent;
+			}
+			continue;
+		}
+		if (rv <= 0) {
+			return sent ? sent : -1;
+		}
+		for (j = 0; j < rv; ++j) {
+			for (n = 0; n < packets[j]; ++n) {
+				iov += iovcnt[sent++];
+			}
+		}
+	}
+	return sent;
+}
+#endif
+
+// Returns the next packet of iov as one contiguous buffer, copying its pieces
+// into the scratch buffer if there are several.
+static const uint8_t* oscnet_gather(oscnet_t* net, const struct iovec** iov, int iovcnt,
+									int32_t* len)
+{
+	int k;
+
+	if (iovcnt == 1) {
+		*len = (int32_t)(*iov)->iov_len;
+		return (const uint8_t*)(*iov)++->iov_base;
+	}
+	if (!net->scratch &&
+		(net->scratch = (uint8_t*)malloc(OSCNET_MAX_PACKET)) == NULL) {
+		return NULL;
+	}
+	for (k = 0, *len = 0; k < iovcnt; ++k, ++*iov) {
+		if (*len + (int32_t)(*iov)->iov_len > OSCNET_MAX_PACKET) {
+			errno = EMSGSIZE;
+			return NULL;
+		}
+		memcpy(net->scratch + *len, (*iov)->iov_base, (*iov)->iov_len);
+		*len += (int32_t)(*iov)->iov_len;
+	}
+	return net->scratch;
+}
+
+static int oscnet_sendiov_shm(oscnet_t* net, const struct iovec* iov, const int* iovcnt,
+							  int count)
+{
+	const uint8_t* packet;
+	int32_t len;
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		// The ring takes a contiguous packet
+		if (!(packet = oscnet_gather(net, &iov, iovcnt[i], &len)) ||
+			oscshm_send(net->shm, packet, len) == -1) {
+			return i ? i : -1;
+		}
+	}
+	return count;
+}
+
+// Sends a delta frame: size prefix, marker and records
+static int oscnet_flushdelta(oscnet_t* net, int32_t len)
+{
+	struct iovec out;
+	uint32_t prefix = htonl((uint32_t)(len - 4));
+
+	memcpy(net->deltaframe, &prefix, 4);
+	out.iov_base = net->deltaframe;
+	out.iov_len = len;
+	return oscnet_sendall(net->fd, &out, 1);
+}
+
+// Encodes the packets of a delta session into as few frames as they fit in
+static int oscnet_sendiov_delta(oscnet_t* net, const struct iovec* iov, const int* iovcnt,
+								int count)
+{
+	const uint8_t* packet;
+	int32_t size, n, len = 5;
+	int i, sent = 0;
+
+	net->deltaframe[4] = OSCDELTA_FRAME;
+	for (i = 0; i < count; ++i) {
+		if (!(packet = oscnet_gather(net, &iov, iovcnt[i], &size))) {
+			break;
+		}
+		n = oscdelta_encode(net->delta, packet, size, net->deltaframe + len,
+							OSCNET_MAX_PACKET + 4 - len);
+		if (n == -1 && len > 5) {
+			if (oscnet_flushdelta(net, len) == -1) {
+				return sent ? sent : -1;
+			}
+			sent = i;
+			len = 5;
+			n = oscdelta_encode(net->delta, packet, size, net->deltaframe + len,
+								OSCNET_MAX_PACKET + 4 - len);
+		}
+		if (n == -1) {
+			errno = EMSGSIZE;
+			break;
+		}
+		len += n;
+	}
+	if (len > 5) {
+		if (oscnet_flushdelta(net, len) == -1) {
+			return sent ? sent : -1;
+		}
+		sent = i;
+	}
+	return sent || i == count ? sent : -1;
+}
+
+// Counts the packets of one send call that went out and the ones that did not
+static void oscnet_sent(const struct iovec* iov, const int* iovcnt, int count, int sent)
+{
+#ifdef OSC_METRICS
+	uint64_t bytes = 0;
+	int i, k;
+
+	for (i = 0; i < sent; ++i) {
+		for (k = 0; k < iovcnt[i]; ++k) {
+			bytes += (iov++)->iov_len;
+		}
+	}
+	if (sent > 0) {
+		OSCMETRICS_ADD(OSCMETRICS_SENT, sent);
+		OSCMETRICS_ADD(OSCMETRICS_SENT_BYTES, bytes);
+	}
+	if (sent < count) {
+		OSCMETRICS_ADD(OSCMETRICS_SEND_ERRORS, 1);
+		OSCMETRICS_ADD(OSCMETRICS_DROPS, sent < 0 ? count : count - sent);
+	}
+#else
+	(void)iov; (void)iovcnt; (void)count; (void)sent;
+#endif
+}
+
+static uint64_t oscnet_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int oscnet_sendiov_udp(oscnet_t* net, const struct iovec* iov, const int* iovcnt,
+							  int count, const uint64_t* txtime)
+{
+#ifdef OSCNET_HAVE_OFFLOAD
+	if (net->gso && !txtime) {
+		return oscnet_sendiov_gso(net, iov, iovcnt, count);
+	}
+#endif
+	return oscnet_sendiov_dgram(net, iov, iovcnt, count, txtime);
+}
+
+static oscrel_t* oscnet_newrel(struct oscnet_rel* r)
+{
+	oscrel_t* rel = oscrel_new(r->packets, r->rtt_us);
+	int k;
+
+	for (k = 0; rel && k < r->nlatest; ++k) {
+		oscrel_latest(rel, r->latest[k]);
+	}
+	return rel;
+}
+
+static void oscnet_addstats(oscrel_stats_t* sum, const oscrel_t* rel)
+{
+	oscrel_stats_t st;
+
+	oscrel_stats(rel, &st);
+	sum->sent += st.sent;
+	sum->resent += st.resent;
+	sum->superseded += st.superseded;
+	sum->gone += st.gone;
+	sum->received += st.received;
+	sum->recovered += st.recovered;
+	sum->duplicates += st.duplicates;
+	sum->skipped += st.skipped;
+	sum->lost += st.lost;
+	sum->nacks += st.nacks;
+}
+
+static void oscnet_dropped(struct oscnet_rel* r, oscrel_t* rel)
+{
+	oscnet_addstats(&r->dropped, rel);
+	oscrel_free(rel);
+}
+
+// Stream of a datagram: the only one of a connected endpoint, the one of
+// its sender on a listening endpoint (dropping the oldest if all are taken)
+static struct oscnet_relpeer* oscnet_relpeer(oscnet_t* net, const struct sockaddr_storage* from,
+											 socklen_t len)
+{
+	struct oscnet_rel* r = net->rel;
+	struct oscnet_relpeer* p;
+	int i, oldest = 0;
+
+	if (!net->listening) {
+		return r->npeers ? &r->peer[0] : NULL;
+	}
+	for (i = 0; i < r->npeers; ++i) {
+		p = &r->peer[i];
+		if (p->addrlen == len && memcmp(&p->addr, from, len) == 0) {
+			p->used = ++r->clock;
+			return p;
+		}
+		if (p->used < r->peer[oldest].used) {
+			oldest = i;
+		}
+	}
+	if (len > sizeof(struct sockaddr_storage)) {
+		return NULL;
+	}
+	if (r->npeers == OSCNET_MAX_CONN) {
+		i = oldest;
+		oscnet_dropped(r, r->peer[i].rel);
+	}
+	else {
+		i = r->npeers++;
+	}
+	p = &r->peer[i];
+	if ((p->rel = oscnet_newrel(r)) == NULL) {
+		r->peer[i] = r->peer[--r->npeers];
+		return NULL;
+	}
+	memcpy(&p->addr, from, len);
+	p->addrlen = len;
+	p->used = ++r->clock;
+	return p;
+}
+
+// Takes the oscrel datagrams out of msgs and unwraps the packets in them.
+// Returns the packets left.
+static int oscnet_relinput(oscnet_t* net, oscnet_msg_t* msgs, int n, uint64_t now)
+{
+	struct oscnet_relpeer* p;
+	const uint8_t* packet;
+	int32_t size;
+	int i, k = 0;
+
+	for (i = 0; i < n; ++i) {
+		packet = msgs[i].buf;
+		size = msgs[i].size;
+		if (size >= OSCREL_HEADER && packet[0] == '#' && packet[1] != 'b' &&
+			(p = oscnet_relpeer(net, &msgs[i].from, msgs[i].fromlen)) != NULL &&
+			(size = oscrel_input(p->rel, msgs[i].buf, msgs[i].size, now, &packet)) == 0) {
+			continue;		// request, heartbeat or duplicate
+		}
+		if (size == -1) {
+			packet = msgs[i].buf;
+			size = msgs[i].size;
+		}
+		if (size > msgs[k].bufsize) {
+			size = msgs[k].bufsize;
+		}
+		memmove(msgs[k].buf, packet, size);
+		msgs[k].size = size;
+		if (k != i) {
+			memcpy(&msgs[k].from, &msgs[i].from, msgs[i].fromlen);
+			msgs[k].fromlen = msgs[i].fromlen;
+			msgs[k].stamp_ns = msgs[i].stamp_ns;
+		}
+		k++;
+	}
+	return k;
+}
+
+// Sends what the streams have due: retransmissions, skips, heartbeats, NACKs
+static void oscnet_relflush(oscnet_t* net, uint64_t now)
+{
+	struct oscnet_rel* r = net->rel;
+	struct oscnet_relpeer* p;
+	int32_t n;
+	int i;
+
+	for (i = 0; i < r->npeers; ++i) {
+		p = &r->peer[i];
+		while ((n = oscrel_poll(p->rel, now, r->out, OSCNET_MAX_PACKET + OSCREL_HEADER)) > 0) {
+			sendto(net->fd, r->out, n, MSG_NOSIGNAL, (struct sockaddr*)&p->addr, p->addrlen);
+		}
+	}
+}
+
+// Milliseconds until a stream has something to send, or -1
+static int32_t oscnet_relwait(oscnet_t* net, uint64_t now)
+{
+	struct oscnet_rel* r = net->rel;
+	int64_t ns, wait = -1;
+	int i;
+
+	for (i = 0; i < r->npeers; ++i) {
+		ns = oscrel_timeout(r->peer[i].rel, now);
+		if (ns >= 0 && (wait < 0 || ns < wait)) {
+			wait = ns;
+		}
+	}
+	return wait < 0 ? -1 : (int32_t)((wait + 999999) / 1000000);
+}
+
+// True while there is no room to hold a packet of any size
+static int oscnet_relfull(const struct oscnet_rel* r)
+{
+	return r->heldlen + (int32_t)sizeof(struct oscnet_held) + OSCNET_MAX_PACKET > OSCNET_HELD;
+}
+
+// Reads the requests that came in without waiting, and answers them. The
+// packets that came with them are held for the next receive; while there is
+// no room to hold another, the rest stay in the socket.
+static void oscnet_relpoll(oscnet_t* net)
+{
+	struct oscnet_rel* r = net->rel;
+	struct oscnet_held h;
+	oscnet_msg_t msg;
+	socklen_t len;
+	ssize_t n;
+
+	if (r->heldoff > 0) {
+		memmove(r->held, r->held + r->heldoff, r->heldlen - r->heldoff);
+		r->heldlen -= r->heldoff;
+		r->heldoff = 0;
+	}
+	msg.buf = r->in;
+	msg.bufsize = OSCNET_MAX_PACKET;
+	while (!oscnet_relfull(r)) {
+		len = sizeof(msg.from);
+		n = recvfrom(net->fd, msg.buf, msg.bufsize, MSG_DONTWAIT,
+					 (struct sockaddr*)&msg.from, &len);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n < 0) {
+			break;
+		}
+		msg.size = (int32_t)n;
+		msg.fromlen = len;
+		if (oscnet_relinput(net, &msg, 1, oscnet_now()) == 0) {
+			continue;
+		}
+		if (!r->held && (r->held = (uint8_t*)malloc(OSCNET_HELD)) == NULL) {
+			fprintf(stderr, "oscnet: Critical memory error...\n");
+			break;
+		}
+		memcpy(&h.from, &msg.from, msg.fromlen);
+		h.fromlen = msg.fromlen;
+		h.size = msg.size;
+		memcpy(r->held + r->heldlen, &h, sizeof(h));
+		memcpy(r->held + r->heldlen + sizeof(h), msg.buf, msg.size);
+		r->heldlen += sizeof(h) + ((msg.size + 7) & ~7);
+	}
+	oscnet_relflush(net, oscnet_now());
+}
+
+// Hands out the packets oscnet_relpoll() held, oldest first
+static int oscnet_relheld(struct oscnet_rel* r, oscnet_msg_t* msgs, int count)
+{
+	struct oscnet_held h;
+	int i;
+
+	for (i = 0; i < count && r->heldoff < r->heldlen; ++i) {
+		memcpy(&h, r->held + r->heldoff, sizeof(h));
+		msgs[i].size = h.size < msgs[i].bufsize ? h.size : msgs[i].bufsize;
+		memcpy(msgs[i].buf, r->held + r->heldoff + sizeof(h), msgs[i].size);
+		memcpy(&msgs[i].from, &h.from, h.fromlen);
+		msgs[i].fromlen = h.fromlen;
+		msgs[i].stamp_ns = 0;
+		r->heldoff += sizeof(h) + ((h.size + 7) & ~7);
+	}
+	if (r->heldoff == r->heldlen) {
+		r->heldoff = r->heldlen = 0;
+	}
+	return i;
+}
+
+// Numbers the packets and keeps them for retransmission
+static int oscnet_sendiov_rel(oscnet_t* net, const struct iovec* iov, const int* iovcnt,
+							  int count, const uint64_t* txtime)
+{
+	struct oscnet_relpeer* p = &net->rel->peer[0];
+	struct iovec out[OSCNET_BATCH];
+	int ones[OSCNET_BATCH];
+	const uint8_t* packet;
+	uint64_t now;
+	int32_t len, size;
+	int i, n, rv, batch, sent = 0;
+
+	if (net->rel->npeers == 0) {
+		errno = EDESTADDRREQ;
+		return -1;
+	}
+
+	// Retransmissions go ahead of new packets
+	oscnet_relpoll(net);
+
+	// Wrapped packets stay in place until the ring comes round again
+	batch = net->rel->packets < OSCNET_BATCH ? net->rel->packets : OSCNET_BATCH;
+	while (sent < count) {
+		n = count - sent < batch ? count - sent : batch;
+		now = oscnet_now();
+		for (i = 0; i < n; ++i) {
+			if (!(packet = oscnet_gather(net, &iov, iovcnt[sent + i], &len)) ||
+				!(out[i].iov_base = (void*)oscrel_wrap(p->rel, packet, len, now, &size))) {
+				break;
+			}
+			out[i].iov_len = size;
+			ones[i] = 1;
+		}
+		if (i == 0) {
+			return sent ? sent : -1;
+		}
+		rv = oscnet_sendiov_udp(net, out, ones, i, txtime ? txtime + sent : NULL);
+		if (rv <= 0) {
+			return sent ? sent : -1;
+		}
+		sent += rv;
+		if (rv < i || i < n) {
+			break;
+		}
+	}
+	return sent;
+}
+
+static int oscnet_sendraw(oscnet_t* net, const struct iovec* iov, const int* iovcnt,
+						  int count, const uint64_t* txtime)
+{
+	switch (net->type) {
+		case OSCNET_TCP:
+			if (net->delta) {
+				return oscnet_sendiov_delta(net, iov, iovcnt, count);
+			}
+			return oscnet_sendiov_tcp(net, iov, iovcnt, count);
+		case OSCNET_SHM:
+			return oscnet_sendiov_shm(net, iov, iovcnt, count);
+		case OSCNET_UDP:
+			if (net->rel) {
+				return oscnet_sendiov_rel(net, iov, iovcnt, count, txtime);
+			}
+			return oscnet_sendiov_udp(net, iov, iovcnt, count, txtime);
+		default:
+			return oscnet_sendiov_dgram(net, iov, iovcnt, count, txtime);
+	}
+}
+
+static void oscnet_sleep(uint64_t t)
+{
+	struct timespec ts;
+
+	ts.tv_sec = t / 1000000000ull;
+	ts.tv_nsec = t % 1000000000ull;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+		;
+}
+
+int oscnet_pace(oscnet_t* net, double packets, double bytes, int32_t burst_us, int flags)
+{
+	struct oscnet_pace* p;
+
+	if (packets <= 0.0 && bytes <= 0.0) {
+		free(net->pace);
+		net->pace = NULL;
+		return 0;
+	}
+	if (flags & OSCNET_PACE_TXTIME) {
+#ifdef OSCNET_HAVE_TXTIME
+		struct sock_txtime st;
+
+		if (net->type != OSCNET_UDP && net->type != OSCNET_UNIXDGRAM) {
+			errno = EOPNOTSUPP;
+			return -1;
+		}
+		memset(&st, 0, sizeof(st));
+		st.clockid = CLOCK_MONOTONIC;
+		if (setsockopt(net->fd, SOL_SOCKET, SO_TXTIME, &st, sizeof(st)) == -1) {
+			return -1;
+		}
+#else
+		errno = EOPNOTSUPP;
+		return -1;
+#endif
+	}
+	if (!net->pace && (net->pace = (struct oscnet_pace*)calloc(1, sizeof(*p))) == NULL) {
+		fprintf(stderr, "oscnet: Critical memory error...\n");
+		return -1;
+	}
+	p = net->pace;
+	p->packet_ns = packets > 0.0 ? (uint64_t)(1e9 / packets) : 0;
+	p->byte_ns = bytes > 0.0 ? 1e9 / bytes : 0.0;
+	p->burst_ns = burst_us > 0 ? (uint64_t)burst_us * 1000 : 0;
+	p->txtime = (flags & OSCNET_PACE_TXTIME) != 0;
+	p->tatp = p->tatb = oscnet_now();
+	return 0;
+}
+
+void oscnet_pacestats(oscnet_t* net, oscnet_pacestats_t* stats)
+{
+	if (net->pace) {
+		*stats = net->pace->stats;
+	}
+	else {
+		memset(stats, 0, sizeof(*stats));
+	}
+}
+
+// Send through the token buckets. Every packet of a batch gets its departure
+// time up front; then either the qdisc releases them (SO_TXTIME) or the
+// packets due together go out in one call after sleeping until they are.
+static int oscnet_sendpaced(oscnet_t* net, const struct iovec* iov, const int* iovcnt,
+							int count)
+{
+	struct oscnet_pace* p = net->pace;
+	uint64_t when[OSCNET_BATCH], tatp[OSCNET_BATCH], tatb[OSCNET_BATCH];
+	uint64_t start = oscnet_now(), sched, now, t, len, tp, tb;
+	const struct iovec* v;
+	int i, k = 0, j, n, rv, waiting, sent = 0;
+
+	while (sent < count) {
+		n = count - sent < OSCNET_BATCH ? count - sent : OSCNET_BATCH;
+
+		tp = p->tatp;
+		tb = p->tatb;
+		now = sched = oscnet_now();
+		for (i = 0, v = iov, waiting = 0; i < n; ++i) {
+			for (k = 0, len = 0; k < iovcnt[sent + i]; ++k) {
+				len += (v++)->iov_len;
+			}
+			t = now;
+			if (p->packet_ns && p->tatp > t + p->burst_ns) {
+				t = p->tatp - p->burst_ns;
+			}
+			if (p->byte_ns > 0.0 && p->tatb > t + p->burst_ns) {
+				t = p->tatb - p->burst_ns;
+			}
+			when[i] = t;
+			tatp[i] = p->tatp = (p->tatp > t ? p->tatp : t) + p->packet_ns;
+			tatb[i] = p->tatb = (p->tatb > t ? p->tatb : t) + (uint64_t)(len * p->byte_ns);
+			waiting += t > now;
+		}
+		p->stats.queue = waiting;
+		if (waiting > p->stats.max_queue) {
+			p->stats.max_queue = waiting;
+		}
+
+		if (p->txtime) {
+			rv = oscnet_sendraw(net, iov, iovcnt + sent, n, when);
+			k = rv < 0 ? 0 : rv;
+			for (i = 0, v = iov; i < k; ++i) {
+				v += iovcnt[sent + i];
+			}
+		}
+		else {
+			for (i = 0, v = iov; i < n; i = k) {
+				now = oscnet_now();
+				if (when[i] > now + OSCNET_PACE_SLACK) {
+					oscnet_sleep(when[i]);
+					now = oscnet_now();
+				}
+				p->stats.queue = n - i;
+				for (k = i; k < n && when[k] <= now + OSCNET_PACE_SLACK; ++k)
+					;
+				rv = oscnet_sendraw(net, v, iovcnt + sent + i, k - i, NULL);
+				if (rv > 0) {
+					for (j = 0; j < rv; ++j) {
+						v += iovcnt[sent + i + j];
+					}
+				}
+				if (rv < k - i) {
+					k = i + (rv > 0 ? rv : 0);
+					break;
+				}
+			}
+		}
+
+		// Shaping delay of the packets that went out
+		for (i = 0; i < k; ++i) {
+			if (when[i] > sched) {
+				t = when[i] - start;
+				p->stats.delayed++;
+				p->stats.delay_ns += t;
+				if (t > p->stats.max_delay_ns) {
+					p->stats.max_delay_ns = t;
+				}
+			}
+		}
+		p->stats.packets += k;
+		p->stats.queue = 0;
+
+		if (k < n) {
+			// Packets that were not sent give their tokens back
+			p->tatp = k > 0 ? tatp[k-1] : tp;
+			p->tatb = k > 0 ? tatb[k-1] : tb;
+			return sent + k > 0 ? sent + k : -1;
+		}
+		sent += n;
+		iov = v;
+	}
+	return sent;
+}
+
+int oscnet_sendiov(oscnet_t* net, const struct iovec* iov, const int* iovcnt, int count)
+{
+	int sent;
+
+	if (net->pace) {
+		sent = oscnet_sendpaced(net, iov, iovcnt, count);
+	}
+	else {
+		sent = oscnet_sendraw(net, iov, iovcnt, count, NULL);
+	}
+	oscnet_sent(iov, iovcnt, count, sent);
+	return sent;
+}
+
+int oscnet_sendv(oscnet_t* net, uint8_t* const* bufs, const int32_t* sizes, int count)
+{
+	struct iovec iov[OSCNET_BATCH];
+	int iovcnt[OSCNET_BATCH];
+	int i, n, rv, sent = 0;
+
+	while (sent < count) {
+		n = count - sent < OSCNET_BATCH ? count - sent : OSCNET_BATCH;
+		for (i = 0; i < n; ++i) {
+			iov[i].iov_base = bufs[sent + i];
+			iov[i].iov_len = sizes[sent + i];
+			iovcnt[i] = 1;
+		}
+		rv = oscnet_sendiov(net, iov, iovcnt, n);
+		if (rv <= 0) {
+			return sent ? sent : -1;
+		}
+		sent += rv;
+		if (rv < n) {
+			break;
+		}
+	}
+	return sent;
+}
+
+int32_t oscnet_send(oscnet_t* net, const uint8_t* buf, int32_t size)
+{
+	struct iovec iov;
+	int iovcnt = 1;
+
+	iov.iov_base = (void*)buf;
+	iov.iov_len = size;
+	return oscnet_sendiov(net, &iov, &iovcnt, 1) == 1 ? size : -1;
+}
+
+int oscnet_lastconn(oscnet_t* net)
+{
+	if ((net->type != OSCNET_TCP && net->type != OSCNET_UNIX) ||
+		net->last < 0 || net->last >= net->nconn) {
+		return -1;
+	}
+	return net->conn[net->last].id;
+}
+
+int oscnet_hasconn(oscnet_t* net, int conn)
+{
+	int i;
+
+	for (i = 0; i < net->nconn && net->conn[i].id != conn; ++i)
+		;
+	return i < net->nconn;
+}
+
+int32_t oscnet_sendconn(oscnet_t* net, int conn, const uint8_t* buf, int32_t size)
+{
+	struct iovec out[2];
+	uint32_t prefix;
+	int i, rv;
+
+	for (i = 0; i < net->nconn && net->conn[i].id != conn; ++i)
+		;
+	if (i == net->nconn || size < 0 || size > OSCNET_MAX_PACKET) {
+		return -1;
+	}
+	if (net->type == OSCNET_TCP) {
+		prefix = htonl((uint32_t)size);
+		out[0].iov_base = &prefix;
+		out[0].iov_len = 4;
+		out[1].iov_base = (void*)buf;
+		out[1].iov_len = size;
+		rv = oscnet_sendall(net->conn[i].fd, out, 2);
+	}
+	else {
+		rv = send(net->conn[i].fd, buf, size, MSG_NOSIGNAL) == size ? 0 : -1;
+	}
+	if (rv == -1) {
+		// The peer is gone or broke the stream; it can not be sent to again
+		oscnet_dropconn(net, i);
+		return -1;
+	}
+	return size;
+}
+
+// Pop one complete frame from a TCP connection's reassembly buffer
+static int32_t oscnet_frame(struct oscnet_conn* c, uint8_t* buf, int32_t size)
+{
+	uint32_t bit32;
+	int32_t len;
+
+	if (c->len - c->off < 4) {
+		return 0;
+	}
+	memcpy(&bit32, c->buf + c->off, 4);
+	len = (int32_t)ntohl(bit32);
+	if (len < 0 || len > OSCNET_MAX_PACKET) {
+		return -1;
+	}
+	if (c->len - c->off < len + 4) {
+		return 0;
+	}
+	memcpy(buf, c->buf + c->off + 4, len < size ? len : size);
+	c->off += len + 4;
+	if (c->off == c->len) {
+		c->off = c->len = 0;
+	}
+	return len < size ? len : size;
+}
+
+// Answers a request for a delta session with the number of entries granted
+static int oscnet_accept_delta(oscnet_t* net, struct oscnet_conn* c, int32_t entries)
+{
+	uint8_t reply[36];
+	struct iovec out;
+	uint32_t prefix;
+	int32_t n;
+
+	oscdelta_free(c->delta);
+	if (entries > net->deltamax) {
+		entries = net->deltamax;
+	}
+	if ((c->delta = oscdelta_new(entries)) == NULL) {
+		return -1;
+	}
+	n = oscdelta_handshake(reply + 4, OSCDELTA_OK, entries);
+	prefix = htonl((uint32_t)n);
+	memcpy(reply, &prefix, 4);
+	out.iov_base = reply;
+	out.iov_len = n + 4;
+	return oscnet_sendall(c->fd, &out, 1);
+}
+
+// Pop the next packet of a connection on a listener that accepts delta
+// sessions: frames go through c->frame so that a delta frame, which holds
+// several packets, is never truncated to the caller's buffer. Returns -1 on
+// a malformed record, and the connection must be dropped.
+static int32_t oscnet_next(oscnet_t* net, struct oscnet_conn* c, uint8_t* buf,
+						   int32_t size)
+{
+	uint8_t* out;
+	int32_t len, n, entries;
+
+	if (!c->frame && (c->frame = (uint8_t*)malloc(2 * OSCNET_MAX_PACKET)) == NULL) {
+		return -1;
+	}
+	for (;;) {
+		if (c->foff < c->flen) {
+			// Decode in place unless the packet could be truncated
+			out = size >= OSCNET_MAX_PACKET ? buf : c->frame + OSCNET_MAX_PACKET;
+			n = oscdelta_decode(c->delta, c->frame + c->foff, c->flen - c->foff,
+								out, OSCNET_MAX_PACKET, &len);
+			if (n == -1) {
+				// Records carry no length to skip by, and the dictionary is
+				// out of step with the sender from here on: give up the rest
+				// of the frame and have the caller drop the connection
+				c->foff = c->flen = 0;
+				return -1;
+			}
+			c->foff += n;
+			if (out != buf) {
+				memcpy(buf, out, len < size ? len : size);
+			}
+			return len < size ? len : size;
+		}
+		if ((len = oscnet_frame(c, c->frame, OSCNET_MAX_PACKET)) <= 0) {
+			return len;
+		}
+		if (c->frame[0] == OSCDELTA_FRAME && c->delta) {
+			c->foff = 1;
+			c->flen = len;
+			continue;
+		}
+		if (oscdelta_parse_handshake(c->frame, len, OSCDELTA_HELLO, &entries) == 0) {
+			if (oscnet_accept_delta(net, c, entries) == -1) {
+				return -1;
+			}
+			continue;
+		}
+		memcpy(buf, c->frame, len < size ? len : size);
+		return len < size ? len : size;
+	}
+}
+
+static int32_t oscnet_recv_stream(oscnet_t* net, uint8_t* buf, int32_t size,
+								  int32_t timeout_ms)
+{
+	struct pollfd pfd[OSCNET_MAX_CONN + 1];
+	struct oscnet_conn* c;
+	int i, n, fd, one = 1;
+	ssize_t rv;
+	int32_t len, wait = timeout_ms;
+	uint64_t now, deadline;
+
+	// Partial frames and accepts come back here; they do not restart the wait
+	deadline = timeout_ms < 0 ? UINT64_MAX : oscnet_now() + (uint64_t)timeout_ms * 1000000;
+	for (;;) {
+		// Deliver frames already buffered before touching the sockets
+		if (net->type == OSCNET_TCP) {
+			for (i = 0; i < net->nconn; ++i) {
+				if (net->deltamax > 0) {
+					len = oscnet_next(net, &net->conn[i], buf, size);
+				}
+				else {
+					len = oscnet_frame(&net->conn[i], buf, size);
+				}
+				if (len > 0) {
+					net->last = i;
+					return len;
+				}
+				if (len == -1) {
+					oscnet_dropconn(net, i--);
+				}
+			}
+		}
+
+		n = 0;
+		for (i = 0; i < net->nconn; ++i) {
+			pfd[n].fd = net->conn[i].fd;
+			pfd[n++].events = POLLIN;
+		}
+		if (net->listening) {
+			pfd[n].fd = net->fd;
+			pfd[n++].events = POLLIN;
+		}
+		if (n == 0) {
+			return -1;
+		}
+
+		if (deadline != UINT64_MAX) {
+			now = oscnet_now();
+			wait = now < deadline ? (int32_t)((deadline - now + 999999) / 1000000) : 0;
+		}
+		if ((rv = poll(pfd, n, wait)) <= 0) {
+			if (rv == -1 && errno == EINTR) {
+				continue;
+			}
+			return (int32_t)rv;
+		}
+
+		if (net->listening && (pfd[n-1].revents & POLLIN)) {
+			if ((fd = accept(net->fd, NULL, NULL)) != -1) {
+				// Answers sent with oscnet_sendconn() go out at once rather
+				// than wait for the peer to acknowledge the last one
+				if (net->type == OSCNET_TCP) {
+					setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+				}
+				oscnet_addconn(net, fd);
+			}
+		}
+
+		// Walk backwards so dropping a connection does not skip one
+		for (i = (net->listening ? n - 2 : n - 1); i >= 0; --i) {
+			if (!(pfd[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+				continue;
+			}
+			c = &net->conn[i];
+
+			if (net->type == OSCNET_UNIX) {
+				rv = recv(c->fd, buf, size, 0);
+				if (rv > 0) {
+					net->last = i;
+					return (int32_t)rv;
+				}
+			}
+			else {
+				if (c->off > 0) {
+					memmove(c->buf, c->buf + c->off, c->len - c->off);
+					c->len -= c->off;
+					c->off = 0;
+				}
+				rv = recv(c->fd, c->buf + c->len, OSCNET_MAX_PACKET + 4 - c->len, 0);
+				if (rv > 0) {
+					c->len += rv;
+					continue;
+				}
+			}
+
+			if (rv == 0 || (errno != EINTR && errno != EAGAIN)) {
+				oscnet_dropconn(net, i);
+			}
+		}
+
+		if (!net->listening && net->nconn == 0) {
+			return -1;
+		}
+	}
+}
+
+#ifdef OSCNET_HAVE_OFFLOAD
+// Coalesced datagrams are received while GRO is on and handed out until none
+// are left, also after it was turned off
+static int oscnet_isgro(oscnet_t* net)
+{
+	return net->coalesced && (net->gro || net->coalesced->off < net->coalesced->len);
+}
+
+// Fills msgs with the segments of coalesced datagrams, receiving another run
+// of them while there is room and the socket has one
+static int oscnet_recv_gro(oscnet_t* net, oscnet_msg_t* msgs, int count, int32_t timeout_ms)
+{
+	struct oscnet_gro* g = net->coalesced;
+	struct msghdr msg;
+	struct iovec iov;
+	struct pollfd pfd;
+	struct cmsghdr* cm;
+	struct timespec ts;
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(struct timespec))];
+	} ctrl;
+	ssize_t rv;
+	int32_t n;
+	int i = 0, segment;
+
+	while (i < count) {
+		if (g->off < g->len) {
+			n = g->len - g->off < g->segment ? g->len - g->off : g->segment;
+			msgs[i].size = n < msgs[i].bufsize ? n : msgs[i].bufsize;
+			memcpy(msgs[i].buf, g->buf + g->off, msgs[i].size);
+			memcpy(&msgs[i].from, &g->from, g->fromlen);
+			msgs[i].fromlen = g->fromlen;
+			msgs[i].stamp_ns = g->stamp_ns;
+			g->off += n;
+			i++;
+			continue;
+		}
+		if (!net->gro && i > 0) {
+			break;
+		}
+		if (i == 0 && timeout_ms >= 0) {
+			pfd.fd = net->fd;
+			pfd.events = POLLIN;
+			if ((rv = poll(&pfd, 1, timeout_ms)) <= 0) {
+				return rv == -1 && errno == EINTR ? 0 : (int)rv;
+			}
+		}
+
+		// Only the first receive waits
+		memset(&msg, 0, sizeof(msg));
+		iov.iov_base = g->buf;
+		iov.iov_len = sizeof(g->buf);
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_name = &g->from;
+		msg.msg_namelen = sizeof(g->from);
+		msg.msg_control = ctrl.buf;
+		msg.msg_controllen = sizeof(ctrl.buf);
+		do {
+			rv = recvmsg(net->fd, &msg, i ? MSG_DONTWAIT : 0);
+		} while (rv == -1 && errno == EINTR);
+		if (rv == -1) {
+			return i ? i : -1;
+		}
+		g->fromlen = msg.msg_namelen;
+		g->stamp_ns = 0;
+		segment = 0;
+		for (cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+			if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO) {
+				memcpy(&segment, CMSG_DATA(cm), sizeof(int));
+			}
+#ifdef SO_TIMESTAMPNS
+			else if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SO_TIMESTAMPNS) {
+				memcpy(&ts, CMSG_DATA(cm), sizeof(ts));
+				g->stamp_ns = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+			}
+#endif
+		}
+		(void)ts;
+		g->off = 0;
+		g->len = (int32_t)rv;
+		g->segment = segment > 0 ? segment : (int32_t)rv;
+		if (rv == 0) {
+			// An empty datagram
+			msgs[i].size = 0;
+			memcpy(&msgs[i].from, &g->from, g->fromlen);
+			msgs[i].fromlen = g->fromlen;
+			msgs[i].stamp_ns = g->stamp_ns;
+			i++;
+		}
+	}
+	return i;
+}
+#endif
+
+// Receives up to count datagrams with one recvmmsg()
+static int oscnet_recvdgram(oscnet_t* net, oscnet_msg_t* msgs, int count, int32_t timeout_ms)
+{
+	struct pollfd pfd;
+#ifdef __linux__
+	struct mmsghdr mm[OSCNET_BATCH];
+	struct iovec iov[OSCNET_BATCH];
+	struct cmsghdr* cm;
+	struct timespec ts;
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(sizeof(struct timespec))];
+	} ctrl[OSCNET_BATCH];
+	int i;
+#else
+	socklen_t len;
+#endif
+	int rv;
+
+#ifdef OSCNET_HAVE_OFFLOAD
+	if (oscnet_isgro(net)) {
+		return oscnet_recv_gro(net, msgs, count, timeout_ms);
+	}
+#endif
+	if (count > OSCNET_BATCH) {
+		count = OSCNET_BATCH;
+	}
+	if (timeout_ms >= 0) {
+		pfd.fd = net->fd;
+		pfd.events = POLLIN;
+		if ((rv = poll(&pfd, 1, timeout_ms)) <= 0) {
+			return rv == -1 && errno == EINTR ? 0 : rv;
+		}
+	}
+
+#ifdef __linux__
+	memset(mm, 0, sizeof(struct mmsghdr) * count);
+	for (i = 0; i < count; ++i) {
+		iov[i].iov_base = msgs[i].buf;
+		iov[i].iov_len = msgs[i].bufsize;
+		mm[i].msg_hdr.msg_iov = &iov[i];
+		mm[i].msg_hdr.msg_iovlen = 1;
+		mm[i].msg_hdr.msg_name = &msgs[i].from;
+		mm[i].msg_hdr.msg_namelen = sizeof(msgs[i].from);
+		if (net->timestamps) {
+			mm[i].msg_hdr.msg_control = ctrl[i].buf;
+			mm[i].msg_hdr.msg_controllen = sizeof(ctrl[i].buf);
+		}
+	}
+	do {
+		rv = recvmmsg(net->fd, mm, count, MSG_WAITFORONE, NULL);
+	} while (rv == -1 && errno == EINTR);
+	for (i = 0; i < rv; ++i) {
+		msgs[i].size = (int32_t)mm[i].msg_len;
+		msgs[i].fromlen = mm[i].msg_hdr.msg_namelen;
+		msgs[i].stamp_ns = 0;
+		if (!net->timestamps) {
+			continue;
+		}
+		for (cm = CMSG_FIRSTHDR(&mm[i].msg_hdr); cm != NULL;
+			 cm = CMSG_NXTHDR(&mm[i].msg_hdr, cm)) {
+			if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SO_TIMESTAMPNS) {
+				memcpy(&ts, CMSG_DATA(cm), sizeof(ts));
+				msgs[i].stamp_ns = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+			}
+		}
+	}
+	return rv;
+#else
+	if (count < 1) {
+		return 0;
+	}
+	len = sizeof(msgs[0].from);
+	do {
+		rv = (int)recvfrom(net->fd, msgs[0].buf, msgs[0].bufsize, 0,
+						   (struct sockaddr*)&msgs[0].from, &len);
+	} while (rv == -1 && errno == EINTR);
+	if (rv == -1) {
+		return -1;
+	}
+	msgs[0].size = rv;
+	msgs[0].fromlen = len;
+	msgs[0].stamp_ns = 0;
+	return 1;
+#endif
+}
+
+// Receives the packets of a reliable endpoint, answering the streams and
+// waking up for their timers, until there are packets or the timeout passed
+static int oscnet_recvrel(oscnet_t* net, oscnet_msg_t* msgs, int count, int32_t timeout_ms)
+{
+	uint64_t now = oscnet_now(), deadline = now + (uint64_t)timeout_ms * 1000000;
+	int32_t wait, left;
+	int n;
+
+	if ((n = oscnet_relheld(net->rel, msgs, count)) > 0) {
+		return n;
+	}
+	for (;;) {
+		wait = oscnet_relwait(net, now);
+		if (timeout_ms >= 0) {
+			left = now < deadline ? (int32_t)((deadline - now + 999999) / 1000000) : 0;
+			if (wait < 0 || left < wait) {
+				wait = left;
+			}
+		}
+		if ((n = oscnet_recvdgram(net, msgs, count, wait)) < 0) {
+			return n;
+		}
+		now = oscnet_now();
+		n = oscnet_relinput(net, msgs, n, now);
+		oscnet_relflush(net, now);
+		if (n > 0 || (timeout_ms >= 0 && now >= deadline)) {
+			return n;
+		}
+	}
+}
+
+int32_t oscnet_recv(oscnet_t* net, uint8_t* buf, int32_t size, int32_t timeout_ms)
+{
+	oscnet_msg_t msg;
+	struct pollfd pfd;
+	ssize_t rv;
+
+	switch (net->type) {
+		case OSCNET_SHM:
+			return oscshm_recv(net->shm, buf, size, timeout_ms);
+		case OSCNET_TCP:
+		case OSCNET_UNIX:
+			return oscnet_recv_stream(net, buf, size, timeout_ms);
+		default:
+			if (net->rel) {
+				msg.buf = buf;
+				msg.bufsize = size;
+				rv = oscnet_recvrel(net, &msg, 1, timeout_ms);
+				return rv > 0 ? msg.size : (int32_t)rv;
+			}
+#ifdef OSCNET_HAVE_OFFLOAD
+			if (oscnet_isgro(net)) {
+				msg.buf = buf;
+				msg.bufsize = size;
+				rv = oscnet_recv_gro(net, &msg, 1, timeout_ms);
+				return rv > 0 ? msg.size : (int32_t)rv;
+			}
+#endif
+			if (timeout_ms >= 0) {
+				pfd.fd = net->fd;
+				pfd.events = POLLIN;
+				if ((rv = poll(&pfd, 1, timeout_ms)) <= 0) {
+					return rv == -1 && errno == EINTR ? 0 : (int32_t)rv;
+				}
+			}
+			do {
+				rv = recv(net->fd, buf, size, 0);
+			} while (rv == -1 && errno == EINTR);
+			return (int32_t)rv;
+	}
+}
+
+static int oscnet_received(const oscnet_msg_t* msgs, int n)
+{
+#ifdef OSC_METRICS
+	uint64_t bytes = 0;
+	int i;
+
+	for (i = 0; i < n; ++i) {
+		bytes += msgs[i].size;
+	}
+	if (n > 0) {
+		OSCMETRICS_ADD(OSCMETRICS_RECEIVED, n);
+		OSCMETRICS_ADD(OSCMETRICS_RECEIVED_BYTES, bytes);
+	}
+#else
+	(void)msgs;
+#endif
+	return n;
+}
+
+int oscnet_delta(oscnet_t* net, int32_t entries, int32_t timeout_ms)
+{
+	uint8_t buf[64];
+	struct iovec iov;
+	int32_t n, granted;
+	int iovcnt = 1;
+
+	if (net->type != OSCNET_TCP || entries < 1) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+	if (net->listening) {
+		net->deltamax = entries;
+		return 0;
+	}
+
+	// The hello itself goes out as a plain packet
+	oscdelta_free(net->delta);
+	net->delta = NULL;
+	n = oscdelta_handshake(buf, OSCDELTA_HELLO, entries);
+	iov.iov_base = buf;
+	iov.iov_len = n;
+	if (oscnet_sendraw(net, &iov, &iovcnt, 1, NULL) != 1) {
+		return -1;
+	}
+	n = oscnet_recv(net, buf, sizeof(buf), timeout_ms);
+	if (n <= 0 || oscdelta_parse_handshake(buf, n, OSCDELTA_OK, &granted) == -1 ||
+		granted > entries) {
+		errno = EPROTONOSUPPORT;
+		return -1;
+	}
+	if (!net->deltaframe &&
+		(net->deltaframe = (uint8_t*)malloc(OSCNET_MAX_PACKET + 4)) == NULL) {
+		fprintf(stderr, "oscnet: Critical memory error...\n");
+		return -1;
+	}
+	return (net->delta = oscdelta_new(granted)) ? 0 : -1;
+}
+
+void oscnet_deltastats(oscnet_t* net, uint64_t* bytes, uint64_t* coded)
+{
+	*bytes = *coded = 0;
+	if (net->delta) {
+		oscdelta_stats(net->delta, NULL, bytes, coded);
+	}
+}
+
+int oscnet_timestamps(oscnet_t* net, int on)
+{
+#if defined(__linux__) && defined(SO_TIMESTAMPNS)
+	if (net->type == OSCNET_UDP || net->type == OSCNET_UNIXDGRAM) {
+		if (setsockopt(net->fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == -1) {
+			return -1;
+		}
+		net->timestamps = on != 0;
+		return 0;
+	}
+#endif
+	(void)on;
+	errno = EOPNOTSUPP;
+	return -1;
+}
+
+int oscnet_offload(oscnet_t* net, int flags)
+{
+	int on = 0;
+
+	if (net->type != OSCNET_UDP) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+#ifdef OSCNET_HAVE_OFFLOAD
+	// A segment size of 0 only asks whether the kernel knows UDP_SEGMENT;
+	// every segmented send carries its own
+	net->gso = (flags & OSCNET_GSO) &&
+			   setsockopt(net->fd, SOL_UDP, UDP_SEGMENT, &on, sizeof(on)) == 0;
+	on = (flags & OSCNET_GRO) != 0;
+	if (setsockopt(net->fd, SOL_UDP, UDP_GRO, &on, sizeof(on)) == -1) {
+		on = 0;
+	}
+	if (on && !net->coalesced &&
+		(net->coalesced = (struct oscnet_gro*)calloc(1, sizeof(struct oscnet_gro))) == NULL) {
+		fprintf(stderr, "oscnet: Critical memory error...\n");
+		setsockopt(net->fd, SOL_UDP, UDP_GRO, &net->gro, sizeof(net->gro));
+		on = 0;
+	}
+	net->gro = on;
+	return (net->gso ? OSCNET_GSO : 0) | (net->gro ? OSCNET_GRO : 0);
+#else
+	(void)flags;
+	(void)on;
+	return 0;
+#endif
+}
+
+int oscnet_reliable(oscnet_t* net, int32_t packets, int32_t rtt_us)
+{
+	struct oscnet_rel* r;
+
+	if (net->type != OSCNET_UDP || net->rel) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+	if ((r = (struct oscnet_rel*)calloc(1, sizeof(struct oscnet_rel))) == NULL ||
+		(r->in = (uint8_t*)malloc(OSCNET_MAX_PACKET)) == NULL ||
+		(r->out = (uint8_t*)malloc(OSCNET_MAX_PACKET + OSCREL_HEADER)) == NULL) {
+		fprintf(stderr, "oscnet: Critical memory error...\n");
+		if (r) {
+			free(r->in);
+		}
+		free(r);
+		return -1;
+	}
+	r->packets = packets;
+	r->rtt_us = rtt_us;
+	if (!net->listening) {
+		if ((r->peer[0].rel = oscnet_newrel(r)) == NULL) {
+			free(r->in);
+			free(r->out);
+			free(r);
+			return -1;
+		}
+		memcpy(&r->peer[0].addr, &net->addr, net->addrlen);
+		r->peer[0].addrlen = net->addrlen;
+		r->npeers = 1;
+	}
+	net->rel = r;
+	return 0;
+}
+
+int oscnet_latest(oscnet_t* net, const char* prefix)
+{
+	struct oscnet_rel* r = net->rel;
+	int i;
+
+	if (!r || r->nlatest == OSCREL_PREFIXES) {
+		errno = r ? ENOSPC : EOPNOTSUPP;
+		return -1;
+	}
+	if ((r->latest[r->nlatest] = strdup(prefix)) == NULL) {
+		fprintf(stderr, "oscnet: Critical memory error...\n");
+		return -1;
+	}
+	r->nlatest++;
+	for (i = 0; i < r->npeers; ++i) {
+		oscrel_latest(r->peer[i].rel, prefix);
+	}
+	return 0;
+}
+
+int oscnet_service(oscnet_t* net, int32_t timeout_ms)
+{
+	struct pollfd pfd;
+	uint64_t now, deadline;
+	int32_t wait, left;
+
+	if (!net->rel) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+	now = oscnet_now();
+	deadline = timeout_ms < 0 ? UINT64_MAX : now + (uint64_t)timeout_ms * 1000000;
+	for (;;) {
+		oscnet_relpoll(net);
+		now = oscnet_now();
+		if ((wait = oscnet_relwait(net, now)) < 0) {
+			return 0;
+		}
+		if (now >= deadline) {
+			return 1;
+		}
+		if (deadline != UINT64_MAX) {
+			left = (int32_t)((deadline - now + 999999) / 1000000);
+			wait = wait < left ? wait : left;
+		}
+		// Only the timers can be served while the held packets fill the room
+		pfd.fd = net->fd;
+		pfd.events = oscnet_relfull(net->rel) ? 0 : POLLIN;
+		poll(&pfd, 1, wait);
+	}
+}
+
+void oscnet_relstats(oscnet_t* net, oscrel_stats_t* stats)
+{
+	int i;
+
+	memset(stats, 0, sizeof(*stats));
+	if (!net->rel) {
+		return;
+	}
+	*stats = net->rel->dropped;
+	for (i = 0; i < net->rel->npeers; ++i) {
+		oscnet_addstats(stats, net->rel->peer[i].rel);
+	}
+}
+
+int oscnet_recvmsgs(oscnet_t* net, oscnet_msg_t* msgs, int count, int32_t timeout_ms)
+{
+	struct oscnet_conn* c;
+
+	if (net->type == OSCNET_UDP || net->type == OSCNET_UNIXDGRAM) {
+		if (net->rel) {
+			return oscnet_received(msgs, oscnet_recvrel(net, msgs, count, timeout_ms));
+		}
+		return oscnet_received(msgs, oscnet_recvdgram(net, msgs, count, timeout_ms));
+	}
+
+	if (count < 1) {
+		return 0;
+	}
+	msgs[0].size = oscnet_recv(net, msgs[0].buf, msgs[0].bufsize, timeout_ms);
+	msgs[0].fromlen = 0;
+	msgs[0].stamp_ns = 0;
+	if (msgs[0].size <= 0) {
+		return msgs[0].size;
+	}
+
+	// Streams report the peer of the connection the packet came from
+	if (net->last >= 0 && net->last < net->nconn) {
+		c = &net->conn[net->last];
+		memcpy(&msgs[0].from, &c->peer, c->peerlen);
+		msgs[0].fromlen = c->peerlen;
+	}
+	return oscnet_received(msgs, 1);
+}
+
+int oscnet_recvv(oscnet_t* net, uint8_t* const* bufs, int32_t* sizes, int32_t bufsize,
+				 int count, int32_t timeout_ms)
+{
+	oscnet_msg_t msgs[OSCNET_BATCH];
+	int i, rv;
+
+	if (count > OSCNET_BATCH) {
+		count = OSCNET_BATCH;
+	}
+	for (i = 0; i < count; ++i) {
+		msgs[i].buf = bufs[i];
+		msgs[i].bufsize = bufsize;
+	}
+	rv = oscnet_recvmsgs(net, msgs, count, timeout_ms);
+	for (i = 0; i < rv; ++i) {
+		sizes[i] = msgs[i].size;
+	}
+	return rv;
+}
+
+void oscnet_close(oscnet_t* net)
+{
+	int i;
+
+	if (!net) {
+		return;
+	}
+	for (i = 0; i < OSCNET_MAX_CONN; ++i) {
+		if (i < net->nconn) {
+			close(net->conn[i].fd);
+			oscdelta_free(net->conn[i].delta);
+		}
+		free(net->conn[i].buf);
+		free(net->conn[i].frame);
+	}
+	if (net->fd != -1) {
+		close(net->fd);
+	}
+	if (net->path[0]) {
+		unlink(net->path);
+	}
+	free(net->pace);
+	oscshm_close(net->shm);
+	free(net->scratch);
+	oscdelta_free(net->delta);
+	free(net->deltaframe);
+	free(net->coalesced);
+	if (net->rel) {
+		for (i = 0; i < net->rel->npeers; ++i) {
+			oscrel_free(net->rel->peer[i].rel);
+		}
+		for (i = 0; i < net->rel->nlatest; ++i) {
+			free(net->rel->latest[i]);
+		}
+		free(net->rel->in);
+		free(net->rel->out);
+		free(net->rel->held);
+		free(net->rel);
+	}
+	free(net);
+}
@@ -0,0 +1,361 @@
+/******************************************************************************
+ *  oscnet
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#ifndef __OSC_NET_H__
+#define __OSC_NET_H__
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "../oscrel/oscrel.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ *	oscnet sends and receives whole OSC packets over the transports supported
+ *	by the command-line tools, so a tool can take a destination from its
+ *	arguments without caring how the packet gets there.
+ *
+ *	Destinations are either an IP endpoint given as three arguments
+ *	(host port tcp|udp) or a local endpoint given as a single argument:
+ *
+ *		unix:/path			AF_UNIX SOCK_SEQPACKET socket
+ *		unixdgram:/path		AF_UNIX SOCK_DGRAM socket
+ *		shm://name			shared memory ring (see oscshm)
+ *
+ *	Packets passed to and returned from oscnet never include the TCP size
+ *	prefix. oscnet adds it when sending over TCP and strips it when receiving.
+ *	The local transports preserve message boundaries so no prefix is used.
+ *
+ *
+ *	Usage example for sender:
+ *		oscnet_t* net = oscnet_connect("unix:/tmp/engine", NULL, NULL);
+ *		oscnet_send(net, packet, size);
+ *		oscnet_close(net);
+ *
+ *	Usage example for receiver:
+ *		oscnet_t* net = oscnet_listen(NULL, "7374", "udp");
+ *		size = oscnet_recv(net, packet, sizeof(packet), -1);
+ */
+
+// Largest packet oscnet will receive
+#define OSCNET_MAX_PACKET 65536
+
+// Transport types
+#define OSCNET_UDP			0
+#define OSCNET_TCP			1
+#define OSCNET_UNIX			2	// SOCK_SEQPACKET
+#define OSCNET_UNIXDGRAM	3
+#define OSCNET_SHM			4
+
+typedef struct oscnet oscnet_t;
+
+/*
+ *	oscnet_islocal() returns 1 if dest is a single-argument local endpoint
+ *	(unix:, unixdgram: or shm://), 0 if it is a host name or address.
+ */
+int oscnet_islocal(const char* dest);
+
+/*
+ *	oscnet_connect() opens a sending endpoint.
+ *
+ *	Arguments:
+ *		const char* dest: Host name, IP address or local endpoint.
+ *		const char* port: Port number. Ignored for local endpoints.
+ *		const char* proto: "tcp" or "udp". Ignored for local endpoints.
+ *
+ *	Return:
+ *		Endpoint or NULL on error. Errors are printed to stderr.
+ */
+oscnet_t* oscnet_connect(const char* dest, const char* port, const char* proto);
+
+/*
+ *	oscnet_listen() opens a receiving endpoint. For IP endpoints dest is the
+ *	address to bind and may be NULL to bind all interfaces. A unix socket
+ *	path is removed first if it exists and again by oscnet_close().
+ */
+oscnet_t* oscnet_listen(const char* dest, const char* port, const char* proto);
+
+/* Returns the transport type (OSCNET_UDP, ...). */
+int oscnet_type(oscnet_t* net);
+
+/*
+ *	oscnet_unsent() returns the bytes written to a connected TCP or unix
+ *	endpoint that the peer has not taken yet (SIOCOUTQ): a large value means
+ *	anything sent now waits behind them. Returns 0 for other endpoints and
+ *	where the system cannot tell, or -1 on error.
+ */
+int32_t oscnet_unsent(oscnet_t* net);
+
+/*
+ *	oscnet_send() sends one OSC packet.
+ *
+ *	Return:
+ *		Size of the packet sent or -1 on error.
+ */
+int32_t oscnet_send(oscnet_t* net, const uint8_t* buf, int32_t size);
+
+/*
+ *	oscnet_sendv() sends count packets with as few system calls as possible:
+ *	one sendmmsg() for datagram and seqpacket sockets, one writev() for TCP.
+ *
+ *	Return:
+ *		Number of packets sent, or -1 if none could be sent.
+ */
+int oscnet_sendv(oscnet_t* net, uint8_t* const* bufs, const int32_t* sizes, int count);
+
+/*
+ *	oscnet_sendiov() is oscnet_sendv() for packets made of several pieces, such
+ *	as a rewritten address followed by the rest of a received packet. Packet i
+ *	is the next iovcnt[i] entries of iov.
+ */
+int oscnet_sendiov(oscnet_t* net, const struct iovec* iov, const int* iovcnt, int count);
+
+/*
+ *	oscnet_lastconn() names the connection of a TCP or seqpacket listener
+ *	that the last packet received came from, so that the caller can answer
+ *	it with oscnet_sendconn(). The number stays the same for as long as the
+ *	connection is open and is not given to another one soon after.
+ *
+ *	Return:
+ *		Connection number, or -1 for other endpoints or before a packet.
+ */
+int oscnet_lastconn(oscnet_t* net);
+
+/*
+ *	oscnet_hasconn() tells if a connection named by oscnet_lastconn() is
+ *	still open. A connection closed by its peer is gone once the listener
+ *	has received past the close.
+ *
+ *	Return:
+ *		1 if the connection is open, 0 if it is gone.
+ */
+int oscnet_hasconn(oscnet_t* net, int conn);
+
+/*
+ *	oscnet_sendconn() sends one OSC packet to a single connection of a
+ *	listener, as a plain packet even on a delta session.
+ *
+ *	Return:
+ *		Size of the packet sent, or -1 if the connection is gone. A
+ *		connection that can not be sent to is closed.
+ */
+int32_t oscnet_sendconn(oscnet_t* net, int conn, const uint8_t* buf, int32_t size);
+
+/*
+ *	oscnet_recv() receives one OSC packet. A listening TCP or seqpacket
+ *	endpoint accepts new connections and receives from all of them.
+ *
+ *	Arguments:
+ *		int32_t timeout_ms: Milliseconds to wait. 0 returns immediately, -1
+ *							waits forever.
+ *
+ *	Return:
+ *		Size of the packet, 0 on timeout or -1 on error. Packets larger than
+ *		size are truncated.
+ */
+int32_t oscnet_recv(oscnet_t* net, uint8_t* buf, int32_t size, int32_t timeout_ms);
+
+/*
+ *	oscnet_recvv() receives up to count packets, each into a buffer of
+ *	bufsize bytes, using a single recvmmsg() on datagram sockets. Other
+ *	transports return one packet per call.
+ *
+ *	Return:
+ *		Number of packets received, 0 on timeout or -1 on error.
+ */
+int oscnet_recvv(oscnet_t* net, uint8_t* const* bufs, int32_t* sizes, int32_t bufsize,
+				 int count, int32_t timeout_ms);
+
+/*
+ *	oscnet_recvmsgs() is oscnet_recvv() that also reports who sent each
+ *	packet. The caller sets buf and bufsize of each entry.
+ */
+typedef struct {
+	uint8_t* buf;			// receive buffer (set by caller)
+	int32_t bufsize;		// size of buf (set by caller)
+	int32_t size;			// size of the packet received
+	struct sockaddr_storage from;	// sender, if known
+	uint32_t fromlen;		// 0 if the sender is not known (shm)
+	uint64_t stamp_ns;		// kernel receive time, see oscnet_timestamps()
+} oscnet_msg_t;
+
+int oscnet_recvmsgs(oscnet_t* net, oscnet_msg_t* msgs, int count, int32_t timeout_ms);
+
+/*
+ *	oscnet_timestamps() asks the kernel to stamp every packet with the time it
+ *	was received (SO_TIMESTAMPNS). oscnet_recvmsgs() then sets stamp_ns to
+ *	that time in CLOCK_REALTIME nanoseconds; otherwise stamp_ns is 0.
+ *
+ *	Return:
+ *		0 on success, -1 if the transport has no kernel timestamps (only
+ *		udp and unixdgram endpoints on Linux do).
+ */
+int oscnet_timestamps(oscnet_t* net, int on);
+
+/*
+ *	oscnet_offload() turns on UDP segmentation offload for a udp endpoint, for
+ *	high rates of packets that have the same size (meters, telemetry).
+ *
+ *	With OSCNET_GSO a run of packets of the same size in one oscnet_sendv()
+ *	or oscnet_sendiov() call goes down the network stack as one buffer, which
+ *	the kernel or the network card cuts back into datagrams (UDP_SEGMENT).
+ *	The last packet of a run may be shorter. Receivers see plain datagrams.
+ *
+ *	With OSCNET_GRO the kernel hands over runs of datagrams from one sender
+ *	as one buffer (UDP_GRO), which oscnet_recvmsgs(), oscnet_recvv() and
+ *	oscnet_recv() split back into packets, so one system call yields many.
+ *
+ *	Flags the kernel does not support are left off, and a send the kernel
+ *	or the device refuses goes out again as plain datagrams. Packets larger
+ *	than an Ethernet payload and packets with a departure time (see
+ *	OSCNET_PACE_TXTIME) are never segmented.
+ *
+ *	Arguments:
+ *		int flags: OSCNET_GSO, OSCNET_GRO, both, or 0 to turn both off.
+ *
+ *	Return:
+ *		The flags that are on, or -1 if the endpoint is not udp.
+ */
+#define OSCNET_GSO 1
+#define OSCNET_GRO 2
+
+int oscnet_offload(oscnet_t* net, int flags);
+
+/*
+ *	oscnet_pace() limits the rate at which the endpoint sends, to protect
+ *	receivers with small buffers from bursts. Packets are held back by two
+ *	token buckets, one in packets per second and one in bytes per second,
+ *	and spread evenly: oscnet_sendv() and oscnet_sendiov() sleep until each
+ *	packet is due, sending the packets due together in one system call.
+ *
+ *	With OSCNET_PACE_TXTIME the whole batch is handed to the kernel at once
+ *	with a departure time on every packet (SO_TXTIME), and the fq qdisc
+ *	releases them (tc qdisc replace dev eth0 root fq). Only udp and unixdgram
+ *	endpoints on Linux support it.
+ *
+ *	Arguments:
+ *		double packets: Packets per second, or 0 for no packet limit.
+ *		double bytes: Bytes per second, or 0 for no byte limit. Both 0 turns
+ *					  pacing off.
+ *		int32_t burst_us: Microseconds of tokens that may be used at once
+ *						  after the endpoint was idle. 0 spaces every packet.
+ *		int flags: 0 or OSCNET_PACE_TXTIME.
+ *
+ *	Return:
+ *		0 on success, -1 if SO_TXTIME was asked for and is not available.
+ */
+#define OSCNET_PACE_TXTIME 1
+
+int oscnet_pace(oscnet_t* net, double packets, double bytes, int32_t burst_us, int flags);
+
+typedef struct {
+	uint64_t packets;		// packets sent through the buckets
+	uint64_t delayed;		// packets that had to wait for tokens
+	uint64_t delay_ns;		// total shaping delay of the delayed packets
+	uint64_t max_delay_ns;
+	int32_t queue;			// packets of the current send waiting for tokens
+	int32_t max_queue;
+} oscnet_pacestats_t;
+
+/* Reports the queue depth and shaping delay of a paced endpoint. */
+void oscnet_pacestats(oscnet_t* net, oscnet_pacestats_t* stats);
+
+/*
+ *	oscnet_delta() turns on delta compression (see oscdelta) for a TCP
+ *	endpoint. Streams that repeat the same addresses and type tags, such as
+ *	control surface traffic, shrink to a header ID and the argument words
+ *	that changed, and several packets share one frame.
+ *
+ *	On a listening endpoint it lets each connection ask for a session with
+ *	up to entries dictionary entries; the packets of a session are returned
+ *	as standard OSC packets, and plain connections are not affected.
+ *
+ *	On a connected endpoint it asks the listener for a session with entries
+ *	entries and waits up to timeout_ms for the answer. Without one the
+ *	endpoint keeps sending plain packets; a listener that does not accept
+ *	sessions receives the request as one "/_delta/hello ,ii" message.
+ *
+ *	Return:
+ *		0 if the session is on (or the listener accepts sessions), -1 if
+ *		the listener refused or did not answer or the endpoint is not TCP.
+ */
+int oscnet_delta(oscnet_t* net, int32_t entries, int32_t timeout_ms);
+
+/* Bytes of packets sent in a delta session and of the frames they took. */
+void oscnet_deltastats(oscnet_t* net, uint64_t* bytes, uint64_t* coded);
+
+/*
+ *	oscnet_reliable() turns on reliable delivery (see oscrel) for a udp
+ *	endpoint. Packets get a sequence number and are kept in a ring of
+ *	packets; the receiver asks again for what it missed and gets packets in
+ *	the order they arrive, without waiting for a lost one as TCP does. Both
+ *	ends must turn it on. A listening endpoint keeps one stream per sender
+ *	(up to 64) and still takes plain packets.
+ *
+ *	A sender reads the requests of the receiver on each send. When it stops
+ *	sending for a while, and before it closes, it calls oscnet_service() so
+ *	that lost packets are still sent again. Packets that arrive with the
+ *	requests are kept for the next oscnet_recv() or oscnet_recvmsgs().
+ *
+ *	Arguments:
+ *		int32_t packets: Packets kept for retransmission and tracked by the
+ *						 receiver.
+ *		int32_t rtt_us: Expected round trip time, or 0 for 10 ms.
+ *
+ *	Return:
+ *		0 on success, -1 if the endpoint is not udp.
+ */
+int oscnet_reliable(oscnet_t* net, int32_t packets, int32_t rtt_us);
+
+/*
+ *	oscnet_latest() marks messages whose address starts with prefix as
+ *	latest-only on a reliable endpoint: a lost one is not sent again once a
+ *	newer message to the same address was sent.
+ */
+int oscnet_latest(oscnet_t* net, const char* prefix);
+
+/*
+ *	oscnet_service() answers the requests of receivers and sends the
+ *	retransmissions and heartbeats that are due, for up to timeout_ms.
+ *	Packets that arrive meanwhile are held for the next oscnet_recv() or
+ *	oscnet_recvmsgs(); while the held packets fill their buffer, only the
+ *	timers are served and the socket is left unread.
+ *
+ *	Return:
+ *		0 once nothing is left to send, 1 if the timeout came first, or -1
+ *		if the endpoint is not reliable.
+ */
+int oscnet_service(oscnet_t* net, int32_t timeout_ms);
+
+/* Adds up the counters of the streams of a reliable endpoint. */
+void oscnet_relstats(oscnet_t* net, oscrel_stats_t* stats);
+
+/* Closes the endpoint and all accepted connections. */
+void oscnet_close(oscnet_t* net);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __OSC_NET_H__
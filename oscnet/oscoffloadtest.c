@@ -0,0 +1,237 @@
+/******************************************************************************
+ *  oscoffloadtest
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *
+ *  Sends batches of packets of mixed sizes over loopback UDP with and
+ *  without GSO and GRO on either side, and checks every packet arrives
+ *  whole and in order. Then one thread streams equal-size meter messages to
+ *  another, which receives them in batches of 64, and prints the packet
+ *  rate, the CPU time each side spends per packet and the packets each
+ *  receive call returns, without offload, with GSO, with GRO and with both.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "oscnet.h"
+#include "../oscpack/oscpack.h"
+#include "../oscpack/osctest.h"
+
+const char usage[] = "usage: oscoffloadtest [packets] [port]\n";
+
+#define BATCH 64
+#define WINDOW 256			// packets the sender may be ahead of the receiver
+#define METERS 64
+#define CHECK_PACKETS 200
+
+static double now(clockid_t clock)
+{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Size of the check packet i: runs of one size broken by shorter, longer and
+// oversized packets, and a run longer than one segmented send takes
+static int32_t check_size(int i)
+{
+	if (i == 20 || i == 120) return 40;
+	if (i == 26) return 100;
+	if (i == 27) return 2000;
+	if (i == 28) return 4;
+	return 48;
+}
+
+static void check(const char* port, int txflags, int rxflags)
+{
+	static uint8_t bufs[CHECK_PACKETS][2048], in[BATCH][2048];
+	uint8_t* ptrs[CHECK_PACKETS];
+	int32_t sizes[CHECK_PACKETS];
+	oscnet_msg_t msgs[BATCH];
+	oscnet_t *rx, *tx;
+	char what[64];
+	int i, k, n, got = 0, bad = 0;
+
+	if ((rx = oscnet_listen(NULL, port, "udp")) == NULL ||
+		(tx = oscnet_connect("127.0.0.1", port, "udp")) == NULL) {
+		osctest_errors++;
+		return;
+	}
+	oscnet_offload(tx, txflags);
+	oscnet_offload(rx, rxflags);
+	for (i = 0; i < CHECK_PACKETS; ++i) {
+		sizes[i] = check_size(i);
+		for (k = 0; k < sizes[i]; ++k) {
+			bufs[i][k] = (uint8_t)(i * 7 + k);
+		}
+		ptrs[i] = bufs[i];
+	}
+	for (i = 0; i < BATCH; ++i) {
+		msgs[i].buf = in[i];
+		msgs[i].bufsize = sizeof(in[i]);
+	}
+
+	snprintf(what, sizeof(what), "send with flags %d to %d", txflags, rxflags);
+	expect(oscnet_sendv(tx, ptrs, sizes, CHECK_PACKETS) == CHECK_PACKETS, what);
+
+	// The first packets one at a time, then the rest in batches
+	for (; got < 3; ++got) {
+		n = oscnet_recv(rx, in[0], sizeof(in[0]), 1000);
+		bad += n != sizes[got] || memcmp(in[0], bufs[got], n) != 0;
+	}
+	while (got < CHECK_PACKETS && (n = oscnet_recvmsgs(rx, msgs, BATCH, 1000)) > 0) {
+		for (i = 0; i < n && got < CHECK_PACKETS; ++i, ++got) {
+			bad += msgs[i].size != sizes[got] || msgs[i].fromlen == 0 ||
+				   memcmp(msgs[i].buf, bufs[got], msgs[i].size) != 0;
+		}
+	}
+	snprintf(what, sizeof(what), "packets whole and in order with flags %d to %d",
+			 txflags, rxflags);
+	expect(got == CHECK_PACKETS && bad == 0, what);
+	oscnet_close(tx);
+	oscnet_close(rx);
+}
+
+struct stream {
+	oscnet_t* net;
+	int packets;
+	volatile int received;		// written by the receiver only
+	int calls;					// receive calls that returned packets
+	double cpu;					// thread CPU seconds
+};
+
+static void* receive(void* arg)
+{
+	struct stream* s = (struct stream*)arg;
+	static uint8_t in[BATCH][256];
+	oscnet_msg_t msgs[BATCH];
+	double t = now(CLOCK_THREAD_CPUTIME_ID);
+	int i, n;
+
+	for (i = 0; i < BATCH; ++i) {
+		msgs[i].buf = in[i];
+		msgs[i].bufsize = sizeof(in[i]);
+	}
+	while (s->received < s->packets && (n = oscnet_recvmsgs(s->net, msgs, BATCH, 200)) > 0) {
+		__atomic_store_n(&s->received, s->received + n, __ATOMIC_RELEASE);
+		s->calls++;
+	}
+	s->cpu = now(CLOCK_THREAD_CPUTIME_ID) - t;
+	return NULL;
+}
+
+static void bench(const char* port, int txflags, int rxflags, int packets)
+{
+	static uint8_t bufs[BATCH][64];
+	uint8_t* ptrs[BATCH];
+	int32_t sizes[BATCH];
+	struct stream s;
+	pthread_t thread;
+	oscnet_t* tx;
+	double t, cpu, wait;
+	int i, sent = 0, on;
+
+	memset(&s, 0, sizeof(s));
+	if ((s.net = oscnet_listen(NULL, port, "udp")) == NULL ||
+		(tx = oscnet_connect("127.0.0.1", port, "udp")) == NULL) {
+		osctest_errors++;
+		return;
+	}
+	on = oscnet_offload(tx, txflags) | oscnet_offload(s.net, rxflags);
+
+	// Equal-size telemetry: every meter message is 28 bytes
+	for (i = 0; i < BATCH; ++i) {
+		char addr[16];
+		snprintf(addr, sizeof(addr), "/meter/%02d", i % METERS);
+		sizes[i] = oscpack(bufs[i], addr, "f", 0.5f);
+		ptrs[i] = bufs[i];
+	}
+	s.packets = packets;
+	pthread_create(&thread, NULL, receive, &s);
+
+	t = now(CLOCK_MONOTONIC);
+	cpu = now(CLOCK_THREAD_CPUTIME_ID);
+	while (sent < packets) {
+		// Stay within what the receive buffer holds; give up on lost packets
+		wait = now(CLOCK_MONOTONIC);
+		while (sent - __atomic_load_n(&s.received, __ATOMIC_ACQUIRE) >= WINDOW &&
+			   now(CLOCK_MONOTONIC) - wait < 0.02) {
+			sched_yield();
+		}
+		if (oscnet_sendv(tx, ptrs, sizes, BATCH) != BATCH) {
+			break;
+		}
+		sent += BATCH;
+	}
+	cpu = now(CLOCK_THREAD_CPUTIME_ID) - cpu;
+	pthread_join(thread, NULL);
+	t = now(CLOCK_MONOTONIC) - t;
+
+	printf("    %-4s %-4s %-9s %8.2f  %8.0f  %8.0f  %8.1f  %7.2f%%\n",
+		   txflags ? "gso" : "-", rxflags ? "gro" : "-",
+		   (on & (OSCNET_GSO | OSCNET_GRO)) == (txflags | rxflags) ? "on" : "missing",
+		   s.received / t * 1e-6, cpu / sent * 1e9, s.cpu / s.received * 1e9,
+		   s.calls ? (double)s.received / s.calls : 0.0,
+		   100.0 * (sent - s.received) / sent);
+	oscnet_close(tx);
+	oscnet_close(s.net);
+}
+
+int main (int argc, char* const argv[])
+{
+	static const int modes[4][2] = {
+		{0, 0}, {OSCNET_GSO, 0}, {0, OSCNET_GRO}, {OSCNET_GSO, OSCNET_GRO}
+	};
+	const char* port = "17383";
+	oscnet_t* tcp;
+	int i, packets = 2000000;
+
+	if (argc > 1 && argv[1][0] == '-') {
+		printf(usage);
+		return 0;
+	}
+	if (argc > 1) packets = atoi(argv[1]);
+	if (argc > 2) port = argv[2];
+	if (packets < BATCH) {
+		printf(usage);
+		return 0;
+	}
+	packets -= packets % BATCH;
+
+	for (i = 0; i < 4; ++i) {
+		check(port, modes[i][0], modes[i][1]);
+	}
+	if ((tcp = oscnet_listen(NULL, port, "tcp")) != NULL) {
+		expect(oscnet_offload(tcp, OSCNET_GSO) == -1, "tcp has no offload");
+		oscnet_close(tcp);
+	}
+
+	printf("oscoffloadtest: %d meter messages of 28 bytes over loopback udp\n", packets);
+	printf("    send recv kernel    Mpkt/s    send ns   recv ns   per call  lost\n");
+	for (i = 0; i < 4; ++i) {
+		bench(port, modes[i][0], modes[i][1], packets);
+	}
+	printf("checks:\n");
+	return osctest_report();
+}
@@ -0,0 +1,158 @@
+/******************************************************************************
+ *  oscpacetest
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *  Sends runs of packets in one oscnet_sendv() call through oscnet_pace() to
+ *  a loopback UDP receiver, limited in packets per second, in bytes per
+ *  second and with a burst after the endpoint was idle, and checks that the
+ *  send takes as long as the rate allows, that the kernel receive times are
+ *  spread the same way and that only the packets beyond the burst waited.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "oscnet.h"
+#include "../oscpack/osctest.h"
+
+const char usage[] = "usage: oscpacetest [port]\n";
+
+#define PACKETS 100
+#define SLACK 0.0001		// a paced send may go this much early (seconds)
+#define LATE 0.05			// scheduling delay allowed on a loaded host
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+struct run {
+	double elapsed;			// seconds oscnet_sendv() took
+	double span;			// seconds from the first to the last arrival
+	int early;				// packets that arrived within 1 ms of the first
+	int received;
+	oscnet_pacestats_t stats;
+};
+
+// Sends count packets of size bytes at once and receives them
+static void run(const char* port, double packets, double bytes, int32_t burst_us,
+				int count, int32_t size, struct run* r)
+{
+	static uint8_t bufs[PACKETS][1024], in[PACKETS][1024];
+	uint8_t* ptrs[PACKETS];
+	int32_t sizes[PACKETS];
+	oscnet_msg_t msgs[PACKETS];
+	oscnet_t *rx, *tx;
+	uint64_t first = 0, last = 0;
+	double t;
+	int i, n;
+
+	memset(r, 0, sizeof(*r));
+	if ((rx = oscnet_listen(NULL, port, "udp")) == NULL ||
+		(tx = oscnet_connect("127.0.0.1", port, "udp")) == NULL) {
+		osctest_errors++;
+		return;
+	}
+	expect(oscnet_timestamps(rx, 1) == 0, "kernel receive times");
+	for (i = 0; i < count; ++i) {
+		memset(bufs[i], i, size);
+		ptrs[i] = bufs[i];
+		sizes[i] = size;
+		msgs[i].buf = in[i];
+		msgs[i].bufsize = sizeof(in[i]);
+	}
+
+	oscnet_pace(tx, packets, bytes, burst_us, 0);
+	// Idle long enough to earn the whole burst
+	t = now() + burst_us * 2e-6;
+	while (now() < t)
+		;
+	t = now();
+	expect(oscnet_sendv(tx, ptrs, sizes, count) == count, "sends every packet");
+	r->elapsed = now() - t;
+	oscnet_pacestats(tx, &r->stats);
+
+	while (r->received < count &&
+		   (n = oscnet_recvmsgs(rx, msgs, count - r->received, 500)) > 0) {
+		for (i = 0; i < n; ++i) {
+			if (r->received + i == 0) {
+				first = msgs[i].stamp_ns;
+			}
+			last = msgs[i].stamp_ns;
+			r->early += msgs[i].stamp_ns <= first + 1000000;
+		}
+		r->received += n;
+	}
+	r->span = (last - first) * 1e-9;
+	oscnet_close(tx);
+	oscnet_close(rx);
+}
+
+// True if seconds is at least what the rate needs, and not much more
+static int paced(double seconds, double expected)
+{
+	return seconds >= expected - SLACK && seconds <= expected * 1.5 + LATE;
+}
+
+int main (int argc, char* const argv[])
+{
+	const char* port = "7791";
+	struct run r;
+
+	if (argc > 2 || (argc > 1 && argv[1][0] == '-')) {
+		printf(usage);
+		return 1;
+	}
+	if (argc > 1) port = argv[1];
+
+	printf("checks:\n");
+
+	// 1000 packets per second, every packet spaced 1 ms
+	run(port, 1000.0, 0.0, 0, PACKETS, 32, &r);
+	printf("    %d packets at 1000/s: %.1f ms, arrivals over %.1f ms\n",
+		   PACKETS, r.elapsed * 1e3, r.span * 1e3);
+	expect(r.received == PACKETS, "every packet arrives");
+	expect(paced(r.elapsed, (PACKETS - 1) * 1e-3), "the send takes 1 ms a packet");
+	expect(paced(r.span, (PACKETS - 1) * 1e-3), "the arrivals are 1 ms apart");
+	expect(r.stats.packets == PACKETS && r.stats.delayed == PACKETS - 1,
+		   "every packet but the first waits");
+
+	// 200 KB per second of 1000-byte packets, one every 5 ms
+	run(port, 0.0, 200000.0, 0, 40, 1000, &r);
+	printf("    40 packets of 1000 bytes at 200000 bytes/s: %.1f ms, "
+		   "arrivals over %.1f ms\n", r.elapsed * 1e3, r.span * 1e3);
+	expect(r.received == 40, "every packet arrives");
+	expect(paced(r.elapsed, 39 * 5e-3), "the send takes 5 ms a packet");
+	expect(paced(r.span, 39 * 5e-3), "the arrivals are 5 ms apart");
+
+	// 1000 packets per second with 20 ms of burst: 21 packets go at once,
+	// then the rest 1 ms apart
+	run(port, 1000.0, 0.0, 20000, PACKETS, 32, &r);
+	printf("    %d packets at 1000/s with 20 ms burst: %.1f ms, %d at once\n",
+		   PACKETS, r.elapsed * 1e3, r.early);
+	expect(r.received == PACKETS, "every packet arrives");
+	expect(paced(r.elapsed, (PACKETS - 21) * 1e-3), "the burst shortens the send");
+	expect(r.early >= 21 && r.early <= 22, "the burst goes out at once");
+	expect(r.stats.delayed == PACKETS - 21, "only packets beyond the burst wait");
+
+	return osctest_report();
+}
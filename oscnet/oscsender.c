@@ -0,0 +1,680 @@
+/******************************************************************************
+ *  oscsender
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE		// ppoll
+#endif
+
+#include "oscsender.h"
+#include "../oscpack/oscpack.h"
+#include "../oscmetrics/oscmetrics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+// Empty polls of the queue before the I/O thread goes to sleep
+#define SPINS 2000
+
+// No reservation open
+#define NONE UINT64_MAX
+
+// Bytes of a lower lane sent before the higher lanes are looked at again
+#define CHUNK 16384
+
+// Lower lanes wait while a stream socket holds more than this unsent, so
+// that an urgent packet is not queued in the kernel behind a whole snapshot;
+// they are looked at again after THROTTLE nanoseconds or the next publish.
+#define INFLIGHT 65536
+#define THROTTLE 50000
+
+struct ring;
+
+// A published packet; nodes live in the buffer of the thread that wrote them
+// and are linked into the queue in place.
+struct node {
+	struct node* next;
+	struct ring* ring;
+	uint64_t end;			// position in the ring after this packet
+	uint64_t stamp;			// CLOCK_MONOTONIC nanoseconds when published
+	int32_t size;
+	int32_t pad;
+	uint8_t data[];
+};
+
+// The buffer of one producer thread on one lane. Positions only grow; a packet at
+// position p is at buf + p % cap, and one that would cross the end of the
+// buffer starts at the next multiple of cap instead.
+struct ring {
+	uint64_t head;			// end of the last published packet
+	uint64_t open;			// position of the open reservation, or NONE
+	int32_t reserved;		// its size
+	uint64_t published;		// packets published
+	uint8_t* buf;
+	int32_t cap;
+	int active;				// a thread owns it
+	struct ring* next;
+
+	// Written by the I/O thread only
+	uint64_t tail __attribute__((aligned(64)));		// space before it is free
+	uint64_t sent;			// packets handed to the transport
+};
+
+// What a thread that sends keeps: its lane and a ring for each lane it used
+struct producer {
+	oscsender_t* owner;
+	int lane;
+	struct ring* rings[OSCSENDER_LANES];
+	struct producer* next;
+};
+
+// The queue of one lane
+struct lane {
+	// Producers exchange the newest node in
+	struct node* head __attribute__((aligned(64)));
+	uint64_t drops;
+
+	// Only the I/O thread writes below here
+	struct node* tail __attribute__((aligned(64)));
+	struct node stub;
+	uint64_t packets;
+	uint64_t bytes;
+	uint64_t delay;			// nanoseconds from publish to send, summed
+	uint64_t max_delay;
+};
+
+struct oscsender {
+	oscnet_t* net;
+	int32_t bufsize;
+	pthread_key_t key;
+	int wake[2];			// pipe the I/O thread sleeps on
+	int sleeping;
+	int stop;
+	int stream;				// TCP or unix stream endpoint
+	pthread_t thread;
+	pthread_mutex_t lock;	// guards rings and producers
+	struct ring* rings;
+	struct producer* producers;
+	uint64_t wakeups;
+	uint64_t batches;		// written by the I/O thread only
+	uint64_t errors;
+
+	struct lane lanes[OSCSENDER_LANES];
+};
+
+static uint64_t nanoseconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Intrusive multi-producer single-consumer queue (D. Vyukov). A push is one
+// atomic exchange; a node whose predecessor is not linked yet stays invisible
+// to pop() until it is.
+static void push(struct lane* l, struct node* n)
+{
+	struct node* prev;
+
+	__atomic_store_n(&n->next, NULL, __ATOMIC_RELAXED);
+	prev = __atomic_exchange_n(&l->head, n, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&prev->next, n, __ATOMIC_RELEASE);
+}
+
+static struct node* pop(struct lane* l)
+{
+	struct node* tail = l->tail;
+	struct node* next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+	if (tail == &l->stub) {
+		if (next == NULL) {
+			return NULL;
+		}
+		l->tail = tail = next;
+		next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+	}
+	if (next) {
+		l->tail = next;
+		return tail;
+	}
+	if (tail != __atomic_load_n(&l->head, __ATOMIC_ACQUIRE)) {
+		return NULL;		// a push is half done
+	}
+	// tail is the last node; put the stub behind it so it can be taken
+	push(l, &l->stub);
+	next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	if (next) {
+		l->tail = next;
+		return tail;
+	}
+	return NULL;
+}
+
+// Nothing queued on the lane and no push in progress
+static int empty(struct lane* l)
+{
+	return l->tail == &l->stub && __atomic_load_n(&l->head, __ATOMIC_SEQ_CST) == &l->stub;
+}
+
+static int idle(oscsender_t* s)
+{
+	int i;
+
+	for (i = 0; i < OSCSENDER_LANES; ++i) {
+		if (!empty(&s->lanes[i])) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void wake(oscsender_t* s)
+{
+	char c = 0;
+
+	if (__atomic_load_n(&s->sleeping, __ATOMIC_SEQ_CST) &&
+		__atomic_exchange_n(&s->sleeping, 0, __ATOMIC_SEQ_CST)) {
+		__atomic_add_fetch(&s->wakeups, 1, __ATOMIC_RELAXED);
+		if (write(s->wake[1], &c, 1) == -1 && errno != EAGAIN) {
+			perror("oscsender: write");
+		}
+	}
+}
+
+// Sleeps until a producer publishes, or for at most ns nanoseconds while the
+// lower lanes are held back (ns > 0)
+static void snooze(oscsender_t* s, long ns)
+{
+	struct pollfd pfd;
+	struct timespec ts = {0, ns};
+	char c[64];
+
+	pfd.fd = s->wake[0];
+	pfd.events = POLLIN;
+	__atomic_store_n(&s->sleeping, 1, __ATOMIC_SEQ_CST);
+	// A producer that published before the store above did not see it
+	if ((ns > 0 ? empty(&s->lanes[0]) : idle(s)) &&
+		!__atomic_load_n(&s->stop, __ATOMIC_ACQUIRE)) {
+		ppoll(&pfd, 1, ns > 0 ? &ts : NULL, NULL);
+	}
+	while (read(s->wake[0], c, sizeof(c)) > 0)
+		;
+	__atomic_store_n(&s->sleeping, 0, __ATOMIC_SEQ_CST);
+}
+
+// Sends a batch of one lane and gives the space back to the producers. The
+// nodes must not be touched once their tail is stored.
+static void deliver(oscsender_t* s, struct lane* l, struct node** nodes, uint8_t** bufs,
+					int32_t* sizes, int n)
+{
+	struct ring* r;
+	uint64_t bytes = 0, delay = 0, max = l->max_delay, end, t;
+	int i, sent;
+
+	sent = oscnet_sendv(s->net, bufs, sizes, n);
+	t = nanoseconds();
+	for (i = 0; i < n; ++i) {
+		bytes += sizes[i];
+		if (t - nodes[i]->stamp > max) {
+			max = t - nodes[i]->stamp;
+		}
+		delay += t - nodes[i]->stamp;
+		r = nodes[i]->ring;
+		end = nodes[i]->end;
+		__atomic_store_n(&r->tail, end, __ATOMIC_RELEASE);
+		__atomic_store_n(&r->sent, r->sent + 1, __ATOMIC_RELEASE);
+	}
+	__atomic_store_n(&s->batches, s->batches + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&l->packets, l->packets + n, __ATOMIC_RELAXED);
+	__atomic_store_n(&l->bytes, l->bytes + bytes, __ATOMIC_RELAXED);
+	__atomic_store_n(&l->delay, l->delay + delay, __ATOMIC_RELAXED);
+	__atomic_store_n(&l->max_delay, max, __ATOMIC_RELAXED);
+	if (sent < n) {
+		__atomic_store_n(&s->errors, s->errors + (sent < 0 ? n : n - sent),
+						 __ATOMIC_RELAXED);
+	}
+}
+
+// Takes a batch off the most urgent lane that has packets. Lane 0 gives a
+// full batch; lower lanes stop after CHUNK bytes so that a large writev()
+// of bulk packets cannot hold up the next urgent one for long. Sets held
+// when lower lanes were skipped because the socket is full.
+static int take(oscsender_t* s, struct lane** l, struct node** nodes, uint8_t** bufs,
+				int32_t* sizes, int* held)
+{
+	int32_t bytes;
+	int i, n;
+
+	*held = 0;
+	for (i = 0; i < OSCSENDER_LANES; ++i) {
+		*l = &s->lanes[i];
+		if (i == 1 && s->stream && !idle(s) && oscnet_unsent(s->net) > INFLIGHT) {
+			*held = 1;
+			return 0;
+		}
+		for (n = 0, bytes = 0; n < OSCSENDER_BATCH && (i == 0 || bytes < CHUNK) &&
+			 (nodes[n] = pop(*l)) != NULL; ++n) {
+			bufs[n] = nodes[n]->data;
+			sizes[n] = nodes[n]->size;
+			bytes += sizes[n];
+		}
+		if (n > 0) {
+			return n;
+		}
+	}
+	return 0;
+}
+
+static void* run(void* arg)
+{
+	oscsender_t* s = (oscsender_t*)arg;
+	struct node* nodes[OSCSENDER_BATCH];
+	uint8_t* bufs[OSCSENDER_BATCH];
+	int32_t sizes[OSCSENDER_BATCH];
+	struct lane* l;
+	int n, held, spins = 0;
+
+	for (;;) {
+		if ((n = take(s, &l, nodes, bufs, sizes, &held)) > 0) {
+			deliver(s, l, nodes, bufs, sizes, n);
+			spins = 0;
+		}
+		else if (held) {
+			snooze(s, THROTTLE);
+		}
+		else if (!idle(s)) {
+			sched_yield();		// let the producer finish its push
+		}
+		else if (__atomic_load_n(&s->stop, __ATOMIC_ACQUIRE)) {
+			break;
+		}
+		else if (++spins >= SPINS) {
+			snooze(s, 0);
+			spins = 0;
+		}
+	}
+	return NULL;
+}
+
+// The rings are kept for the next threads that send; their packets may still
+// be queued.
+static void detach(void* arg)
+{
+	struct producer* p = (struct producer*)arg;
+	struct producer** at;
+	int i;
+
+	pthread_mutex_lock(&p->owner->lock);
+	for (i = 0; i < OSCSENDER_LANES; ++i) {
+		if (p->rings[i]) {
+			p->rings[i]->open = NONE;
+			p->rings[i]->active = 0;
+		}
+	}
+	for (at = &p->owner->producers; *at != p; at = &(*at)->next)
+		;
+	*at = p->next;
+	pthread_mutex_unlock(&p->owner->lock);
+	free(p);
+}
+
+static struct producer* producer(oscsender_t* s)
+{
+	struct producer* p = (struct producer*)pthread_getspecific(s->key);
+
+	if (p == NULL) {
+		if ((p = (struct producer*)calloc(1, sizeof(struct producer))) == NULL) {
+			fprintf(stderr, "oscsender: Critical memory error...\n");
+			return NULL;
+		}
+		p->owner = s;
+		pthread_mutex_lock(&s->lock);
+		p->next = s->producers;
+		s->producers = p;
+		pthread_mutex_unlock(&s->lock);
+		pthread_setspecific(s->key, p);
+	}
+	return p;
+}
+
+// A ring that is free, or a new one, for the calling thread's current lane
+static struct ring* attach(oscsender_t* s, struct producer* prod)
+{
+	struct ring* r;
+	void* p;
+
+	pthread_mutex_lock(&s->lock);
+	for (r = s->rings; r != NULL; r = r->next) {
+		if (!r->active && __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == r->head) {
+			break;
+		}
+	}
+	if (r == NULL) {
+		if (posix_memalign(&p, 64, sizeof(struct ring)) != 0) {
+			pthread_mutex_unlock(&s->lock);
+			fprintf(stderr, "oscsender: Critical memory error...\n");
+			return NULL;
+		}
+		r = (struct ring*)p;
+		memset(r, 0, sizeof(*r));
+		if (posix_memalign(&p, 64, s->bufsize) != 0) {
+			free(r);
+			pthread_mutex_unlock(&s->lock);
+			fprintf(stderr, "oscsender: Critical memory error...\n");
+			return NULL;
+		}
+		r->buf = (uint8_t*)p;
+		r->cap = s->bufsize;
+		r->next = s->rings;
+		s->rings = r;
+	}
+	r->open = NONE;
+	r->active = 1;
+	pthread_mutex_unlock(&s->lock);
+
+	prod->rings[prod->lane] = r;
+	return r;
+}
+
+oscsender_t* oscsender_new(oscnet_t* net, int32_t bufsize)
+{
+	oscsender_t* s;
+	void* p;
+	int i;
+
+	if (bufsize <= 0) {
+		bufsize = OSCSENDER_BUFFER;
+	}
+	// Nodes stay 8-byte aligned and at least a 64 KB packet fits
+	bufsize = (bufsize + 7) & ~7;
+	if (net == NULL || bufsize < 2 * ((int32_t)sizeof(struct node) + 65536)) {
+		fprintf(stderr, "oscsender: buffer of %d bytes is too small\n", bufsize);
+		return NULL;
+	}
+	if (posix_memalign(&p, 64, sizeof(oscsender_t)) != 0) {
+		fprintf(stderr, "oscsender: Critical memory error...\n");
+		return NULL;
+	}
+	s = (oscsender_t*)p;
+	memset(s, 0, sizeof(*s));
+	s->net = net;
+	s->bufsize = bufsize;
+	s->stream = oscnet_type(net) == OSCNET_TCP || oscnet_type(net) == OSCNET_UNIX;
+	for (i = 0; i < OSCSENDER_LANES; ++i) {
+		s->lanes[i].head = s->lanes[i].tail = &s->lanes[i].stub;
+	}
+
+	if (pipe(s->wake) == -1) {
+		perror("oscsender: pipe");
+		free(s);
+		return NULL;
+	}
+	for (i = 0; i < 2; ++i) {
+		fcntl(s->wake[i], F_SETFL, fcntl(s->wake[i], F_GETFL) | O_NONBLOCK);
+		fcntl(s->wake[i], F_SETFD, FD_CLOEXEC);
+	}
+	pthread_mutex_init(&s->lock, NULL);
+	if (pthread_key_create(&s->key, detach) != 0) {
+		fprintf(stderr, "oscsender: no thread-specific key left\n");
+		close(s->wake[0]);
+		close(s->wake[1]);
+		free(s);
+		return NULL;
+	}
+	if (pthread_create(&s->thread, NULL, run, s) != 0) {
+		fprintf(stderr, "oscsender: could not start the I/O thread\n");
+		pthread_key_delete(s->key);
+		close(s->wake[0]);
+		close(s->wake[1]);
+		free(s);
+		return NULL;
+	}
+	return s;
+}
+
+int oscsender_lane(oscsender_t* s, int lane)
+{
+	struct producer* p = producer(s);
+	struct ring* r;
+	int prev;
+
+	if (p == NULL || lane < 0 || lane >= OSCSENDER_LANES) {
+		return -1;
+	}
+	r = p->rings[p->lane];
+	if (r && r->open != NONE) {
+		return -1;
+	}
+	prev = p->lane;
+	p->lane = lane;
+	return prev;
+}
+
+uint8_t* oscsender_reserve(oscsender_t* s, int32_t size)
+{
+	struct producer* p = producer(s);
+	struct ring* r = p ? p->rings[p->lane] : NULL;
+	struct node* n;
+	uint64_t pos;
+	int32_t need;
+
+	if (r == NULL && (p == NULL || (r = attach(s, p)) == NULL)) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	need = ((int32_t)sizeof(struct node) + size + 7) & ~7;
+	if (size < 0 || need > r->cap / 2) {
+		errno = EMSGSIZE;
+		return NULL;
+	}
+	pos = r->head;
+	if (pos % r->cap + need > (uint64_t)r->cap) {
+		pos += r->cap - pos % r->cap;
+	}
+	if (pos + need - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) > (uint64_t)r->cap) {
+		__atomic_add_fetch(&s->lanes[p->lane].drops, 1, __ATOMIC_RELAXED);
+		OSCMETRICS_ADD(OSCMETRICS_DROPS, 1);
+		errno = EAGAIN;
+		return NULL;
+	}
+	n = (struct node*)(r->buf + pos % r->cap);
+	r->open = pos;
+	r->reserved = size;
+	return n->data;
+}
+
+int32_t oscsender_commit(oscsender_t* s, int32_t len)
+{
+	struct producer* p = (struct producer*)pthread_getspecific(s->key);
+	struct ring* r = p ? p->rings[p->lane] : NULL;
+	struct node* n;
+
+	if (r == NULL || r->open == NONE || len < 0 || len > r->reserved) {
+		return -1;
+	}
+	n = (struct node*)(r->buf + r->open % r->cap);
+	n->ring = r;
+	n->stamp = nanoseconds();
+	n->size = len;
+	n->end = r->open + (((int32_t)sizeof(struct node) + len + 7) & ~7);
+	r->head = n->end;
+	r->open = NONE;
+	__atomic_store_n(&r->published, r->published + 1, __ATOMIC_RELAXED);
+
+	push(&s->lanes[p->lane], n);
+	wake(s);
+	return len;
+}
+
+int32_t oscsender_pack(oscsender_t* s, const char* addr, const char* format, ...)
+{
+	va_list ap;
+	uint8_t* buf;
+	int32_t size;
+
+	va_start(ap, format);
+	if ((size = voscsize(addr, format, ap)) < 0) {
+		errno = EINVAL;
+	}
+	else if ((buf = oscsender_reserve(s, size)) == NULL) {
+		size = -1;
+	}
+	else {
+		size = oscsender_commit(s, voscpack(buf, addr, format, ap));
+	}
+	va_end(ap);
+	return size;
+}
+
+int32_t oscsender_pack_addr(oscsender_t* s, const oscaddr_t* addr, const char* format,
+							...)
+{
+	va_list ap;
+	uint8_t* buf;
+	int32_t size;
+
+	va_start(ap, format);
+	if ((size = voscsize_addr(addr, format, ap)) < 0) {
+		errno = EINVAL;
+	}
+	else if ((buf = oscsender_reserve(s, size)) == NULL) {
+		size = -1;
+	}
+	else {
+		size = oscsender_commit(s, voscpack_addr(buf, addr, format, ap));
+	}
+	va_end(ap);
+	return size;
+}
+
+int32_t oscsender_send(oscsender_t* s, const uint8_t* buf, int32_t size)
+{
+	uint8_t* p;
+
+	if ((p = oscsender_reserve(s, size)) == NULL) {
+		return -1;
+	}
+	memcpy(p, buf, size);
+	return oscsender_commit(s, size);
+}
+
+int oscsender_flush(oscsender_t* s, int32_t timeout_ms)
+{
+	struct producer* p = (struct producer*)pthread_getspecific(s->key);
+	struct ring* r;
+	struct timespec ts = {0, 50000};
+	int64_t waited = 0;
+	int i;
+
+	if (p == NULL) {
+		return 0;
+	}
+	for (i = 0; i < OSCSENDER_LANES; ++i) {
+		if ((r = p->rings[i]) == NULL) {
+			continue;
+		}
+		while (__atomic_load_n(&r->sent, __ATOMIC_ACQUIRE) < r->published) {
+			if (timeout_ms >= 0 && waited >= (int64_t)timeout_ms * 1000000) {
+				return -1;
+			}
+			nanosleep(&ts, NULL);
+			waited += ts.tv_nsec;
+		}
+	}
+	return 0;
+}
+
+void oscsender_stats(oscsender_t* s, oscsender_stats_t* stats)
+{
+	struct producer* p;
+	int i, k;
+
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < OSCSENDER_LANES; ++i) {
+		stats->packets += __atomic_load_n(&s->lanes[i].packets, __ATOMIC_RELAXED);
+		stats->bytes += __atomic_load_n(&s->lanes[i].bytes, __ATOMIC_RELAXED);
+		stats->drops += __atomic_load_n(&s->lanes[i].drops, __ATOMIC_RELAXED);
+	}
+	stats->batches = __atomic_load_n(&s->batches, __ATOMIC_RELAXED);
+	stats->errors = __atomic_load_n(&s->errors, __ATOMIC_RELAXED);
+	stats->wakeups = __atomic_load_n(&s->wakeups, __ATOMIC_RELAXED);
+	// A thread that sent on several lanes holds a ring for each
+	pthread_mutex_lock(&s->lock);
+	for (p = s->producers; p != NULL; p = p->next) {
+		for (k = 0; k < OSCSENDER_LANES && !p->rings[k]; ++k)
+			;
+		stats->producers += k < OSCSENDER_LANES;
+	}
+	pthread_mutex_unlock(&s->lock);
+}
+
+int oscsender_lane_stats(oscsender_t* s, int lane, oscsender_lane_stats_t* stats)
+{
+	struct lane* l;
+
+	if (lane < 0 || lane >= OSCSENDER_LANES) {
+		return -1;
+	}
+	l = &s->lanes[lane];
+	stats->packets = __atomic_load_n(&l->packets, __ATOMIC_RELAXED);
+	stats->bytes = __atomic_load_n(&l->bytes, __ATOMIC_RELAXED);
+	stats->drops = __atomic_load_n(&l->drops, __ATOMIC_RELAXED);
+	stats->delay = __atomic_load_n(&l->delay, __ATOMIC_RELAXED);
+	stats->max_delay = __atomic_load_n(&l->max_delay, __ATOMIC_RELAXED);
+	return 0;
+}
+
+void oscsender_free(oscsender_t* s)
+{
+	struct producer* p;
+	struct ring* r;
+	char c = 0;
+
+	if (s == NULL) {
+		return;
+	}
+	__atomic_store_n(&s->stop, 1, __ATOMIC_RELEASE);
+	if (write(s->wake[1], &c, 1) == -1 && errno != EAGAIN) {
+		perror("oscsender: write");
+	}
+	pthread_join(s->thread, NULL);
+
+	pthread_key_delete(s->key);
+	while ((p = s->producers) != NULL) {
+		s->producers = p->next;
+		free(p);
+	}
+	while ((r = s->rings) != NULL) {
+		s->rings = r->next;
+		free(r->buf);
+		free(r);
+	}
+	pthread_mutex_destroy(&s->lock);
+	close(s->wake[0]);
+	close(s->wake[1]);
+	free(s);
+}
@@ -0,0 +1,200 @@
+/******************************************************************************
+ *  oscsender
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#ifndef __OSC_SENDER_H__
+#define __OSC_SENDER_H__
+
+#include <stdint.h>
+
+#include "oscnet.h"
+#include "../oscpack/oscintern.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ *	oscsender lets any number of threads send through one oscnet endpoint
+ *	without sharing a lock or making a system call. Each thread that sends
+ *	gets its own buffer for each lane it sends on, encodes its packets straight
+ *	into it and publishes them to a lock-free multi-producer queue. A single
+ *	I/O thread takes the packets off the queue in the order they were
+ *	published and sends them in batches with oscnet_sendv() (one sendmmsg()
+ *	or writev() per batch), then hands the space back to the thread that
+ *	wrote them.
+ *
+ *	A producer never waits for the socket. When its buffer is full because
+ *	the I/O thread cannot keep up, the packet is refused: the call returns -1
+ *	with errno set to EAGAIN and the packet is counted as a drop, like a full
+ *	UDP socket buffer. Packets of one thread are sent in the order that
+ *	thread published them.
+ *
+ *	Packets go out on one of OSCSENDER_LANES lanes, each with its own queue.
+ *	The I/O thread always sends what is waiting on lane 0 first and takes
+ *	lower lanes in chunks of a few kilobytes, looking at the higher lanes
+ *	again after each, so a cue published during a large snapshot waits for
+ *	at most one chunk instead of the whole snapshot. Over TCP this also keeps
+ *	each writev() of bulk packets short.
+ *
+ *	The I/O thread only sleeps when the queues stay empty, and producers
+ *	only wake it (one write() to a pipe) when it is asleep.
+ *
+ *
+ *	Usage example:
+ *		oscnet_t* net = oscnet_connect("10.0.0.11", "7374", "udp");
+ *		oscsender_t* s = oscsender_new(net, 0);
+ *
+ *		// from any thread
+ *		oscsender_pack(s, "/mixer/ch/1/gain", "f", 0.5);
+ *
+ *		// from the thread that sends a snapshot
+ *		oscsender_lane(s, 1);
+ *		for (...)
+ *			oscsender_pack(s, addr, "f", value);
+ *
+ *		oscsender_free(s);		// sends what is queued, then stops
+ *		oscnet_close(net);
+ */
+
+// Buffer of each producer thread unless oscsender_new() is given one
+#define OSCSENDER_BUFFER (1 << 20)
+
+// Most packets the I/O thread sends with one call
+#define OSCSENDER_BATCH 64
+
+// Lanes, 0 being the most urgent
+#define OSCSENDER_LANES 4
+
+typedef struct oscsender oscsender_t;
+
+/*
+ *	oscsender_new() starts the I/O thread of net. net must stay open until
+ *	oscsender_free() and should not be sent on by anything else meanwhile.
+ *
+ *	Arguments:
+ *		oscnet_t* net: Connected endpoint to send to.
+ *		int32_t bufsize: Bytes of each buffer (one per thread and lane), or
+ *						 0 for OSCSENDER_BUFFER. A packet larger than about
+ *						 half of it cannot be sent.
+ *
+ *	Return:
+ *		Sender, or NULL on error (printed to stderr).
+ */
+oscsender_t* oscsender_new(oscnet_t* net, int32_t bufsize);
+
+/*
+ *	oscsender_pack() encodes a message as oscpack() does into the calling
+ *	thread's buffer for its lane and publishes it.
+ *
+ *	Return:
+ *		Size of the message, or -1 if the format is invalid (EINVAL), the
+ *		message is too large (EMSGSIZE) or the buffer is full (EAGAIN).
+ */
+int32_t oscsender_pack(oscsender_t* s, const char* addr, const char* format, ...);
+
+/* oscsender_pack() for an address interned with oscintern(). */
+int32_t oscsender_pack_addr(oscsender_t* s, const oscaddr_t* addr, const char* format,
+							...);
+
+/* oscsender_pack() for a packet that is already encoded; it is copied. */
+int32_t oscsender_send(oscsender_t* s, const uint8_t* buf, int32_t size);
+
+/*
+ *	oscsender_lane() sends the calling thread's next packets on lane. A
+ *	thread starts on lane 0. Packets of one thread on one lane are sent in
+ *	order; packets on different lanes are not.
+ *
+ *	Return:
+ *		The previous lane, or -1 if lane is out of range or a reservation
+ *		is open.
+ */
+int oscsender_lane(oscsender_t* s, int lane);
+
+/*
+ *	oscsender_reserve() and oscsender_commit() let a producer encode a packet
+ *	of at most size bytes in place, with any encoder, then publish the first
+ *	len bytes of it. The space is the calling thread's own and stays valid
+ *	until the commit; a thread has at most one reservation open.
+ *
+ *	Return:
+ *		oscsender_reserve(): Space for the packet, or NULL as for
+ *		oscsender_pack().
+ *		oscsender_commit(): len, or -1 if there is no reservation or len is
+ *		larger than it.
+ *
+ *	Usage example:
+ *		uint8_t* p = oscsender_reserve(s, 512);
+ *		if (p) oscsender_commit(s, oscpack(p, "/cue/go", "i", 12));
+ */
+uint8_t* oscsender_reserve(oscsender_t* s, int32_t size);
+int32_t oscsender_commit(oscsender_t* s, int32_t len);
+
+/*
+ *	oscsender_flush() waits until every packet the calling thread published
+ *	before the call has been handed to the transport, or until timeout_ms
+ *	milliseconds have passed (-1 waits for ever).
+ *
+ *	Return:
+ *		0 when flushed or -1 on timeout.
+ */
+int oscsender_flush(oscsender_t* s, int32_t timeout_ms);
+
+typedef struct {
+	uint64_t packets;		// packets handed to the transport
+	uint64_t bytes;			// their bytes
+	uint64_t batches;		// send calls made by the I/O thread
+	uint64_t errors;		// packets the transport refused
+	uint64_t drops;			// packets refused because a buffer was full
+	uint64_t wakeups;		// times a producer woke the I/O thread
+	int32_t producers;		// live threads that have sent, whatever their lanes
+} oscsender_stats_t;
+
+/* Counters since oscsender_new(); may be read from any thread. */
+void oscsender_stats(oscsender_t* s, oscsender_stats_t* stats);
+
+typedef struct {
+	uint64_t packets;		// packets handed to the transport
+	uint64_t bytes;			// their bytes
+	uint64_t drops;			// packets refused because a buffer was full
+	uint64_t delay;			// nanoseconds from publish to send, summed
+	uint64_t max_delay;		// longest of them
+} oscsender_lane_stats_t;
+
+/*
+ *	oscsender_lane_stats() reads the counters of one lane. delay / packets
+ *	is the mean time a packet of the lane waited in its queue.
+ *
+ *	Return:
+ *		0, or -1 if there is no such lane.
+ */
+int oscsender_lane_stats(oscsender_t* s, int lane, oscsender_lane_stats_t* stats);
+
+/*
+ *	oscsender_free() sends everything published so far, stops the I/O thread
+ *	and frees the buffers. net is not closed. No thread may use s during or
+ *	after the call.
+ */
+void oscsender_free(oscsender_t* s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __OSC_SENDER_H__
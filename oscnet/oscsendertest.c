@@ -0,0 +1,424 @@
+/******************************************************************************
+ *  oscsendertest
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *
+ *  Several threads send numbered messages through one oscsender over a unix
+ *  datagram socket, and the receiver checks that none is lost and each
+ *  thread's messages arrive in order. Then 1 to 32 threads send to a UDP
+ *  port nobody reads, through oscsender and through one endpoint behind a
+ *  mutex. Prints the wall time per message, the time a producer spends in
+ *  each call that sends, and the send calls the I/O thread made. Last, one
+ *  thread sends a 100k-message snapshot over TCP while another sends a cue
+ *  every millisecond, first on one lane and then with the snapshot on a
+ *  lower lane, and prints how late the cues arrived and how long each lane
+ *  waited in the sender.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "oscsender.h"
+#include "../oscpack/oscpack.h"
+
+const char usage[] = "usage: oscsendertest [messages] [threads]\n";
+
+#define CHECK_THREADS 4
+#define CHECK_MESSAGES 5000
+#define SNAPSHOT 100000
+#define LINK 40e6				// bytes per second the receiver reads
+
+struct producer {
+	pthread_t thread;
+	int id;
+	int count;
+	oscsender_t* sender;		// NULL sends through net under lock
+	oscnet_t* net;
+	pthread_mutex_t* lock;
+	uint64_t full;				// tries refused for lack of space
+	double seconds;				// time spent in the calls that sent
+};
+
+static const oscaddr_t* address;
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void* produce(void* arg)
+{
+	struct producer* p = (struct producer*)arg;
+	uint8_t buf[64];
+	int32_t size;
+	double t;
+	int i;
+
+	// A refused call is retried after a yield and only the call that got
+	// through is timed, so the time is what a producer waits per message
+	for (i = 0; i < p->count; ++i) {
+		if (p->sender) {
+			t = now();
+			while (oscsender_pack_addr(p->sender, address, "ii", p->id, i) == -1) {
+				p->full++;
+				sched_yield();
+				t = now();
+			}
+		}
+		else {
+			t = now();
+			size = oscpack_addr(buf, address, "ii", p->id, i);
+			pthread_mutex_lock(p->lock);
+			oscnet_send(p->net, buf, size);
+			pthread_mutex_unlock(p->lock);
+		}
+		p->seconds += now() - t;
+	}
+	if (p->sender) {
+		oscsender_flush(p->sender, -1);
+	}
+	return NULL;
+}
+
+static int check(void)
+{
+	char path[64];
+	oscnet_t* rx;
+	oscnet_t* tx;
+	oscsender_t* s;
+	oscsender_stats_t st;
+	struct producer p[CHECK_THREADS];
+	int next[CHECK_THREADS];
+	uint8_t buf[64];
+	uint32_t be;
+	int32_t id, seq;
+	int i, received = 0, errors = 0;
+
+	snprintf(path, sizeof(path), "unixdgram:/tmp/oscsendertest.%d", (int)getpid());
+	if ((rx = oscnet_listen(path, NULL, NULL)) == NULL ||
+		(tx = oscnet_connect(path, NULL, NULL)) == NULL ||
+		(s = oscsender_new(tx, 0)) == NULL) {
+		return 1;
+	}
+	for (i = 0; i < CHECK_THREADS; ++i) {
+		memset(&p[i], 0, sizeof(p[i]));
+		p[i].id = i;
+		p[i].count = CHECK_MESSAGES;
+		p[i].sender = s;
+		next[i] = 0;
+		pthread_create(&p[i].thread, NULL, produce, &p[i]);
+	}
+	// The message is the address followed by ",ii\0" and the two integers
+	while (received < CHECK_THREADS * CHECK_MESSAGES &&
+		   oscnet_recv(rx, buf, sizeof(buf), 2000) == address->size + 12) {
+		memcpy(&be, buf + address->size + 4, 4);
+		id = (int32_t)ntohl(be);
+		memcpy(&be, buf + address->size + 8, 4);
+		seq = (int32_t)ntohl(be);
+		if (id < 0 || id >= CHECK_THREADS || seq != next[id]++) {
+			errors++;
+		}
+		received++;
+	}
+	for (i = 0; i < CHECK_THREADS; ++i) {
+		pthread_join(p[i].thread, NULL);
+	}
+
+	// Threads that exited no longer count, and one that sends on two lanes
+	// counts once
+	oscsender_stats(s, &st);
+	errors += st.producers != 0;
+	oscsender_lane(s, 0);
+	oscsender_pack_addr(s, address, "ii", CHECK_THREADS, 0);
+	oscsender_lane(s, 1);
+	oscsender_pack_addr(s, address, "ii", CHECK_THREADS, 1);
+	oscsender_stats(s, &st);
+	errors += st.producers != 1;
+	oscsender_free(s);
+	oscnet_close(tx);
+	oscnet_close(rx);
+	unlink(path + 10);
+
+	printf("oscsendertest: %d threads sent %d messages, %d received: %s\n",
+		   CHECK_THREADS, CHECK_THREADS * CHECK_MESSAGES, received,
+		   errors || received != CHECK_THREADS * CHECK_MESSAGES ? "MISMATCH" : "in order");
+	return errors || received != CHECK_THREADS * CHECK_MESSAGES;
+}
+
+// Sends messages from nthreads threads and prints one line of the table
+static void bench(oscnet_t* net, int nthreads, int messages, int locked)
+{
+	struct producer* p;
+	pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+	oscsender_t* s = NULL;
+	oscsender_stats_t st;
+	uint64_t full = 0;
+	double t, busy = 0;
+	int i;
+
+	p = (struct producer*)calloc(nthreads, sizeof(struct producer));
+	if (!p || (!locked && (s = oscsender_new(net, 0)) == NULL)) {
+		fprintf(stderr, "oscsendertest: Critical memory error...\n");
+		exit(1);
+	}
+	t = now();
+	for (i = 0; i < nthreads; ++i) {
+		p[i].id = i;
+		p[i].count = messages / nthreads;
+		p[i].sender = s;
+		p[i].net = net;
+		p[i].lock = &lock;
+		pthread_create(&p[i].thread, NULL, produce, &p[i]);
+	}
+	for (i = 0; i < nthreads; ++i) {
+		pthread_join(p[i].thread, NULL);
+		busy += p[i].seconds;
+		full += p[i].full;
+	}
+	t = now() - t;
+
+	messages = messages / nthreads * nthreads;
+	printf("    %2d  %-9s %8.0f  %8.0f", nthreads, locked ? "mutex" : "oscsender",
+		   t / messages * 1e9, busy / messages * 1e9);
+	if (s) {
+		oscsender_stats(s, &st);
+		printf("  %8llu  %6.1f  %llu\n", (unsigned long long)st.batches,
+			   (double)st.packets / st.batches, (unsigned long long)full);
+		oscsender_free(s);
+	}
+	else {
+		printf("  %8d  %6.1f  -\n", messages, 1.0);
+	}
+	free(p);
+}
+
+// Reads the TCP stream itself at LINK bytes per second, like the far end of
+// a slow link, and with a small receive buffer so that, as on such a link,
+// the backlog builds up on the sending side
+struct receiver {
+	pthread_t thread;
+	int fd;
+	int stop;
+	int snapshot;			// snapshot messages received
+	int cues;
+	double late;			// seconds from publishing a cue to receiving it
+	double max_late;
+};
+
+static void* receive(void* arg)
+{
+	struct receiver* r = (struct receiver*)arg;
+	uint8_t buf[65536];
+	const uint8_t* p;
+	uint32_t be, hi, lo;
+	int32_t size, len = 0, off;
+	ssize_t n;
+	double late, start, bytes = 0;
+	struct timespec ts;
+	int fd;
+
+	if ((fd = accept(r->fd, NULL, NULL)) == -1) {
+		perror("oscsendertest: accept");
+		return NULL;
+	}
+	start = now();
+	while ((n = read(fd, buf + len, sizeof(buf) - len)) > 0) {
+		bytes += n;
+		if ((late = start + bytes / LINK - now()) > 0) {
+			ts.tv_sec = 0;
+			ts.tv_nsec = (long)(late * 1e9);
+			nanosleep(&ts, NULL);
+		}
+		len += (int32_t)n;
+		for (off = 0; len - off >= 4; off += 4 + size) {
+			memcpy(&be, buf + off, 4);
+			size = (int32_t)ntohl(be);
+			if (len - off < 4 + size) {
+				break;
+			}
+			p = buf + off + 4;
+			// "/cue/go\0" ",h\0\0" and the stamp
+			if (size == 20 && memcmp(p, "/cue", 4) == 0) {
+				memcpy(&hi, p + 12, 4);
+				memcpy(&lo, p + 16, 4);
+				late = now() - (((uint64_t)ntohl(hi) << 32) | ntohl(lo)) * 1e-9;
+				r->late += late;
+				if (late > r->max_late) {
+					r->max_late = late;
+				}
+				r->cues++;
+			}
+			else {
+				r->snapshot++;
+			}
+		}
+		memmove(buf, buf + off, len - off);
+		len -= off;
+	}
+	close(fd);
+	return NULL;
+}
+
+static int snapshot_lane, snapshot_done;
+
+static void* snapshot(void* arg)
+{
+	oscsender_t* s = (oscsender_t*)arg;
+	char addr[32];
+	int i;
+
+	oscsender_lane(s, snapshot_lane);
+	for (i = 0; i < SNAPSHOT; ++i) {
+		snprintf(addr, sizeof(addr), "/snap/%d/value", i);
+		while (oscsender_pack(s, addr, "f", i * 0.5f) == -1) {
+			sched_yield();
+		}
+	}
+	oscsender_flush(s, -1);
+	__atomic_store_n(&snapshot_done, 1, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+// A snapshot and cues over TCP, with the snapshot on lane bulk; returns the
+// number of messages that did not arrive
+static int lanes(int bulk)
+{
+	struct receiver r;
+	struct sockaddr_in sin;
+	socklen_t len = sizeof(sin);
+	oscnet_t* tx;
+	oscsender_t* s;
+	oscsender_lane_stats_t st[2];
+	pthread_t thread;
+	struct timespec ms = {0, 1000000};
+	char port[16];
+	int rcvbuf = 32768, cues = 0;
+	double t;
+
+	memset(&r, 0, sizeof(r));
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if ((r.fd = socket(AF_INET, SOCK_STREAM, 0)) == -1 ||
+		setsockopt(r.fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) == -1 ||
+		bind(r.fd, (struct sockaddr*)&sin, sizeof(sin)) == -1 ||
+		listen(r.fd, 1) == -1 ||
+		getsockname(r.fd, (struct sockaddr*)&sin, &len) == -1) {
+		perror("oscsendertest: socket");
+		return 1;
+	}
+	snprintf(port, sizeof(port), "%d", ntohs(sin.sin_port));
+	pthread_create(&r.thread, NULL, receive, &r);
+	if ((tx = oscnet_connect("127.0.0.1", port, "tcp")) == NULL ||
+		(s = oscsender_new(tx, 0)) == NULL) {
+		return 1;
+	}
+
+	t = now();
+	snapshot_lane = bulk;
+	snapshot_done = 0;
+	pthread_create(&thread, NULL, snapshot, s);
+	while (!__atomic_load_n(&snapshot_done, __ATOMIC_ACQUIRE)) {
+		nanosleep(&ms, NULL);
+		oscsender_pack(s, "/cue/go", "h", (int64_t)(now() * 1e9));
+		cues++;
+	}
+	t = now() - t;
+	pthread_join(thread, NULL);
+	oscsender_flush(s, -1);
+
+	oscsender_lane_stats(s, 0, &st[0]);
+	oscsender_lane_stats(s, 1, &st[1]);
+	oscsender_free(s);
+	oscnet_close(tx);
+	pthread_join(r.thread, NULL);
+	close(r.fd);
+
+	printf("    %-6s  %8.1f  %5d  %8.3f  %8.3f  %8.3f  %8.3f  %8.3f\n",
+		   bulk ? "lanes" : "fifo", t * 1e3, cues, r.late / (r.cues ? r.cues : 1) * 1e3,
+		   r.max_late * 1e3, st[0].delay / (st[0].packets ? st[0].packets : 1) * 1e-6,
+		   st[0].max_delay * 1e-6, st[1].max_delay * 1e-6);
+	return (SNAPSHOT - r.snapshot) + (cues - r.cues);
+}
+
+int main (int argc, char* const argv[])
+{
+	struct sockaddr_in sin;
+	socklen_t len = sizeof(sin);
+	oscnet_t* net;
+	char port[16];
+	int fd, n, messages = 200000, threads = 32, errors;
+
+	if (argc > 1 && argv[1][0] == '-') {
+		printf(usage);
+		return 0;
+	}
+	if (argc > 1) messages = atoi(argv[1]);
+	if (argc > 2) threads = atoi(argv[2]);
+	if (messages < 1 || threads < 1) {
+		printf(usage);
+		return 0;
+	}
+	address = oscintern("/engine/voice/level");
+
+	errors = check();
+
+	// A bound socket that is never read; the kernel drops what overflows it
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) == -1 ||
+		bind(fd, (struct sockaddr*)&sin, sizeof(sin)) == -1 ||
+		getsockname(fd, (struct sockaddr*)&sin, &len) == -1) {
+		perror("oscsendertest: socket");
+		return 1;
+	}
+	snprintf(port, sizeof(port), "%d", ntohs(sin.sin_port));
+	if ((net = oscnet_connect("127.0.0.1", port, "udp")) == NULL) {
+		return 1;
+	}
+
+	printf("oscsendertest: %d messages over udp, ns per message\n", messages);
+	printf("    threads  wall      call      sends     batch   full\n");
+	for (n = 1; n <= threads; n *= 2) {
+		bench(net, n, messages, 1);
+		bench(net, n, messages, 0);
+	}
+
+	oscnet_close(net);
+	close(fd);
+
+	printf("oscsendertest: %d-message snapshot and a cue per ms over tcp, ms\n",
+		   SNAPSHOT);
+	printf("    queues  snapshot  cues   cue mean  cue max   lane 0    lane 0    lane 1\n");
+	printf("                                                  mean      max       max\n");
+	n = lanes(0) + lanes(1);
+	printf("    %s\n", n ? "MISMATCH: messages lost" : "all messages received");
+	return errors || n;
+}
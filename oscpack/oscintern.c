@@ -0,0 +1,121 @@
+/******************************************************************************
+ *  oscintern
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#include "oscintern.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+// Buckets of the table; chains stay short up to a few times this many
+#define BUCKETS 16384
+
+// Entries are only ever added at the head of a chain and never change once
+// published, so readers walk the chains without a lock.
+struct entry {
+	oscaddr_t a;
+	struct entry* next;
+	char addr[];
+};
+
+static struct entry* buckets[BUCKETS];
+static int32_t count;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+uint32_t oscintern_hash(const char* addr, int32_t len)
+{
+	uint32_t h = 2166136261u;
+	int32_t i;
+
+	for (i = 0; i < len; ++i) {
+		h = (h ^ (uint8_t)addr[i]) * 16777619u;
+	}
+	return h;
+}
+
+static const oscaddr_t* find(const char* addr, int32_t len, uint32_t h)
+{
+	struct entry* e;
+
+	for (e = __atomic_load_n(&buckets[h % BUCKETS], __ATOMIC_ACQUIRE); e != NULL;
+		 e = e->next) {
+		if (e->a.hash == h && e->a.len == len && memcmp(e->addr, addr, len) == 0) {
+			return &e->a;
+		}
+	}
+	return NULL;
+}
+
+const oscaddr_t* oscintern_find(const char* addr, int32_t len)
+{
+	return find(addr, len, oscintern_hash(addr, len));
+}
+
+const oscaddr_t* oscintern_len(const char* addr, int32_t len)
+{
+	const oscaddr_t* a;
+	struct entry* e;
+	uint32_t h;
+	int32_t size;
+
+	if (len < 1 || addr[0] != '/' || memchr(addr, '\0', len) != NULL) {
+		return NULL;
+	}
+	h = oscintern_hash(addr, len);
+	if ((a = find(addr, len, h)) != NULL) {
+		return a;
+	}
+
+	pthread_mutex_lock(&lock);
+	// Another thread may have added it while we waited
+	if ((a = find(addr, len, h)) != NULL || count == OSCINTERN_MAX) {
+		pthread_mutex_unlock(&lock);
+		return a;
+	}
+	size = (len + 4) & ~3;
+	if ((e = (struct entry*)malloc(sizeof(struct entry) + size)) == NULL) {
+		pthread_mutex_unlock(&lock);
+		fprintf(stderr, "oscintern: Critical memory error...\n");
+		return NULL;
+	}
+	memcpy(e->addr, addr, len);
+	memset(e->addr + len, 0, size - len);
+	e->a.addr = e->addr;
+	e->a.len = len;
+	e->a.size = size;
+	e->a.hash = h;
+	e->a.id = count;
+	e->next = buckets[h % BUCKETS];
+	__atomic_store_n(&buckets[h % BUCKETS], e, __ATOMIC_RELEASE);
+	__atomic_store_n(&count, count + 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&lock);
+	return &e->a;
+}
+
+const oscaddr_t* oscintern(const char* addr)
+{
+	return oscintern_len(addr, (int32_t)strlen(addr));
+}
+
+int32_t oscintern_count(void)
+{
+	return __atomic_load_n(&count, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,83 @@
+/******************************************************************************
+ *  oscintern
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#ifndef __OSC_INTERN_H__
+#define __OSC_INTERN_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ *	oscintern turns an OSC address into a handle once, so code that sends or
+ *	looks up the same addresses over and over does not measure, pad and hash
+ *	them every time. A handle holds the address already padded with zeros to
+ *	a multiple of 4 bytes, ready to be copied into a packet, its length and
+ *	its FNV-1a hash (the hash oscroute and oscmetrics use).
+ *
+ *	Handles live until the program exits and never move. oscintern_find() and
+ *	the handles themselves may be used from any number of threads without a
+ *	lock and never allocate; oscintern() takes a lock only to add an address
+ *	it has not seen.
+ *
+ *	Usage example:
+ *		const oscaddr_t* gain = oscintern("/mixer/ch/1/gain");
+ *		size = oscpack_addr(buf, gain, "f", 0.5);
+ */
+
+// Most addresses the table holds; oscintern() returns NULL beyond it
+#define OSCINTERN_MAX 65536
+
+typedef struct {
+	const char* addr;		// address padded with '\0' to size bytes
+	int32_t len;			// strlen(addr)
+	int32_t size;			// padded size, a multiple of 4
+	uint32_t hash;			// oscintern_hash(addr, len)
+	int32_t id;				// 0, 1, 2, ... in the order interned
+} oscaddr_t;
+
+/*
+ *	oscintern() returns the handle of addr, adding it on first use.
+ *
+ *	Return:
+ *		Handle, or NULL if addr does not start with '/', the table is full
+ *		or out of memory.
+ */
+const oscaddr_t* oscintern(const char* addr);
+
+/* oscintern() for an address of len bytes that need not be terminated. */
+const oscaddr_t* oscintern_len(const char* addr, int32_t len);
+
+/* Handle of an address already interned, or NULL. Never allocates. */
+const oscaddr_t* oscintern_find(const char* addr, int32_t len);
+
+/* Number of addresses interned so far; ids are below it. */
+int32_t oscintern_count(void);
+
+/* FNV-1a hash of len bytes of addr. */
+uint32_t oscintern_hash(const char* addr, int32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __OSC_INTERN_H__
@@ -0,0 +1,150 @@
+/******************************************************************************
+ *  oscinterntest
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *
+ *  Threads intern the same addresses at once and must get the same handles.
+ *  Then checks that oscpack_addr() and oscsize() agree with oscpack() and
+ *  prints the encode time with a C string and with an interned address.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "oscpack.h"
+#include "oscintern.h"
+
+const char usage[] = "usage: oscinterntest [addresses] [threads]\n";
+
+static int addresses = 1000;
+static const oscaddr_t** handles;
+
+static void name(char* addr, size_t size, int i)
+{
+	snprintf(addr, size, "/mixer/ch/%d/eq/band/%d/gain", i / 4, i % 4);
+}
+
+// Every thread interns every address, each starting at a different one
+static void* internloop(void* arg)
+{
+	char addr[64];
+	const oscaddr_t* a;
+	int i, k, start = (int)(long)arg * 37, bad = 0;
+
+	for (k = 0; k < addresses; ++k) {
+		i = (start + k) % addresses;
+		name(addr, sizeof(addr), i);
+		a = oscintern(addr);
+		if (!__sync_bool_compare_and_swap(&handles[i], NULL, a) && handles[i] != a) {
+			bad++;
+		}
+	}
+	return (void*)(long)bad;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main (int argc, char* const argv[])
+{
+	pthread_t* threads;
+	uint8_t a[256], b[256];
+	char addr[64];
+	const oscaddr_t* h;
+	double t, tstr, taddr;
+	void* rv;
+	int i, k, n, rounds = 200, nthreads = 4, errors = 0;
+
+	if (argc > 1 && argv[1][0] == '-') {
+		printf(usage);
+		return 0;
+	}
+	if (argc > 1) addresses = atoi(argv[1]);
+	if (argc > 2) nthreads = atoi(argv[2]);
+	if (addresses < 1 || addresses > OSCINTERN_MAX || nthreads < 1) {
+		printf(usage);
+		return 0;
+	}
+
+	handles = (const oscaddr_t**)calloc(addresses, sizeof(*handles));
+	threads = (pthread_t*)calloc(nthreads, sizeof(pthread_t));
+	if (!handles || !threads) {
+		fprintf(stderr, "oscinterntest: Critical memory error...\n");
+		return 1;
+	}
+	for (i = 0; i < nthreads; ++i) {
+		pthread_create(&threads[i], NULL, internloop, (void*)(long)i);
+	}
+	for (i = 0; i < nthreads; ++i) {
+		pthread_join(threads[i], &rv);
+		errors += (int)(long)rv;
+	}
+	if (oscintern_count() != addresses) {
+		errors++;
+	}
+
+	for (i = 0; i < addresses; ++i) {
+		name(addr, sizeof(addr), i);
+		h = handles[i];
+		if (!h || oscintern_find(addr, strlen(addr)) != h || h->size % 4 != 0 ||
+			strcmp(h->addr, addr) != 0 || h->hash != oscintern_hash(addr, strlen(addr))) {
+			errors++;
+			continue;
+		}
+		n = oscpack(a, addr, "ifs", i, 0.5, "text");
+		k = oscpack_addr(b, h, "ifs", i, 0.5, "text");
+		if (n != k || memcmp(a, b, n) != 0 || oscsize(addr, "ifs", i, 0.5, "text") != n ||
+			oscsize_addr(h, "ifs", i, 0.5, "text") != n) {
+			errors++;
+		}
+	}
+	if (oscintern("no/slash") != NULL || oscintern_find("/not/interned", 13) != NULL) {
+		errors++;
+	}
+
+	t = now();
+	for (k = 0; k < rounds; ++k) {
+		for (i = 0; i < addresses; ++i) {
+			oscpack(a, handles[i]->addr, "if", k, 0.5);
+		}
+	}
+	tstr = now() - t;
+	t = now();
+	for (k = 0; k < rounds; ++k) {
+		for (i = 0; i < addresses; ++i) {
+			oscpack_addr(a, handles[i], "if", k, 0.5);
+		}
+	}
+	taddr = now() - t;
+
+	printf("oscinterntest: %d addresses interned by %d threads: %s\n", addresses,
+		   nthreads, errors ? "MISMATCH" : "match");
+	printf("    oscpack():      %.1f ns per message\n", tstr / rounds / addresses * 1e9);
+	printf("    oscpack_addr(): %.1f ns per message\n", taddr / rounds / addresses * 1e9);
+
+	free(handles);
+	free(threads);
+	return errors ? 1 : 0;
+}
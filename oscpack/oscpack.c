@@ -19,37 +19,12 @@
  *
  ******************************************************************************/
 #include "oscpack.h"
+#include "../oscmetrics/oscmetrics.h"
+#include "../osccodec/osccodec.h"
 
 #include <string.h>
 #include <assert.h>
 
-#ifdef _WIN32
-#include <winsock2.h>
-#else
-#include <arpa/inet.h>
-#endif
-
-//	Network to Host 
-
-// Following ntohll() and htonll() code snipits were taken from
-// http://www.codeproject.com/KB/cpp/endianness.aspx?msg=1661457
-#define ntohll(x) (((int64_t)(ntohl((int32_t)((x << 32) >> 32))) << 32) | \
-(uint32_t)ntohl(((int32_t)(x >> 32)))) //By Runner
-//#define ntohf(x) (float)ntohl(x)
-inline double ntohf(int32_t x) { x = ntohl(x); return *(float*)&x; }
-//#define ntohd(x) (double)ntohll(x)
-inline double ntohd(int64_t x) { return (double)ntohll(x); }
-
-
-//	Host to Network
-
-#define htonll(x) ntohll(x)
-//#define htonf(x) (int32_t)htonl(*(int32_t*)&x)
-inline int32_t htonf(float x) { return (int32_t)htonl(*(int32_t*)&x); }
-//#define htond(x) (int64_t)htonll(*(int64_t*)&x)
-inline int64_t htond(double x) { return (int64_t)htonll(*(int64_t*)&x); }
-
-
 int32_t oscpack(uint8_t* buf, const char* addr, const char* format, ...)
 {
 	va_list ap;
@@ -62,12 +37,24 @@ int32_t oscpack(uint8_t* buf, const char* addr, const char* format, ...)
 	return size;
 }
 
-int32_t voscpack(uint8_t* buf, const char* addr, const char* format, va_list ap)
+int32_t oscpack_addr(uint8_t* buf, const oscaddr_t* addr, const char* format, ...)
+{
+	va_list ap;
+	int32_t size;
+	
+	va_start(ap, format);
+	size = voscpack_addr(buf, addr, format, ap);
+	va_end(ap);
+	
+	return size;
+}
+
+// Type tag and arguments of a message. Returns their size or -1 if format
+// has a type that is not supported.
+static int32_t packargs(uint8_t* buf, const char* format, va_list ap)
 {
 	int32_t size = 0, len;
 	char* str;
-	int32_t bit32;
-	int64_t bit64;
 	union {
 		char c;
 		char* cptr;
@@ -77,23 +64,6 @@ int32_t voscpack(uint8_t* buf, const char* addr, const char* format, va_list ap)
 		double d;
 	} bytes;
 	
-	// Make sure the address starts with '/'
-	if (addr && addr[0] != '/') {
-		return -1;
-	}
-	
-	// Copy the OSC address
-	len = strlen(addr);
-	memcpy(buf, addr, len);
-	size += len;
-	buf += len;
-	// Need to pad zero until 32-bit aligned.
-	if ((len = (4 - len % 4)) != 0) {
-		memset(buf, '\0', len);
-		size += len;
-		buf += len;
-	}
-	
 	// Length of type tag (+1 for ',')
 	len = strlen(format) + 1;
 	
@@ -136,8 +106,7 @@ int32_t voscpack(uint8_t* buf, const char* addr, const char* format, va_list ap)
 			case 'i':	// 32-bit integer
 				len = sizeof(int32_t);
 				bytes.i = va_arg(ap, int32_t);
-				bit32 = htonl(bytes.i);
-				memcpy(buf, (char*)&bit32, len);
+				oscstore32(buf, (uint32_t)bytes.i);
 				buf += len;
 				size += len;
 				break;
@@ -145,8 +114,7 @@ int32_t voscpack(uint8_t* buf, const char* addr, const char* format, va_list ap)
 			case 'h':	// 64-bit integer
 				len = sizeof(int64_t);
 				bytes.h = va_arg(ap, int64_t);
-				bit64 = htonll(bytes.h);
-				memcpy(buf, (char*)&bit64, len);
+				oscstore64(buf, (uint64_t)bytes.h);
 				buf += len;
 				size += len;
 				break;
@@ -154,8 +122,7 @@ int32_t voscpack(uint8_t* buf, const char* addr, const char* format, va_list ap)
 			case 'f':	// 32-bit float
 				len = sizeof(float);
 				bytes.f = (float)va_arg(ap, double);
-				bit32 = htonf(bytes.f);
-				memcpy(buf, (char*)&bit32, len);
+				oscstoref(buf, bytes.f);
 				buf += len;
 				size += len;
 				break;
@@ -163,8 +130,7 @@ int32_t voscpack(uint8_t* buf, const char* addr, const char* format, va_list ap)
 			case 'd':	// 64-bit float
 				len = sizeof(double);
 				bytes.d = va_arg(ap, double);
-				bit64 = htond(bytes.d);
-				memcpy(buf, (char*)&bit64, len);
+				oscstored(buf, bytes.d);
 				buf += len;
 				size += len;
 				break;
@@ -206,67 +172,96 @@ int32_t voscpack(uint8_t* buf, const char* addr, const char* format, va_list ap)
 		}
 	}
 	
-	assert(size % 4 == 0);
 	return size;
 }
 
-int32_t oscsize(const char* addr, const char* format, ...)
+int32_t voscpack(uint8_t* buf, const char* addr, const char* format, va_list ap)
 {
-	va_list ap;
-	int32_t size = 0, len;
-	char* str;
+	int32_t size, len, addrlen;
 	
 	// Make sure the address starts with '/'
 	if (addr && addr[0] != '/') {
+		OSCMETRICS_ADD(OSCMETRICS_ENCODE_ERRORS, 1);
 		return -1;
 	}
 	
-	// Length of OSC address
-	len = strlen(addr);
-	size = len + (4 - len % 4);
+	// Copy the OSC address
+	len = addrlen = strlen(addr);
+	memcpy(buf, addr, len);
+	size = len;
+	// Need to pad zero until 32-bit aligned.
+	if ((len = (4 - len % 4)) != 0) {
+		memset(buf + size, '\0', len);
+		size += len;
+	}
 	
-	// +1 for ',' in type tag)
-	size++;
+	if ((len = packargs(buf + size, format, ap)) == -1) {
+		OSCMETRICS_ADD(OSCMETRICS_ENCODE_ERRORS, 1);
+		return -1;
+	}
+	size += len;
+	
+	assert(size % 4 == 0);
+	OSCMETRICS_MESSAGE(addr, addrlen, size);
+	return size;
+}
+
+int32_t voscpack_addr(uint8_t* buf, const oscaddr_t* addr, const char* format, va_list ap)
+{
+	int32_t len;
+	
+	// The interned address is already padded
+	memcpy(buf, addr->addr, addr->size);
+	
+	if ((len = packargs(buf + addr->size, format, ap)) == -1) {
+		OSCMETRICS_ADD(OSCMETRICS_ENCODE_ERRORS, 1);
+		return -1;
+	}
+	
+	OSCMETRICS_MESSAGE_HASH(addr->addr, addr->len, addr->hash, addr->size + len);
+	return addr->size + len;
+}
+
+// Size of the type tag and arguments of a message, or -1
+static int32_t sizeargs(const char* format, va_list ap)
+{
+	int32_t size, len;
+	char* str;
+	
+	// Type tag: ',', the types and at least one '\0', padded
+	size = (int32_t)(strlen(format) + 1 + 4) & ~3;
 	
-	va_start(ap, format);
 	for (; *format != '\0'; ++format) {
 		switch (*format) {
 			case 'i':	// 32-bit integer
 				(void)va_arg(ap, int32_t);
-				size += 5;
-				size++;
+				size += 4;
 				break;
 			case 'h':	// 64-bit integer
 				(void)va_arg(ap, int64_t);
-				size += 5;
-				size++;
+				size += 8;
 				break;
 			case 'f':	// 32-bit float
 				(void)va_arg(ap, double);
-				size += 5;
-				size++;
+				size += 4;
 				break;
 			case 'd':	// 64-bit float
 				(void)va_arg(ap, double);
-				size += 5;
-				size++;
+				size += 8;
 				break;
 			case 'c':	// ascii character
 				(void)va_arg(ap, int);
-				size += 5;
-				size++;
+				size += 4;
 				break;
 			case 's':	// string (array of character)
 				str = va_arg(ap, char*);
 				len = strlen(str);
 				size += len + (4 - len % 4);
-				size++;
 				break;
 			case 'T':	// True
 			case 'F':	// False
 			case 'N':	// Nil
 			case 'I':	// Infinitum
-				size++;
 				break;
 			case 'b':	// blob
 			case 't':	// timetag
@@ -276,7 +271,62 @@ int32_t oscsize(const char* addr, const char* format, ...)
 				return -1;
 		}		
 	}
+	return size;
+}
+
+int32_t oscsize(const char* addr, const char* format, ...)
+{
+	va_list ap;
+	int32_t size;
+	
+	va_start(ap, format);
+	size = voscsize(addr, format, ap);
+	va_end(ap);
+	
+	return size;
+}
+
+int32_t voscsize(const char* addr, const char* format, va_list arg)
+{
+	va_list ap;
+	int32_t size, len;
+	
+	// Make sure the address starts with '/'
+	if (addr && addr[0] != '/') {
+		return -1;
+	}
+	
+	// Length of OSC address
+	len = strlen(addr);
+	
+	// sizeargs() consumes the arguments; leave arg for the caller to encode
+	va_copy(ap, arg);
+	size = sizeargs(format, ap);
+	va_end(ap);
+	
+	return size == -1 ? -1 : size + len + (4 - len % 4);
+}
+
+int32_t oscsize_addr(const oscaddr_t* addr, const char* format, ...)
+{
+	va_list ap;
+	int32_t size;
+	
+	va_start(ap, format);
+	size = voscsize_addr(addr, format, ap);
 	va_end(ap);
 	
 	return size;
 }
+
+int32_t voscsize_addr(const oscaddr_t* addr, const char* format, va_list arg)
+{
+	va_list ap;
+	int32_t size;
+	
+	va_copy(ap, arg);
+	size = sizeargs(format, ap);
+	va_end(ap);
+	
+	return size == -1 ? -1 : size + addr->size;
+}
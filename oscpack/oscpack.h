@@ -45,6 +45,8 @@
 
 #include <stdarg.h>
 
+#include "oscintern.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -119,6 +121,26 @@ int32_t voscpack(uint8_t* buf, const char* addr, const char* format, va_list arg
 
 int32_t oscsize(const char* addr, const char* format, ...);
 
+/* oscsize for a va_list; arg is left unread so it can be passed to voscpack */
+int32_t voscsize(const char* addr, const char* format, va_list arg);
+
+/*
+ *	oscpack_addr() and oscsize_addr() take an address interned with
+ *	oscintern(). The address is copied already padded instead of being
+ *	measured and padded on every call, and the metrics hooks reuse its hash.
+ *
+ *	Usage example:
+ *		static const oscaddr_t* fader;
+ *		if (!fader) fader = oscintern("/mixer/fader");
+ *		size = oscpack_addr(packet, fader, "if", 1, 0.5);
+ */
+
+int32_t oscpack_addr(uint8_t* buf, const oscaddr_t* addr, const char* format, ...);
+int32_t voscpack_addr(uint8_t* buf, const oscaddr_t* addr, const char* format,
+					  va_list arg);
+int32_t oscsize_addr(const oscaddr_t* addr, const char* format, ...);
+int32_t voscsize_addr(const oscaddr_t* addr, const char* format, va_list arg);
+
 #ifdef __cplusplus
 }
 #endif
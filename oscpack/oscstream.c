@@ -0,0 +1,582 @@
+/******************************************************************************
+ *  oscstream
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#include "oscstream.h"
+#include "../oscmetrics/oscmetrics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+struct oscstream {
+	int fd;					// -1 when writing to a callback
+	int socket;				// fd takes sendmsg(); cleared on ENOTSOCK
+	oscstream_write_fn write;
+	void* user;
+	uint8_t* buf;
+	int32_t cap;
+	int32_t len;			// bytes waiting in buf
+	int error;
+
+	// The message being written
+	const char* type;		// next type in the type tag, NULL between messages
+	int64_t left;			// argument bytes still to come
+	int32_t size;
+};
+
+static const uint8_t zeros[4] = {0, 0, 0, 0};
+
+oscblob_t oscblob_mem(const void* data, int32_t size)
+{
+	oscblob_t b;
+
+	memset(&b, 0, sizeof(b));
+	b.size = size;
+	b.data = (const uint8_t*)data;
+	b.fd = -1;
+	return b;
+}
+
+oscblob_t oscblob_fd(int fd, int32_t size)
+{
+	oscblob_t b = oscblob_mem(NULL, size);
+
+	b.fd = fd;
+	return b;
+}
+
+oscblob_t oscblob_fn(oscstream_read_fn read, void* user, int32_t size)
+{
+	oscblob_t b = oscblob_mem(NULL, size);
+
+	b.read = read;
+	b.user = user;
+	return b;
+}
+
+static oscstream_t* create(int fd, oscstream_write_fn write, void* user, int32_t bufsize)
+{
+	oscstream_t* st;
+
+	if (bufsize <= 0) {
+		bufsize = OSCSTREAM_BUFFER;
+	}
+	if (bufsize < 64) {
+		bufsize = 64;
+	}
+	st = (oscstream_t*)calloc(1, sizeof(oscstream_t));
+	if (st == NULL || (st->buf = (uint8_t*)malloc(bufsize)) == NULL) {
+		free(st);
+		fprintf(stderr, "oscstream: Critical memory error...\n");
+		return NULL;
+	}
+	st->fd = fd;
+	st->socket = 1;
+	st->write = write;
+	st->user = user;
+	st->cap = bufsize;
+	return st;
+}
+
+oscstream_t* oscstream_new(int fd, int32_t bufsize)
+{
+	return create(fd, NULL, NULL, bufsize);
+}
+
+oscstream_t* oscstream_new_fn(oscstream_write_fn write, void* user, int32_t bufsize)
+{
+	return create(-1, write, user, bufsize);
+}
+
+static int broken(oscstream_t* st)
+{
+	st->error = 1;
+	st->type = NULL;
+	OSCMETRICS_ADD(OSCMETRICS_ENCODE_ERRORS, 1);
+	return -1;
+}
+
+// Waits until a nonblocking descriptor takes more
+static int writable(int fd)
+{
+	struct pollfd pfd;
+
+	pfd.fd = fd;
+	pfd.events = POLLOUT;
+	return poll(&pfd, 1, -1) == -1 && errno != EINTR ? -1 : 0;
+}
+
+// Writes all of iov, resuming after partial writes
+static int out(oscstream_t* st, struct iovec* iov, int iovcnt)
+{
+	struct msghdr msg;
+	ssize_t n;
+	int32_t rv;
+
+	while (iovcnt > 0) {
+		if (iov->iov_len == 0) {
+			++iov;
+			--iovcnt;
+			continue;
+		}
+		if (st->fd == -1) {
+			if ((rv = st->write(st->user, (const uint8_t*)iov->iov_base,
+								(int32_t)iov->iov_len)) <= 0) {
+				return -1;
+			}
+			n = rv;
+		}
+		else {
+			if (st->socket) {
+				memset(&msg, 0, sizeof(msg));
+				msg.msg_iov = iov;
+				msg.msg_iovlen = iovcnt;
+				n = sendmsg(st->fd, &msg, MSG_NOSIGNAL);
+				if (n == -1 && errno == ENOTSOCK) {
+					st->socket = 0;
+					continue;
+				}
+			}
+			else {
+				n = writev(st->fd, iov, iovcnt);
+			}
+			if (n == -1) {
+				if (errno == EINTR) {
+					continue;
+				}
+				if ((errno == EAGAIN || errno == EWOULDBLOCK) && writable(st->fd) == 0) {
+					continue;
+				}
+				perror("oscstream: write");
+				return -1;
+			}
+		}
+		for (; iovcnt > 0 && (size_t)n >= iov->iov_len; ++iov, --iovcnt) {
+			n -= iov->iov_len;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = (uint8_t*)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+	return 0;
+}
+
+static int flush(oscstream_t* st)
+{
+	struct iovec iov;
+
+	if (st->len == 0) {
+		return 0;
+	}
+	iov.iov_base = st->buf;
+	iov.iov_len = st->len;
+	st->len = 0;
+	return out(st, &iov, 1);
+}
+
+// Copies into the buffer; what does not fit in a buffer is written from
+// where it is, together with what is buffered
+static int emit(oscstream_t* st, const void* data, int32_t len)
+{
+	struct iovec iov[2];
+	int32_t n;
+
+	if (len <= st->cap - st->len) {
+		memcpy(st->buf + st->len, data, len);
+		st->len += len;
+		return 0;
+	}
+	if (len < st->cap) {
+		n = st->cap - st->len;
+		memcpy(st->buf + st->len, data, n);
+		st->len = st->cap;
+		if (flush(st) == -1) {
+			return -1;
+		}
+		memcpy(st->buf, (const uint8_t*)data + n, len - n);
+		st->len = len - n;
+		return 0;
+	}
+	iov[0].iov_base = st->buf;
+	iov[0].iov_len = st->len;
+	iov[1].iov_base = (void*)data;
+	iov[1].iov_len = len;
+	st->len = 0;
+	return out(st, iov, 2);
+}
+
+int oscstream_flush(oscstream_t* st)
+{
+	if (st->error) {
+		return -1;
+	}
+	return flush(st) == -1 ? broken(st) : 0;
+}
+
+int oscstream_begin(oscstream_t* st, const char* addr, const char* format, int32_t argsize)
+{
+	const char* t;
+	int32_t addrlen = (int32_t)strlen(addr);
+	int64_t tlen = (int64_t)strlen(format) + 1;
+	int64_t size;
+	uint32_t be;
+
+	if (st->error) {
+		return -1;
+	}
+	if (st->type) {
+		return broken(st);		// the last message was not ended
+	}
+	for (t = format; *t != '\0'; ++t) {
+		if (strchr("ihfdscbTFNI", *t) == NULL) {
+			OSCMETRICS_ADD(OSCMETRICS_ENCODE_ERRORS, 1);
+			errno = EINVAL;
+			return -1;
+		}
+	}
+	size = ((addrlen + 4) & ~3) + ((tlen + 4) & ~3) + (int64_t)argsize;
+	if (argsize < 0 || size > INT32_MAX) {
+		OSCMETRICS_ADD(OSCMETRICS_ENCODE_ERRORS, 1);
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	be = htonl((uint32_t)size);
+	if (emit(st, &be, 4) == -1 ||
+		emit(st, addr, addrlen) == -1 ||
+		emit(st, zeros, 4 - addrlen % 4) == -1 ||
+		emit(st, ",", 1) == -1 ||
+		emit(st, format, (int32_t)(tlen - 1)) == -1 ||
+		emit(st, zeros, (int32_t)(4 - tlen % 4)) == -1) {
+		return broken(st);
+	}
+	st->type = format;
+	st->left = argsize;
+	st->size = (int32_t)size;
+	OSCMETRICS_MESSAGE(addr, addrlen, (int32_t)size);
+	return 0;
+}
+
+// Takes the next type of the message, which must be t, and len argument bytes
+static int next(oscstream_t* st, char t, int32_t len)
+{
+	if (st->error) {
+		return -1;
+	}
+	if (st->type == NULL) {
+		return broken(st);
+	}
+	while (*st->type == 'T' || *st->type == 'F' || *st->type == 'N' || *st->type == 'I') {
+		st->type++;
+	}
+	if (*st->type != t || st->left < len) {
+		return broken(st);
+	}
+	st->type++;
+	st->left -= len;
+	return 0;
+}
+
+static int put32(oscstream_t* st, char t, uint32_t v)
+{
+	uint32_t be = htonl(v);
+
+	if (next(st, t, 4) == -1) {
+		return -1;
+	}
+	return emit(st, &be, 4) == -1 ? broken(st) : 0;
+}
+
+static int put64(oscstream_t* st, char t, uint64_t v)
+{
+	uint32_t be[2];
+
+	be[0] = htonl((uint32_t)(v >> 32));
+	be[1] = htonl((uint32_t)v);
+	if (next(st, t, 8) == -1) {
+		return -1;
+	}
+	return emit(st, be, 8) == -1 ? broken(st) : 0;
+}
+
+int oscstream_int32(oscstream_t* st, int32_t i)
+{
+	return put32(st, 'i', (uint32_t)i);
+}
+
+int oscstream_int64(oscstream_t* st, int64_t h)
+{
+	return put64(st, 'h', (uint64_t)h);
+}
+
+int oscstream_float(oscstream_t* st, float f)
+{
+	uint32_t v;
+
+	memcpy(&v, &f, 4);
+	return put32(st, 'f', v);
+}
+
+int oscstream_double(oscstream_t* st, double d)
+{
+	uint64_t v;
+
+	memcpy(&v, &d, 8);
+	return put64(st, 'd', v);
+}
+
+int oscstream_char(oscstream_t* st, char c)
+{
+	uint8_t b[4] = {0, 0, 0, 0};
+
+	// The character first, as oscpack() writes it
+	b[0] = (uint8_t)c;
+	if (next(st, 'c', 4) == -1) {
+		return -1;
+	}
+	return emit(st, b, 4) == -1 ? broken(st) : 0;
+}
+
+int oscstream_string(oscstream_t* st, const char* s)
+{
+	int32_t len = (int32_t)strlen(s);
+
+	if (next(st, 's', (len + 4) & ~3) == -1) {
+		return -1;
+	}
+	if (emit(st, s, len) == -1 || emit(st, zeros, 4 - len % 4) == -1) {
+		return broken(st);
+	}
+	return 0;
+}
+
+// Reads a blob from its descriptor or callback straight into the buffer
+static int readblob(oscstream_t* st, const oscblob_t* b)
+{
+	int32_t left = b->size, want, n;
+
+#ifdef __linux__
+	// A regular file to a descriptor needs no copy through the buffer
+	if (b->read == NULL && st->fd != -1 && left > st->cap) {
+		ssize_t sent;
+
+		if (flush(st) == -1) {
+			return -1;
+		}
+		while (left > 0) {
+			sent = sendfile(st->fd, b->fd, NULL, left);
+			if (sent > 0) {
+				left -= (int32_t)sent;
+			}
+			else if (sent == -1 && errno == EINTR) {
+				continue;
+			}
+			else if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+				if (writable(st->fd) == -1) {
+					return -1;
+				}
+			}
+			else if (sent == -1 && left == b->size &&
+					 (errno == EINVAL || errno == ENOSYS || errno == EOVERFLOW)) {
+				break;			// not a file sendfile() can read; copy it
+			}
+			else {
+				if (sent == -1) {
+					perror("oscstream: sendfile");
+				}
+				return -1;
+			}
+		}
+	}
+#endif
+	while (left > 0) {
+		if (st->len == st->cap && flush(st) == -1) {
+			return -1;
+		}
+		want = st->cap - st->len < left ? st->cap - st->len : left;
+		if (b->read) {
+			n = b->read(b->user, st->buf + st->len, want);
+		}
+		else {
+			do {
+				n = (int32_t)read(b->fd, st->buf + st->len, want);
+			} while (n == -1 && errno == EINTR);
+		}
+		if (n <= 0) {
+			if (n == -1 && b->read == NULL) {
+				perror("oscstream: read");
+			}
+			return -1;
+		}
+		st->len += n;
+		left -= n;
+	}
+	return 0;
+}
+
+int oscstream_blob(oscstream_t* st, const oscblob_t* b)
+{
+	uint32_t be;
+
+	if (b->size < 0) {
+		return st->error ? -1 : broken(st);
+	}
+	if (next(st, 'b', 4 + ((b->size + 3) & ~3)) == -1) {
+		return -1;
+	}
+	be = htonl((uint32_t)b->size);
+	if (emit(st, &be, 4) == -1) {
+		return broken(st);
+	}
+	if (b->data ? emit(st, b->data, b->size) : readblob(st, b)) {
+		return broken(st);
+	}
+	return emit(st, zeros, (4 - b->size % 4) % 4) == -1 ? broken(st) : 0;
+}
+
+int32_t oscstream_end(oscstream_t* st)
+{
+	const char* t;
+
+	if (st->error) {
+		return -1;
+	}
+	if ((t = st->type) == NULL) {
+		return broken(st);
+	}
+	while (*t == 'T' || *t == 'F' || *t == 'N' || *t == 'I') {
+		++t;
+	}
+	if (*t != '\0' || st->left != 0) {
+		return broken(st);
+	}
+	st->type = NULL;
+	return st->size;
+}
+
+int32_t oscstream_pack(oscstream_t* st, const char* addr, const char* format, ...)
+{
+	va_list ap;
+	int32_t size;
+
+	va_start(ap, format);
+	size = voscstream_pack(st, addr, format, ap);
+	va_end(ap);
+	return size;
+}
+
+int32_t voscstream_pack(oscstream_t* st, const char* addr, const char* format, va_list arg)
+{
+	const oscblob_t* b;
+	const char* t;
+	int64_t argsize = 0;
+	va_list ap;
+	int rv = 0;
+
+	// Measure the arguments first for the size prefix
+	va_copy(ap, arg);
+	for (t = format; *t != '\0' && argsize >= 0; ++t) {
+		switch (*t) {
+			case 'i':
+			case 'c':
+				(void)va_arg(ap, int);
+				argsize += 4;
+				break;
+			case 'f':
+				(void)va_arg(ap, double);
+				argsize += 4;
+				break;
+			case 'h':
+				(void)va_arg(ap, int64_t);
+				argsize += 8;
+				break;
+			case 'd':
+				(void)va_arg(ap, double);
+				argsize += 8;
+				break;
+			case 's':
+				argsize += (strlen(va_arg(ap, const char*)) + 4) & ~3;
+				break;
+			case 'b':
+				b = va_arg(ap, const oscblob_t*);
+				argsize = b->size < 0 ? -1 : argsize + 4 + ((b->size + 3) & ~3);
+				break;
+		}
+	}
+	va_end(ap);
+	if (argsize > INT32_MAX) {
+		argsize = -1;
+	}
+	if (oscstream_begin(st, addr, format, (int32_t)argsize) == -1) {
+		return -1;
+	}
+
+	for (t = format; *t != '\0' && rv == 0; ++t) {
+		switch (*t) {
+			case 'i':
+				rv = oscstream_int32(st, va_arg(arg, int32_t));
+				break;
+			case 'h':
+				rv = oscstream_int64(st, va_arg(arg, int64_t));
+				break;
+			case 'f':
+				rv = oscstream_float(st, (float)va_arg(arg, double));
+				break;
+			case 'd':
+				rv = oscstream_double(st, va_arg(arg, double));
+				break;
+			case 'c':
+				rv = oscstream_char(st, (char)va_arg(arg, int));
+				break;
+			case 's':
+				rv = oscstream_string(st, va_arg(arg, const char*));
+				break;
+			case 'b':
+				rv = oscstream_blob(st, va_arg(arg, const oscblob_t*));
+				break;
+		}
+	}
+	return rv == 0 ? oscstream_end(st) : -1;
+}
+
+void oscstream_free(oscstream_t* st)
+{
+	if (st == NULL) {
+		return;
+	}
+	oscstream_flush(st);
+	free(st->buf);
+	free(st);
+}
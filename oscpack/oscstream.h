@@ -0,0 +1,156 @@
+/******************************************************************************
+ *  oscstream
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#ifndef __OSC_STREAM_H__
+#define __OSC_STREAM_H__
+
+#include <stdint.h>
+#include <stdarg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ *	oscstream writes OSC messages to a TCP stream without ever holding a
+ *	whole message in memory. The size of a message is worked out from its
+ *	arguments first and sent as the TCP size prefix; the address, type tag
+ *	and arguments then go out through one fixed buffer, which is written to
+ *	the socket each time it fills. Blobs can be read in pieces from a file
+ *	descriptor or a callback while they are sent, so a 200 MB blob costs the
+ *	buffer and nothing more. Large pieces that are already in memory (blobs,
+ *	a long type tag) are written straight from where they are, and a blob in
+ *	a regular file is sent with sendfile() where the system has it.
+ *
+ *	A stream writes to a file descriptor (a connected TCP socket, or any
+ *	other descriptor) or to a callback. Messages are written complete and
+ *	back to back with a 4-byte big-endian size in front of each, as OSC over
+ *	TCP expects; oscstream_flush() pushes out what is still buffered.
+ *
+ *	If a write or a blob source fails partway through a message, the stream
+ *	is left in an error state and every later call returns -1: the receiver
+ *	has part of a message and the connection should be closed.
+ *
+ *
+ *	Usage example:
+ *		oscstream_t* st = oscstream_new(sock, 0);
+ *		oscblob_t b = oscblob_fd(fd, size);		// size bytes read from fd
+ *		oscstream_pack(st, "/sample/load", "isb", 7, "kick.wav", &b);
+ *		oscstream_flush(st);
+ *		oscstream_free(st);
+ */
+
+// Buffer of a stream unless oscstream_new() is given one
+#define OSCSTREAM_BUFFER 65536
+
+typedef struct oscstream oscstream_t;
+
+/* Writes up to size bytes; returns how many, or -1 on error */
+typedef int32_t (*oscstream_write_fn)(void* user, const uint8_t* buf, int32_t size);
+
+/* Reads up to size bytes; returns how many, 0 at the end or -1 on error */
+typedef int32_t (*oscstream_read_fn)(void* user, uint8_t* buf, int32_t size);
+
+/*
+ *	Where the bytes of a blob come from. Use oscblob_mem(), oscblob_fd() or
+ *	oscblob_fn() to fill one in. A source that ends before size bytes is an
+ *	error.
+ */
+typedef struct {
+	int32_t size;
+	const uint8_t* data;	// blob in memory, or
+	int fd;					// descriptor to read it from (-1 if not), or
+	oscstream_read_fn read;	// callback to read it from
+	void* user;
+} oscblob_t;
+
+oscblob_t oscblob_mem(const void* data, int32_t size);
+oscblob_t oscblob_fd(int fd, int32_t size);
+oscblob_t oscblob_fn(oscstream_read_fn read, void* user, int32_t size);
+
+/*
+ *	oscstream_new() creates a stream that writes to fd, and
+ *	oscstream_new_fn() one that calls write.
+ *
+ *	Arguments:
+ *		int32_t bufsize: Bytes of the buffer, or 0 for OSCSTREAM_BUFFER.
+ *
+ *	Return:
+ *		Stream, or NULL on error.
+ */
+oscstream_t* oscstream_new(int fd, int32_t bufsize);
+oscstream_t* oscstream_new_fn(oscstream_write_fn write, void* user, int32_t bufsize);
+
+/*
+ *	oscstream_pack() writes a message like oscpack() does, and also takes
+ *	blobs: 'b' takes a const oscblob_t*.
+ *
+ *	Return:
+ *		Size of the message without the size prefix, or -1 if the format is
+ *		invalid or the message is 2 GB or more (nothing is written), or on
+ *		a write or read error (the stream is broken).
+ */
+int32_t oscstream_pack(oscstream_t* st, const char* addr, const char* format, ...);
+int32_t voscstream_pack(oscstream_t* st, const char* addr, const char* format, va_list arg);
+
+/*
+ *	oscstream_begin(), the oscstream_put functions and oscstream_end() write
+ *	a message one argument at a time, for argument lists too long to pass to
+ *	oscstream_pack(). Each put must match the next type in format; T, F, N
+ *	and I take no put.
+ *
+ *	Arguments:
+ *		int32_t argsize: Bytes the arguments take in the message: 4 for
+ *						 each i, f and c, 8 for each h and d, strlen + 1
+ *						 rounded up to a multiple of 4 for a string and
+ *						 4 + size rounded up to a multiple of 4 for a blob.
+ *
+ *	Return:
+ *		oscstream_begin() and puts: 0, or -1 on error.
+ *		oscstream_end(): size of the message, or -1 if the arguments did not
+ *		match format or argsize (the stream is broken).
+ *
+ *	Usage example:
+ *		oscstream_begin(st, "/wave", format, n * 4);	// format is n 'f's
+ *		for (i = 0; i < n; ++i)
+ *			oscstream_float(st, wave[i]);
+ *		oscstream_end(st);
+ */
+int oscstream_begin(oscstream_t* st, const char* addr, const char* format, int32_t argsize);
+int oscstream_int32(oscstream_t* st, int32_t i);
+int oscstream_int64(oscstream_t* st, int64_t h);
+int oscstream_float(oscstream_t* st, float f);
+int oscstream_double(oscstream_t* st, double d);
+int oscstream_char(oscstream_t* st, char c);
+int oscstream_string(oscstream_t* st, const char* s);
+int oscstream_blob(oscstream_t* st, const oscblob_t* b);
+int32_t oscstream_end(oscstream_t* st);
+
+/* Writes out what is buffered. Returns 0, or -1 on error. */
+int oscstream_flush(oscstream_t* st);
+
+/* Flushes the stream and frees it; the descriptor is not closed. */
+void oscstream_free(oscstream_t* st);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __OSC_STREAM_H__
@@ -0,0 +1,437 @@
+/******************************************************************************
+ *  oscstreamtest
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *
+ *  Checks that oscstream writes the same bytes as oscpack() with the TCP size
+ *  prefix, that blobs from memory, a file and a callback and a 100k-argument
+ *  message come back intact through oscunpack(), and that a message whose
+ *  arguments do not match breaks the stream. Then sends one large blob (200
+ *  MB by default) over loopback TCP: packed whole in memory and sent, and
+ *  through oscstream from a callback and from a file. Prints the throughput
+ *  of each next to memcpy() and how much the peak memory of the process grew.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include "oscstream.h"
+#include "oscpack.h"
+#include "oscunpack.h"
+#include "osctest.h"
+
+const char usage[] = "usage: oscstreamtest [megabytes]\n";
+
+#define ARGS 100000
+
+// A sink that keeps everything written to it
+struct memory {
+	uint8_t* data;
+	int32_t len;
+	int32_t cap;
+};
+
+static int32_t keep(void* user, const uint8_t* buf, int32_t size)
+{
+	struct memory* m = (struct memory*)user;
+
+	if (m->len + size > m->cap) {
+		m->cap = (m->len + size) * 2;
+		m->data = (uint8_t*)realloc(m->data, m->cap);
+	}
+	memcpy(m->data + m->len, buf, size);
+	m->len += size;
+	return size;
+}
+
+// The byte of a blob at offset i
+static uint8_t pattern(int64_t i)
+{
+	return (uint8_t)(i * 7 + (i >> 8));
+}
+
+struct source {
+	int64_t at;
+	int64_t end;		// fail with -1 at this offset
+};
+
+static int32_t generate(void* user, uint8_t* buf, int32_t size)
+{
+	struct source* src = (struct source*)user;
+	int32_t i;
+
+	if (src->at == src->end) {
+		return -1;
+	}
+	if (src->at + size > src->end) {
+		size = (int32_t)(src->end - src->at);
+	}
+	for (i = 0; i < size; ++i) {
+		buf[i] = pattern(src->at + i);
+	}
+	src->at += size;
+	return size;
+}
+
+// Faster source for the benchmark: the pattern repeats every 4096 bytes
+static int32_t repeat(void* user, uint8_t* buf, int32_t size)
+{
+	static uint8_t page[4096];
+	struct source* src = (struct source*)user;
+	int32_t off, n;
+
+	if (page[1] == 0) {
+		for (off = 0; off < 4096; ++off) {
+			page[off] = pattern(off);
+		}
+	}
+	for (off = 0; off < size; off += n) {
+		n = 4096 - (int32_t)((src->at + off) % 4096);
+		if (n > size - off) {
+			n = size - off;
+		}
+		memcpy(buf + off, page + (src->at + off) % 4096, n);
+	}
+	src->at += size;
+	return size;
+}
+
+static int blobok(const uint8_t* b, int32_t size)
+{
+	int32_t i;
+
+	for (i = 0; i < size; ++i) {
+		if (b[i] != pattern(i)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// The message of a stream, after checking its size prefix
+static int unpack(const struct memory* m, int32_t at, oscmsg_t* msg)
+{
+	uint32_t be;
+
+	memcpy(&be, m->data + at, 4);
+	return (int32_t)ntohl(be) == m->len - at - 4 &&
+		   oscunpack(m->data + at + 4, m->len - at - 4, msg) == 0;
+}
+
+static void check(void)
+{
+	struct memory m = {NULL, 0, 0};
+	oscstream_t* st;
+	oscblob_t b;
+	struct source src = {0, 1 << 30};
+	oscmsg_t msg;
+	oscargs_t it;
+	oscarg_t arg;
+	uint8_t packet[256], *data;
+	char path[] = "/tmp/oscstreamtest.XXXXXX";
+	char* format;
+	int32_t size, i;
+	int fd, ok;
+
+	// Same bytes as oscpack(), small buffer so every piece crosses it
+	st = oscstream_new_fn(keep, &m, 64);
+	size = oscpack(packet, "/mixer/ch/1/name", "ihfdscTFNI", 7, (int64_t)-3, 0.5f, 0.25,
+				   "lead vocal", 'x');
+	expect(oscstream_pack(st, "/mixer/ch/1/name", "ihfdscTFNI", 7, (int64_t)-3, 0.5f,
+						  0.25, "lead vocal", 'x') == size, "pack size");
+	oscstream_flush(st);
+	expect(m.len == size + 4 && memcmp(m.data + 4, packet, size) == 0, "same as oscpack");
+	expect(oscstream_pack(st, "/bad", "iq", 1, 2) == -1, "invalid format refused");
+	oscstream_free(st);
+
+	// Blobs from memory, a callback and a file, of sizes that need padding
+	data = (uint8_t*)malloc(1 << 20);
+	for (i = 0; i < 1 << 20; ++i) {
+		data[i] = pattern(i);
+	}
+	if ((fd = mkstemp(path)) == -1 || write(fd, data, (1 << 20) - 3) != (1 << 20) - 3) {
+		perror("oscstreamtest: temporary file");
+		exit(1);
+	}
+	lseek(fd, 0, SEEK_SET);
+	unlink(path);
+	st = oscstream_new_fn(keep, &m, 4096);
+	m.len = 0;
+	b = oscblob_mem(data, 1000001);
+	oscstream_pack(st, "/blob", "b", &b);
+	oscstream_flush(st);
+	ok = unpack(&m, 0, &msg);
+	oscargs(&msg, &it);
+	expect(ok && oscargs_next(&it, &arg) && arg.size == 1000001 && blobok(arg.b, arg.size),
+		   "memory blob");
+	m.len = 0;
+	b = oscblob_fn(generate, &src, 99999);
+	oscstream_pack(st, "/blob", "sbi", "name", &b, 42);
+	oscstream_flush(st);
+	ok = unpack(&m, 0, &msg);
+	oscargs(&msg, &it);
+	expect(ok && oscargs_next(&it, &arg) && oscargs_next(&it, &arg) && arg.size == 99999 &&
+		   blobok(arg.b, arg.size) && oscargs_next(&it, &arg) && arg.i == 42,
+		   "callback blob");
+	m.len = 0;
+	b = oscblob_fd(fd, (1 << 20) - 3);
+	oscstream_pack(st, "/blob", "b", &b);
+	oscstream_flush(st);
+	ok = unpack(&m, 0, &msg);
+	oscargs(&msg, &it);
+	expect(ok && oscargs_next(&it, &arg) && arg.size == (1 << 20) - 3 &&
+		   blobok(arg.b, arg.size), "file blob");
+
+	// An argument list too long for a va_list
+	m.len = 0;
+	format = (char*)malloc(ARGS + 1);
+	memset(format, 'f', ARGS);
+	format[ARGS] = '\0';
+	oscstream_begin(st, "/wave", format, ARGS * 4);
+	for (i = 0; i < ARGS; ++i) {
+		oscstream_float(st, i * 0.5f);
+	}
+	expect(oscstream_end(st) == 8 + ((ARGS + 5) & ~3) + ARGS * 4, "long list size");
+	oscstream_flush(st);
+	ok = unpack(&m, 0, &msg);
+	oscargs(&msg, &it);
+	for (i = 0; ok && i < ARGS; ++i) {
+		ok = oscargs_next(&it, &arg) && arg.f == i * 0.5f;
+	}
+	expect(ok, "long list");
+
+	// Too few arguments breaks the stream for good
+	oscstream_begin(st, "/wave", "ff", 8);
+	oscstream_float(st, 1);
+	expect(oscstream_end(st) == -1, "missing argument");
+	expect(oscstream_pack(st, "/next", "i", 1) == -1, "broken stream stays broken");
+	oscstream_free(st);
+
+	// A callback that fails partway breaks it too
+	st = oscstream_new_fn(keep, &m, 4096);
+	src.at = 0;
+	src.end = 5000;
+	b = oscblob_fn(generate, &src, 10000);
+	expect(oscstream_pack(st, "/blob", "b", &b) == -1, "short source");
+	oscstream_free(st);
+
+	free(format);
+	free(data);
+	free(m.data);
+	close(fd);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Peak resident memory of the process in MB
+static double peak(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_maxrss / 1024.0;
+}
+
+struct reader {
+	pthread_t thread;
+	int fd;
+	int64_t bytes;
+};
+
+static void* drain(void* arg)
+{
+	struct reader* r = (struct reader*)arg;
+	static uint8_t buf[1 << 20];
+	ssize_t n;
+	int fd = accept(r->fd, NULL, NULL);
+
+	while ((n = read(fd, buf, sizeof(buf))) > 0) {
+		r->bytes += n;
+	}
+	close(fd);
+	return NULL;
+}
+
+// A connected TCP socket whose other end is read and thrown away
+static int connected(struct reader* r)
+{
+	struct sockaddr_in sin;
+	socklen_t len = sizeof(sin);
+	int fd;
+
+	memset(r, 0, sizeof(*r));
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if ((r->fd = socket(AF_INET, SOCK_STREAM, 0)) == -1 ||
+		bind(r->fd, (struct sockaddr*)&sin, sizeof(sin)) == -1 ||
+		listen(r->fd, 1) == -1 ||
+		getsockname(r->fd, (struct sockaddr*)&sin, &len) == -1 ||
+		(fd = socket(AF_INET, SOCK_STREAM, 0)) == -1 ||
+		connect(fd, (struct sockaddr*)&sin, sizeof(sin)) == -1) {
+		perror("oscstreamtest: socket");
+		exit(1);
+	}
+	pthread_create(&r->thread, NULL, drain, r);
+	return fd;
+}
+
+// Closes the socket and waits for the reader; returns the bytes it read
+static int64_t finish(struct reader* r, int fd)
+{
+	close(fd);
+	pthread_join(r->thread, NULL);
+	close(r->fd);
+	return r->bytes;
+}
+
+static void report(const char* what, int64_t bytes, double t, double before)
+{
+	if (before < 0) {
+		printf("    %-26s %8.0f  %8s\n", what, bytes / t / 1e6, "-");
+	}
+	else {
+		printf("    %-26s %8.0f  %8.0f\n", what, bytes / t / 1e6, peak() - before);
+	}
+}
+
+// One blob of size bytes sent each way
+static void bench(int32_t size)
+{
+	struct reader r;
+	struct source src;
+	oscstream_t* st;
+	oscblob_t b;
+	uint8_t *whole, *copy;
+	uint32_t be;
+	char path[] = "/tmp/oscstreamtest.XXXXXX";
+	int64_t total = 4 + 8 + 4 + 4 + ((size + 3) & ~3);
+	int32_t off, n;
+	double t, before;
+	ssize_t w;
+	int fd, file;
+
+	printf("oscstreamtest: one %d MB blob over loopback tcp\n", size >> 20);
+	printf("    %-26s %8s  %8s\n", "", "MB/s", "peak MB");
+
+	// oscstream reading the blob from a callback
+	before = peak();
+	fd = connected(&r);
+	t = now();
+	st = oscstream_new(fd, 0);
+	src.at = 0;
+	src.end = size;
+	b = oscblob_fn(repeat, &src, size);
+	expect(oscstream_pack(st, "/sample", "b", &b) > 0, "stream from callback");
+	oscstream_free(st);
+	expect(finish(&r, fd) == total, "all bytes from callback");
+	report("oscstream, callback", total, now() - t, before);
+
+	// oscstream reading the blob from a file
+	if ((file = mkstemp(path)) == -1) {
+		perror("oscstreamtest: temporary file");
+		exit(1);
+	}
+	unlink(path);
+	whole = (uint8_t*)malloc(1 << 20);
+	src.at = 0;
+	for (off = 0; off < size; off += n) {
+		n = size - off < (1 << 20) ? size - off : (1 << 20);
+		repeat(&src, whole, n);
+		if (write(file, whole, n) != n) {
+			perror("oscstreamtest: write");
+			exit(1);
+		}
+	}
+	free(whole);
+	lseek(file, 0, SEEK_SET);
+	before = peak();
+	fd = connected(&r);
+	t = now();
+	st = oscstream_new(fd, 0);
+	b = oscblob_fd(file, size);
+	expect(oscstream_pack(st, "/sample", "b", &b) > 0, "stream from file");
+	oscstream_free(st);
+	expect(finish(&r, fd) == total, "all bytes from file");
+	report("oscstream, file", total, now() - t, before);
+	close(file);
+
+	// The whole message in memory, then one send
+	before = peak();
+	fd = connected(&r);
+	t = now();
+	whole = (uint8_t*)malloc(total);
+	be = htonl((uint32_t)(total - 4));
+	memcpy(whole, &be, 4);
+	memcpy(whole + 4, "/sample\0,b\0\0", 12);
+	be = htonl((uint32_t)size);
+	memcpy(whole + 16, &be, 4);
+	src.at = 0;
+	repeat(&src, whole + 20, size);
+	memset(whole + 20 + size, 0, total - 20 - size);
+	for (off = 0; off < total; off += (int32_t)w) {
+		if ((w = write(fd, whole + off, total - off)) <= 0) {
+			break;
+		}
+	}
+	expect(finish(&r, fd) == total, "all bytes in one piece");
+	report("whole message in memory", total, now() - t, before);
+
+	// What copying the blob once costs
+	copy = (uint8_t*)malloc(total);
+	memcpy(copy, whole, total);
+	__asm__ __volatile__("" ::: "memory");	// keep both copies
+	t = now();
+	memcpy(copy, whole, total);
+	__asm__ __volatile__("" ::: "memory");
+	report("memcpy", total, now() - t, -1);
+	free(copy);
+	free(whole);
+}
+
+int main (int argc, char* const argv[])
+{
+	int megabytes = 200;
+
+	if (argc > 1 && argv[1][0] == '-') {
+		printf(usage);
+		return 0;
+	}
+	if (argc > 1) megabytes = atoi(argv[1]);
+	if (megabytes < 1 || megabytes > 1023) {
+		printf(usage);
+		return 0;
+	}
+
+	check();
+	bench(megabytes << 20);
+	printf("checks:\n");
+	return osctest_report();
+}
@@ -0,0 +1,49 @@
+/******************************************************************************
+ *  osctest
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *
+ *  Checks shared by the test programs. A test prints "checks:", calls
+ *  expect() for each property, which prints the ones that fail, and ends
+ *  with osctest_report(), whose result is the exit status.
+ *
+ ******************************************************************************/
+#ifndef __OSC_TEST_H__
+#define __OSC_TEST_H__
+
+#include <stdio.h>
+
+// Checks that failed so far
+static int osctest_errors;
+
+static inline void expect(int ok, const char* what)
+{
+	if (!ok) {
+		printf("    FAILED: %s\n", what);
+		osctest_errors++;
+	}
+}
+
+/* Prints whether every check so far passed; non-zero if one failed. */
+static inline int osctest_report(void)
+{
+	printf("    %s\n", osctest_errors ? "MISMATCH" : "match");
+	return osctest_errors != 0;
+}
+
+#endif // __OSC_TEST_H__
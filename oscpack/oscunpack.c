@@ -0,0 +1,255 @@
+/******************************************************************************
+ *  oscunpack
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#include "oscunpack.h"
+#include "../osccodec/osccodec.h"
+
+#include <string.h>
+
+// Size of a NUL terminated string padded to 32 bits, or -1 if it is not
+// terminated before end.
+static int32_t oscstrsize(const uint8_t* p, const uint8_t* end)
+{
+	const uint8_t* nul = (const uint8_t*)memchr(p, '\0', end - p);
+	if (!nul) {
+		return -1;
+	}
+	return (int32_t)((nul - p) + 4) & ~3;
+}
+
+const char* oscaddress(const uint8_t* buf, int32_t size, int32_t* addrlen)
+{
+	const uint8_t* nul;
+
+	if (size < 4 || buf[0] != '/') {
+		return NULL;
+	}
+	if ((nul = (const uint8_t*)memchr(buf, '\0', size)) == NULL) {
+		return NULL;
+	}
+	if (addrlen) {
+		*addrlen = (int32_t)(nul - buf);
+	}
+	return (const char*)buf;
+}
+
+// Size of the arguments described by typetag, starting at p. Returns -2 if
+// they run past end and -1 if they are malformed or a type is unknown.
+static int32_t oscargsize(const char* typetag, const uint8_t* p, const uint8_t* end)
+{
+	const char* t;
+	int32_t len, argsize = 0, avail = (int32_t)(end - p);
+
+	for (t = typetag; *t != '\0'; ++t) {
+		switch (*t) {
+			case 'i':	// 32-bit integer
+			case 'f':	// 32-bit float
+			case 'c':	// ascii character
+			case 'r':	// 32-bit RGBA color
+			case 'm':	// MIDI
+				argsize += 4;
+				break;
+			case 'h':	// 64-bit integer
+			case 'd':	// 64-bit float
+			case 't':	// timetag
+				argsize += 8;
+				break;
+			case 's':	// string (array of character)
+			case 'S':	// symbol
+				if (argsize >= avail ||
+					(len = oscstrsize(p + argsize, end)) == -1) {
+					return -2;
+				}
+				argsize += len;
+				break;
+			case 'b':	// blob
+				if (argsize + 4 > avail) {
+					return -2;
+				}
+				len = (int32_t)oscload32(p + argsize);
+				if (len < 0 || len > (1 << 30)) {
+					return -1;
+				}
+				argsize += 4 + ((len + 3) & ~3);
+				break;
+			case 'T':	// True
+			case 'F':	// False
+			case 'N':	// Nil
+			case 'I':	// Infinitum
+			case '[':	// array start
+			case ']':	// array end
+				break;
+			default:	// unknown type!
+				return -1;
+		}
+		if (argsize > avail) {
+			return -2;
+		}
+	}
+	return argsize;
+}
+
+int32_t oscunpack(const uint8_t* buf, int32_t size, oscmsg_t* msg)
+{
+	const uint8_t* end = buf + size;
+	const uint8_t* p;
+	int32_t len;
+
+	if (size % 4 != 0 || oscaddress(buf, size, &msg->addrlen) == NULL) {
+		return -1;
+	}
+	msg->address = (const char*)buf;
+	msg->size = size;
+	p = buf + ((msg->addrlen + 4) & ~3);
+
+	// A message without arguments may leave out the type tag
+	if (p == end) {
+		msg->typetag = "";
+		msg->typelen = 0;
+		msg->args = end;
+		msg->argsize = 0;
+		return 0;
+	}
+
+	if (*p != ',' || (len = oscstrsize(p, end)) == -1) {
+		return -1;
+	}
+	msg->typetag = (const char*)p + 1;
+	msg->typelen = (int32_t)strlen(msg->typetag);
+	p += len;
+	msg->args = p;
+	msg->argsize = (int32_t)(end - p);
+
+	// Walk the arguments to make sure they all fit
+	return oscargsize(msg->typetag, p, end) < 0 ? -1 : 0;
+}
+
+int32_t oscmsglen(const uint8_t* buf, int32_t size)
+{
+	const uint8_t* end = buf + size;
+	const uint8_t* p;
+	int32_t len, argsize;
+
+	if (size < 1 || buf[0] != '/') {
+		return -1;
+	}
+	if ((len = oscstrsize(buf, end)) == -1 || len >= size) {
+		return 0;
+	}
+	p = buf + len;
+	if (*p != ',') {
+		return len;		// no type tag
+	}
+	if ((len = oscstrsize(p, end)) == -1 || p + len > end) {
+		return 0;
+	}
+	if ((argsize = oscargsize((const char*)p + 1, p + len, end)) < 0) {
+		return argsize == -2 ? 0 : -1;
+	}
+	return (int32_t)(p + len - buf) + argsize;
+}
+
+int oscisbundle(const uint8_t* buf, int32_t size)
+{
+	return size >= 16 && memcmp(buf, "#bundle", 8) == 0;
+}
+
+int32_t oscbundle(const uint8_t* buf, int32_t size, oscbundle_t* b)
+{
+	if (!oscisbundle(buf, size) || size % 4 != 0) {
+		return -1;
+	}
+	b->timetag = oscload64(buf + 8);
+	b->buf = buf;
+	b->size = size;
+	b->pos = 16;
+	return 0;
+}
+
+int32_t oscbundle_next(oscbundle_t* b, const uint8_t** elem)
+{
+	int32_t len;
+
+	if (b->pos == b->size) {
+		return 0;
+	}
+	if (b->size - b->pos < 4) {
+		return -1;
+	}
+	len = (int32_t)oscload32(b->buf + b->pos);
+	if (len <= 0 || len % 4 != 0 || len > b->size - b->pos - 4) {
+		return -1;
+	}
+	*elem = b->buf + b->pos + 4;
+	b->pos += 4 + len;
+	return len;
+}
+
+void oscargs(const oscmsg_t* msg, oscargs_t* it)
+{
+	it->type = msg->typetag;
+	it->p = msg->args;
+}
+
+int oscargs_next(oscargs_t* it, oscarg_t* arg)
+{
+	if (*it->type == '\0') {
+		return 0;
+	}
+	arg->type = *it->type++;
+	switch (arg->type) {
+		case 'i':
+		case 'r':
+		case 'm':
+			arg->i = (int32_t)oscload32(it->p);
+			it->p += 4;
+			break;
+		case 'c':
+			// oscpack puts the character first; others send it as an int32
+			arg->i = it->p[0] ? it->p[0] : it->p[3];
+			it->p += 4;
+			break;
+		case 'f':
+			arg->f = oscloadf(it->p);
+			it->p += 4;
+			break;
+		case 'h':
+		case 't':
+		case 'd':
+			arg->h = (int64_t)oscload64(it->p);
+			if (arg->type == 'd') {
+				arg->d = oscloadd(it->p);
+			}
+			it->p += 8;
+			break;
+		case 's':
+		case 'S':
+			arg->s = (const char*)it->p;
+			arg->size = (int32_t)strlen(arg->s);
+			it->p += (arg->size + 4) & ~3;
+			break;
+		case 'b':
+			arg->size = (int32_t)oscload32(it->p);
+			arg->b = it->p + 4;
+			it->p += 4 + ((arg->size + 3) & ~3);
+			break;
+	}
+	return 1;
+}
@@ -0,0 +1,165 @@
+/******************************************************************************
+ *  oscunpack
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#ifndef __OSC_UNPACK_H__
+#define __OSC_UNPACK_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ *	oscunpack() is the counterpart of oscpack(). It validates an OSC message
+ *	and points into it without copying anything: the address, type tag and
+ *	arguments in oscmsg_t all refer to the original buffer, which must stay
+ *	valid while they are used.
+ *
+ *	Usage example:
+ *		oscmsg_t msg;
+ *		if (oscunpack(packet, size, &msg) == 0) {
+ *			printf("%s ,%s\n", msg.address, msg.typetag);
+ *		}
+ */
+
+typedef struct {
+	const char* address;	// OSC address, NUL terminated
+	int32_t addrlen;		// strlen(address)
+	const char* typetag;	// types without the leading ',', NUL terminated
+	int32_t typelen;		// strlen(typetag)
+	const uint8_t* args;	// first argument
+	int32_t argsize;		// bytes of argument data
+	int32_t size;			// size of the whole message
+} oscmsg_t;
+
+/*
+ *	oscunpack() parses a single OSC message (not a bundle).
+ *
+ *	Arguments:
+ *		const uint8_t* buf: OSC message.
+ *		int32_t size: Size of the packet. Must be a multiple of 4.
+ *		oscmsg_t* msg: Filled in on success.
+ *
+ *	Return:
+ *		0 on success, -1 if the message is malformed or has an argument type
+ *		whose size is unknown.
+ */
+int32_t oscunpack(const uint8_t* buf, int32_t size, oscmsg_t* msg);
+
+/*
+ *	oscmsglen() finds where a message ends when packets are not framed, as in
+ *	a stream of messages written back to back.
+ *
+ *	Arguments:
+ *		const uint8_t* buf: Start of a message.
+ *		int32_t size: Bytes available at buf.
+ *
+ *	Return:
+ *		Size of the message, 0 if more bytes are needed to tell, or -1 if buf
+ *		does not start with a valid message.
+ */
+int32_t oscmsglen(const uint8_t* buf, int32_t size);
+
+/*
+ *	Arguments of a message unpacked by oscunpack() are read one at a time.
+ *	Each one is converted to host byte order; strings and blobs point into
+ *	the message.
+ *
+ *	Usage example:
+ *		oscargs_t it;
+ *		oscarg_t arg;
+ *		oscargs(&msg, &it);
+ *		while (oscargs_next(&it, &arg)) {
+ *			if (arg.type == 'f') printf("%f\n", arg.f);
+ *		}
+ */
+
+typedef struct {
+	char type;				// type tag character
+	int32_t i;				// i, c, r, m
+	int64_t h;				// h, t
+	float f;
+	double d;
+	const char* s;			// s, S
+	const uint8_t* b;		// blob data
+	int32_t size;			// length of s or b
+} oscarg_t;
+
+typedef struct {
+	const char* type;
+	const uint8_t* p;
+} oscargs_t;
+
+void oscargs(const oscmsg_t* msg, oscargs_t* it);
+
+/* Reads the next argument. Returns 1, or 0 after the last one. T F N I [ ]
+ * have no data and only set type. */
+int oscargs_next(oscargs_t* it, oscarg_t* arg);
+
+/*
+ *	oscaddress() returns the address of a message without validating the
+ *	rest of it, or NULL if buf does not start with a valid address. This is
+ *	enough to route a packet.
+ */
+const char* oscaddress(const uint8_t* buf, int32_t size, int32_t* addrlen);
+
+/* Returns 1 if buf holds a bundle ("#bundle"), 0 otherwise. */
+int oscisbundle(const uint8_t* buf, int32_t size);
+
+/*
+ *	Bundles are walked one element at a time. Elements may themselves be
+ *	bundles.
+ *
+ *	Usage example:
+ *		oscbundle_t b;
+ *		const uint8_t* elem;
+ *		int32_t len;
+ *		if (oscbundle(packet, size, &b) == 0) {
+ *			while ((len = oscbundle_next(&b, &elem)) > 0) {
+ *				...
+ *			}
+ *		}
+ */
+
+typedef struct {
+	const uint8_t* buf;
+	int32_t size;
+	int32_t pos;
+	uint64_t timetag;		// NTP format, 1 means "immediately"
+} oscbundle_t;
+
+/* Starts walking a bundle. Returns 0, or -1 if buf is not a bundle. */
+int32_t oscbundle(const uint8_t* buf, int32_t size, oscbundle_t* b);
+
+/*
+ *	oscbundle_next() returns the next element of the bundle.
+ *
+ *	Return:
+ *		Size of the element, 0 after the last element, or -1 if the bundle
+ *		is malformed.
+ */
+int32_t oscbundle_next(oscbundle_t* b, const uint8_t** elem);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __OSC_UNPACK_H__
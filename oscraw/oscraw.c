@@ -1,7 +1,7 @@
 /******************************************************************************
  *  oscraw
  *
- *  Copyright (C) 2010-2011 The Regents of the University of California. 
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
  *  All Rights Reserved.
  *
  *  Sonic Arts Research and Development Group
@@ -18,22 +18,33 @@
  *  Contact: toyamada [at] ucsd.edu
  *
  *
- *	This is a command line tool to print raw hexidecimal values of an OSC 
- *  packet. To use the command, specify tcp or udp, OSC address and arguments. 
+ *	This is a command line tool to print raw hexidecimal values of an OSC
+ *  packet. To use the command, specify tcp or udp, OSC address and arguments.
  *  When specified as tcp, the beginning of the packet is encoded with the size
- *  of the OSC message in 32-bit big-endian integer. Consequently, the packet 
+ *  of the OSC message in 32-bit big-endian integer. Consequently, the packet
  *  size is 4 bytes larger.
  *
+ *  In batch mode (-b), message specs are read one per line from a file or
+ *  standard input and the packets are written as binary or hex through one
+ *  large output buffer.
+ *
  ******************************************************************************/
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
-#include "byteorder.h"
+#include "../osccodec/osccodec.h"
+#include "../oscpack/oscunpack.h"
 
 #define HELP "\n" \
 "usage: oscraw tcp|udp /osc/address -type messages ...\n" \
+"       oscraw -b tcp|udp [-x] [-o file] [specfile]\n" \
+"       oscraw -d tcp|udp|slip [-x] [file]\n" \
 "\n" \
 "The first argument should be \"tcp\" or \"udp\". If set to \"tcp\", the\n" \
 "first bytes specify the size of the OSC message.\n" \
@@ -55,253 +66,1355 @@
 "        -F      False (no value)\n" \
 "        -N      Nil (no value)\n" \
 "        -I      Infinitum (no value)\n" \
+"\n" \
+"Batch mode (-b) reads one message per line from specfile, or from standard\n" \
+"input, and writes the packets to standard output or to the -o file. With\n" \
+"tcp every packet is preceded by its size; with udp packets are written back\n" \
+"to back. -x writes hex instead of binary. A spec line is written like the\n" \
+"command line above:\n" \
+"\n" \
+"        /mixer/ch/1/gain -f 0.5\n" \
+"        /cue/name -s \"act one\" -T\n" \
+"\n" \
+"Lines between \"[ timetag\" and \"]\" are put in a bundle (the timetag is\n" \
+"optional, 1 means immediately). Bundles may be nested. Empty lines and\n" \
+"lines starting with '#' are skipped.\n" \
+"\n" \
+"Decode mode (-d) reads packets from file, or from standard input, and prints\n" \
+"one line per message: address, type tag and arguments, with the messages of\n" \
+"a bundle indented under it. Packets are framed by a size (tcp), by SLIP\n" \
+"(slip, OSC 1.1), or written back to back as by nc -lu (udp). With -x the\n" \
+"input is hex text such as the output of -b -x, od or xxd -p.\n" \
 "\n"
 
-int main (int argc, const char * argv[]) 
-{	
-	char* net;
-	char* osc_addr;
-	int32_t osc_size = 0;
-	int32_t addr_size = 0;
-	int32_t type_size = 0;
-	int32_t mess_size = 0;
-	uint8_t* osc_data = NULL;
-	uint8_t* addr_ptr = NULL;
-	uint8_t* type_ptr = NULL;
-	uint8_t* mess_ptr = NULL;
-	int32_t bit32;
-	int64_t bit64;
-	int i;
+// Output buffer of batch mode
+#define OUTSIZE (1024 * 1024)
+
+// Bytes formatted as hex at a time; a multiple of 16 that fits OUTSIZE
+#define HEXSLICE (64 * 1024)
+
+// Spec lines are read this many bytes at a time
+#define INSIZE (1024 * 1024)
+
+// Bundles nested deeper than this are rejected
+#define MAX_DEPTH 16
+
+// One typed argument; s points at the value, or is NULL for -T -F -N -I
+struct token {
+	char type;
+	const char* s;
 	int32_t len;
-	char bad_mess = 0;
-	
-	if (argc < 3) {
-		goto help;
+};
+
+struct buffer {
+	uint8_t* data;
+	int32_t len;
+	int32_t cap;
+};
+
+struct writer {
+	int fd;
+	int hex;
+	uint8_t* buf;
+	size_t len;
+	size_t cap;
+};
+
+static const char* error;
+
+static void reserve(struct buffer* b, int32_t n)
+{
+	uint8_t* p;
+	int32_t cap;
+
+	if (b->len + n <= b->cap) {
+		return;
 	}
-	
-	// Check first argument
-	net = (char*)argv[1];
-	if (strcmp(net, "tcp") != 0 && strcmp(net, "udp") != 0) {
-		printf("Error: First argument must be \"tcp\" or \"udp\"" \
-			   "(without quotes)\n");
-		goto help;
+	for (cap = b->cap ? b->cap : 256; cap < b->len + n; cap *= 2)
+		;
+	if ((p = (uint8_t*)realloc(b->data, cap)) == NULL) {
+		fprintf(stderr, "Critical memory error...\n");
+		exit(1);
 	}
-	
-	// Check OSC Address Pattern
-	osc_addr = (char*)argv[2];
-	if (osc_addr[0] != '/') {
-		printf("Error: OSC Address Pattern must start with '/' " \
-			   "(forward slash)\n");
-		goto help;
+	b->data = p;
+	b->cap = cap;
+}
+
+/******************************************************************************
+ *  Number parsing. Like C++ from_chars(): the whole token must be a number,
+ *  no locale or errno, and nothing is allocated.
+ ******************************************************************************/
+
+static int parse_int(const char* s, int32_t len, int64_t min, int64_t max, int64_t* out)
+{
+	const char* end = s + len;
+	uint64_t v = 0, limit, digit;
+	int neg = 0;
+
+	if (s < end && (*s == '-' || *s == '+')) {
+		neg = *s++ == '-';
 	}
-	addr_size = strlen(osc_addr);
-	addr_size += (4 - addr_size % 4);
-	
-	// +1 for ',' of type specifier
-	type_size = 1;
-	
-	// Iterate once to check OSC type and messages, and calculate size
-	for (i = 3; i < argc; ++i) {
-		if (strcmp(argv[i], "-i") == 0) {
-			i++;
-			type_size++;
-			mess_size += 4;
+	// No sign when the range has no negative numbers, where the limit
+	// below would be meaningless
+	if (s == end || (neg && min >= 0)) {
+		return -1;
+	}
+	limit = neg ? (uint64_t)0 - (uint64_t)min : (uint64_t)max;
+	for (; s < end; ++s) {
+		if (*s < '0' || *s > '9') {
+			return -1;
 		}
-		else if (strcmp(argv[i], "-h") == 0) {
-			i++;
-			type_size++;
-			mess_size += 8;
+		digit = (uint64_t)(*s - '0');
+		if (digit > limit || v > (limit - digit) / 10) {
+			return -1;
 		}
-		else if (strcmp(argv[i], "-f") == 0) {
-			i++;
-			type_size++;
-			mess_size += 4;
+		v = v * 10 + digit;
+	}
+	*out = neg ? (int64_t)(0 - v) : (int64_t)v;
+	return 0;
+}
+
+static const double pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// s must be NUL terminated at s[len]
+static int parse_double(const char* s, int32_t len, double* out)
+{
+	const char* p = s;
+	const char* end = s + len;
+	char* stop;
+	uint64_t m = 0;
+	int digits = 0, exp = 0, e = 0, neg = 0, eneg = 0, any = 0;
+
+	if (p < end && (*p == '-' || *p == '+')) {
+		neg = *p++ == '-';
+	}
+	for (; p < end && *p >= '0' && *p <= '9'; ++p, any = 1) {
+		if (m || *p != '0') {
+			m = m * 10 + (*p - '0');
+			digits++;
 		}
-		else if (strcmp(argv[i], "-d") == 0) {
-			i++;
-			type_size++;
-			mess_size += 8;
+	}
+	if (p < end && *p == '.') {
+		for (++p; p < end && *p >= '0' && *p <= '9'; ++p, any = 1) {
+			if (m || *p != '0') {
+				m = m * 10 + (*p - '0');
+				digits++;
+			}
+			exp--;
 		}
-		else if (strcmp(argv[i], "-s") == 0) {
-			i++;
-			if (i >= argc) {
-				bad_mess = 1;
-				break;
+	}
+	if (any && p < end && (*p == 'e' || *p == 'E')) {
+		if (++p < end && (*p == '-' || *p == '+')) {
+			eneg = *p++ == '-';
+		}
+		for (any = 0; p < end && *p >= '0' && *p <= '9'; ++p, any = 1) {
+			if (e < 10000) {
+				e = e * 10 + (*p - '0');
 			}
-			
-			type_size++;
-			len = strlen(argv[i]);
-			len += (4 - len % 4);
-			mess_size += len;
 		}
-		else if (strcmp(argv[i], "-c") == 0) {
-			i++;
-			if (i >= argc) {
-				bad_mess = 1;
-				break;
+		exp += eneg ? -e : e;
+	}
+
+	// Both the digits and the power of ten are exact doubles, so one
+	// multiplication or division rounds correctly.
+	if (any && p == end && digits <= 19 && m <= (1ull << 53) &&
+		exp >= -22 && exp <= 22) {
+		*out = exp < 0 ? (double)m / pow10[-exp] : (double)m * pow10[exp];
+		if (neg) {
+			*out = -*out;
+		}
+		return 0;
+	}
+
+	// Long mantissas, large exponents, inf and nan
+	*out = strtod(s, &stop);
+	return len > 0 && stop == end ? 0 : -1;
+}
+
+/******************************************************************************
+ *  Encoding
+ ******************************************************************************/
+
+// Checks the arguments and returns the size of the encoded message
+static int32_t message_size(const char* addr, int32_t addrlen,
+							const struct token* tok, int n)
+{
+	int32_t size = (addrlen + 4) & ~3;
+	int i;
+
+	if (addr[0] != '/') {
+		error = "OSC Address Pattern must start with '/' (forward slash)";
+		return -1;
+	}
+	size += (n + 1 + 4) & ~3;
+	for (i = 0; i < n; ++i) {
+		switch (tok[i].type) {
+		case 'i': case 'f': case 'c':
+			size += 4;
+			break;
+		case 'h': case 'd':
+			size += 8;
+			break;
+		case 's':
+			size += (tok[i].len + 4) & ~3;
+			break;
+		}
+	}
+	return size;
+}
+
+// Appends the message to b
+static int encode(struct buffer* b, const char* addr, int32_t addrlen,
+				  const struct token* tok, int n)
+{
+	int32_t size;
+	uint8_t* type;
+	uint8_t* arg;
+	int64_t v;
+	double d;
+	int i;
+
+	if ((size = message_size(addr, addrlen, tok, n)) == -1) {
+		return -1;
+	}
+	reserve(b, size);
+	memset(b->data + b->len, 0, size);
+
+	memcpy(b->data + b->len, addr, addrlen);
+	type = b->data + b->len + ((addrlen + 4) & ~3);
+	arg = type + ((n + 1 + 4) & ~3);
+	*type++ = ',';
+
+	for (i = 0; i < n; ++i) {
+		*type++ = tok[i].type;
+		switch (tok[i].type) {
+		case 'i':
+			if (parse_int(tok[i].s, tok[i].len, INT32_MIN, INT32_MAX, &v) == -1) {
+				error = "-i needs a 32-bit integer";
+				return -1;
 			}
-			
-			type_size++;
-			if (strlen(argv[i]) > 1) {
-				bad_mess = 1;
-				break;
+			oscstore32(arg, (uint32_t)v);
+			arg += 4;
+			break;
+		case 'h':
+			if (parse_int(tok[i].s, tok[i].len, INT64_MIN, INT64_MAX, &v) == -1) {
+				error = "-h needs a 64-bit integer";
+				return -1;
+			}
+			oscstore64(arg, (uint64_t)v);
+			arg += 8;
+			break;
+		case 'f':
+			if (parse_double(tok[i].s, tok[i].len, &d) == -1) {
+				error = "-f needs a number";
+				return -1;
 			}
-			mess_size += 4;
+			oscstoref(arg, (float)d);
+			arg += 4;
+			break;
+		case 'd':
+			if (parse_double(tok[i].s, tok[i].len, &d) == -1) {
+				error = "-d needs a number";
+				return -1;
+			}
+			oscstored(arg, d);
+			arg += 8;
+			break;
+		case 's':
+			memcpy(arg, tok[i].s, tok[i].len);
+			arg += (tok[i].len + 4) & ~3;
+			break;
+		case 'c':
+			arg[0] = tok[i].s[0];
+			arg += 4;
+			break;
 		}
-		else if (strcmp(argv[i], "-T") == 0) {
-			i++;
-			type_size++;
+	}
+
+	b->len += size;
+	return 0;
+}
+
+// Adds the token for option opt with value s; returns 1 if the value was used
+static int token(struct token* t, const char* opt, const char* s, int32_t len)
+{
+	if (opt[0] != '-' || opt[1] == '\0' || opt[2] != '\0') {
+		return -1;
+	}
+	t->type = opt[1];
+	t->s = NULL;
+	t->len = 0;
+	switch (opt[1]) {
+	case 'T': case 'F': case 'N': case 'I':
+		return 0;
+	case 'i': case 'h': case 'f': case 'd': case 's':
+		break;
+	case 'c':
+		if (s && len != 1) {
+			return -1;
 		}
-		else if (strcmp(argv[i], "-F") == 0) {
-			i++;
-			type_size++;
+		break;
+	default:
+		return -1;
+	}
+	if (s == NULL) {
+		return -1;
+	}
+	t->s = s;
+	t->len = len;
+	return 1;
+}
+
+/******************************************************************************
+ *  Output
+ ******************************************************************************/
+
+static char hex[256][3];
+static int8_t hexval[256];
+
+static void hex_init(void)
+{
+	const char digits[] = "0123456789abcdef";
+	int i;
+
+	for (i = 0; i < 256; ++i) {
+		hex[i][0] = digits[i >> 4];
+		hex[i][1] = digits[i & 15];
+		hex[i][2] = ' ';
+	}
+	memset(hexval, -1, sizeof(hexval));
+	for (i = 0; i < 16; ++i) {
+		hexval[(uint8_t)digits[i]] = (int8_t)i;
+		hexval[(uint8_t)toupper(digits[i])] = (int8_t)i;
+	}
+}
+
+// Formats size bytes as "xx " with 16 bytes per line; out needs 3 * size +
+// size / 16 + 1 bytes. Returns the length written.
+static size_t hex_format(char* out, const uint8_t* data, int32_t size)
+{
+	char* p = out;
+	int32_t i;
+
+	for (i = 0; i < size; ++i) {
+		memcpy(p, hex[data[i]], 3);
+		p += 3;
+		if (i % 16 == 15) {
+			*p++ = '\n';
 		}
-		else if (strcmp(argv[i], "-N") == 0) {
-			i++;
-			type_size++;
+	}
+	return p - out;
+}
+
+static int writeall(int fd, const uint8_t* p, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = write(fd, p, len)) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("write");
+			return -1;
 		}
-		else if (strcmp(argv[i], "-I") == 0) {
-			i++;
-			type_size++;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int flush(struct writer* w)
+{
+	if (writeall(w->fd, w->buf, w->len) == -1) {
+		return -1;
+	}
+	w->len = 0;
+	return 0;
+}
+
+static int output(struct writer* w, const uint8_t* data, int32_t size)
+{
+	int32_t n;
+
+	if (!w->hex) {
+		if (w->len + size > w->cap && flush(w) == -1) {
+			return -1;
+		}
+		if ((size_t)size > w->cap) {
+			return writeall(w->fd, data, size);
+		}
+		memcpy(w->buf + w->len, data, size);
+		w->len += size;
+		return 0;
+	}
+
+	// Whole lines at a time so a packet of any size fits the buffer
+	do {
+		n = size < HEXSLICE ? size : HEXSLICE;
+		if (w->len + n * 3 + n / 16 + 2 > w->cap && flush(w) == -1) {
+			return -1;
+		}
+		w->len += hex_format((char*)w->buf + w->len, data, n);
+		data += n;
+		size -= n;
+	} while (size > 0);
+	if (n % 16) {
+		w->buf[w->len++] = '\n';
+	}
+	w->buf[w->len++] = '\n';
+	return 0;
+}
+
+// Returns room for n more bytes of output, flushing or growing the buffer
+static char* space(struct writer* w, size_t n)
+{
+	uint8_t* p;
+
+	if (w->len + n > w->cap) {
+		if (flush(w) == -1) {
+			return NULL;
+		}
+		if (n > w->cap) {
+			if ((p = (uint8_t*)realloc(w->buf, n)) == NULL) {
+				fprintf(stderr, "Critical memory error...\n");
+				exit(1);
+			}
+			w->buf = p;
+			w->cap = n;
+		}
+	}
+	return (char*)w->buf + w->len;
+}
+
+/******************************************************************************
+ *  Batch mode
+ ******************************************************************************/
+
+// Splits a spec line in place into NUL terminated words. Quotes group words
+// and \" \\ escape inside quotes. Returns the word count or -1.
+static int split(char* line, char** words, int32_t* lens, int max)
+{
+	char* p = line;
+	char* out;
+	int n = 0;
+
+	for (;;) {
+		while (*p == ' ' || *p == '\t' || *p == '\r') {
+			p++;
+		}
+		if (*p == '\0') {
+			return n;
+		}
+		if (n == max) {
+			error = "too many arguments";
+			return -1;
+		}
+		words[n] = out = p;
+		if (*p == '"') {
+			for (++p; *p != '"'; ++p) {
+				if (*p == '\0') {
+					error = "missing closing quote";
+					return -1;
+				}
+				if (*p == '\\' && (p[1] == '"' || p[1] == '\\')) {
+					p++;
+				}
+				*out++ = *p;
+			}
+			p++;
+			if (*p != ' ' && *p != '\t' && *p != '\r' && *p != '\0') {
+				error = "text after closing quote";
+				return -1;
+			}
 		}
 		else {
-			bad_mess = 1;
+			while (*p != ' ' && *p != '\t' && *p != '\r' && *p != '\0') {
+				*out++ = *p++;
+			}
+		}
+		lens[n] = (int32_t)(out - words[n]);
+		n++;
+		if (*p != '\0') {
+			p++;
+		}
+		*out = '\0';
+	}
+}
+
+struct batch {
+	struct writer w;
+	int tcp;
+	struct buffer packet;	// the top level packet being built
+	int32_t open[MAX_DEPTH];	// offsets of the size field of open bundles
+	int depth;
+	char** words;
+	int32_t* lens;
+	struct token* tokens;
+	int max;
+	uint64_t packets;
+};
+
+static int emit(struct batch* b)
+{
+	uint8_t prefix[4];
+
+	if (b->tcp) {
+		oscstore32(prefix, (uint32_t)b->packet.len);
+		if (b->w.hex) {
+			// The prefix goes on the same lines as the packet
+			reserve(&b->packet, 4);
+			memmove(b->packet.data + 4, b->packet.data, b->packet.len);
+			memcpy(b->packet.data, prefix, 4);
+			b->packet.len += 4;
+		}
+		else if (output(&b->w, prefix, 4) == -1) {
+			return -1;
+		}
+	}
+	b->packets++;
+	if (output(&b->w, b->packet.data, b->packet.len) == -1) {
+		return -1;
+	}
+	b->packet.len = 0;
+	return 0;
+}
+
+static int line(struct batch* b, char* s)
+{
+	int n, i, r, t;
+	int32_t start;
+	int64_t timetag = 1;
+
+	while (*s == ' ' || *s == '\t') {
+		s++;
+	}
+	if (*s == '#') {
+		return 0;
+	}
+	if ((n = split(s, b->words, b->lens, b->max)) <= 0) {
+		return n;
+	}
+
+	if (strcmp(b->words[0], "[") == 0) {
+		if (b->depth == MAX_DEPTH) {
+			error = "bundles nested too deep";
+			return -1;
+		}
+		if (n > 2 || (n == 2 && parse_int(b->words[1], b->lens[1], 0, INT64_MAX,
+										   &timetag) == -1)) {
+			error = "expected \"[ timetag\"";
+			return -1;
+		}
+		if (b->depth > 0) {
+			reserve(&b->packet, 4);
+			b->packet.len += 4;
+		}
+		b->open[b->depth++] = b->packet.len - 4;
+		reserve(&b->packet, 16);
+		memcpy(b->packet.data + b->packet.len, "#bundle\0", 8);
+		oscstore64(b->packet.data + b->packet.len + 8, (uint64_t)timetag);
+		b->packet.len += 16;
+		return 0;
+	}
+
+	if (strcmp(b->words[0], "]") == 0) {
+		if (n != 1 || b->depth == 0) {
+			error = "unexpected \"]\"";
+			return -1;
+		}
+		start = b->open[--b->depth];
+		if (b->depth > 0) {
+			oscstore32(b->packet.data + start, b->packet.len - start - 4);
+			return 0;
+		}
+		return emit(b);
+	}
+
+	for (i = 1, t = 0; i < n; i += 1 + r, ++t) {
+		r = token(&b->tokens[t], b->words[i], i + 1 < n ? b->words[i+1] : NULL,
+				  i + 1 < n ? b->lens[i+1] : 0);
+		if (r == -1) {
+			error = "bad OSC type or message";
+			return -1;
+		}
+	}
+
+	start = b->packet.len;
+	if (b->depth > 0) {
+		reserve(&b->packet, 4);
+		b->packet.len += 4;
+	}
+	if (encode(&b->packet, b->words[0], b->lens[0], b->tokens, t) == -1) {
+		return -1;
+	}
+	if (b->depth > 0) {
+		oscstore32(b->packet.data + start, b->packet.len - start - 4);
+		return 0;
+	}
+	return emit(b);
+}
+
+static int batch(int tcp, int hexout, const char* outpath, const char* inpath)
+{
+	struct batch b;
+	char* in;
+	char* p;
+	char* nl;
+	size_t len = 0, cap = INSIZE;
+	ssize_t n;
+	uint64_t lineno = 0;
+	int fd = 0, eof = 0, ret = 0;
+
+	memset(&b, 0, sizeof(b));
+	b.tcp = tcp;
+	b.w.hex = hexout;
+	b.w.fd = 1;
+	b.max = 256;
+	b.w.buf = (uint8_t*)malloc(OUTSIZE);
+	b.w.cap = OUTSIZE;
+	in = (char*)malloc(cap + 1);
+	b.words = (char**)malloc(sizeof(char*) * b.max);
+	b.lens = (int32_t*)malloc(sizeof(int32_t) * b.max);
+	b.tokens = (struct token*)malloc(sizeof(struct token) * b.max);
+	if (!b.w.buf || !in || !b.words || !b.lens || !b.tokens) {
+		fprintf(stderr, "Critical memory error...\n");
+		exit(1);
+	}
+	hex_init();
+
+	if (inpath && (fd = open(inpath, O_RDONLY)) == -1) {
+		perror(inpath);
+		return 1;
+	}
+	if (outpath && (b.w.fd = open(outpath, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+		perror(outpath);
+		return 1;
+	}
+
+	while (!eof) {
+		if (len == cap) {
+			// A line longer than the buffer
+			cap *= 2;
+			if ((in = (char*)realloc(in, cap + 1)) == NULL) {
+				fprintf(stderr, "Critical memory error...\n");
+				exit(1);
+			}
+		}
+		if ((n = read(fd, in + len, cap - len)) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("read");
+			ret = 1;
 			break;
 		}
-		
-		if (i >= argc) {
-			bad_mess = 1;
+		if (n == 0) {
+			eof = 1;
+			if (len > 0 && in[len-1] != '\n') {
+				in[len++] = '\n';		// last line without a newline
+			}
+		}
+		len += n;
+
+		p = in;
+		while ((nl = (char*)memchr(p, '\n', in + len - p)) != NULL) {
+			*nl = '\0';
+			lineno++;
+			if (line(&b, p) == -1) {
+				fprintf(stderr, "Error: line %llu: %s\n", (unsigned long long)lineno,
+						error);
+				ret = 1;
+				eof = 1;
+				break;
+			}
+			p = nl + 1;
+		}
+		len -= p - in;
+		memmove(in, p, len);
+	}
+
+	if (ret == 0 && b.depth > 0) {
+		fprintf(stderr, "Error: bundle not closed at end of input\n");
+		ret = 1;
+	}
+	if (flush(&b.w) == -1) {
+		ret = 1;
+	}
+	if (b.w.fd != 1) {
+		close(b.w.fd);
+	}
+	if (fd != 0) {
+		close(fd);
+	}
+	fprintf(stderr, "oscraw: %llu packets\n", (unsigned long long)b.packets);
+
+	free(in);
+	free(b.w.buf);
+	free(b.packet.data);
+	free(b.words);
+	free(b.lens);
+	free(b.tokens);
+	return ret;
+}
+
+/******************************************************************************
+ *  Decode mode
+ ******************************************************************************/
+
+#define FRAME_TCP 0
+#define FRAME_UDP 1
+#define FRAME_SLIP 2
+
+// Largest packet decode mode accepts
+#define MAX_PACKET (1024 * 1024)
+
+// Longest word of hex input
+#define MAX_WORD 4096
+
+// Packets printed from this bundle depth on are shown as malformed
+#define MAX_NESTING 32
+
+#define SLIP_END 0xc0
+#define SLIP_ESC 0xdb
+#define SLIP_ESC_END 0xdc
+#define SLIP_ESC_ESC 0xdd
+
+struct decoder {
+	struct writer w;
+	int framing;
+	struct buffer in;		// bytes not decoded yet
+	struct buffer slip;		// SLIP: the packet being unescaped
+	int esc;				// SLIP: the last byte was SLIP_ESC
+	int overflow;			// SLIP: the packet is too large and is dropped
+	char word[MAX_WORD];	// hex input: the word being read
+	int wordlen;
+	uint64_t packets;
+	uint64_t messages;
+	uint64_t malformed;
+};
+
+static char* fmt_u64(char* p, uint64_t v)
+{
+	char tmp[20];
+	int n = 0;
+
+	do {
+		tmp[n++] = (char)('0' + v % 10);
+		v /= 10;
+	} while (v);
+	while (n) {
+		*p++ = tmp[--n];
+	}
+	return p;
+}
+
+static char* fmt_i64(char* p, int64_t v)
+{
+	if (v < 0) {
+		*p++ = '-';
+		return fmt_u64(p, 0 - (uint64_t)v);
+	}
+	return fmt_u64(p, (uint64_t)v);
+}
+
+// Shortest of two precisions that reads back as the same value
+static char* fmt_float(char* p, float v)
+{
+	int n = sprintf(p, "%.6g", v);
+	if ((float)strtod(p, NULL) != v) {
+		n = sprintf(p, "%.9g", v);
+	}
+	return p + n;
+}
+
+static char* fmt_double(char* p, double v)
+{
+	int n = sprintf(p, "%.15g", v);
+	if (strtod(p, NULL) != v) {
+		n = sprintf(p, "%.17g", v);
+	}
+	return p + n;
+}
+
+// Quoted text; at most 4 bytes per character plus the quotes
+static char* fmt_string(char* p, const char* s, int32_t len, char quote)
+{
+	const uint8_t* c = (const uint8_t*)s;
+	const uint8_t* end = c + len;
+
+	*p++ = quote;
+	for (; c < end; ++c) {
+		if (*c == quote || *c == '\\') {
+			*p++ = '\\';
+			*p++ = (char)*c;
+		}
+		else if (*c == '\n') {
+			*p++ = '\\';
+			*p++ = 'n';
+		}
+		else if (*c < 0x20 || *c == 0x7f) {
+			*p++ = '\\';
+			*p++ = 'x';
+			memcpy(p, hex[*c], 2);
+			p += 2;
+		}
+		else {
+			*p++ = (char)*c;
+		}
+	}
+	*p++ = quote;
+	return p;
+}
+
+static char* fmt_hex(char* p, const uint8_t* data, int32_t size)
+{
+	int32_t i;
+
+	for (i = 0; i < size; ++i) {
+		memcpy(p, hex[data[i]], 2);
+		p += 2;
+	}
+	return p;
+}
+
+// NTP time as seconds.microseconds, or "immediately"
+static char* fmt_timetag(char* p, uint64_t t)
+{
+	uint32_t usec;
+
+	if (t == 1) {
+		memcpy(p, "immediately", 11);
+		return p + 11;
+	}
+	p = fmt_u64(p, t >> 32);
+	usec = (uint32_t)(((t & 0xffffffffull) * 1000000) >> 32);
+	*p++ = '.';
+	sprintf(p, "%06u", usec);
+	return p + 6;
+}
+
+static char* indent(char* p, int depth)
+{
+	memset(p, ' ', depth * 2);
+	return p + depth * 2;
+}
+
+static void malformed(struct decoder* d, const uint8_t* buf, int32_t size, int depth)
+{
+	int32_t n = size < 64 ? size : 64;
+	char* p;
+
+	if ((p = space(&d->w, depth * 2 + 64 + n * 2)) == NULL) {
+		exit(1);
+	}
+	p = indent(p, depth);
+	memcpy(p, "# malformed, ", 13);
+	p = fmt_u64(p + 13, (uint64_t)size);
+	memcpy(p, " bytes: ", 8);
+	p = fmt_hex(p + 8, buf, n);
+	if (n < size) {
+		memcpy(p, "...", 3);
+		p += 3;
+	}
+	*p++ = '\n';
+	d->w.len = (uint8_t*)p - d->w.buf;
+	d->malformed++;
+}
+
+static int message(struct decoder* d, const uint8_t* buf, int32_t size, int depth)
+{
+	oscmsg_t msg;
+	oscargs_t it;
+	oscarg_t arg;
+	uint8_t raw[4];
+	char* p;
+	char ch;
+
+	if (oscunpack(buf, size, &msg) == -1) {
+		return -1;
+	}
+	// Every argument byte formats to at most 4 characters
+	if ((p = space(&d->w, depth * 2 + 8 + (size_t)size * 4 + msg.typelen * 32)) == NULL) {
+		exit(1);
+	}
+	p = indent(p, depth);
+	memcpy(p, msg.address, msg.addrlen);
+	p += msg.addrlen;
+	if (msg.typelen > 0) {
+		*p++ = ' ';
+		*p++ = ',';
+		memcpy(p, msg.typetag, msg.typelen);
+		p += msg.typelen;
+	}
+
+	oscargs(&msg, &it);
+	while (oscargs_next(&it, &arg)) {
+		*p++ = ' ';
+		switch (arg.type) {
+		case 'i':
+			p = fmt_i64(p, arg.i);
+			break;
+		case 'h':
+			p = fmt_i64(p, arg.h);
+			break;
+		case 'f':
+			p = fmt_float(p, arg.f);
+			break;
+		case 'd':
+			p = fmt_double(p, arg.d);
+			break;
+		case 's':
+		case 'S':
+			p = fmt_string(p, arg.s, arg.size, '"');
+			break;
+		case 'c':
+			ch = (char)arg.i;
+			p = fmt_string(p, &ch, 1, '\'');
+			break;
+		case 'b':
+			*p++ = '<';
+			p = fmt_hex(p, arg.b, arg.size);
+			*p++ = '>';
+			break;
+		case 't':
+			p = fmt_timetag(p, (uint64_t)arg.h);
+			break;
+		case 'r':
+		case 'm':
+			oscstore32(raw, (uint32_t)arg.i);
+			memcpy(p, "0x", 2);
+			p = fmt_hex(p + 2, raw, 4);
+			break;
+		default:
+			// T F N I [ ] have no value; the type tag shows them
+			p--;
 			break;
 		}
 	}
-	
-	if (bad_mess) {
-		printf("Error: Bad OSC Type or Message\n");
-		goto help;
+	*p++ = '\n';
+	d->w.len = (uint8_t*)p - d->w.buf;
+	d->messages++;
+	return 0;
+}
+
+static int packet(struct decoder* d, const uint8_t* buf, int32_t size, int depth)
+{
+	oscbundle_t b;
+	const uint8_t* elem;
+	int32_t len;
+	char* p;
+
+	if (!oscisbundle(buf, size)) {
+		return message(d, buf, size, depth);
 	}
-	
-	type_size += (4 - type_size % 4);
-	
-	osc_size = addr_size + type_size + mess_size;
-	
-	// Create an array
-	if (strcmp(net, "tcp") == 0) {
-		osc_data = (uint8_t*)calloc(1, osc_size+4);
-		if (osc_data == NULL) {
-			fprintf(stderr, "Critical memory error...\n");
-			exit(1);
-		}
-		bit32 = htonl(osc_size);
-		memcpy(osc_data, (uint8_t*)&bit32, 4);
-		osc_size += 4;
-		addr_ptr = osc_data+4;
-	}
-	else {
-		osc_data = (uint8_t*)calloc(1, osc_size);
-		if (osc_data == NULL) {
-			fprintf(stderr, "Critical memory error...\n");
-			exit(1);
-		}
-		addr_ptr = osc_data;
-	}
-	
-	// Copy OSC Address Pattern
-	strcpy((char*)addr_ptr, osc_addr);
-	
-	type_ptr = addr_ptr + addr_size;
-	mess_ptr = type_ptr + type_size;
-	
-	*(type_ptr++) = ',';
-	
-	// Iterate the arguments to fill the array
-	for (i = 3; i < argc; ++i) {
-		if (strcmp(argv[i], "-i") == 0) {
-			i++;
-			*(type_ptr++) = 'i';
-			if (sizeof(int) == 4) {
-				bit32 = htonl(atoi(argv[i]));
+	if (depth == MAX_NESTING || oscbundle(buf, size, &b) == -1) {
+		return -1;
+	}
+
+	if ((p = space(&d->w, depth * 2 + 64)) == NULL) {
+		exit(1);
+	}
+	p = indent(p, depth);
+	memcpy(p, "#bundle ", 8);
+	p = fmt_timetag(p + 8, b.timetag);
+	*p++ = '\n';
+	d->w.len = (uint8_t*)p - d->w.buf;
+
+	while ((len = oscbundle_next(&b, &elem)) > 0) {
+		if (packet(d, elem, len, depth + 1) == -1) {
+			malformed(d, elem, len, depth + 1);
+		}
+	}
+	if (len == -1) {
+		malformed(d, buf + b.pos, size - b.pos, depth + 1);
+	}
+	return 0;
+}
+
+static void top(struct decoder* d, const uint8_t* buf, int32_t size)
+{
+	d->packets++;
+	if (packet(d, buf, size, 0) == -1) {
+		malformed(d, buf, size, 0);
+	}
+}
+
+// Size of the packet at the start of unframed input, 0 if more bytes are
+// needed, or -1 if buf does not start with a packet. A bundle ends at the
+// first byte that cannot start an element size (sizes are below 16M, so
+// they start with a zero byte; packets start with '/' or '#') or where the
+// input ends, which with nc -lu is where the datagram ended.
+static int32_t rawlen(const uint8_t* buf, int32_t avail, int final)
+{
+	oscmsg_t msg;
+	int32_t pos, n;
+
+	if (buf[0] == '/') {
+		n = oscmsglen(buf, avail);
+		if (n == 0 && final) {
+			// A message without type tag at the very end
+			n = oscunpack(buf, avail, &msg) == 0 ? avail : -1;
+		}
+		return n;
+	}
+	if (avail < 16) {
+		return final || memcmp(buf, "#bundle", avail < 8 ? avail : 8) ? -1 : 0;
+	}
+	if (memcmp(buf, "#bundle", 8) != 0) {
+		return -1;
+	}
+	for (pos = 16; pos < avail && buf[pos] == 0; pos += 4 + n) {
+		if (avail - pos < 4) {
+			return final ? -1 : 0;
+		}
+		n = (int32_t)oscload32(buf + pos);
+		if (n <= 0 || n % 4 || n > MAX_PACKET) {
+			return -1;
+		}
+		if (avail - pos - 4 < n) {
+			return final ? -1 : 0;
+		}
+	}
+	return pos;
+}
+
+// Decodes the packets in d->in and keeps what is left of a partial one
+static int frames(struct decoder* d, int final)
+{
+	const uint8_t* p = d->in.data;
+	int32_t avail = d->in.len, pos = 0, n, start;
+	uint8_t c;
+
+	switch (d->framing) {
+	case FRAME_TCP:
+		while (avail - pos >= 4) {
+			n = (int32_t)oscload32(p + pos);
+			if (n < 0 || n > MAX_PACKET) {
+				fprintf(stderr, "Error: bad packet size %d; not a tcp stream?\n", n);
+				return -1;
 			}
-			else if (sizeof(long) == 4) {
-				bit32 = htonl(atol(argv[i]));
+			if (avail - pos - 4 < n) {
+				break;
 			}
-			memcpy(mess_ptr, (uint8_t*)&bit32, 4);
-			mess_ptr += 4;
+			top(d, p + pos + 4, n);
+			pos += 4 + n;
 		}
-		else if (strcmp(argv[i], "-h") == 0) {
-			i++;
-			*(type_ptr++) = 'h';
-			if (sizeof(long) == 8) {
-				bit64 = htonll((int64_t)atol(argv[i]));
+		if (final && pos < avail) {
+			d->packets++;
+			malformed(d, p + pos, avail - pos, 0);
+			pos = avail;
+		}
+		break;
+
+	case FRAME_UDP:
+		while (pos < avail) {
+			n = rawlen(p + pos, avail - pos, final);
+			if (n == 0 && avail - pos < MAX_PACKET) {
+				break;
 			}
-			else if (sizeof(long long) == 8) {
-				bit64 = htonll(atoll(argv[i]));
+			if (n <= 0) {
+				// Skip to something that could start a packet
+				start = pos;
+				for (pos++; pos < avail && p[pos] != '/' && p[pos] != '#'; ++pos)
+					;
+				d->packets++;
+				malformed(d, p + start, pos - start, 0);
+				continue;
 			}
-			memcpy(mess_ptr, (uint8_t*)&bit64, 8);
-			mess_ptr += 8;
+			top(d, p + pos, n);
+			pos += n;
 		}
-		else if (strcmp(argv[i], "-f") == 0) {
-			i++;
-			*(type_ptr++) = 'f';
-			bit32 = htonf((float)atof(argv[i]));
-			memcpy(mess_ptr, (uint8_t*)&bit32, 4);
-			mess_ptr += 4;
+		break;
+
+	case FRAME_SLIP:
+		reserve(&d->slip, avail);
+		for (; pos < avail; ++pos) {
+			c = p[pos];
+			if (d->esc) {
+				d->esc = 0;
+				c = c == SLIP_ESC_END ? SLIP_END : c == SLIP_ESC_ESC ? SLIP_ESC : c;
+			}
+			else if (c == SLIP_ESC) {
+				d->esc = 1;
+				continue;
+			}
+			else if (c == SLIP_END) {
+				if (d->overflow) {
+					d->packets++;
+					malformed(d, d->slip.data, d->slip.len, 0);
+				}
+				else if (d->slip.len > 0) {
+					top(d, d->slip.data, d->slip.len);
+				}
+				d->slip.len = 0;
+				d->overflow = 0;
+				continue;
+			}
+			if (d->slip.len == MAX_PACKET) {
+				d->overflow = 1;
+				continue;
+			}
+			d->slip.data[d->slip.len++] = c;
 		}
-		else if (strcmp(argv[i], "-d") == 0) {
-			i++;
-			*(type_ptr++) = 'd';
-			bit64 = htond(atof(argv[i]));
-			memcpy(mess_ptr, (uint8_t*)&bit64, 8);
-			mess_ptr += 8;
+		if (final && d->slip.len > 0) {
+			top(d, d->slip.data, d->slip.len);
 		}
-		else if (strcmp(argv[i], "-s") == 0) {
-			i++;
-			*(type_ptr++) = 's';
-			strcpy((char*)mess_ptr, argv[i]);
-			len = strlen(argv[i]);
-			len += (4 - len % 4);
-			mess_ptr += len;
+		break;
+	}
+
+	d->in.len = avail - pos;
+	memmove(d->in.data, p + pos, d->in.len);
+	return 0;
+}
+
+// Appends the bytes of a hex word ("2f", "2f6d792f") to d->in; other words,
+// such as offsets ending in ':' or text, are ignored.
+static void hexword(struct decoder* d)
+{
+	uint8_t* out;
+	int i;
+
+	if (d->wordlen == 0 || d->wordlen % 2) {
+		d->wordlen = 0;
+		return;
+	}
+	for (i = 0; i < d->wordlen; ++i) {
+		if (hexval[(uint8_t)d->word[i]] < 0) {
+			d->wordlen = 0;
+			return;
 		}
-		else if (strcmp(argv[i], "-c") == 0) {
-			i++;
-			*(type_ptr++) = 'c';
-			memcpy(mess_ptr, argv[i], 1);
-			mess_ptr += 4;
+	}
+	reserve(&d->in, d->wordlen / 2);
+	out = d->in.data + d->in.len;
+	for (i = 0; i < d->wordlen; i += 2) {
+		*out++ = (uint8_t)(hexval[(uint8_t)d->word[i]] << 4 |
+						   hexval[(uint8_t)d->word[i+1]]);
+	}
+	d->in.len += d->wordlen / 2;
+	d->wordlen = 0;
+}
+
+static void unhex(struct decoder* d, const char* text, ssize_t n)
+{
+	ssize_t i;
+
+	for (i = 0; i < n; ++i) {
+		if ((uint8_t)text[i] <= ' ') {
+			hexword(d);
 		}
-		else if (strcmp(argv[i], "-T") == 0) {
-			i++;
-			*(type_ptr++) = 'T';
+		else if (d->wordlen < MAX_WORD) {
+			d->word[d->wordlen++] = text[i];
 		}
-		else if (strcmp(argv[i], "-F") == 0) {
-			i++;
-			*(type_ptr++) = 'F';
+		else {
+			d->wordlen = MAX_WORD + 1;		// too long; never hex
 		}
-		else if (strcmp(argv[i], "-N") == 0) {
-			i++;
-			*(type_ptr++) = 'N';
+	}
+}
+
+static int decode(int framing, int hexin, const char* inpath)
+{
+	struct decoder* d;
+	char* text = NULL;
+	ssize_t n;
+	int fd = 0, final = 0, ret = 0;
+
+	if ((d = (struct decoder*)calloc(1, sizeof(struct decoder))) == NULL ||
+		(d->w.buf = (uint8_t*)malloc(OUTSIZE)) == NULL ||
+		(hexin && (text = (char*)malloc(INSIZE)) == NULL)) {
+		fprintf(stderr, "Critical memory error...\n");
+		exit(1);
+	}
+	d->w.fd = 1;
+	d->w.cap = OUTSIZE;
+	d->framing = framing;
+	hex_init();
+
+	if (inpath && (fd = open(inpath, O_RDONLY)) == -1) {
+		perror(inpath);
+		return 1;
+	}
+
+	while (!final) {
+		if (hexin) {
+			n = read(fd, text, INSIZE);
+		}
+		else {
+			reserve(&d->in, INSIZE);
+			n = read(fd, d->in.data + d->in.len, INSIZE);
+		}
+		if (n == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("read");
+			ret = 1;
+			break;
+		}
+		if (n == 0) {
+			final = 1;
+			if (hexin) {
+				hexword(d);
+			}
+		}
+		else if (hexin) {
+			unhex(d, text, n);
+		}
+		else {
+			d->in.len += (int32_t)n;
+		}
+
+		if (frames(d, final) == -1) {
+			ret = 1;
+			break;
+		}
+
+		// Show what has arrived before waiting for more
+		if (flush(&d->w) == -1) {
+			ret = 1;
+			break;
 		}
-		else if (strcmp(argv[i], "-I") == 0) {
+	}
+
+	flush(&d->w);
+	if (fd != 0) {
+		close(fd);
+	}
+	fprintf(stderr, "oscraw: %llu packets, %llu messages, %llu malformed\n",
+			(unsigned long long)d->packets, (unsigned long long)d->messages,
+			(unsigned long long)d->malformed);
+
+	free(text);
+	free(d->in.data);
+	free(d->slip.data);
+	free(d->w.buf);
+	free(d);
+	return ret;
+}
+
+int main (int argc, const char * argv[])
+{
+	struct buffer osc;
+	struct token* tok;
+	const char* outpath = NULL;
+	char* text;
+	int i, n, r, tcp, framing, hexout = 0;
+	uint8_t prefix[4];
+
+	if (argc > 2 && strcmp(argv[1], "-b") == 0) {
+		if (strcmp(argv[2], "tcp") != 0 && strcmp(argv[2], "udp") != 0) {
+			goto help;
+		}
+		for (i = 3; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; ++i) {
+			if (strcmp(argv[i], "-x") == 0) {
+				hexout = 1;
+			}
+			else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+				outpath = argv[++i];
+			}
+			else {
+				goto help;
+			}
+		}
+		if (i < argc - 1) {
+			goto help;
+		}
+		return batch(strcmp(argv[2], "tcp") == 0, hexout, outpath,
+					 i < argc && strcmp(argv[i], "-") != 0 ? argv[i] : NULL);
+	}
+
+	if (argc > 2 && strcmp(argv[1], "-d") == 0) {
+		if (strcmp(argv[2], "tcp") == 0) {
+			framing = FRAME_TCP;
+		}
+		else if (strcmp(argv[2], "udp") == 0) {
+			framing = FRAME_UDP;
+		}
+		else if (strcmp(argv[2], "slip") == 0) {
+			framing = FRAME_SLIP;
+		}
+		else {
+			goto help;
+		}
+		i = 3;
+		if (i < argc && strcmp(argv[i], "-x") == 0) {
+			hexout = 1;
 			i++;
-			*(type_ptr++) = 'I';
 		}
+		if (i < argc - 1) {
+			goto help;
+		}
+		return decode(framing, hexout,
+					  i < argc && strcmp(argv[i], "-") != 0 ? argv[i] : NULL);
 	}
-	
-	printf("\n8-bit hex data is:\n");
-	for (i = 0; i < osc_size; ++i) {
-		printf("%02x ", osc_data[i]);
-		if (i % 16 == 15) {
-			printf("\n");
+
+	if (argc < 3) {
+		goto help;
+	}
+
+	// Check first argument
+	if (strcmp(argv[1], "tcp") != 0 && strcmp(argv[1], "udp") != 0) {
+		printf("Error: First argument must be \"tcp\" or \"udp\"" \
+			   "(without quotes)\n");
+		goto help;
+	}
+	tcp = strcmp(argv[1], "tcp") == 0;
+
+	// Check OSC Address Pattern
+	if (argv[2][0] != '/') {
+		printf("Error: OSC Address Pattern must start with '/' " \
+			   "(forward slash)\n");
+		goto help;
+	}
+
+	tok = (struct token*)malloc(sizeof(struct token) * argc);
+	memset(&osc, 0, sizeof(osc));
+	if (tok == NULL) {
+		fprintf(stderr, "Critical memory error...\n");
+		exit(1);
+	}
+
+	for (i = 3, n = 0; i < argc; i += 1 + r, ++n) {
+		r = token(&tok[n], argv[i], i + 1 < argc ? argv[i+1] : NULL,
+				  i + 1 < argc ? (int32_t)strlen(argv[i+1]) : 0);
+		if (r == -1) {
+			printf("Error: Bad OSC Type or Message\n");
+			goto help;
 		}
-//		else if (i % 8 == 7 || i % 16 == 15) {
-//			printf("   ");
-//		}
 	}
-	printf("\n\n");
-	
-	free(osc_data);
+
+	if (tcp) {
+		reserve(&osc, 4);
+		osc.len = 4;
+	}
+	if (encode(&osc, argv[2], (int32_t)strlen(argv[2]), tok, n) == -1) {
+		printf("Error: %s\n", error);
+		goto help;
+	}
+	if (tcp) {
+		oscstore32(prefix, osc.len - 4);
+		memcpy(osc.data, prefix, 4);
+	}
+
+	hex_init();
+	text = (char*)malloc(osc.len * 3 + osc.len / 16 + 1);
+	if (text == NULL) {
+		fprintf(stderr, "Critical memory error...\n");
+		exit(1);
+	}
+	text[hex_format(text, osc.data, osc.len)] = '\0';
+	printf("\n8-bit hex data is:\n%s\n\n", text);
+
+	free(text);
+	free(tok);
+	free(osc.data);
 	return 0;
-	
+
 help:
 	printf(HELP);
-	
+
     return 0;
 }
@@ -0,0 +1,107 @@
+/******************************************************************************
+ *  oscrawtest
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *  Runs oscraw -b -x on spec files and checks the hex it writes for numbers
+ *  at the edges of their range, and that out-of-range integers and negative
+ *  timetags are refused with an error instead of wrapping.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "../oscpack/osctest.h"
+
+const char usage[] = "usage: oscrawtest [path to oscraw]\n";
+
+static const char* oscraw;
+
+// Compiles spec with oscraw -b udp -x; returns its exit status and the hex
+static int batch(const char* spec, char* hex, size_t size)
+{
+	char path[] = "/tmp/oscrawtestXXXXXX";
+	char cmd[1024];
+	FILE* p;
+	size_t n = 0;
+	int fd, status;
+
+	if ((fd = mkstemp(path)) == -1 || write(fd, spec, strlen(spec)) != (ssize_t)strlen(spec)) {
+		perror("oscrawtest: spec file");
+		exit(1);
+	}
+	close(fd);
+	snprintf(cmd, sizeof(cmd), "%s -b udp -x %s 2>/dev/null", oscraw, path);
+	if ((p = popen(cmd, "r")) == NULL) {
+		perror("oscrawtest: popen");
+		exit(1);
+	}
+	n = fread(hex, 1, size - 1, p);
+	hex[n] = '\0';
+	status = pclose(p);
+	unlink(path);
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// True if spec compiles and its hex output contains bytes
+static int writes(const char* spec, const char* bytes)
+{
+	char hex[4096];
+
+	return batch(spec, hex, sizeof(hex)) == 0 && strstr(hex, bytes) != NULL;
+}
+
+// True if spec is refused
+static int refused(const char* spec)
+{
+	char hex[4096];
+
+	return batch(spec, hex, sizeof(hex)) != 0;
+}
+
+int main (int argc, char* const argv[])
+{
+	oscraw = argc > 1 ? argv[1] : "./oscraw";
+	if (argc > 2 || access(oscraw, X_OK) != 0) {
+		printf(usage);
+		return 1;
+	}
+
+	printf("checks:\n");
+
+	expect(writes("[ 5\n/a -i 1\n]\n", "23 62 75 6e 64 6c 65 00 00 00 00 00 00 00 00 05"),
+		   "a bundle with timetag 5");
+	expect(refused("[ -5\n/a -i 1\n]\n"), "a negative timetag");
+	expect(refused("[ +-5\n/a -i 1\n]\n"), "a timetag with two signs");
+	expect(writes("[ 9223372036854775807\n/a -i 1\n]\n", "7f ff ff ff ff ff ff ff"),
+		   "the largest timetag");
+	expect(refused("[ 9223372036854775808\n/a -i 1\n]\n"), "a timetag past the largest");
+
+	expect(writes("/a -i 2147483647\n", "2c 69 00 00 7f ff ff ff"), "the largest int32");
+	expect(writes("/a -i -2147483648\n", "2c 69 00 00 80 00 00 00"), "the smallest int32");
+	expect(refused("/a -i 2147483648\n"), "an int32 past the largest");
+	expect(refused("/a -i -2147483649\n"), "an int32 past the smallest");
+	expect(writes("/a -h -9223372036854775808\n", "80 00 00 00 00 00 00 00"),
+		   "the smallest int64");
+	expect(refused("/a -h 9223372036854775808\n"), "an int64 past the largest");
+	expect(refused("/a -i 12x\n"), "trailing characters");
+
+	return osctest_report();
+}
@@ -0,0 +1,77 @@
+/******************************************************************************
+ *  osclog
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#include "osclog.h"
+
+#include <string.h>
+
+int osclog_indexed(struct osclog_clock* c, uint64_t t)
+{
+	if (t > c->newest) {
+		c->newest = t;
+	}
+	// newest never falls below lastindex, so a clock step back can not wrap
+	if (c->lastindex && c->newest - c->lastindex < OSCLOG_INDEX_NS) {
+		return 0;
+	}
+	c->lastindex = c->newest;
+	return 1;
+}
+
+uint64_t osclog_seek(const uint8_t* map, uint64_t size, const struct osclog_index* idx,
+					 uint64_t n, uint64_t t)
+{
+	struct osclog_record rec;
+	uint64_t off = sizeof(struct osclog_header), newest = 0;
+	uint64_t lo, hi, mid;
+
+	if (idx && n > 0) {
+		// Last entry at or before t
+		lo = 0;
+		hi = n;
+		while (hi - lo > 1) {
+			mid = (lo + hi) / 2;
+			if (idx[mid].time_ns <= t) {
+				lo = mid;
+			}
+			else {
+				hi = mid;
+			}
+		}
+		if (idx[lo].time_ns <= t && idx[lo].offset < size) {
+			off = idx[lo].offset;
+			newest = idx[lo].time_ns;
+		}
+	}
+
+	// Compare the newest time so far, not each record's, so that records
+	// after a step back do not stop the walk early
+	while (off + sizeof(rec) <= size) {
+		memcpy(&rec, map + off, sizeof(rec));
+		if (rec.time_ns > newest) {
+			newest = rec.time_ns;
+		}
+		if (newest >= t) {
+			break;
+		}
+		off += sizeof(rec) + OSCLOG_PAD(rec.size);
+	}
+	return off < size ? off : size;
+}
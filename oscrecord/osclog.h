@@ -0,0 +1,98 @@
+/******************************************************************************
+ *  osclog
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *
+ *  Capture file format shared by oscrecord and oscreplay.
+ *
+ *  A log is a header followed by records. Each record is a fixed-size
+ *  header and the packet exactly as received, padded to 8 bytes so the next
+ *  record header is aligned and the file can be read in place with mmap().
+ *  Fields are in the byte order of the recording host; osclog_header.bom
+ *  tells a reader whether it can use the file.
+ *
+ *  A log "capture.osclog" has an index "capture.osclog.idx" beside it. The
+ *  index is an array of osclog_index entries, one for about every second of
+ *  capture, so a reader can start at any point in time without scanning.
+ *  Record times follow the clock and may step back; index times are the
+ *  newest record time so far, so the index stays sorted, and a seek finds
+ *  the first record by which the capture reached a time.
+ *
+ ******************************************************************************/
+#ifndef __OSC_LOG_H__
+#define __OSC_LOG_H__
+
+#include <stdint.h>
+
+#define OSCLOG_MAGIC "OSCLOG01"
+#define OSCLOG_BOM 0x01020304u
+
+// Capture time between index entries
+#define OSCLOG_INDEX_NS 1000000000ull
+
+struct osclog_header {
+	char magic[8];			// OSCLOG_MAGIC
+	uint32_t bom;			// OSCLOG_BOM in the writer's byte order
+	uint32_t reserved;
+	uint64_t start_ns;		// CLOCK_REALTIME when recording started
+};
+
+struct osclog_record {
+	uint64_t time_ns;		// CLOCK_REALTIME when the packet was received,
+							// as stamped by the kernel where it can; may
+							// step back with the clock
+	uint32_t size;			// size of the packet that follows
+	uint16_t family;		// AF_INET, AF_INET6 or 0 if the source is unknown
+	uint16_t port;			// source port, network byte order
+	uint8_t addr[16];		// source address, network byte order
+};
+
+struct osclog_index {
+	uint64_t time_ns;		// newest record time up to the one at offset
+	uint64_t offset;		// file offset of a record header
+};
+
+#define OSCLOG_PAD(size) (((size) + 7) & ~(uint64_t)7)
+
+// Index state of a writer; start it zeroed
+struct osclog_clock {
+	uint64_t newest;		// newest record time so far
+	uint64_t lastindex;		// time of the last index entry
+};
+
+/*
+ *	osclog_indexed() tells a writer whether the record it is about to append
+ *	at time t gets an index entry: once the newest time has moved at least
+ *	OSCLOG_INDEX_NS past the last entry. The entry's time is then
+ *	c->lastindex.
+ */
+int osclog_indexed(struct osclog_clock* c, uint64_t t);
+
+/*
+ *	osclog_seek() returns the offset of the first record by which the
+ *	capture reached time t, or size if it never did.
+ *
+ *	Arguments:
+ *		const uint8_t* map: The whole log; records start after the header.
+ *		const struct osclog_index* idx: The index, or NULL to scan from the
+ *										start.
+ */
+uint64_t osclog_seek(const uint8_t* map, uint64_t size, const struct osclog_index* idx,
+					 uint64_t n, uint64_t t);
+
+#endif // __OSC_LOG_H__
@@ -0,0 +1,124 @@
+/******************************************************************************
+ *  osclogtest
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *  Builds a log in memory, one record every 100 ms, in which the clock steps
+ *  back 3 seconds after 6 seconds of capture, indexes it the way oscrecord
+ *  does and checks that the index stays sorted and that seeks before, into
+ *  and past the step land on the first record by which the capture reached
+ *  the time, with and without the index.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "osclog.h"
+#include "../oscpack/osctest.h"
+
+#define RECORDS 120
+#define STEP_AT 60				// first record after the clock steps back
+#define SECOND 1000000000ull
+#define BASE (1000 * SECOND)
+
+static uint8_t map[sizeof(struct osclog_header) + RECORDS * (sizeof(struct osclog_record) + 8)];
+static uint64_t offsets[RECORDS];
+static struct osclog_index idx[RECORDS];
+static int nidx;
+
+// Receive time of record i: 100 ms apart, 3 s back from record STEP_AT on
+static uint64_t when(int i)
+{
+	return BASE + i * (SECOND / 10) - (i >= STEP_AT ? 3 * SECOND : 0);
+}
+
+static uint64_t build(void)
+{
+	struct osclog_clock clock;
+	struct osclog_record rec;
+	uint64_t off = sizeof(struct osclog_header);
+	int i;
+
+	memset(&clock, 0, sizeof(clock));
+	for (i = 0; i < RECORDS; ++i) {
+		if (osclog_indexed(&clock, when(i))) {
+			idx[nidx].time_ns = clock.lastindex;
+			idx[nidx++].offset = off;
+		}
+		memset(&rec, 0, sizeof(rec));
+		rec.time_ns = when(i);
+		rec.size = 8;
+		memcpy(map + off, &rec, sizeof(rec));
+		memcpy(map + off + sizeof(rec), &i, sizeof(i));
+		offsets[i] = off;
+		off += sizeof(rec) + OSCLOG_PAD(rec.size);
+	}
+	return off;
+}
+
+// Record a seek lands on, or RECORDS at the end
+static int record(uint64_t off)
+{
+	int i;
+
+	for (i = 0; i < RECORDS && offsets[i] != off; ++i)
+		;
+	return i;
+}
+
+int main (void)
+{
+	static const struct { double seconds; int record; } seeks[] = {
+		{ 0.0, 0 },			// the start
+		{ 2.05, 21 },		// before the step
+		{ 4.0, 40 },		// not the record at 4.0 s after the step
+		{ 5.95, 90 },		// past the newest time before the step
+		{ 8.9, 119 },		// the last record
+		{ 9.5, RECORDS },	// never reached
+	};
+	char what[96];
+	uint64_t size = build(), newest = 0;
+	int i, j, sorted = 1, reached = 1;
+
+	printf("checks:\n");
+
+	for (i = 0; i < nidx; ++i) {
+		sorted &= i == 0 || idx[i].time_ns >= idx[i - 1].time_ns + OSCLOG_INDEX_NS;
+	}
+	for (i = j = 0; i < RECORDS; ++i) {
+		newest = when(i) > newest ? when(i) : newest;
+		if (j < nidx && idx[j].offset == offsets[i]) {
+			reached &= idx[j++].time_ns == newest;
+		}
+	}
+	printf("    %d index entries for %d records\n", nidx, RECORDS);
+	expect(sorted, "index times rise at least a second apart across the step");
+	expect(reached, "index times are the newest record time at their offset");
+
+	for (i = 0; i < (int)(sizeof(seeks) / sizeof(seeks[0])); ++i) {
+		uint64_t t = BASE + (uint64_t)(seeks[i].seconds * SECOND);
+
+		snprintf(what, sizeof(what), "seek to %.2f s with the index", seeks[i].seconds);
+		expect(record(osclog_seek(map, size, idx, nidx, t)) == seeks[i].record, what);
+		snprintf(what, sizeof(what), "seek to %.2f s without the index", seeks[i].seconds);
+		expect(record(osclog_seek(map, size, NULL, 0, t)) == seeks[i].record, what);
+	}
+
+	return osctest_report();
+}
@@ -0,0 +1,245 @@
+/******************************************************************************
+ *  oscrecord
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *
+ *  This is a command line tool to record received OSC packets, with their
+ *  receive time and source, to a log file that oscreplay can play back.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <netinet/in.h>
+
+#include "osclog.h"
+#include "../oscnet/oscnet.h"
+
+#define OSCRECORD "oscrecord"
+
+// Packets per receive call
+#define BATCH 64
+
+// Bytes buffered before writing to the log
+#define BUFSIZE (4 * 1024 * 1024)
+
+// Index entries buffered before writing to the index
+#define INDEXSIZE 256
+
+const char usage[] =
+"usage: oscrecord file port tcp|udp\n" \
+"       oscrecord file unix:/path|unixdgram:/path|shm://name\n" \
+"\n" \
+"Records until interrupted. An index is written to file.idx.\n" \
+"\n";
+
+static volatile sig_atomic_t done;
+
+struct writer {
+	int fd;
+	int idxfd;
+	uint8_t* buf;
+	int32_t len;
+	uint64_t offset;		// file offset of buf[len]
+	struct osclog_index index[INDEXSIZE];
+	int nindex;
+	struct osclog_clock clock;	// when the next index entry is due
+};
+
+static int writeall(int fd, const void* buf, size_t len)
+{
+	const uint8_t* p = (const uint8_t*)buf;
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = write(fd, p, len)) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+// Write the buffered records, then the index entries that point into them
+static int flushlog(struct writer* w)
+{
+	if (writeall(w->fd, w->buf, w->len) == -1 ||
+		writeall(w->idxfd, w->index, w->nindex * sizeof(struct osclog_index)) == -1) {
+		perror("write");
+		return -1;
+	}
+	w->len = 0;
+	w->nindex = 0;
+	return 0;
+}
+
+static int append(struct writer* w, const oscnet_msg_t* m, uint64_t t)
+{
+	struct osclog_record rec;
+	uint64_t padded = OSCLOG_PAD(m->size);
+
+	if (w->len + sizeof(rec) + padded > BUFSIZE || w->nindex == INDEXSIZE) {
+		if (flushlog(w) == -1) {
+			return -1;
+		}
+	}
+
+	if (osclog_indexed(&w->clock, t)) {
+		w->index[w->nindex].time_ns = w->clock.lastindex;
+		w->index[w->nindex++].offset = w->offset;
+	}
+
+	memset(&rec, 0, sizeof(rec));
+	rec.time_ns = t;
+	rec.size = m->size;
+	if (m->fromlen && m->from.ss_family == AF_INET) {
+		const struct sockaddr_in* sin = (const struct sockaddr_in*)&m->from;
+		rec.family = AF_INET;
+		rec.port = sin->sin_port;
+		memcpy(rec.addr, &sin->sin_addr, 4);
+	}
+	else if (m->fromlen && m->from.ss_family == AF_INET6) {
+		const struct sockaddr_in6* sin6 = (const struct sockaddr_in6*)&m->from;
+		rec.family = AF_INET6;
+		rec.port = sin6->sin6_port;
+		memcpy(rec.addr, &sin6->sin6_addr, 16);
+	}
+
+	memcpy(w->buf + w->len, &rec, sizeof(rec));
+	memcpy(w->buf + w->len + sizeof(rec), m->buf, m->size);
+	memset(w->buf + w->len + sizeof(rec) + m->size, 0, padded - m->size);
+	w->len += sizeof(rec) + padded;
+	w->offset += sizeof(rec) + padded;
+	return 0;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void stop(int sig)
+{
+	(void)sig;
+	done = 1;
+}
+
+int main (int argc, char* const argv[])
+{
+	oscnet_t* net;
+	oscnet_msg_t msgs[BATCH];
+	struct writer w;
+	struct osclog_header hdr;
+	char idxpath[1024];
+	uint64_t t, lastflush, packets = 0, bytes = 0;
+	int i, n;
+
+	if (argc == 3 && oscnet_islocal(argv[2])) {
+		net = oscnet_listen(argv[2], NULL, NULL);
+	}
+	else if (argc == 4) {
+		net = oscnet_listen(NULL, argv[2], argv[3]);
+	}
+	else {
+		printf(usage);
+		return 0;
+	}
+	if (net == NULL) {
+		return 1;
+	}
+	// Kernel receive times where the transport has them; otherwise each packet
+	// is stamped when it is read
+	oscnet_timestamps(net, 1);
+
+	memset(&w, 0, sizeof(w));
+	snprintf(idxpath, sizeof(idxpath), "%s.idx", argv[1]);
+	w.fd = open(argv[1], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	w.idxfd = open(idxpath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	w.buf = (uint8_t*)malloc(BUFSIZE);
+	if (w.fd == -1 || w.idxfd == -1) {
+		perror(argv[1]);
+		return 1;
+	}
+	for (i = 0; i < BATCH; ++i) {
+		msgs[i].buf = (uint8_t*)malloc(OSCNET_MAX_PACKET);
+		msgs[i].bufsize = OSCNET_MAX_PACKET;
+		if (!msgs[i].buf || !w.buf) {
+			fprintf(stderr, "%s: Critical memory error...\n", OSCRECORD);
+			return 1;
+		}
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, OSCLOG_MAGIC, 8);
+	hdr.bom = OSCLOG_BOM;
+	hdr.start_ns = lastflush = now_ns();
+	memcpy(w.buf, &hdr, sizeof(hdr));
+	w.len = w.offset = sizeof(hdr);
+
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+
+	while (!done) {
+		n = oscnet_recvmsgs(net, msgs, BATCH, 500);
+		if (n < 0) {
+			perror("recv");
+			break;
+		}
+
+		for (i = 0; i < n; ++i) {
+			t = msgs[i].stamp_ns ? msgs[i].stamp_ns : now_ns();
+			if (append(&w, &msgs[i], t) == -1) {
+				done = 1;
+				break;
+			}
+			bytes += msgs[i].size;
+		}
+		packets += n;
+
+		// Bound what is lost if the recorder is killed
+		t = now_ns();
+		if (t - lastflush >= OSCLOG_INDEX_NS || t < lastflush) {
+			if (flushlog(&w) == -1) {
+				break;
+			}
+			lastflush = t;
+		}
+	}
+
+	flushlog(&w);
+	close(w.fd);
+	close(w.idxfd);
+	oscnet_close(net);
+
+	fprintf(stderr, "%s: %llu packets, %llu bytes recorded to %s\n", OSCRECORD,
+			(unsigned long long)packets, (unsigned long long)bytes, argv[1]);
+	return 0;
+}
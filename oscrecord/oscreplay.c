@@ -0,0 +1,229 @@
+/******************************************************************************
+ *  oscreplay
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *
+ *  This is a command line tool to send the packets of an oscrecord log again,
+ *  at the original timing, at a scaled speed, or as fast as possible. The
+ *  log is mapped into memory and packets are sent straight from the mapping.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "osclog.h"
+#include "../oscnet/oscnet.h"
+
+#define OSCREPLAY "oscreplay"
+
+// Packets per send call
+#define BATCH 256
+
+const char usage[] =
+"usage: oscreplay [options] file ip port tcp|udp\n" \
+"       oscreplay [options] file unix:/path|unixdgram:/path|shm://name\n" \
+"    Options:\n" \
+"        -x speed    play back speed (default 1.0 = original timing)\n" \
+"        -flat       send as fast as possible\n" \
+"        -s seconds  start this many seconds into the capture\n" \
+"\n";
+
+static uint64_t mono_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t t)
+{
+	struct timespec ts;
+
+	ts.tv_sec = t / 1000000000ull;
+	ts.tv_nsec = t % 1000000000ull;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+		;
+}
+
+// Offset of the first record by which the capture reached time t, using the
+// index if there is one to skip most of the log.
+static uint64_t seek(const uint8_t* map, uint64_t size, const char* path, uint64_t t)
+{
+	char idxpath[1024];
+	struct osclog_index* idx;
+	struct stat st;
+	uint64_t off;
+	int fd;
+
+	snprintf(idxpath, sizeof(idxpath), "%s.idx", path);
+	if ((fd = open(idxpath, O_RDONLY)) != -1) {
+		if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(*idx)) {
+			idx = (struct osclog_index*)mmap(NULL, st.st_size, PROT_READ,
+											  MAP_SHARED, fd, 0);
+			if (idx != MAP_FAILED) {
+				off = osclog_seek(map, size, idx, st.st_size / sizeof(*idx), t);
+				munmap(idx, st.st_size);
+				close(fd);
+				return off;
+			}
+		}
+		close(fd);
+	}
+	return osclog_seek(map, size, NULL, 0, t);
+}
+
+int main (int argc, char* const argv[])
+{
+	oscnet_t* net;
+	const char* path;
+	const uint8_t* map;
+	struct osclog_header hdr;
+	struct osclog_record rec;
+	struct stat st;
+	uint8_t* bufs[BATCH];
+	int32_t sizes[BATCH];
+	uint64_t off, t0 = 0, wall0 = 0, due, now, late, maxlate = 0;
+	uint64_t packets = 0, failed = 0;
+	double speed = 1.0, seconds = 0.0, elapsed;
+	int i, n, flat = 0, fd, first = 1;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; ++i) {
+		if (strcmp(argv[i], "-x") == 0 && i + 1 < argc) {
+			speed = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-flat") == 0) {
+			flat = 1;
+		}
+		else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+			seconds = atof(argv[++i]);
+		}
+		else {
+			printf(usage);
+			return 0;
+		}
+	}
+
+	if (argc - i == 2 && oscnet_islocal(argv[i+1])) {
+		net = oscnet_connect(argv[i+1], NULL, NULL);
+	}
+	else if (argc - i == 4) {
+		net = oscnet_connect(argv[i+1], argv[i+2], argv[i+3]);
+	}
+	else {
+		printf(usage);
+		return 0;
+	}
+	if (net == NULL || speed <= 0.0) {
+		return 1;
+	}
+	path = argv[i];
+
+	if ((fd = open(path, O_RDONLY)) == -1 || fstat(fd, &st) == -1) {
+		perror(path);
+		return 1;
+	}
+	if (st.st_size < (off_t)sizeof(hdr)) {
+		fprintf(stderr, "%s: %s is not a log\n", OSCREPLAY, path);
+		return 1;
+	}
+	map = (const uint8_t*)mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	madvise((void*)map, st.st_size, MADV_SEQUENTIAL);
+
+	memcpy(&hdr, map, sizeof(hdr));
+	if (memcmp(hdr.magic, OSCLOG_MAGIC, 8) != 0 || hdr.bom != OSCLOG_BOM) {
+		fprintf(stderr, "%s: %s is not a log or was recorded on a host with "
+				"different byte order\n", OSCREPLAY, path);
+		return 1;
+	}
+
+	off = seek(map, st.st_size, path, hdr.start_ns + (uint64_t)(seconds * 1e9));
+	elapsed = mono_ns();
+
+	while (off + sizeof(rec) <= (uint64_t)st.st_size) {
+		// Gather every packet that is due now, up to a batch
+		for (n = 0; n < BATCH && off + sizeof(rec) <= (uint64_t)st.st_size; ++n) {
+			memcpy(&rec, map + off, sizeof(rec));
+			if (off + sizeof(rec) + rec.size > (uint64_t)st.st_size) {
+				break;		// truncated log
+			}
+
+			if (!flat) {
+				if (first) {
+					t0 = rec.time_ns;
+					wall0 = mono_ns();
+					first = 0;
+				}
+				// A packet stamped before the one that set the pace (the
+				// clock was stepped back while recording) is due at once
+				if (rec.time_ns < t0) {
+					t0 = rec.time_ns;
+					wall0 = mono_ns();
+				}
+				due = wall0 + (uint64_t)((rec.time_ns - t0) / speed);
+				now = mono_ns();
+				if (due > now) {
+					if (n > 0) {
+						break;		// send what is due first
+					}
+					sleep_until(due);
+					now = mono_ns();
+				}
+				late = now - due;
+				if (late > maxlate) {
+					maxlate = late;
+				}
+			}
+
+			bufs[n] = (uint8_t*)map + off + sizeof(rec);
+			sizes[n] = rec.size;
+			off += sizeof(rec) + OSCLOG_PAD(rec.size);
+		}
+		if (n == 0) {
+			break;
+		}
+
+		i = oscnet_sendv(net, bufs, sizes, n);
+		packets += n;
+		failed += i < 0 ? n : n - i;
+	}
+
+	elapsed = (mono_ns() - elapsed) * 1e-9;
+	fprintf(stderr, "%s: %llu packets in %.3f s (%.0f packets/s), %llu failed",
+			OSCREPLAY, (unsigned long long)packets, elapsed,
+			elapsed > 0 ? packets / elapsed : 0.0, (unsigned long long)failed);
+	if (!flat) {
+		fprintf(stderr, ", max %.1f us late", maxlate / 1e3);
+	}
+	fprintf(stderr, "\n");
+
+	munmap((void*)map, st.st_size);
+	oscnet_close(net);
+	return 0;
+}
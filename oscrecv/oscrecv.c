@@ -0,0 +1,373 @@
+/******************************************************************************
+ *  oscrecv
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *
+ *  This is a command line tool to receive OSC packets via TCP, UDP, unix
+ *  domain sockets or shared memory and print their raw hexidecimal values.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+
+#include "../oscnet/oscnet.h"
+#include "../osctrace/osctrace.h"
+#include "../oscstate/oscstate.h"
+#include "../oscsync/oscsync.h"
+
+#define OSCRECV "oscrecv"
+#define BATCH 64
+
+// Most dictionary entries granted to a delta session
+#define DELTA_ENTRIES 4096
+
+// Packets a reliable endpoint tracks behind the newest
+#define REL_PACKETS 1024
+
+// Values kept for -sync, and the bundles each joining client gets
+#define SYNC_ADDRESSES 65536
+#define SYNC_MTU 1400
+#define SYNC_RATE 10e6		// bytes per second to each client
+#define SYNC_CLIENTS 64
+
+const char usage[] =
+"usage: oscrecv [options] port tcp|udp\n" \
+"       oscrecv [options] unix:/path\n" \
+"       oscrecv [options] unixdgram:/path\n" \
+"       oscrecv [options] shm://name\n" \
+"    Options:\n" \
+"        -trace      take the send time off packets stamped by oscsend -trace\n" \
+"                    and print latency percentiles of each stage on exit\n" \
+"        -hdr file   also write the percentile distribution of each stage\n" \
+"        -q          do not print the packets\n" \
+"        -delta      accept delta sessions from oscsend -delta (tcp only)\n" \
+"        -rel        ask oscsend -rel for the packets that were lost and print\n" \
+"                    how many were recovered on exit (udp only)\n" \
+"        -sync       keep the newest value of every address and bring clients\n" \
+"                    that join with oscjoin up to date (tcp or unix: only)\n" \
+"\n";
+
+// Latency stages of a traced packet
+enum { NETWORK, QUEUE, DISPATCH, HANDLER, TOTAL, STAGES };
+
+static const char* stages[STAGES] = {
+	"network", "queue", "dispatch", "handler", "total"
+};
+
+static volatile sig_atomic_t done;
+
+// A client joined to the values with oscsync, by connection
+struct session {
+	int conn;
+	oscsync_t* sync;
+};
+
+static oscstate_t* state;
+static uint64_t epoch;
+static struct session sessions[SYNC_CLIENTS];
+static int nsessions;
+static uint64_t joins;
+
+static void oscdump(const uint8_t* buf, int32_t size)
+{
+	int32_t i;
+
+	printf("%d bytes:\n", size);
+	for (i = 0; i < size; ++i) {
+		printf("%02x ", buf[i]);
+		if (i % 16 == 15) {
+			printf("\n");
+		}
+	}
+	printf("\n\n");
+}
+
+static void stop(int sig)
+{
+	(void)sig;
+	done = 1;
+}
+
+static uint64_t mono_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Stores the values of a packet, or joins the connection it came on to them
+static void serve(oscnet_t* net, const uint8_t* buf, int32_t size)
+{
+	int conn = oscnet_lastconn(net);
+	int i;
+
+	if (size < 8 || memcmp(buf, "/_sync/", 7) != 0) {
+		oscstate_update(state, buf, size);
+		return;
+	}
+	for (i = 0; i < nsessions && sessions[i].conn != conn; ++i)
+		;
+	if (i == nsessions) {
+		if (conn == -1) {
+			return;
+		}
+		if (nsessions == SYNC_CLIENTS) {
+			fprintf(stderr, "%s: refused a join, %d clients are joined\n", OSCRECV,
+					SYNC_CLIENTS);
+			return;
+		}
+		if ((sessions[i].sync = oscsync_new(state, epoch, SYNC_MTU, SYNC_RATE)) == NULL) {
+			return;
+		}
+		sessions[i].conn = conn;
+		nsessions++;
+	}
+	joins += oscsync_input(sessions[i].sync, buf, size);
+}
+
+// Sends every joined client the bundles its rate allows, and forgets those
+// whose connection is gone. Returns milliseconds until more may go.
+static int32_t publish(oscnet_t* net)
+{
+	uint8_t out[SYNC_MTU];
+	uint64_t now = mono_ns();
+	int64_t wait, least = 500000000;
+	int32_t n;
+	int i;
+
+	for (i = 0; i < nsessions; ++i) {
+		while ((n = oscsync_poll(sessions[i].sync, now, out, sizeof(out))) > 0 &&
+			   oscnet_sendconn(net, sessions[i].conn, out, n) == n)
+			;
+		// A client that left, even with nothing left to send it, frees its
+		// place for the next join
+		if (!oscnet_hasconn(net, sessions[i].conn)) {
+			oscsync_free(sessions[i].sync);
+			sessions[i--] = sessions[--nsessions];
+			continue;
+		}
+		wait = oscsync_timeout(sessions[i].sync, now);
+		if (wait > 0 && wait < least) {
+			least = wait;
+		}
+	}
+	return (int32_t)(least / 1000000) + 1;
+}
+
+// Kernel timestamps are only available on datagram sockets; without one the
+// network stage runs to the dequeue and there is no queue stage.
+static void record(osctrace_hist_t** h, uint64_t stamp, uint64_t kernel,
+				   uint64_t dequeue, uint64_t dispatch, uint64_t end)
+{
+	if (kernel) {
+		osctrace_record(h[NETWORK], (int64_t)(kernel - stamp));
+		osctrace_record(h[QUEUE], (int64_t)(dequeue - kernel));
+	}
+	else {
+		osctrace_record(h[NETWORK], (int64_t)(dequeue - stamp));
+	}
+	osctrace_record(h[DISPATCH], (int64_t)(dispatch - dequeue));
+	osctrace_record(h[HANDLER], (int64_t)(end - dispatch));
+	osctrace_record(h[TOTAL], (int64_t)(end - stamp));
+}
+
+int main (int argc, char* const argv[])
+{
+	oscnet_t* net;
+	oscnet_msg_t msgs[BATCH];
+	osctrace_hist_t* h[STAGES];
+	const char* hdr = NULL;
+	const uint8_t* packet;
+	FILE* fp;
+	oscrel_stats_t rs;
+	uint64_t stamp, dequeue, dispatch;
+	int32_t size, wait;
+	int i, n, trace = 0, quiet = 0, delta = 0, rel = 0, sync = 0;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; ++i) {
+		if (strcmp(argv[i], "-trace") == 0) {
+			trace = 1;
+		}
+		else if (strcmp(argv[i], "-hdr") == 0 && i + 1 < argc) {
+			hdr = argv[++i];
+		}
+		else if (strcmp(argv[i], "-q") == 0) {
+			quiet = 1;
+		}
+		else if (strcmp(argv[i], "-delta") == 0) {
+			delta = 1;
+		}
+		else if (strcmp(argv[i], "-rel") == 0) {
+			rel = 1;
+		}
+		else if (strcmp(argv[i], "-sync") == 0) {
+			sync = 1;
+		}
+		else {
+			printf(usage);
+			return 0;
+		}
+	}
+
+	if (argc - i == 1 && oscnet_islocal(argv[i])) {
+		net = oscnet_listen(argv[i], NULL, NULL);
+	}
+	else if (argc - i == 2) {
+		net = oscnet_listen(NULL, argv[i], argv[i+1]);
+	}
+	else {
+		printf(usage);
+		return 0;
+	}
+
+	if (net == NULL) {
+		return 1;
+	}
+	if (delta && oscnet_delta(net, DELTA_ENTRIES, 0) == -1) {
+		fprintf(stderr, "%s: delta sessions need a tcp endpoint\n", OSCRECV);
+		return 1;
+	}
+	if (rel && oscnet_reliable(net, REL_PACKETS, 0) == -1) {
+		return 1;
+	}
+	if (sync && oscnet_type(net) != OSCNET_TCP && oscnet_type(net) != OSCNET_UNIX) {
+		fprintf(stderr, "%s: sync clients need a tcp or unix: endpoint\n", OSCRECV);
+		return 1;
+	}
+	if (sync && (state = oscstate_new(SYNC_ADDRESSES)) == NULL) {
+		return 1;
+	}
+	// Names this life of the values: a client that joined the last one
+	// gets everything again
+	epoch = osctrace_now();
+
+	for (i = 0; i < BATCH; ++i) {
+		msgs[i].buf = (uint8_t*)malloc(OSCNET_MAX_PACKET);
+		msgs[i].bufsize = OSCNET_MAX_PACKET;
+		if (!msgs[i].buf) {
+			fprintf(stderr, "%s: Critical memory error...\n", OSCRECV);
+			return 1;
+		}
+	}
+
+	if (trace) {
+		for (i = 0; i < STAGES; ++i) {
+			if ((h[i] = osctrace_hist_new()) == NULL) {
+				return 1;
+			}
+		}
+		if (oscnet_timestamps(net, 1) == -1) {
+			fprintf(stderr, "%s: no kernel receive timestamps on this transport\n",
+					OSCRECV);
+		}
+	}
+	if (trace || rel || sync) {
+		signal(SIGINT, stop);
+		signal(SIGTERM, stop);
+	}
+
+	while (!done) {
+		wait = trace || rel ? 500 : -1;
+		if (sync) {
+			wait = publish(net);
+		}
+		n = oscnet_recvmsgs(net, msgs, BATCH, wait);
+		if (n < 0) {
+			perror("recv");
+			break;
+		}
+		dequeue = trace ? osctrace_now() : 0;
+
+		for (i = 0; i < n; ++i) {
+			if (!trace) {
+				if (sync) {
+					serve(net, msgs[i].buf, msgs[i].size);
+				}
+				if (!quiet) {
+					oscdump(msgs[i].buf, msgs[i].size);
+				}
+				continue;
+			}
+			dispatch = osctrace_now();
+			if (osctrace_unstamp(msgs[i].buf, msgs[i].size, &stamp, &packet, &size) == -1) {
+				packet = msgs[i].buf;
+				size = msgs[i].size;
+				stamp = 0;
+			}
+			if (sync) {
+				serve(net, packet, size);
+			}
+			if (!quiet) {
+				oscdump(packet, size);
+			}
+			if (stamp) {
+				record(h, stamp, msgs[i].stamp_ns, dequeue, dispatch, osctrace_now());
+			}
+		}
+		fflush(stdout);
+	}
+
+	if (trace) {
+		osctrace_summary(stderr, NULL, NULL);
+		for (i = 0; i < STAGES; ++i) {
+			osctrace_summary(stderr, stages[i], h[i]);
+		}
+		if (hdr && (fp = fopen(hdr, "w")) == NULL) {
+			perror(hdr);
+		}
+		else if (hdr) {
+			for (i = 0; i < STAGES; ++i) {
+				fprintf(fp, "# %s\n", stages[i]);
+				osctrace_percentiles(fp, h[i], 5);
+				fprintf(fp, "\n");
+			}
+			fclose(fp);
+		}
+		for (i = 0; i < STAGES; ++i) {
+			osctrace_hist_free(h[i]);
+		}
+	}
+
+	if (rel) {
+		oscnet_relstats(net, &rs);
+		fprintf(stderr, "%s: %llu packets received, %llu recovered, %llu duplicates, "
+				"%llu skipped, %llu lost\n", OSCRECV, (unsigned long long)rs.received,
+				(unsigned long long)rs.recovered, (unsigned long long)rs.duplicates,
+				(unsigned long long)rs.skipped, (unsigned long long)rs.lost);
+	}
+
+	if (sync) {
+		fprintf(stderr, "%s: %d addresses up to version %llu, %llu joins served\n",
+				OSCRECV, oscstate_count(state),
+				(unsigned long long)oscstate_version(state), (unsigned long long)joins);
+		for (i = 0; i < nsessions; ++i) {
+			oscsync_free(sessions[i].sync);
+		}
+		oscstate_free(state);
+	}
+
+	oscnet_close(net);
+	for (i = 0; i < BATCH; ++i) {
+		free(msgs[i].buf);
+	}
+	return trace || rel || sync ? 0 : 1;
+}
@@ -0,0 +1,634 @@
+/******************************************************************************
+ *  oscrel
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#include "oscrel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#define DEFAULT_RTT_US 10000
+#define MAX_PACKETS 65536
+
+// State of a sequence number in the receive window
+enum { SLOT_EMPTY, SLOT_RECEIVED, SLOT_MISSING, SLOT_DONE };
+
+// A packet kept for retransmission
+struct entry {
+	uint8_t* data;			// header and packet
+	int32_t size;
+	int32_t cap;
+	uint32_t seq;
+	uint32_t hash;			// of the address of a latest-only message
+	int32_t next;			// next latest-only entry in the same bucket, or -1
+	uint8_t latest;			// latest-only and not superseded yet
+	uint8_t superseded;
+	uint8_t queued;			// waiting to be sent again
+	uint64_t resent_ns;
+};
+
+// A sequence number of the receive window
+struct slot {
+	uint32_t seq;
+	uint8_t state;
+	uint8_t tries;
+	uint64_t due_ns;		// next NACK
+};
+
+struct range {
+	uint32_t first;
+	uint32_t count;
+};
+
+struct oscrel {
+	uint32_t mask;				// packets - 1
+	uint64_t retry_ns;			// between NACKs of the same packet
+	uint64_t holdoff_ns;		// ignore NACKs this soon after a retransmission
+	uint64_t beat_ns;			// first heartbeat after the last packet
+
+	// Sender
+	struct entry* ring;
+	int32_t* buckets;			// latest-only entries by address hash
+	uint32_t seq;				// of the next packet
+	uint32_t* queue;			// sequence numbers to send again
+	uint32_t qhead;
+	uint32_t qtail;
+	struct range skip[OSCREL_RANGES];
+	int nskip;
+	int beats;					// heartbeats since the last packet
+	uint64_t beat_due;
+	char* prefix[OSCREL_PREFIXES];
+	int nprefix;
+
+	// Receiver
+	struct slot* window;
+	uint32_t* missing;			// sequence numbers that may be missing
+	uint32_t nmissing;
+	uint32_t expect;			// next sequence number in order
+	int started;
+
+	oscrel_stats_t stats;
+};
+
+static uint32_t hash(const uint8_t* buf, int32_t len)
+{
+	uint32_t h = 2166136261u;
+	int32_t i;
+
+	for (i = 0; i < len; ++i) {
+		h = (h ^ buf[i]) * 16777619u;
+	}
+	return h;
+}
+
+static void put32(uint8_t* p, uint32_t v)
+{
+	v = htonl(v);
+	memcpy(p, &v, 4);
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return ntohl(v);
+}
+
+oscrel_t* oscrel_new(int32_t packets, int32_t rtt_us)
+{
+	struct timespec ts;
+	oscrel_t* r;
+	uint32_t n = 1;
+
+	if (packets < 1 || packets > MAX_PACKETS || rtt_us < 0) {
+		fprintf(stderr, "oscrel: Invalid number of packets %d\n", packets);
+		return NULL;
+	}
+	while (n < (uint32_t)packets) {
+		n <<= 1;
+	}
+	if ((r = (oscrel_t*)calloc(1, sizeof(oscrel_t))) == NULL) {
+		fprintf(stderr, "oscrel: Critical memory error...\n");
+		return NULL;
+	}
+	if (rtt_us == 0) {
+		rtt_us = DEFAULT_RTT_US;
+	}
+	r->mask = n - 1;
+	r->retry_ns = (uint64_t)rtt_us * 1500 + 1000000;
+	r->holdoff_ns = (uint64_t)rtt_us * 500;
+	r->beat_ns = (uint64_t)rtt_us * 500 + 1000000;
+
+	// Start somewhere random, so a restarted sender is far from where it was
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	r->seq = ((uint32_t)ts.tv_nsec ^ (uint32_t)ts.tv_sec << 20 ^ (uint32_t)getpid() << 8) *
+			 2654435761u;
+	return r;
+}
+
+void oscrel_free(oscrel_t* r)
+{
+	uint32_t i;
+	int k;
+
+	if (!r) {
+		return;
+	}
+	if (r->ring) {
+		for (i = 0; i <= r->mask; ++i) {
+			free(r->ring[i].data);
+		}
+	}
+	for (k = 0; k < r->nprefix; ++k) {
+		free(r->prefix[k]);
+	}
+	free(r->ring);
+	free(r->buckets);
+	free(r->queue);
+	free(r->window);
+	free(r->missing);
+	free(r);
+}
+
+int oscrel_latest(oscrel_t* r, const char* prefix)
+{
+	if (r->nprefix == OSCREL_PREFIXES) {
+		fprintf(stderr, "oscrel: Too many latest-only prefixes\n");
+		return -1;
+	}
+	if ((r->prefix[r->nprefix] = strdup(prefix)) == NULL) {
+		fprintf(stderr, "oscrel: Critical memory error...\n");
+		return -1;
+	}
+	r->nprefix++;
+	return 0;
+}
+
+void oscrel_stats(const oscrel_t* r, oscrel_stats_t* stats)
+{
+	*stats = r->stats;
+}
+
+/* ----------------------------------------------------------------------------
+ *	Sender
+ */
+
+// Size of the address of a latest-only message, or 0
+static int32_t latest(const oscrel_t* r, const uint8_t* packet, int32_t size)
+{
+	const uint8_t* end;
+	size_t len;
+	int k;
+
+	if (r->nprefix == 0 || size < 4 || packet[0] != '/' ||
+		(end = (const uint8_t*)memchr(packet, '\0', size)) == NULL) {
+		return 0;
+	}
+	for (k = 0; k < r->nprefix; ++k) {
+		len = strlen(r->prefix[k]);
+		if (len <= (size_t)(end - packet) && memcmp(packet, r->prefix[k], len) == 0) {
+			return (int32_t)(end - packet);
+		}
+	}
+	return 0;
+}
+
+// Takes a latest-only entry out of its bucket
+static void unlink_latest(oscrel_t* r, int32_t i)
+{
+	int32_t* p = &r->buckets[r->ring[i].hash & (r->mask * 2 + 1)];
+
+	while (*p != -1 && *p != i) {
+		p = &r->ring[*p].next;
+	}
+	if (*p == i) {
+		*p = r->ring[i].next;
+	}
+	r->ring[i].latest = 0;
+}
+
+// Marks the last message to the address of entry i as superseded, and
+// makes entry i the last one
+static void supersede(oscrel_t* r, int32_t i)
+{
+	struct entry* e = &r->ring[i];
+	struct entry* old;
+	int32_t* p = &r->buckets[e->hash & (r->mask * 2 + 1)];
+
+	for (; *p != -1; p = &old->next) {
+		old = &r->ring[*p];
+		if (old->hash == e->hash &&
+			strcmp((const char*)old->data + OSCREL_HEADER,
+				   (const char*)e->data + OSCREL_HEADER) == 0) {
+			old->superseded = 1;
+			old->latest = 0;
+			*p = old->next;
+			break;
+		}
+	}
+	e->latest = 1;
+	e->next = r->buckets[e->hash & (r->mask * 2 + 1)];
+	r->buckets[e->hash & (r->mask * 2 + 1)] = i;
+}
+
+static int sender_init(oscrel_t* r)
+{
+	uint32_t i, n = r->mask + 1;
+
+	r->ring = (struct entry*)calloc(n, sizeof(struct entry));
+	r->buckets = (int32_t*)malloc(n * 2 * sizeof(int32_t));
+	r->queue = (uint32_t*)malloc(n * sizeof(uint32_t));
+	if (!r->ring || !r->buckets || !r->queue) {
+		fprintf(stderr, "oscrel: Critical memory error...\n");
+		free(r->ring);
+		free(r->buckets);
+		free(r->queue);
+		r->ring = NULL;
+		r->buckets = NULL;
+		r->queue = NULL;
+		return -1;
+	}
+	memset(r->buckets, 0xff, n * 2 * sizeof(int32_t));
+	for (i = 0; i < n; ++i) {
+		r->ring[i].next = -1;
+	}
+	return 0;
+}
+
+const uint8_t* oscrel_wrap(oscrel_t* r, const uint8_t* packet, int32_t size,
+						   uint64_t now_ns, int32_t* outsize)
+{
+	int32_t i = (int32_t)(r->seq & r->mask), alen;
+	struct entry* e;
+	uint8_t* data;
+
+	if (!r->ring && sender_init(r) == -1) {
+		return NULL;
+	}
+	e = &r->ring[i];
+	if (e->latest) {
+		unlink_latest(r, i);
+	}
+	if (e->cap < size + OSCREL_HEADER) {
+		if ((data = (uint8_t*)realloc(e->data, size + OSCREL_HEADER)) == NULL) {
+			fprintf(stderr, "oscrel: Critical memory error...\n");
+			return NULL;
+		}
+		e->data = data;
+		e->cap = size + OSCREL_HEADER;
+	}
+	memcpy(e->data, "#rel", 4);
+	put32(e->data + 4, r->seq);
+	memcpy(e->data + OSCREL_HEADER, packet, size);
+	e->size = size + OSCREL_HEADER;
+	e->seq = r->seq++;
+	e->superseded = 0;
+	e->queued = 0;
+	e->resent_ns = 0;
+	if ((alen = latest(r, packet, size)) > 0) {
+		e->hash = hash(packet, alen);
+		supersede(r, i);
+	}
+
+	r->beats = 0;
+	r->beat_due = now_ns + r->beat_ns;
+	r->stats.sent++;
+	*outsize = e->size;
+	return e->data;
+}
+
+// Tells the receiver count packets from seq will not come
+static void skip(oscrel_t* r, uint32_t seq, uint32_t count)
+{
+	struct range* last = r->nskip ? &r->skip[r->nskip - 1] : NULL;
+
+	if (last && last->first + last->count == seq) {
+		last->count += count;
+	}
+	else if (r->nskip < OSCREL_RANGES) {
+		r->skip[r->nskip].first = seq;
+		r->skip[r->nskip++].count = count;
+	}
+	// Otherwise the receiver asks again later
+}
+
+static void nack(oscrel_t* r, uint32_t seq, uint64_t now_ns)
+{
+	struct entry* e = r->ring ? &r->ring[seq & r->mask] : NULL;
+
+	if ((int32_t)(seq - r->seq) >= 0) {
+		return;		// not sent yet
+	}
+	if (!e || e->seq != seq || !e->data) {
+		r->stats.gone++;
+		skip(r, seq, 1);
+	}
+	else if (e->superseded) {
+		r->stats.superseded++;
+		skip(r, seq, 1);
+	}
+	else if (!e->queued && (!e->resent_ns || now_ns - e->resent_ns >= r->holdoff_ns) &&
+			 r->qtail - r->qhead <= r->mask) {
+		e->queued = 1;
+		r->queue[r->qtail++ & r->mask] = seq;
+	}
+}
+
+/* ----------------------------------------------------------------------------
+ *	Receiver
+ */
+
+static int receiver_init(oscrel_t* r)
+{
+	r->window = (struct slot*)calloc(r->mask + 1, sizeof(struct slot));
+	r->missing = (uint32_t*)malloc((r->mask + 1) * sizeof(uint32_t));
+	if (!r->window || !r->missing) {
+		fprintf(stderr, "oscrel: Critical memory error...\n");
+		free(r->window);
+		free(r->missing);
+		r->window = NULL;
+		r->missing = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+// Drops the entries of the missing list that are no longer missing
+static void compact(oscrel_t* r)
+{
+	uint32_t i, n = 0;
+	struct slot* s;
+
+	for (i = 0; i < r->nmissing; ++i) {
+		s = &r->window[r->missing[i] & r->mask];
+		if (s->seq == r->missing[i] && s->state == SLOT_MISSING) {
+			r->missing[n++] = r->missing[i];
+		}
+	}
+	r->nmissing = n;
+}
+
+// Moves the window up to seq, marking the numbers in between missing
+static void advance(oscrel_t* r, uint32_t seq, uint64_t now_ns)
+{
+	struct slot* s;
+	int32_t d = (int32_t)(seq - r->expect);
+
+	if (!r->started || d > (int32_t)r->mask || d < -(int32_t)r->mask) {
+		// First packet, or a sender that started over
+		memset(r->window, 0, (r->mask + 1) * sizeof(struct slot));
+		r->nmissing = 0;
+		r->started = 1;
+		r->expect = seq;
+		return;
+	}
+	for (; (int32_t)(seq - r->expect) > 0; r->expect++) {
+		s = &r->window[r->expect & r->mask];
+		if (s->state == SLOT_MISSING) {
+			r->stats.lost++;		// fell out of the window
+		}
+		s->seq = r->expect;
+		s->state = SLOT_MISSING;
+		s->tries = 0;
+		s->due_ns = now_ns;
+		if (r->nmissing > r->mask) {
+			compact(r);
+		}
+		if (r->nmissing <= r->mask) {
+			r->missing[r->nmissing++] = r->expect;
+		}
+	}
+}
+
+static int32_t receive(oscrel_t* r, uint32_t seq, uint64_t now_ns)
+{
+	struct slot* s;
+	int32_t d;
+
+	if (!r->window && receiver_init(r) == -1) {
+		return -1;
+	}
+	d = (int32_t)(seq - r->expect);
+	if (!r->started || d >= 0 || d < -(int32_t)r->mask) {
+		advance(r, seq, now_ns);
+		s = &r->window[seq & r->mask];
+		if (s->state == SLOT_MISSING) {
+			r->stats.lost++;
+		}
+		s->seq = seq;
+		s->state = SLOT_RECEIVED;
+		r->expect = seq + 1;
+		r->stats.received++;
+		return 1;
+	}
+	s = &r->window[seq & r->mask];
+	if (s->seq == seq && s->state == SLOT_MISSING) {
+		s->state = SLOT_RECEIVED;
+		r->stats.received++;
+		r->stats.recovered++;
+		return 1;
+	}
+	r->stats.duplicates++;
+	return 0;
+}
+
+int32_t oscrel_input(oscrel_t* r, const uint8_t* in, int32_t size, uint64_t now_ns,
+					 const uint8_t** packet)
+{
+	struct slot* s;
+	uint32_t first, count, seq;
+	int32_t i;
+
+	if (size < OSCREL_HEADER || in[0] != '#') {
+		return -1;
+	}
+	if (memcmp(in, "#rel", 4) == 0) {
+		if (receive(r, get32(in + 4), now_ns) != 1) {
+			return 0;
+		}
+		*packet = in + OSCREL_HEADER;
+		return size - OSCREL_HEADER;
+	}
+	if (memcmp(in, "#hbt", 4) == 0) {
+		if (r->window || receiver_init(r) == 0) {
+			advance(r, get32(in + 4), now_ns);
+		}
+		return 0;
+	}
+	if (memcmp(in, "#nak", 4) != 0 && memcmp(in, "#skp", 4) != 0) {
+		return -1;
+	}
+	for (i = 4; i + 8 <= size; i += 8) {
+		first = get32(in + i);
+		count = get32(in + i + 4);
+		if (count > r->mask + 1) {
+			// Only the newest are still in the ring or the window
+			if (in[1] == 'n') {
+				r->stats.gone += count - (r->mask + 1);
+				skip(r, first, count - (r->mask + 1));
+			}
+			first += count - (r->mask + 1);
+			count = r->mask + 1;
+		}
+		for (seq = first; seq != first + count; ++seq) {
+			if (in[1] == 'n') {
+				nack(r, seq, now_ns);
+				continue;
+			}
+			if (r->window && (s = &r->window[seq & r->mask])->seq == seq &&
+				s->state == SLOT_MISSING) {
+				s->state = SLOT_DONE;
+				r->stats.skipped++;
+			}
+		}
+	}
+	return 0;
+}
+
+/* ----------------------------------------------------------------------------
+ *	Output
+ */
+
+// Writes the ranges of missing packets that are due for a NACK
+static int32_t nacks(oscrel_t* r, uint64_t now_ns, uint8_t* out, int32_t outsize)
+{
+	struct slot* s;
+	int32_t len = 4;
+	uint32_t i, seq, first = 0, count = 0;
+
+	compact(r);
+	for (i = 0; i < r->nmissing; ++i) {
+		seq = r->missing[i];
+		s = &r->window[seq & r->mask];
+		if (s->due_ns > now_ns) {
+			continue;
+		}
+		if (s->tries == OSCREL_TRIES) {
+			s->state = SLOT_DONE;
+			r->stats.lost++;
+			continue;
+		}
+		if (count && first + count == seq) {
+			count++;
+		}
+		else {
+			if (count) {
+				put32(out + len, first);
+				put32(out + len + 4, count);
+				len += 8;
+			}
+			if (len + 8 > outsize || len == 4 + OSCREL_RANGES * 8) {
+				count = 0;
+				break;		// the rest go in the next NACK
+			}
+			first = seq;
+			count = 1;
+		}
+		s->tries++;
+		s->due_ns = now_ns + r->retry_ns;
+	}
+	if (count) {
+		put32(out + len, first);
+		put32(out + len + 4, count);
+		len += 8;
+	}
+	if (len == 4) {
+		return 0;
+	}
+	memcpy(out, "#nak", 4);
+	r->stats.nacks++;
+	return len;
+}
+
+int32_t oscrel_poll(oscrel_t* r, uint64_t now_ns, uint8_t* out, int32_t outsize)
+{
+	struct entry* e;
+	uint32_t seq;
+	int32_t len;
+	int k;
+
+	// Retransmissions first, then what the receiver should stop asking for
+	while (r->qhead != r->qtail) {
+		seq = r->queue[r->qhead++ & r->mask];
+		e = &r->ring[seq & r->mask];
+		if (e->seq != seq || !e->queued) {
+			continue;
+		}
+		e->queued = 0;
+		if (e->superseded) {
+			r->stats.superseded++;
+			skip(r, seq, 1);
+			continue;
+		}
+		if (e->size > outsize) {
+			continue;
+		}
+		memcpy(out, e->data, e->size);
+		e->resent_ns = now_ns;
+		r->stats.resent++;
+		return e->size;
+	}
+	if (r->nskip && outsize >= 4 + r->nskip * 8) {
+		memcpy(out, "#skp", 4);
+		for (k = 0, len = 4; k < r->nskip; ++k, len += 8) {
+			put32(out + len, r->skip[k].first);
+			put32(out + len + 4, r->skip[k].count);
+		}
+		r->nskip = 0;
+		return len;
+	}
+	if (r->ring && r->beats < OSCREL_BEATS && now_ns >= r->beat_due && outsize >= 8) {
+		memcpy(out, "#hbt", 4);
+		put32(out + 4, r->seq);
+		r->beat_due = now_ns + (r->beat_ns << ++r->beats);
+		return 8;
+	}
+	if (r->nmissing && outsize >= 12) {
+		return nacks(r, now_ns, out, outsize);
+	}
+	return 0;
+}
+
+int64_t oscrel_timeout(const oscrel_t* r, uint64_t now_ns)
+{
+	const struct slot* s;
+	uint64_t due = UINT64_MAX;
+	uint32_t i;
+
+	if (r->qhead != r->qtail || r->nskip) {
+		return 0;
+	}
+	if (r->ring && r->beats < OSCREL_BEATS) {
+		due = r->beat_due;
+	}
+	for (i = 0; i < r->nmissing; ++i) {
+		s = &r->window[r->missing[i] & r->mask];
+		if (s->seq == r->missing[i] && s->state == SLOT_MISSING && s->due_ns < due) {
+			due = s->due_ns;
+		}
+	}
+	if (due == UINT64_MAX) {
+		return -1;
+	}
+	return due > now_ns ? (int64_t)(due - now_ns) : 0;
+}
@@ -0,0 +1,164 @@
+/******************************************************************************
+ *  oscrel
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#ifndef __OSC_REL_H__
+#define __OSC_REL_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ *	oscrel makes a stream of OSC packets over UDP reliable without the head of
+ *	line blocking of TCP. Each packet is sent with a sequence number and
+ *	handed to the receiving application as soon as it arrives, in or out of
+ *	order. The receiver asks for the numbers it missed (NACK), several at a
+ *	time, and the sender sends them again from a ring of the packets it sent
+ *	last. A packet that fell out of the ring is lost.
+ *
+ *	Messages to addresses marked latest-only (oscrel_latest()) are only
+ *	worth their newest value, like a fader position: once a newer message to
+ *	the same address was sent, an older one is not sent again and the
+ *	receiver is told to stop asking for it.
+ *
+ *	When the sender goes quiet it sends a few heartbeats with the next
+ *	sequence number, so the receiver also finds the packets lost at the end
+ *	of a burst. Senders start at a random sequence number, and one more than
+ *	a window away from the expected one (a sender that restarted) starts the
+ *	stream over.
+ *
+ *	oscrel only builds and reads datagrams; the caller moves them (see
+ *	oscnet_reliable()). Both directions of a stream can share one oscrel_t.
+ *
+ *	Datagram layout (numbers are big-endian uint32):
+ *
+ *		"#rel" seq packet				a packet
+ *		"#nak" first count ...			receiver: send these again
+ *		"#skp" first count ...			sender: these will not be sent again
+ *		"#hbt" next						sender: next sequence number
+ *
+ *	OSC packets start with '/' or "#bundle", so other datagrams pass through.
+ *
+ *	Usage example:
+ *		oscrel_t* r = oscrel_new(1024, 10000);	// 1024 packets, 10 ms RTT
+ *		oscrel_latest(r, "/mixer/");
+ *		out = oscrel_wrap(r, packet, size, now, &outsize);
+ *		send(fd, out, outsize, 0);
+ *		...
+ *		while ((n = oscrel_poll(r, now, buf, sizeof(buf))) > 0)
+ *			send(fd, buf, n, 0);		// retransmissions and control
+ */
+
+// Bytes in front of each packet
+#define OSCREL_HEADER 8
+
+// Ranges in one NACK or skip datagram
+#define OSCREL_RANGES 64
+
+// NACKs sent for a missing packet before it is given up
+#define OSCREL_TRIES 8
+
+// Heartbeats sent after the last packet, each twice as late as the one before
+#define OSCREL_BEATS 6
+
+// Latest-only prefixes of a sender
+#define OSCREL_PREFIXES 16
+
+typedef struct oscrel oscrel_t;
+
+/*
+ *	oscrel_new() creates the state of one stream.
+ *
+ *	Arguments:
+ *		int32_t packets: Packets the sender keeps to send again and the
+ *						 receiver tracks behind the newest, rounded up to a
+ *						 power of two.
+ *		int32_t rtt_us: Round trip time the timers are based on, or 0 for
+ *						10 ms.
+ *
+ *	Return:
+ *		State, or NULL on error.
+ */
+oscrel_t* oscrel_new(int32_t packets, int32_t rtt_us);
+void oscrel_free(oscrel_t* r);
+
+/* Marks messages whose address starts with prefix as latest-only. */
+int oscrel_latest(oscrel_t* r, const char* prefix);
+
+/*
+ *	oscrel_wrap() numbers a packet and keeps it for retransmission.
+ *
+ *	Return:
+ *		The datagram to send (OSCREL_HEADER + size bytes), or NULL if memory
+ *		ran out. It stays in place until the ring comes round to it again,
+ *		packets calls later.
+ */
+const uint8_t* oscrel_wrap(oscrel_t* r, const uint8_t* packet, int32_t size,
+						   uint64_t now_ns, int32_t* outsize);
+
+/*
+ *	oscrel_input() reads a datagram from the other end.
+ *
+ *	Arguments:
+ *		const uint8_t** packet: Set to the packet in the datagram.
+ *
+ *	Return:
+ *		Size of a packet seen for the first time, 0 for a duplicate or a
+ *		control datagram, or -1 if it is not an oscrel datagram.
+ */
+int32_t oscrel_input(oscrel_t* r, const uint8_t* in, int32_t size, uint64_t now_ns,
+					 const uint8_t** packet);
+
+/*
+ *	oscrel_poll() writes the next datagram that is due: a retransmission, a
+ *	skip, a heartbeat or a NACK. Call it until it returns 0 after every
+ *	send and input, and when oscrel_timeout() has passed.
+ *
+ *	Return:
+ *		Size of the datagram, or 0 if nothing is due. out must hold the
+ *		largest packet plus OSCREL_HEADER.
+ */
+int32_t oscrel_poll(oscrel_t* r, uint64_t now_ns, uint8_t* out, int32_t outsize);
+
+/* Nanoseconds until oscrel_poll() has something to send, or -1 if never. */
+int64_t oscrel_timeout(const oscrel_t* r, uint64_t now_ns);
+
+typedef struct {
+	uint64_t sent;			// packets wrapped
+	uint64_t resent;		// retransmissions
+	uint64_t superseded;	// asked for, but a newer value was sent
+	uint64_t gone;			// asked for, but no longer in the ring
+	uint64_t received;		// packets received for the first time
+	uint64_t recovered;		// of them, packets that were missing
+	uint64_t duplicates;
+	uint64_t skipped;		// missing packets the sender will not send
+	uint64_t lost;			// missing packets given up
+	uint64_t nacks;			// NACK datagrams sent
+} oscrel_stats_t;
+
+void oscrel_stats(const oscrel_t* r, oscrel_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __OSC_REL_H__
@@ -0,0 +1,735 @@
+/******************************************************************************
+ *  oscreltest
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *
+ *  Checks retransmission, latest-only skips, heartbeats, lost packets and
+ *  restarts between two oscrel states in memory, and that a reliable sender
+ *  keeps the packets it reads along with the requests. Then sends one fader
+ *  value per millisecond and a cue every 10 ms through a proxy on loopback
+ *  that delays each direction by 5 ms and drops packets in bursts, and prints
+ *  cue latency, cues later than 15 ms, losses, stale fader values that
+ *  arrived after a newer one, goodput and the bytes sent beyond the
+ *  messages themselves for plain UDP, oscrel, oscrel with latest-only
+ *  faders, and TCP.
+ *
+ *  The proxy cannot drop TCP segments, so for TCP it holds back what it
+ *  would have lost, and everything behind it, until TCP would have sent it
+ *  again: three segments later plus a round trip (fast retransmit), after a
+ *  tail loss probe (two round trips, at least 10 ms) plus a round trip, or
+ *  200 ms later if the retransmission was lost too.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "oscrel.h"
+#include "../oscnet/oscnet.h"
+#include "../oscpack/oscpack.h"
+#include "../oscpack/oscunpack.h"
+#include "../oscpack/osctest.h"
+
+const char usage[] = "usage: oscreltest [seconds] [loss percent] [port]\n";
+
+#define MS 1000000ull
+#define DELAY (5 * MS)			// one way
+#define RTO (200 * MS)
+#define FADERS 16
+#define HELD 8192				// packets in flight in the proxy
+#define MAXSIZE 2048
+
+enum { UDP, REL, LATEST, TCP, MODES };
+
+static const char* modes[MODES] = { "udp", "oscrel", "latest", "tcp" };
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* ----------------------------------------------------------------------------
+ *	Checks in memory
+ */
+
+// Moves every datagram the sender has due to the receiver, and back
+static void exchange(oscrel_t* tx, oscrel_t* rx, uint64_t t, int* delivered)
+{
+	uint8_t buf[MAXSIZE];
+	const uint8_t* packet;
+	int32_t n;
+	int more = 1;
+
+	while (more) {
+		more = 0;
+		while ((n = oscrel_poll(tx, t, buf, sizeof(buf))) > 0) {
+			if (oscrel_input(rx, buf, n, t, &packet) > 0) {
+				(*delivered)++;
+			}
+			more = 1;
+		}
+		while ((n = oscrel_poll(rx, t, buf, sizeof(buf))) > 0) {
+			oscrel_input(tx, buf, n, t, &packet);
+			more = 1;
+		}
+	}
+}
+
+// Wraps a message and hands it to the receiver unless it is lost
+static int32_t deliver(oscrel_t* tx, oscrel_t* rx, const char* addr, int32_t v, uint64_t t,
+					   int lost)
+{
+	uint8_t buf[64];
+	const uint8_t* out;
+	const uint8_t* packet;
+	int32_t size = oscpack(buf, addr, "i", v), n;
+
+	out = oscrel_wrap(tx, buf, size, t, &n);
+	if (lost) {
+		return 0;
+	}
+	return oscrel_input(rx, out, n, t, &packet) == size &&
+		   memcmp(packet, buf, size) == 0 ? 1 : -1;
+}
+
+static void check(void)
+{
+	oscrel_t *tx = oscrel_new(64, 1000), *rx = oscrel_new(64, 1000);
+	oscrel_stats_t st;
+	uint8_t buf[MAXSIZE];
+	const uint8_t* packet;
+	uint64_t t = MS;
+	int32_t n;
+	int i, ok = 1, got = 0;
+
+	// Losses in the middle are asked for and sent again
+	for (i = 0; i < 20; ++i) {
+		ok &= deliver(tx, rx, "/cue", i, t, i == 3 || i == 4 || i == 10) >= 0;
+	}
+	expect(ok, "in order packets delivered");
+	exchange(tx, rx, t, &got);
+	expect(got == 3, "three packets sent again");
+	oscrel_stats(rx, &st);
+	expect(st.recovered == 3 && st.nacks == 1 && st.received == 20, "one nack");
+	expect(deliver(tx, rx, "/cue", 20, t, 0) == 1, "packet after recovery");
+
+	// A packet that comes twice is delivered once
+	oscrel_wrap(tx, buf, oscpack(buf, "/cue", "i", 21), t, &n);
+	memcpy(buf, oscrel_wrap(tx, buf, oscpack(buf, "/cue", "i", 22), t, &n), n);
+	expect(oscrel_input(rx, buf, n, t, &packet) > 0 && oscrel_input(rx, buf, n, t, &packet) == 0,
+		   "duplicate dropped");
+	exchange(tx, rx, t, &got);		// 21 was lost
+
+	// Latest-only: a lost fader value that was replaced is skipped
+	oscrel_latest(tx, "/fader/");
+	got = 0;
+	deliver(tx, rx, "/fader/1", 1, t, 1);
+	deliver(tx, rx, "/cue", 2, t, 1);
+	deliver(tx, rx, "/fader/1", 3, t, 0);
+	deliver(tx, rx, "/fader/2", 4, t, 1);
+	deliver(tx, rx, "/cue", 5, t, 0);
+	exchange(tx, rx, t, &got);
+	oscrel_stats(tx, &st);
+	expect(got == 2 && st.superseded == 1, "superseded value skipped");
+	oscrel_stats(rx, &st);
+	expect(st.skipped == 1, "receiver stops asking");
+
+	// A loss at the end is found by a heartbeat
+	got = 0;
+	deliver(tx, rx, "/cue", 6, t, 1);
+	exchange(tx, rx, t, &got);
+	expect(got == 0 && oscrel_timeout(tx, t) > 0, "heartbeat pending");
+	t += oscrel_timeout(tx, t);
+	exchange(tx, rx, t, &got);
+	expect(got == 1, "tail loss sent again");
+
+	// A packet that fell out of the ring is gone
+	oscrel_free(rx);
+	rx = oscrel_new(256, 1000);
+	got = 0;
+	deliver(tx, rx, "/cue", 7, t, 0);
+	for (i = 0; i < 100; ++i) {
+		oscrel_wrap(tx, buf, oscpack(buf, "/bulk", "i", i), t, &n);
+	}
+	deliver(tx, rx, "/cue", 8, t, 0);
+	exchange(tx, rx, t, &got);
+	oscrel_stats(tx, &st);
+	expect(got == 63 && st.gone == 37, "packets out of the ring are skipped");
+	oscrel_stats(rx, &st);
+	expect(st.skipped == 37, "receiver stops asking for them");
+
+	// Unanswered NACKs give up
+	oscrel_free(tx);
+	tx = oscrel_new(64, 1000);
+	oscrel_free(rx);
+	rx = oscrel_new(64, 1000);
+	deliver(tx, rx, "/cue", 0, t, 0);
+	deliver(tx, rx, "/cue", 1, t, 1);
+	deliver(tx, rx, "/cue", 2, t, 0);
+	for (i = 0; i <= OSCREL_TRIES; ++i, t += 100 * MS) {
+		while (oscrel_poll(rx, t, buf, sizeof(buf)) > 0) {
+		}
+	}
+	oscrel_stats(rx, &st);
+	expect(st.lost == 1 && st.nacks == OSCREL_TRIES && oscrel_timeout(rx, t) == -1,
+		   "nacks give up");
+
+	// A sender that restarts is followed
+	oscrel_free(tx);
+	tx = oscrel_new(64, 1000);
+	got = 0;
+	for (i = 0; i < 3; ++i) {
+		got += deliver(tx, rx, "/cue", i, t, 0);
+	}
+	expect(got == 3, "restarted sender");
+	oscrel_free(tx);
+	oscrel_free(rx);
+}
+
+// The far end of a reliable sender sends too: what arrives while the sender
+// reads its requests is kept for oscnet_recv(), plain or wrapped
+static void checkheld(int port)
+{
+	struct sockaddr_in sin, from;
+	socklen_t len = sizeof(from);
+	oscrel_t* far = oscrel_new(64, 1000);
+	oscrel_stats_t st;
+	oscnet_t* tx;
+	uint8_t buf[MAXSIZE], plain[64], wrapped[64];
+	const uint8_t* out;
+	char sport[16];
+	int32_t size, psize, wsize;
+	int fd;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sin.sin_port = htons(port);
+	snprintf(sport, sizeof(sport), "%d", port);
+	if (!far || (fd = socket(AF_INET, SOCK_DGRAM, 0)) == -1 ||
+		bind(fd, (struct sockaddr*)&sin, sizeof(sin)) == -1 ||
+		(tx = oscnet_connect("127.0.0.1", sport, "udp")) == NULL ||
+		oscnet_reliable(tx, 64, 1000) == -1) {
+		perror("oscreltest: checkheld");
+		osctest_errors++;
+		return;
+	}
+
+	size = oscpack(buf, "/cue", "i", 0);
+	oscnet_send(tx, buf, size);
+	recvfrom(fd, buf, sizeof(buf), 0, (struct sockaddr*)&from, &len);
+	psize = oscpack(plain, "/plain", "i", 1);
+	sendto(fd, plain, psize, 0, (struct sockaddr*)&from, len);
+	wsize = oscpack(wrapped, "/wrapped", "i", 2);
+	out = oscrel_wrap(far, wrapped, wsize, now_ns(), &size);
+	sendto(fd, out, size, 0, (struct sockaddr*)&from, len);
+
+	// The next send reads both while it looks for requests
+	size = oscpack(buf, "/cue", "i", 1);
+	oscnet_send(tx, buf, size);
+	size = oscnet_recv(tx, buf, sizeof(buf), 0);
+	expect(size == psize && memcmp(buf, plain, psize) == 0,
+		   "a plain packet read while sending is kept");
+	size = oscnet_recv(tx, buf, sizeof(buf), 0);
+	expect(size == wsize && memcmp(buf, wrapped, wsize) == 0,
+		   "an oscrel packet read while sending is kept");
+	oscnet_relstats(tx, &st);
+	expect(st.sent == 2 && st.received == 1 && st.duplicates == 0, "stream counters");
+
+	oscnet_close(tx);
+	oscrel_free(far);
+	close(fd);
+}
+
+/* ----------------------------------------------------------------------------
+ *	Lossy link
+ */
+
+// Gilbert-Elliott loss: bursts in a bad state
+struct link {
+	double to_bad;
+	double to_good;
+	double bad_loss;
+	int bad;
+	unsigned seed;
+};
+
+static int lose(struct link* l)
+{
+	double u = (double)rand_r(&l->seed) / RAND_MAX;
+
+	l->bad = l->bad ? u >= l->to_good : u < l->to_bad;
+	return l->bad && (double)rand_r(&l->seed) / RAND_MAX < l->bad_loss;
+}
+
+static void link_init(struct link* l, double loss, unsigned seed)
+{
+	double bad = loss / 0.7;		// time in the bad state
+
+	l->to_good = 0.3;				// bursts of about 3 packets
+	l->bad_loss = 0.7;
+	l->to_bad = bad < 1 ? bad * l->to_good / (1 - bad) : 1;
+	l->bad = 0;
+	l->seed = seed;
+}
+
+struct held {
+	uint64_t due;
+	int up;					// toward the receiver
+	int lost;				// tcp: waiting for the retransmission
+	int dupacks;
+	int32_t size;
+	uint8_t data[MAXSIZE];
+};
+
+struct proxy {
+	pthread_t thread;
+	int mode;
+	int in;					// sender side
+	int out;				// receiver side
+	struct sockaddr_in sender;
+	struct sockaddr_in receiver;
+	int have_sender;
+	struct link up;
+	struct link down;
+	struct held* held;
+	uint32_t head;
+	uint32_t tail;
+	uint64_t bytes;			// sent by the end points
+	volatile int stop;
+};
+
+static struct held* hold(struct proxy* p)
+{
+	if (p->tail - p->head == HELD) {
+		return NULL;
+	}
+	return &p->held[p->tail++ % HELD];
+}
+
+// Forwards datagrams both ways after DELAY, unless the link loses them
+static void udp_proxy(struct proxy* p)
+{
+	struct pollfd pfd[2];
+	struct held* h;
+	socklen_t len;
+	uint64_t t;
+	int32_t n, wait;
+	uint8_t buf[MAXSIZE];
+
+	pfd[0].fd = p->in;
+	pfd[1].fd = p->out;
+	pfd[0].events = pfd[1].events = POLLIN;
+	while (!p->stop) {
+		t = now_ns();
+		wait = p->head == p->tail ? 10 :
+			   (int32_t)(p->held[p->head % HELD].due > t ?
+						 (p->held[p->head % HELD].due - t + MS - 1) / MS : 0);
+		poll(pfd, 2, wait);
+		for (;;) {
+			len = sizeof(p->sender);
+			if ((n = recvfrom(p->in, buf, sizeof(buf), MSG_DONTWAIT,
+							  (struct sockaddr*)&p->sender, &len)) <= 0) {
+				break;
+			}
+			p->have_sender = 1;
+			p->bytes += n;
+			if (!lose(&p->up) && (h = hold(p)) != NULL) {
+				h->due = now_ns() + DELAY;
+				h->up = 1;
+				h->size = n;
+				memcpy(h->data, buf, n);
+			}
+		}
+		while ((n = recv(p->out, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+			p->bytes += n;
+			if (!lose(&p->down) && (h = hold(p)) != NULL) {
+				h->due = now_ns() + DELAY;
+				h->up = 0;
+				h->size = n;
+				memcpy(h->data, buf, n);
+			}
+		}
+		for (t = now_ns(); p->head != p->tail && p->held[p->head % HELD].due <= t; p->head++) {
+			h = &p->held[p->head % HELD];
+			if (h->up) {
+				sendto(p->out, h->data, h->size, 0, (struct sockaddr*)&p->receiver,
+					   sizeof(p->receiver));
+			}
+			else if (p->have_sender) {
+				sendto(p->in, h->data, h->size, 0, (struct sockaddr*)&p->sender,
+					   sizeof(p->sender));
+			}
+		}
+	}
+}
+
+// Forwards a TCP stream, holding it back as TCP would recover from losses
+static void tcp_proxy(struct proxy* p)
+{
+	struct pollfd pfd;
+	struct held* h;
+	uint64_t t, pto = 4 * DELAY > 10 * MS ? 4 * DELAY : 10 * MS;
+	uint32_t i;
+	int32_t n, wait;
+	int fd;
+
+	if ((fd = accept(p->in, NULL, NULL)) == -1) {
+		perror("oscreltest: accept");
+		return;
+	}
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while (!p->stop) {
+		t = now_ns();
+		wait = p->head == p->tail ? 10 :
+			   (int32_t)(p->held[p->head % HELD].due > t ?
+						 (p->held[p->head % HELD].due - t + MS - 1) / MS : 0);
+		if (poll(&pfd, 1, wait) == 1 && (h = hold(p)) != NULL) {
+			if ((n = read(fd, h->data, sizeof(h->data))) <= 0) {
+				p->tail--;
+				break;
+			}
+			t = now_ns();
+			p->bytes += n;
+			h->size = n;
+			h->dupacks = 0;
+			h->lost = lose(&p->up);
+			h->due = t + DELAY;
+			if (h->lost) {
+				// Found by a tail loss probe unless three segments come first
+				h->due = t + pto + 3 * DELAY;
+				if (lose(&p->up)) {
+					h->due += RTO;
+				}
+				p->bytes += n;
+			}
+			for (i = p->head; i != p->tail - 1; ++i) {
+				struct held* e = &p->held[i % HELD];
+				if (e->lost && ++e->dupacks == 3 && t + 3 * DELAY < e->due) {
+					e->due = t + 3 * DELAY;
+				}
+			}
+		}
+		// In order: nothing passes a segment that is held back
+		for (t = now_ns(); p->head != p->tail && p->held[p->head % HELD].due <= t; p->head++) {
+			h = &p->held[p->head % HELD];
+			if (write(p->out, h->data, h->size) != h->size) {
+				p->stop = 1;
+			}
+		}
+	}
+	close(fd);
+}
+
+static void* proxy_main(void* arg)
+{
+	struct proxy* p = (struct proxy*)arg;
+
+	if (p->mode == TCP) {
+		tcp_proxy(p);
+	}
+	else {
+		udp_proxy(p);
+	}
+	return NULL;
+}
+
+static int proxy_open(struct proxy* p, int mode, int port, double loss)
+{
+	struct sockaddr_in sin;
+	int yes = 1, type = mode == TCP ? SOCK_STREAM : SOCK_DGRAM;
+
+	memset(p, 0, sizeof(*p));
+	p->mode = mode;
+	link_init(&p->up, loss, 7);
+	link_init(&p->down, loss, 11);
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sin.sin_port = htons(port);
+	p->receiver = sin;
+	p->receiver.sin_port = htons(port + 1);
+	if ((p->held = (struct held*)malloc(HELD * sizeof(struct held))) == NULL ||
+		(p->in = socket(AF_INET, type, 0)) == -1 ||
+		setsockopt(p->in, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) == -1 ||
+		bind(p->in, (struct sockaddr*)&sin, sizeof(sin)) == -1 ||
+		(mode == TCP && listen(p->in, 1) == -1) ||
+		(p->out = socket(AF_INET, type, 0)) == -1) {
+		perror("oscreltest: proxy");
+		return -1;
+	}
+	if (mode == TCP) {
+		setsockopt(p->out, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+		if (connect(p->out, (struct sockaddr*)&p->receiver, sizeof(p->receiver)) == -1) {
+			perror("oscreltest: connect");
+			return -1;
+		}
+	}
+	return pthread_create(&p->thread, NULL, proxy_main, p);
+}
+
+static void proxy_close(struct proxy* p)
+{
+	p->stop = 1;
+	pthread_join(p->thread, NULL);
+	close(p->in);
+	close(p->out);
+	free(p->held);
+}
+
+/* ----------------------------------------------------------------------------
+ *	Cues and faders over the proxy
+ */
+
+struct receiver {
+	pthread_t thread;
+	oscnet_t* net;
+	int32_t* latency;		// of each cue, in us
+	uint8_t* seen;			// cues received
+	int cues;
+	int faders;
+	int stale;				// fader values older than one received before
+	int32_t last[FADERS];
+	uint64_t bytes;			// of the messages that were of use
+	volatile int stop;
+};
+
+static void* receive_main(void* arg)
+{
+	struct receiver* r = (struct receiver*)arg;
+	static uint8_t bufs[64][MAXSIZE];
+	oscnet_msg_t msgs[64];
+	oscmsg_t msg;
+	oscargs_t it;
+	oscarg_t stamp, count;
+	uint64_t t;
+	int i, n, ch;
+
+	for (i = 0; i < 64; ++i) {
+		msgs[i].buf = bufs[i];
+		msgs[i].bufsize = MAXSIZE;
+	}
+	while (!r->stop) {
+		if ((n = oscnet_recvmsgs(r->net, msgs, 64, 10)) < 0) {
+			break;
+		}
+		t = now_ns();
+		for (i = 0; i < n; ++i) {
+			if (oscunpack(msgs[i].buf, msgs[i].size, &msg) == -1) {
+				continue;
+			}
+			oscargs(&msg, &it);
+			if (!oscargs_next(&it, &stamp) || !oscargs_next(&it, &count)) {
+				continue;
+			}
+			if (strcmp(msg.address, "/cue/go") == 0 && !r->seen[count.i]) {
+				r->seen[count.i] = 1;
+				r->latency[r->cues++] = (int32_t)((t - (uint64_t)stamp.h) / 1000);
+				r->bytes += msgs[i].size;
+			}
+			else if (sscanf(msg.address, "/mixer/ch/%d/gain", &ch) == 1 &&
+					 ch >= 0 && ch < FADERS) {
+				r->faders++;
+				if (count.i < r->last[ch]) {
+					r->stale++;
+					continue;
+				}
+				r->last[ch] = count.i;
+				r->bytes += msgs[i].size;
+			}
+		}
+	}
+	return NULL;
+}
+
+static int bylatency(const void* a, const void* b)
+{
+	return *(const int32_t*)a - *(const int32_t*)b;
+}
+
+// Sends a packet over tcp with the size prefix
+static void tcp_send(int fd, const uint8_t* buf, int32_t size)
+{
+	uint32_t prefix = htonl((uint32_t)size);
+	uint8_t out[MAXSIZE + 4];
+
+	memcpy(out, &prefix, 4);
+	memcpy(out + 4, buf, size);
+	if (write(fd, out, size + 4) != size + 4) {
+		perror("oscreltest: write");
+	}
+}
+
+static void run(int mode, int seconds, double loss, int port)
+{
+	struct proxy p;
+	struct receiver r;
+	struct timespec ts;
+	struct sockaddr_in sin;
+	oscnet_t* tx = NULL;
+	oscrel_stats_t st;
+	uint8_t buf[128];
+	char addr[32];
+	uint64_t start, t, packets = 0;
+	int32_t size;
+	int k, ticks = seconds * 1000, fd = -1, yes = 1, lost, late;
+	char sport[16], rport[16];
+
+	memset(&r, 0, sizeof(r));
+	memset(r.last, 0xff, sizeof(r.last));
+	r.latency = (int32_t*)malloc(ticks / 10 * sizeof(int32_t) + 4);
+	r.seen = (uint8_t*)calloc(ticks / 10 + 1, 1);
+	snprintf(sport, sizeof(sport), "%d", port);
+	snprintf(rport, sizeof(rport), "%d", port + 1);
+	if (!r.latency || !r.seen ||
+		(r.net = oscnet_listen("127.0.0.1", rport, mode == TCP ? "tcp" : "udp")) == NULL ||
+		proxy_open(&p, mode, port, loss) != 0) {
+		osctest_errors++;
+		return;
+	}
+	if (mode == TCP) {
+		memset(&sin, 0, sizeof(sin));
+		sin.sin_family = AF_INET;
+		sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		sin.sin_port = htons(port);
+		if ((fd = socket(AF_INET, SOCK_STREAM, 0)) == -1 ||
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes)) == -1 ||
+			connect(fd, (struct sockaddr*)&sin, sizeof(sin)) == -1) {
+			perror("oscreltest: connect");
+			osctest_errors++;
+			return;
+		}
+	}
+	else {
+		tx = oscnet_connect("127.0.0.1", sport, "udp");
+		if (mode != UDP) {
+			oscnet_reliable(tx, 1024, 2 * DELAY / 1000);
+			oscnet_reliable(r.net, 1024, 2 * DELAY / 1000);
+		}
+		if (mode == LATEST) {
+			oscnet_latest(tx, "/mixer/");
+		}
+	}
+	pthread_create(&r.thread, NULL, receive_main, &r);
+
+	start = now_ns();
+	for (k = 0; k < ticks; ++k) {
+		t = start + (uint64_t)k * MS;
+		ts.tv_sec = t / 1000000000ull;
+		ts.tv_nsec = t % 1000000000ull;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+		for (lost = 0; lost < (k % 10 == 0 ? 2 : 1); ++lost) {
+			if (lost) {
+				size = oscpack(buf, "/cue/go", "hi", (int64_t)now_ns(), k / 10);
+			}
+			else {
+				snprintf(addr, sizeof(addr), "/mixer/ch/%d/gain", k % FADERS);
+				size = oscpack(buf, addr, "hi", (int64_t)now_ns(), k);
+			}
+			packets += size;
+			if (fd != -1) {
+				tcp_send(fd, buf, size);
+			}
+			else {
+				oscnet_send(tx, buf, size);
+			}
+		}
+		if (mode == REL || mode == LATEST) {
+			oscnet_service(tx, 0);
+		}
+	}
+	t = now_ns();
+	if (mode == REL || mode == LATEST) {
+		oscnet_service(tx, 1000);
+	}
+	ts.tv_sec = 0;
+	ts.tv_nsec = (long)(RTO + 8 * DELAY);
+	nanosleep(&ts, NULL);
+	r.stop = 1;
+	pthread_join(r.thread, NULL);
+	proxy_close(&p);
+
+	qsort(r.latency, r.cues, sizeof(int32_t), bylatency);
+	for (k = 0, late = 0; k < r.cues; ++k) {
+		late += r.latency[k] > (int32_t)(3 * DELAY / 1000);
+	}
+	lost = ticks / 10 - r.cues;
+	printf("    %-7s %6.1f %6.1f %6.1f %5d %5d %7.1f%% %6d %8.1f %8.1f%%\n", modes[mode],
+		   r.cues ? r.latency[r.cues / 2] / 1e3 : -1, r.cues ? r.latency[r.cues * 99 / 100] / 1e3 : -1,
+		   r.cues ? r.latency[r.cues - 1] / 1e3 : -1, late, lost,
+		   100.0 * r.faders / ticks, r.stale, r.bytes / ((t - start) / 1e9) / 1e3,
+		   100.0 * ((double)p.bytes - packets) / packets);
+	if (mode == REL || mode == LATEST) {
+		oscnet_relstats(tx, &st);
+		expect(lost == 0, "oscrel delivers every cue");
+		expect(mode == REL || r.stale == 0, "latest-only sends no stale values");
+	}
+	if (mode == TCP) {
+		expect(lost == 0 && r.stale == 0, "tcp delivers everything in order");
+	}
+	(void)st;
+	oscnet_close(tx);
+	oscnet_close(r.net);
+	if (fd != -1) {
+		close(fd);
+	}
+	free(r.latency);
+	free(r.seen);
+}
+
+int main (int argc, char* const argv[])
+{
+	int mode, seconds = 3, port = 17390;
+	double loss = 2;
+
+	if (argc > 1 && argv[1][0] == '-') {
+		printf(usage);
+		return 0;
+	}
+	if (argc > 1) seconds = atoi(argv[1]);
+	if (argc > 2) loss = atof(argv[2]);
+	if (argc > 3) port = atoi(argv[3]);
+	if (seconds < 1 || loss < 0 || loss >= 70) {
+		printf(usage);
+		return 0;
+	}
+
+	check();
+	checkheld(port + 2);
+	printf("oscreltest: %d s of 1000 faders/s and 100 cues/s, %.0f ms round trip, "
+		   "%.1f%% loss in bursts\n", seconds, 2.0 * DELAY / MS, loss);
+	printf("    mode    cue p50    p99    max  late  lost  faders  stale  goodput  overhead\n");
+	printf("              (ms)    (ms)   (ms)                               (kB/s)\n");
+	for (mode = 0; mode < MODES; ++mode) {
+		run(mode, seconds, loss / 100, port);
+	}
+	printf("checks:\n");
+	return osctest_report();
+}
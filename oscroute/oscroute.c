@@ -0,0 +1,647 @@
+/******************************************************************************
+ *  oscroute
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *
+ *  This is a daemon that receives OSC packets and forwards them to other
+ *  endpoints by address prefix. Packets are forwarded as received: only the
+ *  address is rewritten when a route asks for it, and the rest of the packet
+ *  is sent straight from the receive buffer.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+
+#include "../oscnet/oscnet.h"
+#include "../oscpack/oscunpack.h"
+#include "../oscpack/oscintern.h"
+#include "../oscmetrics/oscmetrics.h"
+
+#define OSCROUTE "oscroute"
+
+// Packets received before forwarding
+#define BATCH 64
+
+// Scratch space for rewritten addresses in one batch
+#define SCRATCH (256 * 1024)
+
+// Longest address considered for routing
+#define MAX_DEPTH 64
+
+// Addresses reported in /_stats/address and in the summary
+#define TOP 10
+
+// Most dictionary entries granted to a delta session
+#define DELTA_ENTRIES 4096
+
+const char usage[] =
+"usage: oscroute [options] routes port tcp|udp\n" \
+"       oscroute [options] routes unix:/path|unixdgram:/path|shm://name\n" \
+"    Options:\n" \
+"        -stats seconds  route a /_stats bundle of traffic counters this often\n" \
+"        -delta          accept delta sessions from oscsend -delta (tcp only)\n" \
+"\n" \
+"Each line of the routes file is an address prefix, a destination and an\n" \
+"optional prefix to replace it with:\n" \
+"\n" \
+"        /mixer      127.0.0.1 9000 udp\n" \
+"        /engine     unix:/tmp/engine        /eng\n" \
+"        /           shm://recorder\n" \
+"\n" \
+"A prefix matches whole address parts, so /mixer matches /mixer/ch/1 but not\n" \
+"/mixers. A packet goes to every destination with a matching prefix, using\n" \
+"the longest matching prefix for each destination. Bundles are forwarded\n" \
+"unchanged to every destination matched by one of their messages.\n" \
+"\n" \
+"The /_stats bundle goes through the routes like any other packet, so add a\n" \
+"/_stats route to receive it.\n" \
+"\n";
+
+struct route {
+	char* prefix;
+	int32_t plen;
+	char* rewrite;			// NULL to keep the address
+	int32_t rlen;
+	int out;
+	uint32_t hash;
+	struct route* next;		// hash chain
+};
+
+struct output {
+	char* spec;
+	oscnet_t* net;
+	struct iovec iov[BATCH * 2];
+	int iovcnt[BATCH];
+	int npkt;
+	int niov;
+	uint32_t stamp;			// last packet queued, to send each packet once
+	uint64_t forwarded;
+	uint64_t errors;
+};
+
+static struct route** table;
+static uint32_t tablemask;
+static struct route* root;			// routes for "/"
+static int nroutes;
+static struct route** unfound;		// routes of an address that is not cached
+
+// Routes of each interned address, longest prefix first and NULL terminated,
+// so an address seen before is not looked up again. Indexed by oscaddr_t id.
+static struct route*** cache;
+static int32_t ncache;
+static struct output* outputs;
+static int noutputs;
+
+static uint8_t scratch[SCRATCH];
+static int32_t scratchlen;
+
+static uint64_t received, unrouted, malformed;
+static volatile sig_atomic_t done;
+
+static uint32_t fnv(uint32_t h, uint8_t c)
+{
+	return (h ^ c) * 16777619u;
+}
+
+static uint32_t fnvstr(const char* s, int32_t len)
+{
+	uint32_t h = 2166136261u;
+	int32_t i;
+
+	for (i = 0; i < len; ++i) {
+		h = fnv(h, (uint8_t)s[i]);
+	}
+	return h;
+}
+
+static int addoutput(const char* spec)
+{
+	int i;
+	void* p;
+
+	for (i = 0; i < noutputs; ++i) {
+		if (strcmp(outputs[i].spec, spec) == 0) {
+			return i;
+		}
+	}
+	if ((p = realloc(outputs, (noutputs + 1) * sizeof(struct output))) == NULL) {
+		return -1;
+	}
+	outputs = (struct output*)p;
+	memset(&outputs[noutputs], 0, sizeof(struct output));
+	outputs[noutputs].spec = strdup(spec);
+	return noutputs++;
+}
+
+static void addroute(struct route* r)
+{
+	uint32_t i;
+
+	if (r->plen == 1) {
+		r->next = root;
+		root = r;
+		return;
+	}
+	i = r->hash & tablemask;
+	r->next = table[i];
+	table[i] = r;
+}
+
+// Read the routes file. Returns the number of routes or -1 on error.
+static int loadroutes(const char* path)
+{
+	FILE* fp;
+	char line[1024], spec[1024];
+	char* tok[6];
+	struct route* r;
+	int n, lineno = 0, count = 0, dest;
+
+	if ((fp = fopen(path, "r")) == NULL) {
+		perror(path);
+		return -1;
+	}
+
+	tablemask = 1023;
+	table = (struct route**)calloc(tablemask + 1, sizeof(struct route*));
+	if (!table) {
+		fclose(fp);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		lineno++;
+		for (n = 0; n < 6 && (tok[n] = strtok(n ? NULL : line, " \t\r\n")); ++n)
+			;
+		if (n == 0 || tok[0][0] == '#') {
+			continue;
+		}
+
+		if (tok[0][0] != '/' || n < 2) {
+			fprintf(stderr, "%s:%d: bad route\n", path, lineno);
+			fclose(fp);
+			return -1;
+		}
+
+		if (oscnet_islocal(tok[1])) {
+			snprintf(spec, sizeof(spec), "%s", tok[1]);
+			dest = 1;
+		}
+		else if (n >= 4) {
+			snprintf(spec, sizeof(spec), "%s %s %s", tok[1], tok[2], tok[3]);
+			dest = 3;
+		}
+		else {
+			fprintf(stderr, "%s:%d: bad destination\n", path, lineno);
+			fclose(fp);
+			return -1;
+		}
+
+		r = (struct route*)calloc(1, sizeof(struct route));
+		if (!r) {
+			fclose(fp);
+			return -1;
+		}
+		r->prefix = strdup(tok[0]);
+		r->plen = strlen(r->prefix);
+
+		// "/mixer/" and "/mixer" are the same prefix
+		if (r->plen > 1 && r->prefix[r->plen - 1] == '/') {
+			r->prefix[--r->plen] = '\0';
+		}
+		if (n > dest + 1) {
+			r->rewrite = strdup(tok[dest + 1]);
+			r->rlen = strlen(r->rewrite);
+			if (r->rlen > 1 && r->rewrite[r->rlen - 1] == '/') {
+				r->rewrite[--r->rlen] = '\0';
+			}
+		}
+		r->hash = fnvstr(r->prefix, r->plen);
+		if ((r->out = addoutput(spec)) == -1) {
+			fclose(fp);
+			return -1;
+		}
+		addroute(r);
+		count++;
+	}
+
+	fclose(fp);
+	nroutes = count;
+	if ((unfound = (struct route**)malloc((nroutes + 1) * sizeof(*unfound))) == NULL) {
+		fprintf(stderr, "%s: Critical memory error...\n", OSCROUTE);
+		return -1;
+	}
+	return count;
+}
+
+static int openoutputs(void)
+{
+	char spec[1024];
+	char *host, *port, *proto;
+	int i;
+
+	for (i = 0; i < noutputs; ++i) {
+		if (oscnet_islocal(outputs[i].spec)) {
+			outputs[i].net = oscnet_connect(outputs[i].spec, NULL, NULL);
+		}
+		else {
+			snprintf(spec, sizeof(spec), "%s", outputs[i].spec);
+			host = strtok(spec, " ");
+			port = strtok(NULL, " ");
+			proto = strtok(NULL, " ");
+			outputs[i].net = oscnet_connect(host, port, proto);
+		}
+		if (outputs[i].net == NULL) {
+			fprintf(stderr, "%s: cannot open %s\n", OSCROUTE, outputs[i].spec);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void flush(void)
+{
+	struct output* o;
+	int i, rv;
+
+	for (i = 0; i < noutputs; ++i) {
+		o = &outputs[i];
+		if (o->npkt == 0) {
+			continue;
+		}
+		rv = oscnet_sendiov(o->net, o->iov, o->iovcnt, o->npkt);
+		if (rv < 0) {
+			rv = 0;
+		}
+		o->forwarded += rv;
+		o->errors += o->npkt - rv;
+		o->npkt = o->niov = 0;
+	}
+	scratchlen = 0;
+}
+
+// Queue a packet on the route's destination unless it is already queued.
+static void enqueue(struct route* r, const uint8_t* buf, int32_t size, int32_t alen,
+					uint32_t stamp)
+{
+	struct output* o = &outputs[r->out];
+	int32_t newlen, padded, skip, plen, rlen;
+	uint8_t* hdr;
+
+	if (o->stamp == stamp) {
+		return;
+	}
+	o->stamp = stamp;
+
+	if (r->rewrite && alen >= 0) {
+		// The root route prepends the rewrite to the whole address
+		plen = r->plen == 1 ? 0 : r->plen;
+		// A rewrite of "/" only stands alone; the rest of the address
+		// already starts with '/'
+		rlen = r->rlen == 1 && alen > plen ? 0 : r->rlen;
+		newlen = rlen + (alen - plen);
+		padded = (newlen + 4) & ~3;
+		if (scratchlen + padded > SCRATCH) {
+			flush();
+		}
+
+		// New address in scratch, then everything after the old one
+		hdr = scratch + scratchlen;
+		memcpy(hdr, r->rewrite, rlen);
+		memcpy(hdr + rlen, buf + plen, alen - plen);
+		memset(hdr + newlen, 0, padded - newlen);
+		scratchlen += padded;
+
+		skip = (alen + 4) & ~3;
+		o->iov[o->niov].iov_base = hdr;
+		o->iov[o->niov++].iov_len = padded;
+		o->iov[o->niov].iov_base = (void*)(buf + skip);
+		o->iov[o->niov++].iov_len = size - skip;
+		o->iovcnt[o->npkt++] = 2;
+	}
+	else {
+		o->iov[o->niov].iov_base = (void*)buf;
+		o->iov[o->niov++].iov_len = size;
+		o->iovcnt[o->npkt++] = 1;
+	}
+}
+
+// Find the routes for addr, longest prefix first so it wins for its
+// destination. found must hold nroutes + 1 entries; the list ends with NULL.
+static void lookup(const char* addr, int32_t len, struct route** found)
+{
+	uint32_t hashes[MAX_DEPTH];
+	int32_t ends[MAX_DEPTH];
+	uint32_t h = 2166136261u;
+	struct route* r;
+	int32_t i;
+	int n = 0, k = 0;
+
+	// Hash every prefix that ends on a part boundary in a single pass
+	for (i = 0; i < len; ++i) {
+		if (addr[i] == '/' && i > 0 && n < MAX_DEPTH) {
+			hashes[n] = h;
+			ends[n++] = i;
+		}
+		h = fnv(h, (uint8_t)addr[i]);
+	}
+	if (n < MAX_DEPTH) {
+		hashes[n] = h;
+		ends[n++] = len;
+	}
+
+	while (n-- > 0) {
+		for (r = table[hashes[n] & tablemask]; r != NULL; r = r->next) {
+			if (r->hash == hashes[n] && r->plen == ends[n] &&
+				memcmp(r->prefix, addr, r->plen) == 0) {
+				found[k++] = r;
+			}
+		}
+	}
+	for (r = root; r != NULL; r = r->next) {
+		found[k++] = r;
+	}
+	found[k] = NULL;
+}
+
+// Routes of an interned address, looked up the first time it is seen.
+// NULL if they could not be cached.
+static struct route** cached(const oscaddr_t* a)
+{
+	struct route** found;
+	int32_t n;
+	void* p;
+
+	if (a->id < ncache && cache[a->id]) {
+		return cache[a->id];
+	}
+	if (a->id >= ncache) {
+		for (n = ncache ? ncache : 1024; n <= a->id; n *= 2)
+			;
+		if ((p = realloc(cache, n * sizeof(*cache))) == NULL) {
+			return NULL;
+		}
+		cache = (struct route***)p;
+		memset(cache + ncache, 0, (n - ncache) * sizeof(*cache));
+		ncache = n;
+	}
+	if ((found = (struct route**)malloc((nroutes + 1) * sizeof(*found))) == NULL) {
+		return NULL;
+	}
+	lookup(a->addr, a->len, found);
+	for (n = 0; found[n]; ++n)
+		;
+	// Shrink to fit; keep the larger list if that fails
+	p = realloc(found, (n + 1) * sizeof(*found));
+	cache[a->id] = p ? (struct route**)p : found;
+	return cache[a->id];
+}
+
+// Count a message of msgsize bytes for addr and queue the packet on its
+// routes. Bundles pass -1 as alen so the packet is forwarded without
+// rewriting.
+static int match(const char* addr, int32_t len, int32_t msgsize, const uint8_t* buf,
+				 int32_t size, int32_t alen, uint32_t stamp)
+{
+	struct route** r;
+	const oscaddr_t* a;
+
+	// Addresses are interned on first sight, up to OSCINTERN_MAX of them
+	if ((a = oscintern_len(addr, len)) != NULL) {
+		oscmetrics_address_hash(a->addr, a->len, a->hash, msgsize);
+	}
+	else {
+		oscmetrics_address(addr, len, msgsize);
+	}
+	if (!a || (r = cached(a)) == NULL) {
+		lookup(addr, len, unfound);
+		r = unfound;
+	}
+	if (!*r) {
+		return 0;
+	}
+	for (; *r; ++r) {
+		enqueue(*r, buf, size, alen, stamp);
+	}
+	return 1;
+}
+
+static int matchbundle(const uint8_t* bundle, int32_t bsize, const uint8_t* buf,
+					   int32_t size, uint32_t stamp, int depth)
+{
+	oscbundle_t b;
+	const uint8_t* elem;
+	const char* addr;
+	int32_t len, alen;
+	int found = 0;
+
+	if (depth > 8 || oscbundle(bundle, bsize, &b) == -1) {
+		return -1;
+	}
+	while ((len = oscbundle_next(&b, &elem)) > 0) {
+		if (oscisbundle(elem, len)) {
+			found |= matchbundle(elem, len, buf, size, stamp, depth + 1) > 0;
+		}
+		else if ((addr = oscaddress(elem, len, &alen)) != NULL) {
+			found |= match(addr, alen, len, buf, size, -1, stamp);
+		}
+	}
+	return len == -1 ? -1 : found;
+}
+
+static void route(const uint8_t* buf, int32_t size, uint32_t stamp)
+{
+	const char* addr;
+	int32_t alen;
+	int found;
+
+	if (oscisbundle(buf, size)) {
+		found = matchbundle(buf, size, buf, size, stamp, 0);
+	}
+	else if ((addr = oscaddress(buf, size, &alen)) != NULL) {
+		found = match(addr, alen, size, buf, size, alen, stamp);
+	}
+	else {
+		found = -1;
+	}
+
+	if (found == -1) {
+		malformed++;
+	}
+	else if (found == 0) {
+		unrouted++;
+		OSCMETRICS_ADD(OSCMETRICS_DROPS, 1);
+	}
+}
+
+static uint64_t mono_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Route a /_stats bundle with the counters since the last one
+static void stats(oscmetrics_snapshot_t* cur, oscmetrics_snapshot_t* prev, uint32_t stamp)
+{
+	static uint8_t buf[8192];
+	oscmetrics_snapshot_t tmp;
+	int32_t size;
+
+	if (oscmetrics_snapshot(cur) == -1) {
+		return;
+	}
+	size = oscmetrics_osc(cur, prev->time_ns ? prev : NULL, TOP, buf, sizeof(buf));
+	if (size > 0) {
+		route(buf, size, stamp);
+		flush();
+	}
+	tmp = *prev;
+	*prev = *cur;
+	*cur = tmp;
+}
+
+static void stop(int sig)
+{
+	(void)sig;
+	done = 1;
+}
+
+int main (int argc, char* const argv[])
+{
+	oscnet_t* in;
+	uint8_t* bufs[BATCH];
+	int32_t sizes[BATCH];
+	oscmetrics_snapshot_t cur, prev;
+	char* text;
+	uint64_t interval = 0, next = 0, now;
+	uint32_t stamp = 0;
+	int32_t timeout = 1000;
+	int i, n, rv, datagram, delta = 0;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; ++i) {
+		if (strcmp(argv[i], "-stats") == 0 && i + 1 < argc) {
+			interval = (uint64_t)(atof(argv[++i]) * 1e9);
+		}
+		else if (strcmp(argv[i], "-delta") == 0) {
+			delta = 1;
+		}
+		else {
+			printf(usage);
+			return 0;
+		}
+	}
+
+	if (argc - i == 2 && oscnet_islocal(argv[i+1])) {
+		in = oscnet_listen(argv[i+1], NULL, NULL);
+	}
+	else if (argc - i == 3) {
+		in = oscnet_listen(NULL, argv[i+1], argv[i+2]);
+	}
+	else {
+		printf(usage);
+		return 0;
+	}
+	if (in == NULL) {
+		return 1;
+	}
+	if (delta && oscnet_delta(in, DELTA_ENTRIES, 0) == -1) {
+		fprintf(stderr, "%s: delta sessions need a tcp endpoint\n", OSCROUTE);
+		return 1;
+	}
+
+	if (loadroutes(argv[i]) <= 0 || openoutputs() == -1) {
+		fprintf(stderr, "%s: no usable routes in %s\n", OSCROUTE, argv[i]);
+		return 1;
+	}
+
+	memset(&cur, 0, sizeof(cur));
+	memset(&prev, 0, sizeof(prev));
+	if (interval > 0) {
+		next = mono_ns() + interval;
+		if (interval < 1000000000ull) {
+			timeout = (int32_t)(interval / 1000000) + 1;
+		}
+	}
+
+	for (i = 0; i < BATCH; ++i) {
+		if ((bufs[i] = (uint8_t*)malloc(OSCNET_MAX_PACKET)) == NULL) {
+			fprintf(stderr, "%s: Critical memory error...\n", OSCROUTE);
+			return 1;
+		}
+	}
+
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+	datagram = oscnet_type(in) == OSCNET_UDP || oscnet_type(in) == OSCNET_UNIXDGRAM;
+
+	while (!done) {
+		n = oscnet_recvv(in, bufs, sizes, OSCNET_MAX_PACKET, BATCH, timeout);
+		if (n < 0) {
+			perror("recv");
+			break;
+		}
+
+		// Streams and the shm ring return one packet per call; keep
+		// collecting what is already waiting so sends are still batched.
+		while (!datagram && n > 0 && n < BATCH) {
+			rv = oscnet_recvv(in, bufs + n, sizes + n, OSCNET_MAX_PACKET,
+							  BATCH - n, 0);
+			if (rv <= 0) {
+				break;
+			}
+			n += rv;
+		}
+
+		for (i = 0; i < n; ++i) {
+			route(bufs[i], sizes[i], ++stamp);
+		}
+		received += n;
+		flush();
+
+		if (interval > 0 && (now = mono_ns()) >= next) {
+			stats(&cur, &prev, ++stamp);
+			next = now + interval;
+		}
+	}
+
+	fprintf(stderr, "%s: %llu received, %llu unrouted, %llu malformed\n", OSCROUTE,
+			(unsigned long long)received, (unsigned long long)unrouted,
+			(unsigned long long)malformed);
+	for (i = 0; i < noutputs; ++i) {
+		fprintf(stderr, "    %s: %llu forwarded, %llu failed\n", outputs[i].spec,
+				(unsigned long long)outputs[i].forwarded,
+				(unsigned long long)outputs[i].errors);
+		oscnet_close(outputs[i].net);
+	}
+
+	// Totals and rates since the start
+	if ((text = (char*)malloc(16384)) != NULL && oscmetrics_snapshot(&cur) == 0 &&
+		oscmetrics_text(&cur, NULL, TOP, text, 16384) > 0) {
+		fprintf(stderr, "\n%s", text);
+	}
+	free(text);
+	free(unfound);
+	oscmetrics_snapshot_free(&cur);
+	oscmetrics_snapshot_free(&prev);
+	oscnet_close(in);
+	return 0;
+}
@@ -27,15 +27,44 @@
 #include <stdint.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
 
-#include <netdb.h>
-#include <netinet/in.h>
-#include <sys/socket.h>
 #include <arpa/inet.h>
+#include <sys/uio.h>
+
+#include "../oscnet/oscnet.h"
+#include "../oscnet/oscfanout.h"
+#include "../osctrace/osctrace.h"
+#include "../osccodec/osccodec.h"
 
 #define OSCSEND "oscsend"
+#define DELTA_ENTRIES 1024
+#define REL_PACKETS 1024
 const char usage[] = 
-"usage: oscsend ip port tcp|udp /osc/address -type value ...\n" \
+"usage: oscsend [options] ip port tcp|udp /osc/address -type value ... [-- /osc/address ...]\n" \
+"       oscsend [options] unix:/path /osc/address -type value ...\n" \
+"       oscsend [options] unixdgram:/path /osc/address -type value ...\n" \
+"       oscsend [options] shm://name /osc/address -type value ...\n" \
+"    Options:\n" \
+"        -n count    send the messages count times\n" \
+"        -r rate     at most rate times per second (default as fast as possible)\n" \
+"        -trace      wrap each packet in a bundle stamped with the send time,\n" \
+"                    for oscrecv -trace, and print the encode time\n" \
+"        -pace pps   send at most pps packets per second, evenly spaced\n" \
+"        -bps rate   send at most rate bytes per second\n" \
+"        -burst us   microseconds of packets that may go back to back (default 0)\n" \
+"        -txtime     let the fq qdisc space the packets (SO_TXTIME, udp only)\n" \
+"        -delta      send repeated addresses as deltas if the receiver accepts\n" \
+"                    (tcp only, see oscrecv -delta)\n" \
+"        -rel        send again what the receiver missed (udp only, see\n" \
+"                    oscrecv -rel)\n" \
+"        -latest prefix  with -rel, only send the newest message to each\n" \
+"                    address under prefix again\n" \
+"        -ttl hops   multicast TTL (default 1, udp only)\n" \
+"        -noloop     do not deliver multicast to listeners on this host\n" \
+"        -iface name send multicast from this interface\n" \
+"    Messages separated by -- are sent in a single batch.\n" \
+"    A comma separated list of ip or ip:port sends to every destination (udp).\n" \
 "    Support type/value pairs:\n" \
 "        -i      32-bit integer\n" \
 "        -h      64-bit integer\n" \
@@ -50,27 +79,10 @@ const char usage[] =
 "        -I      Infinitum (no value)\n" \
 "\n";
 
-//	Network to Host 
-// Following ntohll() and htonll() code snipits were taken from
-// http://www.codeproject.com/KB/cpp/endianness.aspx?msg=1661457
-#define ntohll(x) (((int64_t)(ntohl((int32_t)((x << 32) >> 32))) << 32) | \
-(uint32_t)ntohl(((int32_t)(x >> 32)))) //By Runner
-//#define ntohf(x) *(float*)&(ntohl(x))
-inline double ntohf(int32_t x) { x = ntohl(x); return *(float*)&x; }
-//#define ntohd(x) (double)ntohll(x)
-inline double ntohd(int64_t x) { return (double)ntohll(x); }
-
-//	Host to Network
-#define htonll(x) ntohll(x)
-//#define htonf(x) (int32_t)htonl(*(int32_t*)&x)
-inline int32_t htonf(float x) { return (int32_t)htonl(*(int32_t*)&x); }
-//#define htond(x) (int64_t)htonll(*(int64_t*)&x)
-inline int64_t htond(double x) { return (int64_t)htonll(*(int64_t*)&x); }
-
-
+// Encode argv (/osc/address -type value ...) into a newly allocated buffer.
+// The TCP size prefix is not included; oscnet adds it when sending.
 int32_t oscraw(uint8_t** buf, int argc, char* const argv[])
 {
-	char* net;
 	char* osc_addr;
 	int32_t osc_size = 0;
 	int32_t addr_size = 0;
@@ -95,11 +107,12 @@ int32_t oscraw(uint8_t** buf, int argc, char* const argv[])
 	int32_t len;
 	char bad_mess = 0;
 	
-	// Check first argument
-	net = (char*)argv[0];
-	
 	// Check OSC Address Pattern
-	osc_addr = (char*)argv[1];
+	osc_addr = (char*)argv[0];
+	if (osc_addr[0] != '/') {
+		printf("%s: OSC Address Pattern must start with '/'\n", OSCSEND);
+		return 0;
+	}
 	addr_size = strlen(osc_addr);
 	addr_size += (4 - addr_size % 4);
 	
@@ -107,7 +120,7 @@ int32_t oscraw(uint8_t** buf, int argc, char* const argv[])
 	type_size = 1;
 	
 	// Iterate once to check OSC type and messages, and calculate size
-	for (i = 2; i < argc; ++i) {
+	for (i = 1; i < argc; ++i) {
 		if (strcmp(argv[i], "-i") == 0) {
 			i++;
 			type_size++;
@@ -155,19 +168,15 @@ int32_t oscraw(uint8_t** buf, int argc, char* const argv[])
 			mess_size += 4;
 		}
 		else if (strcmp(argv[i], "-T") == 0) {
-			i++;
 			type_size++;
 		}
 		else if (strcmp(argv[i], "-F") == 0) {
-			i++;
 			type_size++;
 		}
 		else if (strcmp(argv[i], "-N") == 0) {
-			i++;
 			type_size++;
 		}
 		else if (strcmp(argv[i], "-I") == 0) {
-			i++;
 			type_size++;
 		}
 		else {
@@ -191,27 +200,13 @@ int32_t oscraw(uint8_t** buf, int argc, char* const argv[])
 	osc_size = addr_size + type_size + mess_size;
 	
 	// Create an array
-	if (strcmp(net, "tcp") == 0) {
-		*buf = (uint8_t*)calloc(1, osc_size+4);
-		if (*buf == NULL) {
-			fprintf(stderr, "%s: Critical memory error...\n", OSCSEND);
-			return 0;
-		}
-		osc_data = *buf;
-		bit32 = htonl(osc_size);
-		memcpy(osc_data, (uint8_t*)&bit32, 4);
-		osc_size += 4;
-		addr_ptr = osc_data+4;
-	}
-	else {
-		*buf = (uint8_t*)calloc(1, osc_size);
-		if (*buf == NULL) {
-			fprintf(stderr, "%s: Critical memory error...\n", OSCSEND);
-			return 0;
-		}
-		osc_data = *buf;
-		addr_ptr = osc_data;
+	*buf = (uint8_t*)calloc(1, osc_size);
+	if (*buf == NULL) {
+		fprintf(stderr, "%s: Critical memory error...\n", OSCSEND);
+		return 0;
 	}
+	osc_data = *buf;
+	addr_ptr = osc_data;
 	
 	// Copy OSC Address Pattern
 	strcpy((char*)addr_ptr, osc_addr);
@@ -222,29 +217,29 @@ int32_t oscraw(uint8_t** buf, int argc, char* const argv[])
 	*(type_ptr++) = ',';
 	
 	// Iterate the arguments to fill the array
-	for (i = 2; i < argc; ++i) {
+	for (i = 1; i < argc; ++i) {
 		if (strcmp(argv[i], "-i") == 0) {
 			i++;
 			*(type_ptr++) = 'i';
 			if (sizeof(int) == 4) {
-				bit32 = htonl(atoi(argv[i]));
+				bit32 = atoi(argv[i]);
 			}
 			else if (sizeof(long) == 4) {
-				bit32 = htonl(atol(argv[i]));
+				bit32 = atol(argv[i]);
 			}
-			memcpy(mess_ptr, (uint8_t*)&bit32, 4);
+			oscstore32(mess_ptr, (uint32_t)bit32);
 			mess_ptr += 4;
 		}
 		else if (strcmp(argv[i], "-h") == 0) {
 			i++;
 			*(type_ptr++) = 'h';
 			if (sizeof(long) == 8) {
-				bit64 = htonll((int64_t)atol(argv[i]));
+				bit64 = (int64_t)atol(argv[i]);
 			}
 			else if (sizeof(long long) == 8) {
-				bit64 = htonll(atoll(argv[i]));
+				bit64 = atoll(argv[i]);
 			}
-			memcpy(mess_ptr, (uint8_t*)&bit64, 8);
+			oscstore64(mess_ptr, (uint64_t)bit64);
 			mess_ptr += 8;
 		}
 		else if (strcmp(argv[i], "-f") == 0) {
@@ -259,8 +254,7 @@ int32_t oscraw(uint8_t** buf, int argc, char* const argv[])
 			else {
 				atom.f32 = (float)atof(argv[i]);
 			}
-			bit32 = htonf(atom.f32);
-			memcpy(mess_ptr, (uint8_t*)&bit32, 4);
+			oscstoref(mess_ptr, atom.f32);
 			mess_ptr += 4;
 		}
 		else if (strcmp(argv[i], "-d") == 0) {
@@ -275,8 +269,7 @@ int32_t oscraw(uint8_t** buf, int argc, char* const argv[])
 			else {
 				atom.f64 = atof(argv[i]);
 			}
-			bit64 = htond(atom.f64);
-			memcpy(mess_ptr, (uint8_t*)&bit64, 8);
+			oscstored(mess_ptr, atom.f64);
 			mess_ptr += 8;
 		}
 		else if (strcmp(argv[i], "-s") == 0) {
@@ -294,19 +287,15 @@ int32_t oscraw(uint8_t** buf, int argc, char* const argv[])
 			mess_ptr += 4;
 		}
 		else if (strcmp(argv[i], "-T") == 0) {
-			i++;
 			*(type_ptr++) = 'T';
 		}
 		else if (strcmp(argv[i], "-F") == 0) {
-			i++;
 			*(type_ptr++) = 'F';
 		}
 		else if (strcmp(argv[i], "-N") == 0) {
-			i++;
 			*(type_ptr++) = 'N';
 		}
 		else if (strcmp(argv[i], "-I") == 0) {
-			i++;
 			*(type_ptr++) = 'I';
 		}
 	}
@@ -314,98 +303,374 @@ int32_t oscraw(uint8_t** buf, int argc, char* const argv[])
 	return osc_size;
 }
 
-int main (int argc, char* const argv[])
+// Number of argv entries that make up one message: the address followed by
+// its types and values, up to the end of argv or a "--" separator. Only the
+// types that oscraw() reads a value for are followed by one, so a value of
+// "--" is not taken for a separator.
+static int oscmsglen(int argc, char* const argv[])
 {
-	char* ip;
-	char* port;
-	char* protocol;
-	int sockfd, rv;
-	struct addrinfo hints, *servinfo, *p;
-	uint8_t* buf;
-	int32_t size, bit32, sent;
-	char isTCP = 0;
+	int i;
 	
-	if (argc < 5) {
-		printf(usage);
-		return 0;
+	for (i = 1; i < argc && strcmp(argv[i], "--") != 0; ++i) {
+		if (strlen(argv[i]) == 2 && argv[i][0] == '-' && strchr("ihfdsc", argv[i][1])) {
+			i++;
+		}
 	}
+	return i < argc ? i : argc;
+}
+
+// Encode argv (/osc/address -type value ... [-- ...]) from index first into
+// bufs, replacing what they held. With h, the time to encode each message is
+// recorded. Returns the number of messages or -1.
+static int encode(int argc, char* const argv[], int first, uint8_t** bufs,
+				  int32_t* sizes, osctrace_hist_t* h)
+{
+	uint64_t t = 0;
+	int i, len, count = 0;
 	
-	ip = argv[1];
-	port = argv[2];
-	protocol = argv[3];
-	
-	// Check if protocol is tcp or udp
-	if (strcmp(protocol, "tcp") != 0 && strcmp(protocol, "udp") != 0) {
-		fprintf(stderr, "Specify protocol tcp or udp\n");
-		printf(usage);
-		return 1;
+	for (i = first; i < argc; i += len + 1) {
+		len = oscmsglen(argc - i, argv + i);
+		free(bufs[count]);
+		if (h) {
+			t = osctrace_now();
+		}
+		sizes[count] = oscraw(&bufs[count], len, argv + i);
+		if (h) {
+			osctrace_record(h, osctrace_now() - t);
+		}
+		if (sizes[count] <= 0) {
+			fprintf(stderr, "oscraw: error\n");
+			return -1;
+		}
+		count++;
 	}
+	return count;
+}
+
+// Open a fanout to a comma separated list of "ip" or "ip:port" destinations
+static oscfanout_t* oscfanout_open(char* list, const char* port, const char* protocol)
+{
+	oscfanout_t* fan;
+	char *host, *colon;
+	int n;
 	
-	size = oscraw(&buf, argc-3, argv+3);
-	if (size <= 0) {
-		fprintf(stderr, "oscraw: error\n");
-		return 1;
+	if (strcmp(protocol, "udp") != 0) {
+		fprintf(stderr, "Multiple destinations and multicast are only supported over udp\n");
+		return NULL;
 	}
 	
-	isTCP = strcmp(protocol, "tcp") == 0 ? 1 : 0;
-	
-	memset(&hints, 0, sizeof hints);
-	hints.ai_family = AF_UNSPEC;
-	hints.ai_socktype = isTCP ? SOCK_STREAM : SOCK_DGRAM;
+	if ((fan = oscfanout_new()) == NULL) {
+		fprintf(stderr, "%s: Critical memory error...\n", OSCSEND);
+		return NULL;
+	}
 	
-	if ((rv = getaddrinfo(ip, port, &hints, &servinfo)) != 0) {
-		fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(rv));
-		return 1;
+	for (host = strtok(list, ","); host != NULL; host = strtok(NULL, ",")) {
+		// A single ':' separates a port; more than one is an IPv6 address
+		colon = strchr(host, ':');
+		if (colon && strchr(colon+1, ':') == NULL) {
+			*colon = '\0';
+			n = oscfanout_add(fan, host, colon+1);
+		}
+		else {
+			n = oscfanout_add(fan, host, port);
+		}
+		if (n == -1) {
+			oscfanout_free(fan);
+			return NULL;
+		}
 	}
+	return fan;
+}
+
+// Send every message to all destinations of the fanout. Each message is
+// encoded once and sent with one sendmmsg(). Returns 0 if all were sent.
+static int oscfanout_main(oscfanout_t* fan, int* errors, uint8_t** bufs,
+						  int32_t* sizes, int count)
+{
+	int i, k, n = oscfanout_count(fan), rv = 0;
 	
-	// loop through all the results and connect to the first we can
-	for(p = servinfo; p != NULL; p = p->ai_next) {
-		if ((sockfd = socket(p->ai_family, p->ai_socktype,
-							 p->ai_protocol)) == -1) {
+	for (i = 0; i < count; ++i) {
+		if (oscfanout_send(fan, bufs[i], sizes[i], errors) == n) {
 			continue;
 		}
-		
-		if (strcmp(protocol, "tcp") == 0) {
-			if (connect(sockfd, p->ai_addr, p->ai_addrlen) == -1) {
-				close(sockfd);
-				continue;
+		for (k = 0; k < n; ++k) {
+			if (errors[k]) {
+				fprintf(stderr, "send: %s: %s\n", oscfanout_name(fan, k),
+						strerror(errors[k]));
 			}
 		}
-		
-		break;
+		rv = 1;
 	}
+	return rv;
+}
+
+static void sleep_until(uint64_t t)
+{
+	struct timespec ts;
+	
+	ts.tv_sec = t / 1000000000ull;
+	ts.tv_nsec = t % 1000000000ull;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+		;
+}
+
+static uint64_t mono_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int main (int argc, char* const argv[])
+{
+	oscnet_t* net = NULL;
+	oscfanout_t* fan = NULL;
+	osctrace_hist_t* enc = NULL;
+	uint8_t** bufs;
+	uint8_t** stamped = NULL;
+	uint8_t (*hdrs)[OSCTRACE_HEADER] = NULL;
+	struct iovec* iov = NULL;
+	int32_t* sizes;
+	int* iovcnt = NULL;
+	int* errors = NULL;
+	oscnet_pacestats_t ps;
+	oscrel_stats_t rs;
+	const char* latest = NULL;
+	const char* iface = NULL;
+	uint64_t start, stamp, bytes, coded;
+	long round, rounds = 1;
+	double rate = 0.0, pps = 0.0, bps = 0.0;
+	int32_t burst = 0;
+	int ttl = 1, loop = 1, mcast = 0;
+	int i, a, n, first, count = 0, sent = 0, trace = 0, txtime = 0, delta = 0, rel = 0, rv = 0;
 	
-	if (p == NULL) {
-		if (isTCP) {
-			fprintf(stderr, "socket: failed to connect\n");
+	for (a = 1; a < argc && argv[a][0] == '-'; ++a) {
+		if (strcmp(argv[a], "-trace") == 0) {
+			trace = 1;
+		}
+		else if (strcmp(argv[a], "-n") == 0 && a + 1 < argc) {
+			rounds = atol(argv[++a]);
+		}
+		else if (strcmp(argv[a], "-r") == 0 && a + 1 < argc) {
+			rate = atof(argv[++a]);
+		}
+		else if (strcmp(argv[a], "-pace") == 0 && a + 1 < argc) {
+			pps = atof(argv[++a]);
+		}
+		else if (strcmp(argv[a], "-bps") == 0 && a + 1 < argc) {
+			bps = atof(argv[++a]);
+		}
+		else if (strcmp(argv[a], "-burst") == 0 && a + 1 < argc) {
+			burst = atoi(argv[++a]);
+		}
+		else if (strcmp(argv[a], "-txtime") == 0) {
+			txtime = 1;
+		}
+		else if (strcmp(argv[a], "-delta") == 0) {
+			delta = 1;
+		}
+		else if (strcmp(argv[a], "-rel") == 0) {
+			rel = 1;
+		}
+		else if (strcmp(argv[a], "-latest") == 0 && a + 1 < argc) {
+			latest = argv[++a];
+		}
+		else if (strcmp(argv[a], "-ttl") == 0 && a + 1 < argc) {
+			ttl = atoi(argv[++a]);
+			mcast = 1;
+		}
+		else if (strcmp(argv[a], "-noloop") == 0) {
+			loop = 0;
+			mcast = 1;
+		}
+		else if (strcmp(argv[a], "-iface") == 0 && a + 1 < argc) {
+			iface = argv[++a];
+			mcast = 1;
 		}
 		else {
-			fprintf(stderr, "socket: failed to bind socket\n");
+			printf(usage);
+			return 0;
 		}
-		
-		freeaddrinfo(servinfo);
+	}
+	argc -= a - 1;
+	argv += a - 1;
+	
+	// Destination is either "ip port tcp|udp" or a single local endpoint
+	if (argc < 2 || rounds < 1) {
+		printf(usage);
+		return 0;
+	}
+	first = oscnet_islocal(argv[1]) ? 2 : 4;
+	if (argc < first + 1) {
+		printf(usage);
+		return 0;
+	}
+	if (mcast && first == 2) {
+		fprintf(stderr, "%s: multicast options need a udp destination\n", OSCSEND);
 		return 1;
 	}
 	
-	// Create a OSC packet and send
-	if (isTCP) {
-		// Add size of OSC message (32bit big-endian) at the beginning of buffer
-		bit32 = htonl(size);
-		memcpy(buf, &bit32, 4);
-		
-		if ((sent = send(sockfd, buf, size+4, 0)) == -1) {
-			fprintf(stderr, "send: error\n");
+	// Encode every message before opening the destination so they can all
+	// go out in a single batch.
+	bufs = (uint8_t**)calloc(argc, sizeof(uint8_t*));
+	sizes = (int32_t*)calloc(argc, sizeof(int32_t));
+	if (trace) {
+		enc = osctrace_hist_new();
+		stamped = (uint8_t**)calloc(argc, sizeof(uint8_t*));
+		hdrs = (uint8_t (*)[OSCTRACE_HEADER])calloc(argc, OSCTRACE_HEADER);
+		iov = (struct iovec*)calloc(argc * 2, sizeof(struct iovec));
+		iovcnt = (int*)calloc(argc, sizeof(int));
+	}
+	if (!bufs || !sizes || (trace && (!enc || !stamped || !hdrs || !iov || !iovcnt))) {
+		fprintf(stderr, "%s: Critical memory error...\n", OSCSEND);
+		return 1;
+	}
+	if ((count = encode(argc, argv, first, bufs, sizes, enc)) <= 0) {
+		return 1;
+	}
+	
+	// Multicast options need the sockets of oscfanout, even for one group
+	if (strchr(argv[1], ',') != NULL || (mcast && first == 4)) {
+		if (pps > 0.0 || bps > 0.0) {
+			fprintf(stderr, "%s: pacing is not supported with multiple destinations "
+					"or multicast options\n", OSCSEND);
+			return 1;
+		}
+		fan = oscfanout_open(argv[1], argv[2], argv[3]);
+		if (fan == NULL || (mcast && oscfanout_multicast(fan, iface, ttl, loop) == -1) ||
+			(errors = (int*)calloc(oscfanout_count(fan), sizeof(int))) == NULL) {
+			return 1;
+		}
+		// oscfanout sends one buffer per packet, so stamp a copy
+		for (i = 0; trace && i < count; ++i) {
+			if ((stamped[i] = (uint8_t*)malloc(OSCTRACE_HEADER + sizes[i])) == NULL) {
+				fprintf(stderr, "%s: Critical memory error...\n", OSCSEND);
+				return 1;
+			}
 		}
 	}
 	else {
-		if ((sent = sendto(sockfd, buf, size, 0, p->ai_addr, p->ai_addrlen)) == -1) {
-			fprintf(stderr, "send: error\n");
+		if (oscnet_islocal(argv[1])) {
+			net = oscnet_connect(argv[1], NULL, NULL);
+		}
+		else {
+			net = oscnet_connect(argv[1], argv[2], argv[3]);
+		}
+		if (net == NULL) {
+			printf(usage);
+			return 1;
+		}
+		if (oscnet_pace(net, pps, bps, burst, txtime ? OSCNET_PACE_TXTIME : 0) == -1) {
+			perror("SO_TXTIME");
+			return 1;
+		}
+		if (delta && oscnet_delta(net, DELTA_ENTRIES, 1000) == -1) {
+			fprintf(stderr, "%s: receiver did not accept a delta session, "
+					"sending plain packets\n", OSCSEND);
+			delta = 0;
+		}
+		if (rel && (oscnet_reliable(net, REL_PACKETS, 0) == -1 ||
+					(latest && oscnet_latest(net, latest) == -1))) {
+			return 1;
 		}
 	}
 	
-	freeaddrinfo(servinfo);
-	close(sockfd);
-	free(buf);
-	return 0;
+	start = mono_ns();
+	for (round = 0; round < rounds; ++round) {
+		if (rate > 0.0) {
+			sleep_until(start + (uint64_t)(round * 1e9 / rate));
+		}
+		if (trace) {
+			if (round > 0 && encode(argc, argv, first, bufs, sizes, enc) != count) {
+				return 1;
+			}
+			// Stamp as late as possible: right before the send
+			stamp = osctrace_timetag(osctrace_now());
+			for (i = 0; i < count; ++i) {
+				osctrace_header(hdrs[i], stamp, sizes[i]);
+				if (fan) {
+					memcpy(stamped[i], hdrs[i], OSCTRACE_HEADER);
+					memcpy(stamped[i] + OSCTRACE_HEADER, bufs[i], sizes[i]);
+				}
+				iov[i*2].iov_base = hdrs[i];
+				iov[i*2].iov_len = OSCTRACE_HEADER;
+				iov[i*2+1].iov_base = bufs[i];
+				iov[i*2+1].iov_len = sizes[i];
+				iovcnt[i] = 2;
+			}
+		}
+		
+		if (fan) {
+			if (trace) {
+				for (i = 0; i < count; ++i) {
+					sizes[i] += OSCTRACE_HEADER;
+				}
+				rv |= oscfanout_main(fan, errors, stamped, sizes, count);
+				for (i = 0; i < count; ++i) {
+					sizes[i] -= OSCTRACE_HEADER;
+				}
+			}
+			else {
+				rv |= oscfanout_main(fan, errors, bufs, sizes, count);
+			}
+			continue;
+		}
+		
+		sent = trace ? oscnet_sendiov(net, iov, iovcnt, count)
+					 : oscnet_sendv(net, bufs, sizes, count);
+		if (sent < count) {
+			fprintf(stderr, "send: error (%d of %d sent)\n", sent < 0 ? 0 : sent, count);
+			rv = 1;
+		}
+	}
+	
+	if (trace) {
+		osctrace_summary(stderr, NULL, NULL);
+		osctrace_summary(stderr, "encode", enc);
+	}
+	if (net && (pps > 0.0 || bps > 0.0)) {
+		oscnet_pacestats(net, &ps);
+		fprintf(stderr, "%s: %llu packets paced, %llu delayed, mean delay %.1f us, "
+				"max delay %.1f us, max queue %d\n", OSCSEND,
+				(unsigned long long)ps.packets, (unsigned long long)ps.delayed,
+				ps.delayed ? ps.delay_ns / 1e3 / ps.delayed : 0.0,
+				ps.max_delay_ns / 1e3, ps.max_queue);
+	}
+	
+	if (net && delta) {
+		oscnet_deltastats(net, &bytes, &coded);
+		fprintf(stderr, "%s: delta session sent %llu bytes as %llu (%.1fx)\n", OSCSEND,
+				(unsigned long long)bytes, (unsigned long long)coded,
+				coded ? (double)bytes / coded : 0.0);
+	}
+	
+	if (net && rel) {
+		// Stay for the receiver to ask for what it missed
+		oscnet_service(net, 1000);
+		oscnet_relstats(net, &rs);
+		fprintf(stderr, "%s: %llu packets sent, %llu sent again, %llu superseded, "
+				"%llu gone\n", OSCSEND, (unsigned long long)rs.sent,
+				(unsigned long long)rs.resent, (unsigned long long)rs.superseded,
+				(unsigned long long)rs.gone);
+	}
+	
+	oscnet_close(net);
+	if (fan) {
+		oscfanout_free(fan);
+	}
+	for (n = 0; n < count; ++n) {
+		free(bufs[n]);
+		if (stamped) {
+			free(stamped[n]);
+		}
+	}
+	free(bufs);
+	free(sizes);
+	free(stamped);
+	free(hdrs);
+	free(iov);
+	free(iovcnt);
+	free(errors);
+	osctrace_hist_free(enc);
+	return rv;
 }
-
@@ -0,0 +1,186 @@
+/******************************************************************************
+ *  oscsendtest
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *  Runs oscsend with messages separated by --, including the types that take
+ *  no value and a string value of "--", and checks that every message
+ *  arrives on a unixdgram socket with the right types and arguments. Then
+ *  sends to a list of UDP destinations with a multicast group on the
+ *  loopback interface and a destination that fails, and checks that the
+ *  others still receive and that oscsend reports the failure.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "../oscnet/oscnet.h"
+#include "../oscpack/oscunpack.h"
+#include "../oscpack/osctest.h"
+
+const char usage[] = "usage: oscsendtest [path to oscsend]\n";
+
+#define SOCK "unixdgram:/tmp/oscsendtest.sock"
+#define GROUP "239.255.0.2"
+
+// Runs oscsend with args, after the unixdgram destination unless dest is 0,
+// and returns its exit status
+static int run(const char* oscsend, int dest, const char* const* args)
+{
+	char* argv[32];
+	int n, status;
+	pid_t pid;
+
+	argv[0] = (char*)oscsend;
+	argv[1] = (char*)SOCK;
+	for (n = 0; args[n]; ++n) {
+		argv[n + 1 + dest] = (char*)args[n];
+	}
+	argv[n + 1 + dest] = NULL;
+	if ((pid = fork()) == 0) {
+		execv(oscsend, argv);
+		perror(oscsend);
+		_exit(127);
+	}
+	if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status)) {
+		return -1;
+	}
+	return WEXITSTATUS(status);
+}
+
+// Receives one packet and checks its address, types and the first string or
+// integer argument
+static void check(oscnet_t* net, const char* addr, const char* types, const char* s,
+				  int32_t i, const char* what)
+{
+	uint8_t buf[1024];
+	int32_t size;
+	oscmsg_t msg;
+	oscargs_t it;
+	oscarg_t arg;
+	int ok;
+
+	size = oscnet_recv(net, buf, sizeof(buf), 1000);
+	ok = size > 0 && oscunpack(buf, size, &msg) == 0 && strcmp(msg.address, addr) == 0 &&
+		 strcmp(msg.typetag, types) == 0;
+	if (ok) {
+		for (oscargs(&msg, &it); oscargs_next(&it, &arg); ) {
+			if (arg.type == 's') {
+				ok &= s && strcmp(arg.s, s) == 0;
+			}
+			else if (arg.type == 'i') {
+				ok &= arg.i == i;
+			}
+		}
+	}
+	expect(ok, what);
+}
+
+// Sends to 127.0.0.1, a refused broadcast address and a multicast group on
+// lo, all on the port of one receiver that joined the group
+static void checkfanout(const char* oscsend)
+{
+	struct sockaddr_in sin;
+	struct ip_mreqn mreq;
+	struct pollfd pfd;
+	socklen_t len = sizeof(sin);
+	char port[16];
+	const char* args[] = {
+		"-iface", "lo", "-ttl", "1", "127.0.0.1,255.255.255.255," GROUP, port, "udp",
+		"/g", "-i", "3", NULL,
+	};
+	uint8_t buf[256];
+	int fd, n = 0;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	memset(&mreq, 0, sizeof(mreq));
+	mreq.imr_multiaddr.s_addr = inet_addr(GROUP);
+	mreq.imr_ifindex = if_nametoindex("lo");
+	if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) == -1 ||
+		bind(fd, (struct sockaddr*)&sin, sizeof(sin)) == -1 ||
+		getsockname(fd, (struct sockaddr*)&sin, &len) == -1 ||
+		setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) == -1) {
+		printf("    no multicast on lo, skipped\n");
+		if (fd != -1) {
+			close(fd);
+		}
+		return;
+	}
+	snprintf(port, sizeof(port), "%d", ntohs(sin.sin_port));
+
+	expect(run(oscsend, 0, args) == 1, "a failing destination is reported");
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while (poll(&pfd, 1, 200) > 0 && recv(fd, buf, sizeof(buf), 0) > 0) {
+		n++;
+	}
+	expect(n == 2, "the address and the group still receive");
+	close(fd);
+}
+
+int main (int argc, char* const argv[])
+{
+	static const char* const one[] = { "/a", "-T", "--", "/b", "-i", "1", NULL };
+	static const char* const three[] = {
+		"/m", "-F", "-N", "-I", "-i", "7", "--", "/n", "-s", "--", "--", "/o", NULL,
+	};
+	static const char* const last[] = { "/x", "-i", "2", "--", "/y", "-T", NULL };
+	static const char* const bad[] = { "/a", "-T", "-i", NULL };
+	const char* oscsend = argc > 1 ? argv[1] : "./oscsend";
+	uint8_t buf[1024];
+	oscnet_t* net;
+
+	if (argc > 2 || access(oscsend, X_OK) != 0) {
+		printf(usage);
+		return 1;
+	}
+	if ((net = oscnet_listen(SOCK, NULL, NULL)) == NULL) {
+		return 1;
+	}
+
+	printf("checks:\n");
+	expect(run(oscsend, 1, one) == 0, "oscsend /a -T -- /b -i 1");
+	check(net, "/a", "T", NULL, 0, "/a -T");
+	check(net, "/b", "i", NULL, 1, "/b -i 1 after a type without a value");
+
+	expect(run(oscsend, 1, three) == 0, "oscsend /m -F -N -I -i 7 -- /n -s -- -- /o");
+	check(net, "/m", "FNIi", NULL, 7, "/m -F -N -I -i 7");
+	check(net, "/n", "s", "--", 0, "a string value of -- is not a separator");
+	check(net, "/o", "", NULL, 0, "/o without arguments");
+
+	expect(run(oscsend, 1, last) == 0, "oscsend /x -i 2 -- /y -T");
+	check(net, "/x", "i", NULL, 2, "/x -i 2");
+	check(net, "/y", "T", NULL, 0, "a type without a value at the end");
+
+	expect(run(oscsend, 1, bad) != 0, "a missing value fails");
+	expect(oscnet_recv(net, buf, sizeof(buf), 100) == 0, "nothing is sent when one fails");
+
+	checkfanout(oscsend);
+
+	osctest_report();
+	oscnet_close(net);
+	return osctest_errors != 0;
+}
@@ -0,0 +1,414 @@
+/******************************************************************************
+ *  oscshed
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#include "oscshed.h"
+#include "../oscpack/oscintern.h"
+#include "../oscmetrics/oscmetrics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+// Packets taken off the socket per call, and per oscshed_pump()
+#define BATCH 32
+#define PUMP_MAX 4096
+
+// Deepest bundle looked into for the first message
+#define MAX_DEPTH 8
+
+// A bounded queue of packets. Packet seq is in slot seq % depth; the queue
+// holds [head, tail).
+struct class {
+	int policy;
+	int32_t depth;
+	int32_t maxsize;
+	uint8_t* data;			// depth slots of maxsize bytes
+	int32_t* sizes;
+	uint32_t* hashes;		// address hash of each slot
+	uint64_t head;
+	uint64_t tail;
+	oscshed_stats_t st;
+};
+
+struct prefix {
+	char* str;
+	int32_t len;
+	int cls;
+};
+
+struct oscshed {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int waiting;			// threads blocked in oscshed_pop()
+	struct class classes[OSCSHED_MAX_CLASSES];
+	int nclasses;
+	struct prefix prefixes[OSCSHED_MAX_PREFIXES];	// longest first
+	int nprefixes;
+
+	// Receive buffers of oscshed_pump(), a little larger than any class
+	// takes so a truncated datagram is seen as too large
+	oscnet_msg_t msgs[BATCH];
+	uint8_t* bufs;
+	int32_t bufsize;
+};
+
+// The address of a packet, or of the first message of a bundle, without
+// decoding anything else
+static const uint8_t* address(const uint8_t* p, int32_t size, int32_t* len)
+{
+	const uint8_t* end;
+	uint32_t be;
+	int depth;
+
+	for (depth = 0; size >= 20 && memcmp(p, "#bundle", 8) == 0; ++depth) {
+		memcpy(&be, p + 16, 4);
+		if (depth == MAX_DEPTH || ntohl(be) == 0 || ntohl(be) > (uint32_t)(size - 20)) {
+			return NULL;
+		}
+		size = (int32_t)ntohl(be);
+		p += 20;
+	}
+	if (size < 4 || p[0] != '/') {
+		return NULL;
+	}
+	end = (const uint8_t*)memchr(p, '\0', size);
+	*len = end ? (int32_t)(end - p) : size;
+	return p;
+}
+
+static int classify(oscshed_t* s, const uint8_t* addr, int32_t len)
+{
+	int i;
+
+	if (addr) {
+		for (i = 0; i < s->nprefixes; ++i) {
+			if (s->prefixes[i].len <= len &&
+				memcmp(addr, s->prefixes[i].str, s->prefixes[i].len) == 0) {
+				return s->prefixes[i].cls;
+			}
+		}
+	}
+	return s->nclasses - 1;
+}
+
+oscshed_t* oscshed_new(void)
+{
+	oscshed_t* s = (oscshed_t*)calloc(1, sizeof(oscshed_t));
+	pthread_condattr_t attr;
+
+	if (s == NULL) {
+		fprintf(stderr, "oscshed: Critical memory error...\n");
+		return NULL;
+	}
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&s->cond, &attr);
+	pthread_condattr_destroy(&attr);
+	return s;
+}
+
+int oscshed_class(oscshed_t* s, int32_t depth, int32_t maxsize, int policy)
+{
+	struct class* c;
+
+	if (maxsize <= 0) {
+		maxsize = OSCSHED_MAX_SIZE;
+	}
+	maxsize = (maxsize + 3) & ~3;
+	if (s->nclasses == OSCSHED_MAX_CLASSES || depth < 1 || maxsize > OSCNET_MAX_PACKET ||
+		policy < OSCSHED_DROP_NEWEST || policy > OSCSHED_COALESCE) {
+		fprintf(stderr, "oscshed: invalid class\n");
+		return -1;
+	}
+	c = &s->classes[s->nclasses];
+	c->data = (uint8_t*)malloc((size_t)depth * maxsize);
+	c->sizes = (int32_t*)malloc(depth * sizeof(int32_t));
+	c->hashes = (uint32_t*)malloc(depth * sizeof(uint32_t));
+	if (!c->data || !c->sizes || !c->hashes) {
+		free(c->data);
+		free(c->sizes);
+		free(c->hashes);
+		memset(c, 0, sizeof(*c));
+		fprintf(stderr, "oscshed: Critical memory error...\n");
+		return -1;
+	}
+	c->policy = policy;
+	c->depth = depth;
+	c->maxsize = maxsize;
+	if (maxsize + 4 > s->bufsize) {
+		free(s->bufs);
+		s->bufs = NULL;
+		s->bufsize = maxsize + 4;
+	}
+	return s->nclasses++;
+}
+
+int oscshed_prefix(oscshed_t* s, const char* prefix, int cls)
+{
+	struct prefix p;
+	int i;
+
+	if (cls < 0 || cls >= s->nclasses || s->nprefixes == OSCSHED_MAX_PREFIXES ||
+		prefix[0] != '/') {
+		fprintf(stderr, "oscshed: invalid prefix %s\n", prefix);
+		return -1;
+	}
+	if ((p.str = strdup(prefix)) == NULL) {
+		fprintf(stderr, "oscshed: Critical memory error...\n");
+		return -1;
+	}
+	p.len = (int32_t)strlen(prefix);
+	p.cls = cls;
+	for (i = s->nprefixes; i > 0 && s->prefixes[i-1].len < p.len; --i) {
+		s->prefixes[i] = s->prefixes[i-1];
+	}
+	s->prefixes[i] = p;
+	s->nprefixes++;
+	return 0;
+}
+
+int oscshed_classify(oscshed_t* s, const uint8_t* packet, int32_t size)
+{
+	const uint8_t* addr;
+	int32_t len = 0;
+
+	if (s->nclasses == 0) {
+		return -1;
+	}
+	addr = address(packet, size, &len);
+	return classify(s, addr, len);
+}
+
+// Replaces the queued message with the same address; 1 if there was one.
+// Bundles are never replaced, nor replace a message, since the other
+// messages in them would be lost.
+static int coalesce(struct class* c, const uint8_t* packet, int32_t size,
+					const uint8_t* addr, int32_t len, uint32_t h)
+{
+	const uint8_t* other;
+	uint8_t* slot;
+	uint64_t seq;
+	int32_t olen = 0;
+
+	for (seq = c->tail; seq-- > c->head;) {
+		if (c->hashes[seq % c->depth] != h) {
+			continue;
+		}
+		slot = c->data + (size_t)(seq % c->depth) * c->maxsize;
+		if (slot[0] != '/') {
+			continue;
+		}
+		other = address(slot, c->sizes[seq % c->depth], &olen);
+		if (other && olen == len && memcmp(other, addr, len) == 0) {
+			memcpy(slot, packet, size);
+			c->sizes[seq % c->depth] = size;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int push(oscshed_t* s, const uint8_t* packet, int32_t size)
+{
+	const uint8_t* addr;
+	struct class* c;
+	uint32_t h = 0;
+	int32_t len = 0;
+	int cls;
+
+	if (s->nclasses == 0) {
+		return -1;
+	}
+	addr = address(packet, size, &len);
+	cls = classify(s, addr, len);
+	c = &s->classes[cls];
+	c->st.received++;
+	if (size <= 0 || size > c->maxsize) {
+		c->st.dropped++;
+		OSCMETRICS_ADD(OSCMETRICS_DROPS, 1);
+		return -1;
+	}
+	if (c->policy == OSCSHED_COALESCE && addr && packet[0] == '/') {
+		h = oscintern_hash((const char*)addr, len);
+		if (coalesce(c, packet, size, addr, len, h)) {
+			c->st.coalesced++;
+			return cls;
+		}
+	}
+	if (c->tail - c->head == (uint64_t)c->depth) {
+		c->st.dropped++;
+		OSCMETRICS_ADD(OSCMETRICS_DROPS, 1);
+		if (c->policy == OSCSHED_DROP_NEWEST) {
+			return -1;
+		}
+		c->head++;
+	}
+	memcpy(c->data + (size_t)(c->tail % c->depth) * c->maxsize, packet, size);
+	c->sizes[c->tail % c->depth] = size;
+	c->hashes[c->tail % c->depth] = h;
+	c->tail++;
+	if ((int32_t)(c->tail - c->head) > c->st.peak) {
+		c->st.peak = (int32_t)(c->tail - c->head);
+	}
+	return cls;
+}
+
+int oscshed_push(oscshed_t* s, const uint8_t* packet, int32_t size)
+{
+	int cls;
+
+	pthread_mutex_lock(&s->lock);
+	cls = push(s, packet, size);
+	if (cls != -1 && s->waiting) {
+		pthread_cond_signal(&s->cond);
+	}
+	pthread_mutex_unlock(&s->lock);
+	return cls;
+}
+
+int oscshed_pump(oscshed_t* s, oscnet_t* net, int32_t timeout_ms)
+{
+	int i, n, queued, total = 0;
+
+	if (s->bufs == NULL) {
+		if (s->nclasses == 0 ||
+			(s->bufs = (uint8_t*)malloc((size_t)BATCH * s->bufsize)) == NULL) {
+			fprintf(stderr, "oscshed: Critical memory error...\n");
+			return -1;
+		}
+		for (i = 0; i < BATCH; ++i) {
+			s->msgs[i].buf = s->bufs + (size_t)i * s->bufsize;
+			s->msgs[i].bufsize = s->bufsize;
+		}
+	}
+
+	while (total < PUMP_MAX) {
+		if ((n = oscnet_recvmsgs(net, s->msgs, BATCH, total ? 0 : timeout_ms)) <= 0) {
+			return total ? total : n;
+		}
+		pthread_mutex_lock(&s->lock);
+		for (i = 0, queued = 0; i < n; ++i) {
+			queued |= push(s, s->msgs[i].buf, s->msgs[i].size) != -1;
+		}
+		if (queued && s->waiting) {
+			pthread_cond_broadcast(&s->cond);
+		}
+		pthread_mutex_unlock(&s->lock);
+		total += n;
+	}
+	return total;
+}
+
+int32_t oscshed_pop(oscshed_t* s, uint8_t* buf, int32_t size, int* cls,
+					int32_t timeout_ms)
+{
+	struct class* c;
+	struct timespec deadline;
+	int32_t n;
+	int i, rv = 0;
+
+	if (timeout_ms > 0) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += timeout_ms / 1000;
+		deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+	}
+
+	pthread_mutex_lock(&s->lock);
+	for (;;) {
+		for (i = 0; i < s->nclasses; ++i) {
+			c = &s->classes[i];
+			if (c->head == c->tail) {
+				continue;
+			}
+			n = c->sizes[c->head % c->depth];
+			if (n > size) {
+				pthread_mutex_unlock(&s->lock);
+				errno = EMSGSIZE;
+				return -1;
+			}
+			memcpy(buf, c->data + (size_t)(c->head % c->depth) * c->maxsize, n);
+			c->head++;
+			c->st.popped++;
+			pthread_mutex_unlock(&s->lock);
+			if (cls) {
+				*cls = i;
+			}
+			return n;
+		}
+		if (timeout_ms == 0 || rv == ETIMEDOUT) {
+			pthread_mutex_unlock(&s->lock);
+			return 0;
+		}
+		s->waiting++;
+		if (timeout_ms < 0) {
+			pthread_cond_wait(&s->cond, &s->lock);
+		}
+		else {
+			rv = pthread_cond_timedwait(&s->cond, &s->lock, &deadline);
+		}
+		s->waiting--;
+	}
+}
+
+int oscshed_stats(oscshed_t* s, int cls, oscshed_stats_t* stats)
+{
+	struct class* c;
+
+	pthread_mutex_lock(&s->lock);
+	if (cls < 0 || cls >= s->nclasses) {
+		pthread_mutex_unlock(&s->lock);
+		return -1;
+	}
+	c = &s->classes[cls];
+	*stats = c->st;
+	stats->queued = (int32_t)(c->tail - c->head);
+	pthread_mutex_unlock(&s->lock);
+	return 0;
+}
+
+void oscshed_free(oscshed_t* s)
+{
+	int i;
+
+	if (s == NULL) {
+		return;
+	}
+	for (i = 0; i < s->nclasses; ++i) {
+		free(s->classes[i].data);
+		free(s->classes[i].sizes);
+		free(s->classes[i].hashes);
+	}
+	for (i = 0; i < s->nprefixes; ++i) {
+		free(s->prefixes[i].str);
+	}
+	pthread_mutex_destroy(&s->lock);
+	pthread_cond_destroy(&s->cond);
+	free(s->bufs);
+	free(s);
+}
@@ -0,0 +1,176 @@
+/******************************************************************************
+ *  oscshed
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#ifndef __OSC_SHED_H__
+#define __OSC_SHED_H__
+
+#include <stdint.h>
+
+#include "../oscnet/oscnet.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ *	oscshed decides what to lose when more packets arrive than can be
+ *	handled. Instead of letting the socket buffer overflow and the kernel
+ *	drop whatever comes next, the receive thread takes packets off the socket
+ *	as fast as they come and sorts them into priority classes by the prefix
+ *	of their address, compared on the raw bytes without decoding the packet
+ *	(a bundle is classified by its first message). Each class has its own
+ *	bounded queue and its own policy for when the queue is full:
+ *
+ *		OSCSHED_DROP_NEWEST		the arriving packet is dropped
+ *		OSCSHED_DROP_OLDEST		the oldest queued packet is dropped
+ *		OSCSHED_COALESCE		a message replaces the queued message with the
+ *								same address, if any, so only the latest value
+ *								of each address waits; otherwise the oldest is
+ *								dropped. Bundles are only queued and dropped
+ *								oldest first, never coalesced.
+ *
+ *	oscshed_pop() always takes from the highest priority class that has a
+ *	packet, so under overload a critical class waits at most for the packet
+ *	being handled while bulk classes shed. Every class counts what it
+ *	received, handed out, dropped and coalesced.
+ *
+ *	One thread may push (or pump) while others pop; all calls take one
+ *	short lock.
+ *
+ *
+ *	Usage example:
+ *		oscshed_t* s = oscshed_new();
+ *		int cue = oscshed_class(s, 64, 0, OSCSHED_DROP_NEWEST);
+ *		int fader = oscshed_class(s, 256, 0, OSCSHED_COALESCE);
+ *		oscshed_class(s, 256, 0, OSCSHED_DROP_OLDEST);	// everything else
+ *		oscshed_prefix(s, "/cue/", cue);
+ *		oscshed_prefix(s, "/mixer/", fader);
+ *
+ *		// receive thread
+ *		while (oscshed_pump(s, net, -1) >= 0)
+ *			;
+ *
+ *		// handler thread
+ *		while ((size = oscshed_pop(s, packet, sizeof(packet), &cls, -1)) > 0) {
+ *			...
+ *		}
+ */
+
+// Drop policies
+#define OSCSHED_DROP_NEWEST		0
+#define OSCSHED_DROP_OLDEST		1
+#define OSCSHED_COALESCE		2
+
+// Most classes and prefixes
+#define OSCSHED_MAX_CLASSES		8
+#define OSCSHED_MAX_PREFIXES	64
+
+// Largest packet a class queues unless oscshed_class() is given one
+#define OSCSHED_MAX_SIZE		1024
+
+typedef struct oscshed oscshed_t;
+
+/* Creates a scheduler without classes. Returns NULL on error. */
+oscshed_t* oscshed_new(void);
+
+/*
+ *	oscshed_class() adds a class below the ones already added: the first
+ *	class has the highest priority. Packets that match no prefix go to the
+ *	last class.
+ *
+ *	Arguments:
+ *		int32_t depth: Most packets queued in the class.
+ *		int32_t maxsize: Largest packet queued, or 0 for OSCSHED_MAX_SIZE.
+ *						 Larger packets are dropped. Memory for depth
+ *						 packets of maxsize is allocated up front.
+ *		int policy: What to drop when the queue is full.
+ *
+ *	Return:
+ *		Class number (0 for the first), or -1 on error.
+ */
+int oscshed_class(oscshed_t* s, int32_t depth, int32_t maxsize, int policy);
+
+/*
+ *	oscshed_prefix() sends packets whose address starts with prefix to cls.
+ *	The longest matching prefix wins.
+ *
+ *	Return:
+ *		0 on success or -1 on error.
+ */
+int oscshed_prefix(oscshed_t* s, const char* prefix, int cls);
+
+/* Class a packet would go to, or -1 if there are no classes. */
+int oscshed_classify(oscshed_t* s, const uint8_t* packet, int32_t size);
+
+/*
+ *	oscshed_push() copies a packet into the queue of its class.
+ *
+ *	Return:
+ *		The class, or -1 if the packet was dropped (counted in its class).
+ *		A packet that pushed out an older one or was coalesced is queued.
+ */
+int oscshed_push(oscshed_t* s, const uint8_t* packet, int32_t size);
+
+/*
+ *	oscshed_pump() takes every packet waiting on net, up to a few thousand,
+ *	and pushes them. It waits up to timeout_ms for the first one (-1 waits
+ *	forever).
+ *
+ *	Return:
+ *		Number of packets received, 0 on timeout or -1 on error.
+ */
+int oscshed_pump(oscshed_t* s, oscnet_t* net, int32_t timeout_ms);
+
+/*
+ *	oscshed_pop() copies out the oldest packet of the highest priority class
+ *	that has one.
+ *
+ *	Arguments:
+ *		uint8_t* buf: Destination of the packet.
+ *		int32_t size: Size of buf. A packet that does not fit stays queued.
+ *		int* cls: Set to the class of the packet; may be NULL.
+ *		int32_t timeout_ms: Milliseconds to wait for a packet, 0 returns at
+ *							once and -1 waits forever.
+ *
+ *	Return:
+ *		Size of the packet, 0 on timeout or -1 if buf is too small.
+ */
+int32_t oscshed_pop(oscshed_t* s, uint8_t* buf, int32_t size, int* cls,
+					int32_t timeout_ms);
+
+typedef struct {
+	uint64_t received;		// packets classified into the class
+	uint64_t popped;		// packets handed out
+	uint64_t dropped;		// packets lost to the policy or too large
+	uint64_t coalesced;		// packets replaced by a newer one to their address
+	int32_t queued;			// packets waiting now
+	int32_t peak;			// most packets waiting at once
+} oscshed_stats_t;
+
+/* Counters of class cls. Returns 0, or -1 if there is no such class. */
+int oscshed_stats(oscshed_t* s, int cls, oscshed_stats_t* stats);
+
+void oscshed_free(oscshed_t* s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __OSC_SHED_H__
@@ -0,0 +1,334 @@
+/******************************************************************************
+ *  oscshedtest
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *
+ *  Checks the drop policies and classification, then simulates a receiver
+ *  whose handler takes 20 us per packet while fader and meter traffic
+ *  arrives at up to 10 times that rate next to one cue per millisecond.
+ *  Time is simulated in 1 us steps so the result does not depend on the
+ *  machine; the packets go through oscshed itself. Prints the cue latency
+ *  and losses with priority classes and with one queue the size of a
+ *  socket buffer, and the cost of a push and pop.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "oscshed.h"
+#include "../oscpack/oscpack.h"
+#include "../oscpack/oscunpack.h"
+#include "../oscpack/osctest.h"
+
+const char usage[] = "usage: oscshedtest [seconds]\n";
+
+#define SERVICE_US 20		// handler time per packet: 50000 packets/s
+#define CUE_US 997			// about one cue per millisecond
+#define FADERS 16
+#define METERS 256
+
+static int32_t popped_int(oscshed_t* s, int* cls)
+{
+	uint8_t buf[256];
+	oscmsg_t msg;
+	oscargs_t it;
+	oscarg_t arg;
+	int32_t size = oscshed_pop(s, buf, sizeof(buf), cls, 0);
+
+	if (size <= 0 || oscunpack(buf, size, &msg) == -1) {
+		return -1;
+	}
+	oscargs(&msg, &it);
+	return oscargs_next(&it, &arg) && arg.type == 'i' ? arg.i : -1;
+}
+
+static void check(void)
+{
+	oscshed_t* s = oscshed_new();
+	oscshed_stats_t st;
+	uint8_t buf[256], big[2048];
+	int32_t size;
+	int cls, i;
+
+	oscshed_class(s, 2, 0, OSCSHED_DROP_NEWEST);		// 0
+	oscshed_class(s, 2, 0, OSCSHED_DROP_OLDEST);		// 1
+	oscshed_class(s, 2, 0, OSCSHED_COALESCE);			// 2
+	oscshed_class(s, 4, 0, OSCSHED_DROP_NEWEST);		// 3, everything else
+	oscshed_prefix(s, "/new", 0);
+	oscshed_prefix(s, "/old", 1);
+	oscshed_prefix(s, "/co", 2);
+	oscshed_prefix(s, "/cold", 3);
+
+	for (i = 1; i <= 3; ++i) {
+		size = oscpack(buf, "/new", "i", i);
+		expect(oscshed_push(s, buf, size) == (i < 3 ? 0 : -1), "drop newest");
+		size = oscpack(buf, "/old", "i", i);
+		expect(oscshed_push(s, buf, size) == 1, "drop oldest");
+	}
+	size = oscpack(buf, "/co/a", "i", 1);
+	oscshed_push(s, buf, size);
+	size = oscpack(buf, "/co/b", "i", 2);
+	oscshed_push(s, buf, size);
+	size = oscpack(buf, "/co/a", "i", 3);
+	expect(oscshed_push(s, buf, size) == 2, "coalesce");
+	size = oscpack(buf, "/cold", "i", 4);
+	expect(oscshed_classify(s, buf, size) == 3, "longest prefix");
+	size = oscpack(buf + 20, "/old/in/bundle", "i", 0);
+	memcpy(buf, "#bundle\0\0\0\0\0\0\0\0\1\0\0\0", 20);
+	buf[19] = (uint8_t)size;
+	expect(oscshed_classify(s, buf, size + 20) == 1, "bundle classified by first message");
+	size = oscpack(buf, "/unknown", "i", 0);
+	expect(oscshed_classify(s, buf, size) == 3, "default class");
+	// An oversized /new packet is refused and counted as dropped in class 0
+	memset(big, 0, sizeof(big));
+	memcpy(big, "/new", 4);
+	expect(oscshed_push(s, big, OSCSHED_MAX_SIZE + 4) == -1, "too large");
+
+	expect(popped_int(s, &cls) == 1 && cls == 0, "priority 0 first");
+	expect(popped_int(s, &cls) == 2 && cls == 0, "priority 0 in order");
+	expect(popped_int(s, &cls) == 2 && cls == 1, "oldest was dropped");
+	expect(popped_int(s, &cls) == 3 && cls == 1, "newest was kept");
+	expect(popped_int(s, &cls) == 3 && cls == 2, "coalesced value in place");
+	expect(popped_int(s, &cls) == 2 && cls == 2, "other address kept");
+	expect(popped_int(s, &cls) == -1, "empty");
+
+	oscshed_stats(s, 0, &st);
+	expect(st.received == 4 && st.dropped == 2 && st.popped == 2, "newest counters");
+	oscshed_stats(s, 1, &st);
+	expect(st.received == 3 && st.dropped == 1 && st.peak == 2, "oldest counters");
+	oscshed_stats(s, 2, &st);
+	expect(st.received == 3 && st.coalesced == 1 && st.queued == 0, "coalesce counters");
+	oscshed_free(s);
+}
+
+// A bundle of two messages with int arguments
+static int32_t bundle(uint8_t* buf, const char* a, int32_t x, const char* b, int32_t y)
+{
+	int32_t n, m;
+
+	memcpy(buf, "#bundle\0\0\0\0\0\0\0\0\1", 16);
+	n = oscpack(buf + 20, a, "i", x);
+	m = oscpack(buf + 24 + n, b, "i", y);
+	buf[19] = (uint8_t)n;
+	memset(buf + 20 + n, 0, 4);
+	buf[23 + n] = (uint8_t)m;
+	return 24 + n + m;
+}
+
+// Bundles in a coalescing class are queued whole and dropped oldest first
+static void bundles(void)
+{
+	oscshed_t* s = oscshed_new();
+	oscshed_stats_t st;
+	uint8_t buf[256];
+	int32_t size;
+	int cls;
+
+	oscshed_class(s, 3, 0, OSCSHED_COALESCE);
+	size = oscpack(buf, "/co/a", "i", 1);
+	oscshed_push(s, buf, size);
+	size = bundle(buf, "/co/a", 2, "/co/b", 2);
+	expect(oscshed_push(s, buf, size) == 0, "a bundle is queued");
+	size = oscpack(buf, "/co/a", "i", 3);
+	oscshed_push(s, buf, size);
+	oscshed_stats(s, 0, &st);
+	expect(st.coalesced == 1 && st.queued == 2, "a message replaces only a message");
+
+	// The next bundle fills the class and the one after drops the oldest
+	// packet, the message, so the first bundle is at the head with its 2
+	size = bundle(buf, "/co/a", 4, "/co/b", 4);
+	oscshed_push(s, buf, size);
+	size = bundle(buf, "/co/a", 5, "/co/b", 5);
+	oscshed_push(s, buf, size);
+	size = oscshed_pop(s, buf, sizeof(buf), &cls, 0);
+	expect(size > 0 && memcmp(buf, "#bundle", 8) == 0 && buf[35] == 2,
+		   "the oldest packet was dropped, not a bundle coalesced");
+	oscshed_stats(s, 0, &st);
+	expect(st.coalesced == 1 && st.dropped == 1 && st.queued == 2, "bundle counters");
+	oscshed_free(s);
+}
+
+static int bylatency(const void* a, const void* b)
+{
+	return *(const int32_t*)a - *(const int32_t*)b;
+}
+
+static int64_t stamp(const uint8_t* buf, int32_t size)
+{
+	oscmsg_t msg;
+	oscargs_t it;
+	oscarg_t arg;
+
+	if (oscunpack(buf, size, &msg) == -1) {
+		return -1;
+	}
+	oscargs(&msg, &it);
+	return oscargs_next(&it, &arg) && arg.type == 'h' ? arg.h : -1;
+}
+
+// One simulated run; load is the bulk rate over what the handler can take
+static void simulate(double load, int classes, int seconds)
+{
+	oscshed_t* s = oscshed_new();
+	oscshed_stats_t st;
+	uint8_t buf[256];
+	char addr[32];
+	int32_t* lat;
+	int64_t t, ticks = (int64_t)seconds * 1000000, busy = 0;
+	uint64_t bulk = 0, handled = 0, shed = 0;
+	double acc = 0, rate = load / SERVICE_US;
+	int32_t size, n = 0, sent = 0;
+	int cls, k;
+
+	lat = (int32_t*)malloc((ticks / CUE_US + 1) * sizeof(int32_t));
+	if (!s || !lat) {
+		fprintf(stderr, "oscshedtest: Critical memory error...\n");
+		exit(1);
+	}
+	if (classes) {
+		oscshed_prefix(s, "/cue/", oscshed_class(s, 64, 0, OSCSHED_DROP_NEWEST));
+		oscshed_prefix(s, "/mixer/", oscshed_class(s, 64, 0, OSCSHED_COALESCE));
+		oscshed_class(s, 256, 0, OSCSHED_DROP_OLDEST);
+	}
+	else {
+		// What a socket buffer does: one queue that refuses what does not fit
+		oscshed_class(s, 384, 0, OSCSHED_DROP_NEWEST);
+	}
+
+	// Traffic arrives for the simulated seconds; then the handler finishes
+	// what is queued, so a cue still waiting at the end is not counted lost
+	for (t = 0; ; ++t) {
+		for (acc += t < ticks ? rate : 0; acc >= 1; acc -= 1, ++bulk) {
+			if (bulk % 10 < 3) {
+				snprintf(addr, sizeof(addr), "/mixer/ch/%d/gain", (int)(bulk % FADERS));
+			}
+			else {
+				snprintf(addr, sizeof(addr), "/meter/%d", (int)(bulk % METERS));
+			}
+			size = oscpack(buf, addr, "hf", t, 0.5f);
+			oscshed_push(s, buf, size);
+		}
+		if (t < ticks && t % CUE_US == 0) {
+			size = oscpack(buf, "/cue/go", "h", t);
+			oscshed_push(s, buf, size);
+			sent++;
+		}
+		if (t < busy) {
+			continue;
+		}
+		if ((size = oscshed_pop(s, buf, sizeof(buf), &cls, 0)) <= 0) {
+			if (t >= ticks) {
+				break;
+			}
+			continue;
+		}
+		if (memcmp(buf, "/cue/", 5) == 0) {
+			lat[n++] = (int32_t)(t - stamp(buf, size));
+		}
+		else {
+			handled++;
+		}
+		busy = t + SERVICE_US;
+	}
+	for (k = 0; k < 3; ++k) {
+		if (oscshed_stats(s, k, &st) == 0) {
+			shed += st.dropped + st.coalesced;
+		}
+	}
+
+	qsort(lat, n, sizeof(int32_t), bylatency);
+	printf("    %4.1fx  %-7s  %6d  %6d  %6d  %7d  %9llu  %9llu\n", load,
+		   classes ? "classes" : "fifo", n ? lat[n / 2] : -1, n ? lat[n * 99 / 100] : -1,
+		   n ? lat[n - 1] : -1, sent - n, (unsigned long long)handled,
+		   (unsigned long long)shed);
+	if (classes && (n < sent || lat[n * 99 / 100] > SERVICE_US)) {
+		osctest_errors++;
+	}
+	free(lat);
+	oscshed_free(s);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Real cost of classifying, queueing and taking out a packet
+static void cost(void)
+{
+	oscshed_t* s = oscshed_new();
+	uint8_t out[256];
+	int32_t size[4];
+	uint8_t packets[4][64];
+	double t;
+	int i, rounds = 1000000;
+
+	oscshed_prefix(s, "/cue/", oscshed_class(s, 64, 0, OSCSHED_DROP_NEWEST));
+	oscshed_prefix(s, "/mixer/", oscshed_class(s, 64, 0, OSCSHED_COALESCE));
+	oscshed_class(s, 256, 0, OSCSHED_DROP_OLDEST);
+	size[0] = oscpack(packets[0], "/cue/go", "i", 1);
+	size[1] = oscpack(packets[1], "/mixer/ch/1/gain", "f", 0.5);
+	size[2] = oscpack(packets[2], "/mixer/ch/2/gain", "f", 0.5);
+	size[3] = oscpack(packets[3], "/meter/1", "f", 0.5);
+
+	t = now();
+	for (i = 0; i < rounds; ++i) {
+		oscshed_push(s, packets[i & 3], size[i & 3]);
+		if (i & 1) {
+			oscshed_pop(s, out, sizeof(out), NULL, 0);
+			oscshed_pop(s, out, sizeof(out), NULL, 0);
+		}
+	}
+	t = now() - t;
+	printf("    push and pop: %.0f ns per packet\n", t / rounds * 1e9);
+	oscshed_free(s);
+}
+
+int main (int argc, char* const argv[])
+{
+	static const double loads[] = {0.5, 1, 2, 5, 10};
+	int i, seconds = 2;
+
+	if (argc > 1 && argv[1][0] == '-') {
+		printf(usage);
+		return 0;
+	}
+	if (argc > 1) seconds = atoi(argv[1]);
+	if (seconds < 1) {
+		printf(usage);
+		return 0;
+	}
+
+	check();
+	bundles();
+	printf("oscshedtest: handler takes %d us, one cue per %d us, %d s simulated\n",
+		   SERVICE_US, CUE_US, seconds);
+	printf("    load  queues   cue p50 cue p99 cue max  cues lost  bulk handled  bulk shed\n");
+	printf("                   (us)    (us)    (us)\n");
+	for (i = 0; i < 5; ++i) {
+		simulate(loads[i], 1, seconds);
+		simulate(loads[i], 0, seconds);
+	}
+	cost();
+	printf("checks:\n");
+	return osctest_report();
+}
@@ -0,0 +1,341 @@
+/******************************************************************************
+ *  oscshm
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#include "oscshm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#define OSCSHM_MAGIC 0x4f534352		// "OSCR"
+#define OSCSHM_MIN_CAPACITY 4096
+
+// Number of empty polls before the receiver goes to sleep
+#define OSCSHM_SPIN 2000
+
+// Each record starts with a 32-bit word that is written last by the sender.
+// The top bit marks a committed record, the next bit marks padding that
+// skips to the end of the ring, and the rest is the payload length.
+#define REC_COMMIT 0x80000000u
+#define REC_PAD 0x40000000u
+#define REC_LEN(w) ((w) & 0x3fffffffu)
+#define REC_SIZE(len) (((len) + 4 + 7) & ~7u)
+
+// Producer and consumer positions live on separate cache lines so senders
+// reserving space do not invalidate the line the receiver is polling.
+struct oscshm_header {
+	uint32_t magic;
+	uint32_t capacity;
+	uint8_t pad0[56];
+	uint64_t head;			// next byte to reserve (senders)
+	uint8_t pad1[56];
+	uint64_t tail;			// next byte to read (receiver)
+	uint8_t pad2[56];
+	uint32_t waiting;		// receiver is asleep on wakeups
+	uint32_t wakeups;		// futex word
+	uint8_t pad3[56];
+};
+
+struct oscshm {
+	struct oscshm_header* hdr;
+	uint8_t* data;
+	uint32_t mask;
+	size_t maplen;
+	int spin;				// empty polls before sleeping
+};
+
+static void oscshm_path(char* path, size_t len, const char* name)
+{
+	snprintf(path, len, "/osc.%s", name);
+}
+
+static void oscshm_wait(struct oscshm_header* hdr, uint32_t val, int32_t timeout_ms)
+{
+#ifdef __linux__
+	struct timespec ts, *tp = NULL;
+
+	if (timeout_ms >= 0) {
+		ts.tv_sec = timeout_ms / 1000;
+		ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+		tp = &ts;
+	}
+	syscall(SYS_futex, &hdr->wakeups, FUTEX_WAIT, val, tp, NULL, 0);
+#else
+	// No futex; poll at a coarse interval instead
+	struct timespec ts = {0, 50000};
+	(void)hdr;
+	(void)val;
+	(void)timeout_ms;
+	nanosleep(&ts, NULL);
+#endif
+}
+
+static void oscshm_wake(struct oscshm_header* hdr)
+{
+	__atomic_store_n(&hdr->waiting, 0, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&hdr->wakeups, 1, __ATOMIC_RELEASE);
+#ifdef __linux__
+	syscall(SYS_futex, &hdr->wakeups, FUTEX_WAKE, 1, NULL, NULL, 0);
+#endif
+}
+
+static int64_t oscshm_now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+oscshm_t* oscshm_open(const char* name, int32_t capacity)
+{
+	char path[256];
+	int fd, created = 0, i;
+	struct stat st;
+	struct oscshm_header* hdr;
+	oscshm_t* shm;
+	uint32_t cap;
+
+	if (capacity <= 0) {
+		capacity = OSCSHM_DEFAULT_CAPACITY;
+	}
+
+	// Round up to a power of two so positions wrap with a mask
+	for (cap = OSCSHM_MIN_CAPACITY; cap < (uint32_t)capacity; cap <<= 1)
+		;
+
+	oscshm_path(path, sizeof(path), name);
+
+	fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0666);
+	if (fd >= 0) {
+		created = 1;
+		if (ftruncate(fd, sizeof(struct oscshm_header) + cap) == -1) {
+			close(fd);
+			shm_unlink(path);
+			return NULL;
+		}
+	}
+	else if (errno == EEXIST) {
+		fd = shm_open(path, O_RDWR, 0);
+		if (fd == -1) {
+			return NULL;
+		}
+
+		// Another process is creating the ring; wait until it is sized
+		for (i = 0; i < 1000; ++i) {
+			if (fstat(fd, &st) == 0 &&
+				st.st_size > (off_t)sizeof(struct oscshm_header)) {
+				break;
+			}
+			usleep(1000);
+		}
+		if (i == 1000) {
+			close(fd);
+			errno = ETIMEDOUT;
+			return NULL;
+		}
+		cap = (uint32_t)(st.st_size - sizeof(struct oscshm_header));
+	}
+	else {
+		return NULL;
+	}
+
+	hdr = (struct oscshm_header*)mmap(NULL, sizeof(struct oscshm_header) + cap,
+									  PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (hdr == MAP_FAILED) {
+		return NULL;
+	}
+
+	if (created) {
+		// ftruncate already zeroed the ring and positions
+		hdr->capacity = cap;
+		__atomic_store_n(&hdr->magic, OSCSHM_MAGIC, __ATOMIC_RELEASE);
+	}
+	else {
+		for (i = 0; i < 1000; ++i) {
+			if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) == OSCSHM_MAGIC) {
+				break;
+			}
+			usleep(1000);
+		}
+		if (i == 1000 || hdr->capacity != cap) {
+			munmap(hdr, sizeof(struct oscshm_header) + cap);
+			errno = EINVAL;
+			return NULL;
+		}
+	}
+
+	shm = (oscshm_t*)calloc(1, sizeof(oscshm_t));
+	if (!shm) {
+		munmap(hdr, sizeof(struct oscshm_header) + cap);
+		return NULL;
+	}
+	shm->hdr = hdr;
+	shm->data = (uint8_t*)(hdr + 1);
+	shm->mask = cap - 1;
+	shm->maplen = sizeof(struct oscshm_header) + cap;
+
+	// Spinning only helps when the sender can run at the same time
+	shm->spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? OSCSHM_SPIN : 0;
+	return shm;
+}
+
+int32_t oscshm_send(oscshm_t* shm, const uint8_t* buf, int32_t size)
+{
+	struct oscshm_header* hdr = shm->hdr;
+	uint32_t cap = shm->mask + 1;
+	uint32_t need, pad, off;
+	uint64_t head, tail;
+
+	if (size < 0 || size > OSCSHM_MAX_PACKET || REC_SIZE(size) > cap / 2) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+	need = REC_SIZE(size);
+
+	// Reserve space; a record never wraps, so pad to the end of the ring
+	// when it does not fit in the remaining bytes.
+	head = __atomic_load_n(&hdr->head, __ATOMIC_RELAXED);
+	do {
+		off = head & shm->mask;
+		pad = (off + need > cap) ? cap - off : 0;
+		tail = __atomic_load_n(&hdr->tail, __ATOMIC_ACQUIRE);
+		if (head + pad + need - tail > cap) {
+			errno = EAGAIN;
+			return -1;
+		}
+	} while (!__atomic_compare_exchange_n(&hdr->head, &head, head + pad + need,
+										  1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+	if (pad) {
+		__atomic_store_n((uint32_t*)(shm->data + off), REC_COMMIT | REC_PAD | pad,
+						 __ATOMIC_RELEASE);
+		off = 0;
+	}
+
+	memcpy(shm->data + off + 4, buf, size);
+	__atomic_store_n((uint32_t*)(shm->data + off), REC_COMMIT | (uint32_t)size,
+					 __ATOMIC_RELEASE);
+
+	// Only pay for a system call when the receiver is asleep
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&hdr->waiting, __ATOMIC_RELAXED)) {
+		oscshm_wake(hdr);
+	}
+
+	return size;
+}
+
+int32_t oscshm_recv(oscshm_t* shm, uint8_t* buf, int32_t size, int32_t timeout_ms)
+{
+	struct oscshm_header* hdr = shm->hdr;
+	uint64_t tail;
+	uint32_t word, off, len, wakeups;
+	int64_t deadline = 0, left;
+	int32_t n;
+	int spin = 0;
+
+	if (timeout_ms > 0) {
+		deadline = oscshm_now_ms() + timeout_ms;
+	}
+
+	for (;;) {
+		tail = __atomic_load_n(&hdr->tail, __ATOMIC_RELAXED);
+		off = tail & shm->mask;
+		word = __atomic_load_n((uint32_t*)(shm->data + off), __ATOMIC_ACQUIRE);
+
+		if (word & REC_COMMIT) {
+			if (word & REC_PAD) {
+				len = REC_LEN(word);
+				memset(shm->data + off, 0, len);
+				__atomic_store_n(&hdr->tail, tail + len, __ATOMIC_RELEASE);
+				continue;
+			}
+
+			len = REC_LEN(word);
+			n = (int32_t)len < size ? (int32_t)len : size;
+			memcpy(buf, shm->data + off + 4, (size_t)n);
+
+			// Clear the record so a stale word is never mistaken for a
+			// committed one once the space is reused.
+			memset(shm->data + off, 0, REC_SIZE(len));
+			__atomic_store_n(&hdr->tail, tail + REC_SIZE(len), __ATOMIC_RELEASE);
+			return n;
+		}
+
+		if (timeout_ms == 0) {
+			return 0;
+		}
+
+		if (++spin < shm->spin) {
+#if defined(__x86_64__) || defined(__i386__)
+			__builtin_ia32_pause();
+#endif
+			continue;
+		}
+
+		left = -1;
+		if (timeout_ms > 0) {
+			left = deadline - oscshm_now_ms();
+			if (left <= 0) {
+				return 0;
+			}
+		}
+
+		// Announce we are going to sleep, then check once more so a sender
+		// that committed before seeing the flag is not missed.
+		wakeups = __atomic_load_n(&hdr->wakeups, __ATOMIC_ACQUIRE);
+		__atomic_store_n(&hdr->waiting, 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		word = __atomic_load_n((uint32_t*)(shm->data + off), __ATOMIC_ACQUIRE);
+		if (!(word & REC_COMMIT)) {
+			oscshm_wait(hdr, wakeups, (int32_t)left);
+		}
+		__atomic_store_n(&hdr->waiting, 0, __ATOMIC_RELAXED);
+		spin = 0;
+	}
+}
+
+void oscshm_close(oscshm_t* shm)
+{
+	if (shm) {
+		munmap(shm->hdr, shm->maplen);
+		free(shm);
+	}
+}
+
+int oscshm_unlink(const char* name)
+{
+	char path[256];
+
+	oscshm_path(path, sizeof(path), name);
+	return shm_unlink(path);
+}
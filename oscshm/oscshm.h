@@ -0,0 +1,114 @@
+/******************************************************************************
+ *  oscshm
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#ifndef __OSC_SHM_H__
+#define __OSC_SHM_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ *	oscshm is a shared memory transport for OSC packets exchanged between
+ *	processes on the same host. It is a replacement for sending over the UDP
+ *	loopback interface and behaves like a datagram socket: each packet is
+ *	delivered whole, and a full ring drops the packet instead of blocking.
+ *
+ *	The ring lives in a POSIX shared memory object (shm_open) named after the
+ *	transport, so "shm://engine" maps to "/osc.engine". Any number of
+ *	processes may send into the ring, but only one process should receive
+ *	from it.
+ *
+ *	Senders never make a system call unless the receiver is sleeping. The
+ *	receiver spins for a short while when the ring is empty and then sleeps
+ *	on a futex until a sender wakes it up.
+ *
+ *
+ *	Usage example for sender:
+ *		oscshm_t* shm = oscshm_open("engine", 0);
+ *		uint8_t packet[256];
+ *		int32_t size = oscpack(packet, "/osc/address", "if", 123, 1.23);
+ *		oscshm_send(shm, packet, size);
+ *		oscshm_close(shm);
+ *
+ *	Usage example for receiver:
+ *		oscshm_t* shm = oscshm_open("engine", 0);
+ *		uint8_t packet[OSCSHM_MAX_PACKET];
+ *		int32_t size = oscshm_recv(shm, packet, sizeof(packet), -1);
+ */
+
+// Size of the ring when the caller passes 0 as capacity
+#define OSCSHM_DEFAULT_CAPACITY (1 << 20)
+
+// Largest packet that can be sent through the ring
+#define OSCSHM_MAX_PACKET 65536
+
+typedef struct oscshm oscshm_t;
+
+/*
+ *	oscshm_open() maps the shared memory ring of the given name, creating it if
+ *	it does not exist yet.
+ *
+ *	Arguments:
+ *		const char* name: Name of the ring without the "shm://" prefix.
+ *		int32_t capacity: Size of the ring in bytes. Rounded up to a power of
+ *						  two. Ignored if the ring already exists. Use 0 for
+ *						  OSCSHM_DEFAULT_CAPACITY.
+ *
+ *	Return:
+ *		Handle to the ring or NULL on error (errno is set).
+ */
+oscshm_t* oscshm_open(const char* name, int32_t capacity);
+
+/*
+ *	oscshm_send() copies a packet into the ring.
+ *
+ *	Return:
+ *		Number of bytes sent, or -1 if the packet is too large or the ring is
+ *		full (errno is set to EMSGSIZE or EAGAIN).
+ */
+int32_t oscshm_send(oscshm_t* shm, const uint8_t* buf, int32_t size);
+
+/*
+ *	oscshm_recv() copies the next packet out of the ring. If the packet is
+ *	larger than size, it is truncated as recv() does for datagram sockets.
+ *
+ *	Arguments:
+ *		int32_t timeout_ms: Milliseconds to wait for a packet. 0 returns
+ *							immediately, -1 waits forever.
+ *
+ *	Return:
+ *		Size of the packet, 0 on timeout or -1 on error.
+ */
+int32_t oscshm_recv(oscshm_t* shm, uint8_t* buf, int32_t size, int32_t timeout_ms);
+
+/* Unmaps the ring. The shared memory object stays until oscshm_unlink(). */
+void oscshm_close(oscshm_t* shm);
+
+/* Removes the shared memory object of the given name. */
+int oscshm_unlink(const char* name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __OSC_SHM_H__
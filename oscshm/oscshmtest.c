@@ -0,0 +1,97 @@
+/******************************************************************************
+ *  oscshmtest
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *
+ *  Ping-pong between two processes over a pair of shared memory rings and
+ *  print the average one-way latency.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "oscshm.h"
+#include "../oscpack/oscpack.h"
+
+const char usage[] = "usage: oscshmtest [count]\n";
+
+int main (int argc, char* const argv[])
+{
+	oscshm_t *ping, *pong;
+	uint8_t buf[256];
+	int32_t size;
+	int i, count = 100000;
+	pid_t pid;
+	struct timespec t0, t1;
+	double ns;
+
+	if (argc > 2) {
+		printf(usage);
+		return 0;
+	}
+	if (argc == 2) {
+		count = atoi(argv[1]);
+	}
+
+	oscshm_unlink("oscshmtest.ping");
+	oscshm_unlink("oscshmtest.pong");
+	ping = oscshm_open("oscshmtest.ping", 0);
+	pong = oscshm_open("oscshmtest.pong", 0);
+	if (!ping || !pong) {
+		perror("oscshm_open");
+		return 1;
+	}
+
+	if ((pid = fork()) == 0) {
+		// Echo every packet back
+		for (i = 0; i < count; ++i) {
+			size = oscshm_recv(ping, buf, sizeof(buf), -1);
+			while (oscshm_send(pong, buf, size) == -1)
+				;
+		}
+		return 0;
+	}
+
+	size = oscpack(buf, "/oscshmtest", "if", 0, 1.0);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < count; ++i) {
+		while (oscshm_send(ping, buf, size) == -1)
+			;
+		if (oscshm_recv(pong, buf, sizeof(buf), -1) != size) {
+			fprintf(stderr, "oscshm_recv: error\n");
+			break;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	waitpid(pid, NULL, 0);
+
+	ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+	printf("oscshmtest: %d round trips, %.0f ns one-way\n", i, ns / i / 2);
+
+	oscshm_close(ping);
+	oscshm_close(pong);
+	oscshm_unlink("oscshmtest.ping");
+	oscshm_unlink("oscshmtest.pong");
+	return 0;
+}
@@ -0,0 +1,1328 @@
+/******************************************************************************
+ *  oscstat
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *
+ *  This is a command line tool to summarize the OSC traffic in a pcap or
+ *  pcapng capture (tcpdump -w, Wireshark). It prints message counts, rates,
+ *  sizes and type tags for every OSC address found in UDP datagrams and in
+ *  TCP streams with a 4-byte size prefix.
+ *
+ *  The capture is mapped into memory and cut into chunks. Every thread
+ *  finds the first record of a chunk by checking that a run of record
+ *  headers is consistent, then decodes the chunk on its own. UDP packets are
+ *  counted right away; TCP segments are kept and put back in stream order
+ *  in a second pass, where every thread follows its share of the flows.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include "../oscpack/oscunpack.h"
+
+#define OSCSTAT "oscstat"
+
+// Bundles nested deeper than this are not walked
+#define MAX_DEPTH 8
+
+// Type tags counted per address; the rest are added up as "other"
+#define TYPES 4
+#define TYPETAG_MAX 32
+
+// Message sizes are counted in power of two buckets: 0-3, 4-7, ... 64k-
+#define SIZE_BUCKETS 17
+
+// Consistent record headers needed to trust a chunk start
+#define SYNC_RECORDS 16
+
+// Largest frame a capture record may hold
+#define MAX_FRAME 262144
+
+// Largest size prefix accepted in a TCP stream
+#define MAX_TCP_PACKET (1 << 20)
+
+// pcapng interfaces described before the first packet
+#define MAX_IFACES 64
+
+#define PCAP_MAGIC 0xa1b2c3d4u
+#define PCAP_MAGIC_NSEC 0xa1b23c4du
+#define PCAPNG_SHB 0x0a0d0d0au
+#define PCAPNG_BOM 0x1a2b3c4du
+#define PCAPNG_IDB 1
+#define PCAPNG_PB 2
+#define PCAPNG_SPB 3
+#define PCAPNG_EPB 6
+
+#define LINKTYPE_NULL 0
+#define LINKTYPE_ETHERNET 1
+#define LINKTYPE_RAW 101
+#define LINKTYPE_LOOP 108
+#define LINKTYPE_LINUX_SLL 113
+#define LINKTYPE_IPV4 228
+#define LINKTYPE_IPV6 229
+#define LINKTYPE_LINUX_SLL2 276
+
+const char usage[] =
+"usage: oscstat [-t threads] [-p port] [-n count] file\n" \
+"    -t threads  threads to use (default: one per CPU)\n" \
+"    -p port     only count UDP and TCP traffic to or from port\n" \
+"    -n count    addresses to list, 0 for all (default: 50)\n" \
+"\n" \
+"file is a pcap or pcapng capture, e.g. from tcpdump -w.\n" \
+"\n";
+
+/******************************************************************************
+ *  Capture file
+ ******************************************************************************/
+
+struct iface {
+	int linktype;
+	uint64_t units;			// timestamp ticks per second
+	int64_t offset;			// seconds added to timestamps
+};
+
+struct capture {
+	const uint8_t* map;
+	uint64_t size;
+	uint64_t data;			// offset of the first record
+	int ng;					// pcapng
+	int swap;				// headers are in the other byte order
+	int nsec;				// classic pcap with nanosecond timestamps
+	int linktype;			// classic pcap
+	uint32_t snaplen;
+	struct iface ifaces[MAX_IFACES];
+	int nifaces;
+};
+
+static struct capture cap;
+
+static uint16_t rd16(const uint8_t* p)
+{
+	uint16_t v;
+	memcpy(&v, p, 2);
+	return cap.swap ? (uint16_t)((v >> 8) | (v << 8)) : v;
+}
+
+static uint32_t rd32(const uint8_t* p)
+{
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return cap.swap ? __builtin_bswap32(v) : v;
+}
+
+static uint64_t rd64(const uint8_t* p)
+{
+	uint64_t v;
+	memcpy(&v, p, 8);
+	return cap.swap ? __builtin_bswap64(v) : v;
+}
+
+static uint16_t be16(const uint8_t* p)
+{
+	return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t be32(const uint8_t* p)
+{
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return ntohl(v);
+}
+
+static uint64_t ticks_ns(uint64_t ticks, uint64_t units)
+{
+	if (units == 1000000000ull) {
+		return ticks;
+	}
+	if (units == 1000000ull) {
+		return ticks * 1000;
+	}
+	return ticks / units * 1000000000ull +
+		(uint64_t)((double)(ticks % units) * 1e9 / units);
+}
+
+// Reads the interface description blocks at the start of a pcapng section
+static int pcapng_open(void)
+{
+	uint64_t off = 0, opt, end;
+	uint32_t type, len, bom;
+	uint16_t code, olen;
+	struct iface* f;
+	int i;
+
+	memcpy(&bom, cap.map + 8, 4);
+	if (bom == PCAPNG_BOM) {
+		cap.swap = 0;
+	}
+	else if (__builtin_bswap32(bom) == PCAPNG_BOM) {
+		cap.swap = 1;
+	}
+	else {
+		return -1;
+	}
+
+	while (off + 12 <= cap.size) {
+		type = rd32(cap.map + off);
+		len = rd32(cap.map + off + 4);
+		if (len < 12 || len % 4 || off + len > cap.size) {
+			return -1;
+		}
+		if (type == PCAPNG_EPB || type == PCAPNG_SPB || type == PCAPNG_PB) {
+			break;
+		}
+		if (type == PCAPNG_IDB && cap.nifaces < MAX_IFACES && len >= 20) {
+			f = &cap.ifaces[cap.nifaces++];
+			f->linktype = rd16(cap.map + off + 8);
+			f->units = 1000000;
+			f->offset = 0;
+
+			end = off + len - 4;
+			for (opt = off + 16; opt + 4 <= end; opt += 4 + ((olen + 3) & ~3)) {
+				code = rd16(cap.map + opt);
+				olen = rd16(cap.map + opt + 2);
+				if (code == 0 || opt + 4 + olen > end) {
+					break;
+				}
+				if (code == 9 && olen >= 1) {			// if_tsresol
+					uint8_t r = cap.map[opt + 4];
+					f->units = 1;
+					for (i = 0; i < (r & 0x7f) && i < 63; ++i) {
+						f->units *= (r & 0x80) ? 2 : 10;
+					}
+				}
+				else if (code == 14 && olen >= 8) {	// if_tsoffset
+					f->offset = (int64_t)rd64(cap.map + opt + 4);
+				}
+			}
+		}
+		off += len;
+	}
+	cap.ng = 1;
+	cap.data = off;
+	return 0;
+}
+
+static int capture_open(const char* path)
+{
+	struct stat st;
+	uint32_t magic;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) == -1 || fstat(fd, &st) == -1) {
+		perror(path);
+		return -1;
+	}
+	cap.size = st.st_size;
+	if (cap.size < 24) {
+		fprintf(stderr, "%s: %s is not a pcap or pcapng file\n", OSCSTAT, path);
+		close(fd);
+		return -1;
+	}
+	cap.map = (const uint8_t*)mmap(NULL, cap.size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (cap.map == MAP_FAILED) {
+		perror("mmap");
+		return -1;
+	}
+	madvise((void*)cap.map, cap.size, MADV_SEQUENTIAL);
+
+	memcpy(&magic, cap.map, 4);
+	if (magic == PCAPNG_SHB) {
+		if (pcapng_open() == -1) {
+			fprintf(stderr, "%s: %s: bad pcapng header\n", OSCSTAT, path);
+			return -1;
+		}
+		return 0;
+	}
+
+	if (magic == PCAP_MAGIC || magic == PCAP_MAGIC_NSEC) {
+		cap.swap = 0;
+	}
+	else if (__builtin_bswap32(magic) == PCAP_MAGIC ||
+			 __builtin_bswap32(magic) == PCAP_MAGIC_NSEC) {
+		cap.swap = 1;
+	}
+	else {
+		fprintf(stderr, "%s: %s is not a pcap or pcapng file\n", OSCSTAT, path);
+		return -1;
+	}
+	cap.nsec = rd32(cap.map) == PCAP_MAGIC_NSEC;
+	cap.snaplen = rd32(cap.map + 16);
+	if (cap.snaplen == 0 || cap.snaplen > MAX_FRAME) {
+		cap.snaplen = MAX_FRAME;
+	}
+	cap.linktype = rd32(cap.map + 20) & 0xffff;
+	cap.data = 24;
+	return 0;
+}
+
+// Returns the size of the record at off, or 0 if it does not look like one
+static uint64_t record_size(uint64_t off, uint32_t* sec)
+{
+	uint32_t caplen, origlen, frac, len;
+
+	if (cap.ng) {
+		if (off + 12 > cap.size) {
+			return 0;
+		}
+		len = rd32(cap.map + off + 4);
+		if (len < 12 || len % 4 || off + len > cap.size ||
+			rd32(cap.map + off + len - 4) != len) {
+			return 0;
+		}
+		return len;
+	}
+
+	if (off + 16 > cap.size) {
+		return 0;
+	}
+	*sec = rd32(cap.map + off);
+	frac = rd32(cap.map + off + 4);
+	caplen = rd32(cap.map + off + 8);
+	origlen = rd32(cap.map + off + 12);
+	if (caplen > cap.snaplen || caplen > origlen || origlen > MAX_FRAME ||
+		frac >= (cap.nsec ? 1000000000u : 1000000u) || off + 16 + caplen > cap.size) {
+		return 0;
+	}
+	return 16 + caplen;
+}
+
+// First offset at or after off that starts a run of SYNC_RECORDS records
+static uint64_t capture_sync(uint64_t off)
+{
+	uint64_t o, n;
+	uint32_t sec, prev = 0;
+	int i;
+
+	if (cap.ng) {
+		off = (off + 3) & ~(uint64_t)3;		// blocks are 4-byte aligned
+	}
+	for (; off < cap.size; off += cap.ng ? 4 : 1) {
+		for (i = 0, o = off; i < SYNC_RECORDS && o < cap.size; ++i, o += n) {
+			if ((n = record_size(o, &sec)) == 0) {
+				break;
+			}
+			// Timestamps of neighbouring packets are close together
+			if (!cap.ng && i > 0 && (sec - prev + 86400u) > 2 * 86400u) {
+				break;
+			}
+			prev = sec;
+		}
+		if (i == SYNC_RECORDS || o == cap.size) {
+			return off;
+		}
+	}
+	return cap.size;
+}
+
+/******************************************************************************
+ *  Statistics
+ ******************************************************************************/
+
+struct entry {
+	char* key;				// address or type tag, NULL if the slot is free
+	int32_t keylen;
+	uint32_t hash;
+	uint64_t count;
+	uint64_t bytes;
+	int32_t min;
+	int32_t max;
+	uint64_t sizes[SIZE_BUCKETS];
+	struct {
+		char tag[TYPETAG_MAX];
+		uint64_t count;
+	} types[TYPES];
+	uint64_t othertypes;
+};
+
+struct table {
+	struct entry* e;
+	uint32_t mask;
+	uint32_t used;
+};
+
+static uint32_t hash(const char* s, int32_t len)
+{
+	uint32_t h = 2166136261u;
+	int32_t i;
+
+	for (i = 0; i < len; ++i) {
+		h = (h ^ (uint8_t)s[i]) * 16777619u;
+	}
+	return h;
+}
+
+static int table_init(struct table* t, uint32_t n)
+{
+	t->e = (struct entry*)calloc(n, sizeof(struct entry));
+	t->mask = n - 1;
+	t->used = 0;
+	return t->e ? 0 : -1;
+}
+
+static struct entry* table_slot(struct table* t, const char* key, int32_t len, uint32_t h)
+{
+	uint32_t i;
+	struct entry* e;
+
+	for (i = h & t->mask; ; i = (i + 1) & t->mask) {
+		e = &t->e[i];
+		if (e->key == NULL || (e->hash == h && e->keylen == len &&
+							   memcmp(e->key, key, len) == 0)) {
+			return e;
+		}
+	}
+}
+
+static int table_grow(struct table* t)
+{
+	struct table n;
+	uint32_t i;
+
+	if (table_init(&n, (t->mask + 1) * 2) == -1) {
+		return -1;
+	}
+	for (i = 0; i <= t->mask; ++i) {
+		if (t->e[i].key) {
+			*table_slot(&n, t->e[i].key, t->e[i].keylen, t->e[i].hash) = t->e[i];
+		}
+	}
+	n.used = t->used;
+	free(t->e);
+	*t = n;
+	return 0;
+}
+
+static struct entry* table_get(struct table* t, const char* key, int32_t len, uint32_t h)
+{
+	struct entry* e;
+
+	if ((t->used + 1) * 2 > t->mask + 1 && table_grow(t) == -1) {
+		return NULL;
+	}
+	e = table_slot(t, key, len, h);
+	if (e->key == NULL) {
+		if ((e->key = (char*)malloc(len + 1)) == NULL) {
+			return NULL;
+		}
+		memcpy(e->key, key, len);
+		e->key[len] = '\0';
+		e->keylen = len;
+		e->hash = h;
+		e->min = INT32_MAX;
+		t->used++;
+	}
+	return e;
+}
+
+static void table_free(struct table* t)
+{
+	uint32_t i;
+
+	for (i = 0; i <= t->mask; ++i) {
+		free(t->e[i].key);
+	}
+	free(t->e);
+}
+
+static int size_bucket(int32_t size)
+{
+	int b = 0;
+
+	for (size >>= 2; size && b < SIZE_BUCKETS - 1; size >>= 1) {
+		b++;
+	}
+	return b;
+}
+
+static void count_type(struct entry* e, const char* tag, int32_t len, uint64_t count)
+{
+	int i;
+
+	if (len >= TYPETAG_MAX) {
+		e->othertypes += count;
+		return;
+	}
+	for (i = 0; i < TYPES && e->types[i].count; ++i) {
+		if (strcmp(e->types[i].tag, tag) == 0) {
+			e->types[i].count += count;
+			return;
+		}
+	}
+	if (i < TYPES) {
+		memcpy(e->types[i].tag, tag, len + 1);
+		e->types[i].count = count;
+		return;
+	}
+	e->othertypes += count;
+}
+
+static void count_size(struct entry* e, int32_t size)
+{
+	e->count++;
+	e->bytes += size;
+	if (size < e->min) e->min = size;
+	if (size > e->max) e->max = size;
+	e->sizes[size_bucket(size)]++;
+}
+
+static void table_merge(struct table* dst, const struct table* src)
+{
+	const struct entry* s;
+	struct entry* d;
+	uint32_t i;
+	int j;
+
+	for (i = 0; i <= src->mask; ++i) {
+		s = &src->e[i];
+		if (s->key == NULL || (d = table_get(dst, s->key, s->keylen, s->hash)) == NULL) {
+			continue;
+		}
+		d->count += s->count;
+		d->bytes += s->bytes;
+		if (s->min < d->min) d->min = s->min;
+		if (s->max > d->max) d->max = s->max;
+		for (j = 0; j < SIZE_BUCKETS; ++j) {
+			d->sizes[j] += s->sizes[j];
+		}
+		for (j = 0; j < TYPES && s->types[j].count; ++j) {
+			count_type(d, s->types[j].tag, (int32_t)strlen(s->types[j].tag),
+					   s->types[j].count);
+		}
+		d->othertypes += s->othertypes;
+	}
+}
+
+/******************************************************************************
+ *  Decoding
+ ******************************************************************************/
+
+struct flowkey {
+	uint8_t src[16];
+	uint8_t dst[16];
+	uint16_t sport;
+	uint16_t dport;
+	uint32_t family;
+};
+
+// A TCP segment kept for the stream pass
+struct segment {
+	const uint8_t* data;
+	uint32_t len;
+	uint32_t seq;
+	uint32_t hash;
+	uint32_t syn;
+	struct flowkey key;
+};
+
+struct chunk {
+	uint64_t start;			// first record
+	uint64_t end;			// first record of the next chunk
+	uint64_t stop;			// where decoding actually stopped
+	struct segment* segs;
+	size_t nsegs;
+	size_t capsegs;
+};
+
+struct flow {
+	struct flowkey key;
+	uint32_t hash;
+	int used;
+	uint32_t next;			// next expected sequence number
+	uint8_t* buf;			// bytes of a packet split across segments
+	int32_t len;
+	int32_t cap;
+};
+
+struct worker {
+	pthread_t thread;
+	int id;
+	struct table addresses;
+	struct table typetags;
+	struct flow* flows;
+	uint32_t flowmask;
+	uint32_t nflows;
+	uint64_t first_ns;
+	uint64_t last_ns;
+	uint64_t frames;
+	uint64_t udp;			// UDP datagrams
+	uint64_t tcp;			// TCP segments with data
+	uint64_t packets;		// OSC packets
+	uint64_t bundles;
+	uint64_t messages;
+	uint64_t notosc;		// payloads or stream frames that are not OSC
+	uint64_t malformed;		// OSC packets that did not decode
+	uint64_t fragments;		// IP fragments, not reassembled
+	uint64_t truncated;		// frames cut short by the capture snap length
+	uint64_t gaps;			// TCP sequence gaps
+};
+
+static struct chunk* chunks;
+static int nchunks;
+static int nextchunk;
+static struct worker* workers;
+static int nworkers;
+static int port = -1;
+
+static int message(struct worker* w, const uint8_t* buf, int32_t size)
+{
+	oscmsg_t msg;
+	struct entry* e;
+
+	if (oscunpack(buf, size, &msg) == -1) {
+		return -1;
+	}
+	w->messages++;
+	if ((e = table_get(&w->addresses, msg.address, msg.addrlen,
+					   hash(msg.address, msg.addrlen))) != NULL) {
+		count_size(e, size);
+		count_type(e, msg.typetag, msg.typelen, 1);
+	}
+	if ((e = table_get(&w->typetags, msg.typetag, msg.typelen,
+					   hash(msg.typetag, msg.typelen))) != NULL) {
+		count_size(e, size);
+	}
+	return 0;
+}
+
+static int bundle(struct worker* w, const uint8_t* buf, int32_t size, int depth)
+{
+	oscbundle_t b;
+	const uint8_t* elem;
+	int32_t len;
+
+	if (depth == MAX_DEPTH || oscbundle(buf, size, &b) == -1) {
+		return -1;
+	}
+	w->bundles++;
+	while ((len = oscbundle_next(&b, &elem)) > 0) {
+		if (oscisbundle(elem, len) ? bundle(w, elem, len, depth + 1) == -1
+			: message(w, elem, len) == -1) {
+			return -1;
+		}
+	}
+	return len;
+}
+
+static void packet(struct worker* w, const uint8_t* buf, int32_t size)
+{
+	int r;
+
+	if (size < 4 || (buf[0] != '/' && buf[0] != '#')) {
+		w->notosc++;
+		return;
+	}
+	r = oscisbundle(buf, size) ? bundle(w, buf, size, 0) : message(w, buf, size);
+	if (r == -1) {
+		w->malformed++;
+	}
+	else {
+		w->packets++;
+	}
+}
+
+static void segment(struct chunk* c, const struct flowkey* key,
+					const uint8_t* data, uint32_t len, uint32_t seq, int syn)
+{
+	struct segment* s;
+	size_t n;
+
+	if (c->nsegs == c->capsegs) {
+		n = c->capsegs ? c->capsegs * 2 : 1024;
+		if ((s = (struct segment*)realloc(c->segs, n * sizeof(*s))) == NULL) {
+			return;
+		}
+		c->segs = s;
+		c->capsegs = n;
+	}
+	s = &c->segs[c->nsegs++];
+	s->data = data;
+	s->len = len;
+	s->seq = seq;
+	s->syn = syn;
+	s->key = *key;
+	s->hash = hash((const char*)key, sizeof(*key));
+}
+
+static void transport(struct worker* w, struct chunk* c, int proto, struct flowkey* key,
+					  const uint8_t* p, uint32_t len, uint32_t wirelen)
+{
+	uint32_t hl;
+
+	if (proto == 17) {
+		if (len < 8) {
+			w->truncated++;
+			return;
+		}
+		key->sport = be16(p);
+		key->dport = be16(p + 2);
+		if (port != -1 && key->sport != port && key->dport != port) {
+			return;
+		}
+		w->udp++;
+		hl = be16(p + 4);
+		if (hl < 8 || hl > wirelen) {
+			w->malformed++;
+			return;
+		}
+		if (hl > len) {
+			w->truncated++;
+			return;
+		}
+		packet(w, p + 8, hl - 8);
+	}
+	else if (proto == 6) {
+		if (len < 20 || (hl = (p[12] >> 4) * 4) > len) {
+			w->truncated++;
+			return;
+		}
+		key->sport = be16(p);
+		key->dport = be16(p + 2);
+		if (port != -1 && key->sport != port && key->dport != port) {
+			return;
+		}
+		if (wirelen > len) {
+			// Missing bytes make a hole the stream pass will skip
+			w->truncated++;
+			len = hl;
+		}
+		if (len > hl) {
+			w->tcp++;
+		}
+		if (len > hl || (p[13] & 0x02)) {
+			segment(c, key, p + hl, len - hl, be32(p + 4), p[13] & 0x02);
+		}
+	}
+}
+
+static void ip(struct worker* w, struct chunk* c, const uint8_t* p, uint32_t len)
+{
+	struct flowkey key;
+	uint32_t hl, total, nh;
+
+	if (len < 1) {
+		return;
+	}
+	memset(&key, 0, sizeof(key));
+
+	if (p[0] >> 4 == 4) {
+		if (len < 20 || (hl = (p[0] & 15) * 4) < 20 || hl > len) {
+			w->truncated++;
+			return;
+		}
+		total = be16(p + 2);
+		if (total < hl) {
+			return;
+		}
+		if (be16(p + 6) & 0x3fff) {
+			w->fragments++;
+			return;
+		}
+		key.family = 4;
+		memcpy(key.src, p + 12, 4);
+		memcpy(key.dst, p + 16, 4);
+		// Captured bytes past the IP packet are link layer padding
+		if (len > total) {
+			len = total;
+		}
+		transport(w, c, p[9], &key, p + hl, len - hl, total - hl);
+	}
+	else if (p[0] >> 4 == 6) {
+		if (len < 40) {
+			w->truncated++;
+			return;
+		}
+		total = 40 + be16(p + 4);
+		nh = p[6];
+		for (hl = 40; nh == 0 || nh == 43 || nh == 60; ) {
+			if (hl + 8 > len) {
+				w->truncated++;
+				return;
+			}
+			nh = p[hl];
+			hl += (p[hl + 1] + 1) * 8;
+		}
+		if (nh == 44) {
+			w->fragments++;
+			return;
+		}
+		if (hl > len || hl > total) {
+			w->truncated++;
+			return;
+		}
+		key.family = 6;
+		memcpy(key.src, p + 8, 16);
+		memcpy(key.dst, p + 24, 16);
+		if (len > total) {
+			len = total;
+		}
+		transport(w, c, nh, &key, p + hl, len - hl, total - hl);
+	}
+}
+
+static void frame(struct worker* w, struct chunk* c, int linktype,
+				  const uint8_t* p, uint32_t len)
+{
+	uint32_t type, off;
+
+	w->frames++;
+	switch (linktype) {
+	case LINKTYPE_ETHERNET:
+		for (off = 12; off + 2 <= len; off += 4) {
+			type = be16(p + off);
+			if (type != 0x8100 && type != 0x88a8 && type != 0x9100) {
+				break;
+			}
+		}
+		if (off + 2 > len) {
+			return;
+		}
+		if (type == 0x0800 || type == 0x86dd) {
+			ip(w, c, p + off + 2, len - off - 2);
+		}
+		break;
+	case LINKTYPE_NULL:
+	case LINKTYPE_LOOP:
+		// Address family in either byte order; IPv6 values differ by OS
+		if (len >= 4) {
+			ip(w, c, p + 4, len - 4);
+		}
+		break;
+	case LINKTYPE_LINUX_SLL:
+		if (len >= 16 && (be16(p + 14) == 0x0800 || be16(p + 14) == 0x86dd)) {
+			ip(w, c, p + 16, len - 16);
+		}
+		break;
+	case LINKTYPE_LINUX_SLL2:
+		if (len >= 20 && (be16(p) == 0x0800 || be16(p) == 0x86dd)) {
+			ip(w, c, p + 20, len - 20);
+		}
+		break;
+	case LINKTYPE_RAW:
+	case LINKTYPE_IPV4:
+	case LINKTYPE_IPV6:
+	case 12:		// raw IP on some BSDs
+	case 14:
+		ip(w, c, p, len);
+		break;
+	}
+}
+
+static void stamp(struct worker* w, uint64_t t)
+{
+	if (t < w->first_ns) w->first_ns = t;
+	if (t > w->last_ns) w->last_ns = t;
+}
+
+static void decode_chunk(struct worker* w, struct chunk* c)
+{
+	const uint8_t* p;
+	struct iface* f;
+	uint64_t off, n;
+	uint32_t sec, type, id, caplen;
+
+	for (off = c->start; off < c->end; off += n) {
+		if ((n = record_size(off, &sec)) == 0) {
+			break;
+		}
+		p = cap.map + off;
+
+		if (!cap.ng) {
+			caplen = rd32(p + 8);
+			stamp(w, (uint64_t)sec * 1000000000ull +
+				  rd32(p + 4) * (cap.nsec ? 1ull : 1000ull));
+			frame(w, c, cap.linktype, p + 16, caplen);
+			continue;
+		}
+
+		type = rd32(p);
+		if (type == PCAPNG_EPB && n >= 32) {
+			id = rd32(p + 8);
+			caplen = rd32(p + 20);
+			if (id >= (uint32_t)cap.nifaces || 28 + caplen > n - 4) {
+				continue;
+			}
+			f = &cap.ifaces[id];
+			stamp(w, ticks_ns((uint64_t)rd32(p + 12) << 32 | rd32(p + 16), f->units) +
+				  f->offset * 1000000000ll);
+			frame(w, c, f->linktype, p + 28, caplen);
+		}
+		else if (type == PCAPNG_SPB && n >= 16 && cap.nifaces > 0) {
+			// No timestamp; the captured length is bounded by the block
+			caplen = rd32(p + 8);
+			if (caplen > n - 16) {
+				caplen = n - 16;
+			}
+			frame(w, c, cap.ifaces[0].linktype, p + 12, caplen);
+		}
+		// Other blocks carry no packets. Interfaces described after the first
+		// packet are not known to every thread, so their packets are skipped.
+	}
+	c->stop = off;
+}
+
+/******************************************************************************
+ *  TCP streams
+ ******************************************************************************/
+
+static struct flow* flow_get(struct worker* w, const struct segment* s)
+{
+	struct flow* f;
+	struct flow* old;
+	uint32_t i, n;
+
+	if ((w->nflows + 1) * 2 > w->flowmask + 1) {
+		n = w->flowmask ? (w->flowmask + 1) * 2 : 64;
+		old = w->flows;
+		if ((w->flows = (struct flow*)calloc(n, sizeof(struct flow))) == NULL) {
+			w->flows = old;
+			return NULL;
+		}
+		for (i = 0; old && i <= w->flowmask; ++i) {
+			if (old[i].used) {
+				for (f = &w->flows[old[i].hash & (n - 1)]; f->used;
+					 f = &w->flows[(f - w->flows + 1) & (n - 1)])
+					;
+				*f = old[i];
+			}
+		}
+		free(old);
+		w->flowmask = n - 1;
+	}
+
+	for (i = s->hash & w->flowmask; ; i = (i + 1) & w->flowmask) {
+		f = &w->flows[i];
+		if (!f->used) {
+			f->used = 1;
+			f->key = s->key;
+			f->hash = s->hash;
+			f->next = s->seq;
+			w->nflows++;
+			return f;
+		}
+		if (f->hash == s->hash && memcmp(&f->key, &s->key, sizeof(f->key)) == 0) {
+			return f;
+		}
+	}
+}
+
+// Counts the size prefixed packets in data and returns the bytes used
+static uint32_t frames(struct worker* w, const uint8_t* data, uint32_t len)
+{
+	uint32_t pos = 0, n;
+
+	while (len - pos >= 4) {
+		n = be32(data + pos);
+		if (n == 0 || n > MAX_TCP_PACKET || n % 4) {
+			// Not a size prefix: the stream is not OSC or we lost our place
+			w->notosc++;
+			return len;
+		}
+		if (len - pos - 4 < n) {
+			break;
+		}
+		packet(w, data + pos + 4, n);
+		pos += 4 + n;
+	}
+	return pos;
+}
+
+static void stream(struct worker* w, const struct segment* s)
+{
+	struct flow* f;
+	const uint8_t* data = s->data;
+	uint32_t len = s->len, skip, used;
+	uint8_t* buf;
+
+	if ((f = flow_get(w, s)) == NULL) {
+		return;
+	}
+	if (s->syn) {
+		f->next = s->seq + 1;
+		f->len = 0;
+		return;
+	}
+	if (len == 0) {
+		return;
+	}
+
+	if ((int32_t)(s->seq - f->next) < 0) {
+		// Retransmission, maybe with new data at the end
+		skip = f->next - s->seq;
+		if (skip >= len) {
+			return;
+		}
+		data += skip;
+		len -= skip;
+	}
+	else if (s->seq != f->next) {
+		// Lost bytes; assume the segment after the hole starts a packet,
+		// which is how most senders write OSC to a socket.
+		w->gaps++;
+		f->len = 0;
+	}
+	f->next = s->seq + s->len;
+
+	if (f->len == 0) {
+		used = frames(w, data, len);
+		data += used;
+		len -= used;
+		if (len == 0) {
+			return;
+		}
+	}
+
+	if (f->len + len > (uint32_t)f->cap) {
+		if (f->len + len > MAX_TCP_PACKET + 4 ||
+			(buf = (uint8_t*)realloc(f->buf, f->len + len)) == NULL) {
+			f->len = 0;
+			return;
+		}
+		f->buf = buf;
+		f->cap = f->len + len;
+	}
+	memcpy(f->buf + f->len, data, len);
+	f->len += len;
+
+	used = frames(w, f->buf, f->len);
+	memmove(f->buf, f->buf + used, f->len - used);
+	f->len -= used;
+}
+
+/******************************************************************************
+ *  Threads
+ ******************************************************************************/
+
+static void* work(void* arg)
+{
+	struct worker* w = (struct worker*)arg;
+	int i;
+
+	// Pass 1: chunks in any order
+	while ((i = __atomic_fetch_add(&nextchunk, 1, __ATOMIC_RELAXED)) < nchunks) {
+		decode_chunk(w, &chunks[i]);
+	}
+	return NULL;
+}
+
+static void* work_streams(void* arg)
+{
+	struct worker* w = (struct worker*)arg;
+	size_t j;
+	int i;
+
+	// Pass 2: every thread follows its own flows through all the segments in
+	// capture order
+	for (i = 0; i < nchunks; ++i) {
+		for (j = 0; j < chunks[i].nsegs; ++j) {
+			if (chunks[i].segs[j].hash % nworkers == (uint32_t)w->id) {
+				stream(w, &chunks[i].segs[j]);
+			}
+		}
+	}
+	return NULL;
+}
+
+static int run(void* (*fn)(void*))
+{
+	int i;
+
+	for (i = 1; i < nworkers; ++i) {
+		if (pthread_create(&workers[i].thread, NULL, fn, &workers[i]) != 0) {
+			perror("pthread_create");
+			return -1;
+		}
+	}
+	fn(&workers[0]);
+	for (i = 1; i < nworkers; ++i) {
+		pthread_join(workers[i].thread, NULL);
+	}
+	return 0;
+}
+
+/******************************************************************************
+ *  Report
+ ******************************************************************************/
+
+static int bycount(const void* a, const void* b)
+{
+	const struct entry* x = *(const struct entry* const*)a;
+	const struct entry* y = *(const struct entry* const*)b;
+
+	if (x->count != y->count) {
+		return x->count < y->count ? 1 : -1;
+	}
+	return strcmp(x->key, y->key);
+}
+
+static struct entry** sorted(const struct table* t)
+{
+	struct entry** list;
+	uint32_t i, n = 0;
+
+	if ((list = (struct entry**)malloc(sizeof(*list) * (t->used + 1))) == NULL) {
+		return NULL;
+	}
+	for (i = 0; i <= t->mask; ++i) {
+		if (t->e[i].key) {
+			list[n++] = &t->e[i];
+		}
+	}
+	qsort(list, n, sizeof(*list), bycount);
+	return list;
+}
+
+static void report(const char* path, struct worker* w, int top, double elapsed)
+{
+	struct entry** list;
+	struct entry* e;
+	uint64_t sizes[SIZE_BUCKETS];
+	double seconds = w->last_ns > w->first_ns ? (w->last_ns - w->first_ns) * 1e-9 : 0.0;
+	uint32_t i, n;
+	int j, k, best;
+	char rate[32];
+
+	printf("%s: %llu frames, %.3f s of capture\n", path,
+		   (unsigned long long)w->frames, seconds);
+	printf("    OSC packets: %llu from %llu UDP datagrams and %llu TCP segments\n",
+		   (unsigned long long)w->packets, (unsigned long long)w->udp,
+		   (unsigned long long)w->tcp);
+	printf("    messages: %llu, bundles: %llu, addresses: %u\n",
+		   (unsigned long long)w->messages, (unsigned long long)w->bundles,
+		   w->addresses.used);
+	printf("    not OSC: %llu, malformed: %llu, truncated: %llu, fragments: %llu, "
+		   "TCP gaps: %llu\n",
+		   (unsigned long long)w->notosc, (unsigned long long)w->malformed,
+		   (unsigned long long)w->truncated, (unsigned long long)w->fragments,
+		   (unsigned long long)w->gaps);
+
+	memset(sizes, 0, sizeof(sizes));
+	if ((list = sorted(&w->addresses)) != NULL) {
+		n = top > 0 && (uint32_t)top < w->addresses.used ? (uint32_t)top : w->addresses.used;
+		printf("\n%-40s %10s %10s %12s %6s %6s %6s  %s\n", "address", "messages",
+			   "msg/s", "bytes", "min", "avg", "max", "type tags");
+		for (i = 0; i < w->addresses.used; ++i) {
+			e = list[i];
+			for (j = 0; j < SIZE_BUCKETS; ++j) {
+				sizes[j] += e->sizes[j];
+			}
+			if (i >= n) {
+				continue;
+			}
+
+			if (seconds > 0) {
+				snprintf(rate, sizeof(rate), "%.1f", e->count / seconds);
+			}
+			else {
+				snprintf(rate, sizeof(rate), "-");
+			}
+			printf("%-40s %10llu %10s %12llu %6d %6llu %6d ", e->key,
+				   (unsigned long long)e->count, rate, (unsigned long long)e->bytes,
+				   e->min, (unsigned long long)(e->bytes / e->count), e->max);
+
+			// Type tags, most frequent first
+			for (k = 0; k < TYPES; ++k) {
+				best = -1;
+				for (j = 0; j < TYPES; ++j) {
+					if (e->types[j].count && (best == -1 ||
+											  e->types[j].count > e->types[best].count)) {
+						best = j;
+					}
+				}
+				if (best == -1) {
+					break;
+				}
+				printf(" ,%s %.0f%%", e->types[best].tag,
+					   100.0 * e->types[best].count / e->count);
+				e->types[best].count = 0;
+			}
+			if (e->othertypes) {
+				printf(" other %.0f%%", 100.0 * e->othertypes / e->count);
+			}
+			printf("\n");
+		}
+		if (n < w->addresses.used) {
+			printf("... %u more addresses (-n 0 lists all)\n", w->addresses.used - n);
+		}
+		free(list);
+	}
+
+	if ((list = sorted(&w->typetags)) != NULL) {
+		printf("\n%-24s %10s %8s\n", "type tag", "messages", "share");
+		for (i = 0; i < w->typetags.used; ++i) {
+			printf(",%-23s %10llu %7.2f%%\n", list[i]->key,
+				   (unsigned long long)list[i]->count,
+				   100.0 * list[i]->count / w->messages);
+		}
+		free(list);
+	}
+
+	printf("\n%-24s %10s %8s\n", "message size", "messages", "share");
+	for (j = 0; j < SIZE_BUCKETS; ++j) {
+		if (sizes[j] == 0) {
+			continue;
+		}
+		if (j == SIZE_BUCKETS - 1) {
+			printf("%8d -               ", 4 << j >> 1);
+		}
+		else {
+			printf("%8d - %-13d", j ? 4 << (j - 1) : 0, (4 << j) - 1);
+		}
+		printf(" %10llu %7.2f%%\n", (unsigned long long)sizes[j],
+			   100.0 * sizes[j] / w->messages);
+	}
+
+	fprintf(stderr, "%s: %.1f MB analyzed in %.3f s with %d threads\n", OSCSTAT,
+			cap.size / 1e6, elapsed, nworkers);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main (int argc, char* const argv[])
+{
+	struct worker* w;
+	uint64_t chunksize;
+	uint32_t j;
+	double t0;
+	int i, top = 50;
+
+	nworkers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	for (i = 1; i < argc - 1 && argv[i][0] == '-'; i += 2) {
+		if (strcmp(argv[i], "-t") == 0) {
+			nworkers = atoi(argv[i+1]);
+		}
+		else if (strcmp(argv[i], "-p") == 0) {
+			port = atoi(argv[i+1]);
+		}
+		else if (strcmp(argv[i], "-n") == 0) {
+			top = atoi(argv[i+1]);
+		}
+		else {
+			break;
+		}
+	}
+	if (i != argc - 1) {
+		printf(usage);
+		return 0;
+	}
+	if (nworkers < 1) {
+		nworkers = 1;
+	}
+
+	t0 = now();
+	if (capture_open(argv[i]) == -1) {
+		return 1;
+	}
+
+	// Several chunks per thread so a slow chunk does not hold up the rest
+	nchunks = nworkers * 4;
+	chunksize = (cap.size - cap.data) / nchunks;
+	if (chunksize < (1 << 20)) {
+		chunksize = 1 << 20;
+		nchunks = (int)((cap.size - cap.data) / chunksize) + 1;
+	}
+	chunks = (struct chunk*)calloc(nchunks, sizeof(struct chunk));
+	workers = (struct worker*)calloc(nworkers, sizeof(struct worker));
+	if (!chunks || !workers) {
+		fprintf(stderr, "%s: Critical memory error...\n", OSCSTAT);
+		return 1;
+	}
+	chunks[0].start = cap.data;
+	for (i = 1; i < nchunks; ++i) {
+		chunks[i].start = capture_sync(cap.data + chunksize * i);
+		if (chunks[i].start < chunks[i-1].start) {
+			chunks[i].start = chunks[i-1].start;
+		}
+		chunks[i-1].end = chunks[i].start;
+	}
+	chunks[nchunks-1].end = cap.size;
+
+	for (i = 0; i < nworkers; ++i) {
+		w = &workers[i];
+		w->id = i;
+		w->first_ns = UINT64_MAX;
+		if (table_init(&w->addresses, 1024) == -1 || table_init(&w->typetags, 64) == -1) {
+			fprintf(stderr, "%s: Critical memory error...\n", OSCSTAT);
+			return 1;
+		}
+	}
+
+	if (run(work) == -1 || run(work_streams) == -1) {
+		return 1;
+	}
+
+	// Every chunk must end exactly where the next one was found to start
+	for (i = 0; i < nchunks; ++i) {
+		if (chunks[i].stop != chunks[i].end) {
+			fprintf(stderr, "%s: unreadable record at offset %llu; the rest of "
+					"the chunk up to %llu was skipped\n", OSCSTAT,
+					(unsigned long long)chunks[i].stop,
+					(unsigned long long)chunks[i].end);
+		}
+		free(chunks[i].segs);
+	}
+
+	w = &workers[0];
+	for (i = 1; i < nworkers; ++i) {
+		table_merge(&w->addresses, &workers[i].addresses);
+		table_merge(&w->typetags, &workers[i].typetags);
+		if (workers[i].first_ns < w->first_ns) w->first_ns = workers[i].first_ns;
+		if (workers[i].last_ns > w->last_ns) w->last_ns = workers[i].last_ns;
+		w->frames += workers[i].frames;
+		w->udp += workers[i].udp;
+		w->tcp += workers[i].tcp;
+		w->packets += workers[i].packets;
+		w->bundles += workers[i].bundles;
+		w->messages += workers[i].messages;
+		w->notosc += workers[i].notosc;
+		w->malformed += workers[i].malformed;
+		w->fragments += workers[i].fragments;
+		w->truncated += workers[i].truncated;
+		w->gaps += workers[i].gaps;
+	}
+
+	report(argv[argc - 1], w, top, now() - t0);
+
+	for (i = 0; i < nworkers; ++i) {
+		w = &workers[i];
+		table_free(&w->addresses);
+		table_free(&w->typetags);
+		for (j = 0; w->flows && j <= w->flowmask; ++j) {
+			free(w->flows[j].buf);
+		}
+		free(w->flows);
+	}
+	free(chunks);
+	free(workers);
+	munmap((void*)cap.map, cap.size);
+	return 0;
+}
@@ -0,0 +1,357 @@
+/******************************************************************************
+ *  oscstate
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#include "oscstate.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Bundles nested deeper than this are not walked
+#define OSCSTATE_MAX_DEPTH 8
+
+// One value per cache line pair; the seqlock and the data it guards share
+// the lines, and nothing else that is written lives there.
+struct oscstate_value {
+	uint32_t seq;			// odd while the writer is copying
+	int32_t size;			// bytes used in data, 0 if never set
+	uint64_t version;
+	uint8_t data[OSCSTATE_VALUE_MAX];
+} __attribute__((aligned(64)));
+
+// Address of an ID. Written once before the ID is published.
+struct oscstate_key {
+	uint32_t hash;
+	int32_t len;
+	char* address;
+};
+
+struct oscstate {
+	struct oscstate_value* values;
+	struct oscstate_key* keys;
+	int32_t* index;			// open addressing table of IDs, -1 is empty
+	int32_t* older;			// IDs in the order their values changed
+	int32_t* newer;
+	int32_t oldest;
+	int32_t newest;
+	uint32_t mask;
+	int32_t max;
+	int32_t count;
+	uint64_t version;
+};
+
+static uint32_t oscstate_hash(const char* s, int32_t len)
+{
+	uint32_t h = 2166136261u;
+	int32_t i;
+
+	for (i = 0; i < len; ++i) {
+		h = (h ^ (uint8_t)s[i]) * 16777619u;
+	}
+	return h;
+}
+
+oscstate_t* oscstate_new(int32_t max_addresses)
+{
+	oscstate_t* st;
+	uint32_t n;
+
+	if (max_addresses <= 0) {
+		return NULL;
+	}
+	if ((st = (oscstate_t*)calloc(1, sizeof(oscstate_t))) == NULL) {
+		return NULL;
+	}
+
+	// Keep the table at most half full so probes stay short
+	for (n = 16; n < (uint32_t)max_addresses * 2; n <<= 1)
+		;
+	st->mask = n - 1;
+	st->max = max_addresses;
+
+	if (posix_memalign((void**)&st->values, 64,
+					   sizeof(struct oscstate_value) * max_addresses) != 0) {
+		free(st);
+		return NULL;
+	}
+	memset(st->values, 0, sizeof(struct oscstate_value) * max_addresses);
+	st->keys = (struct oscstate_key*)calloc(max_addresses, sizeof(struct oscstate_key));
+	st->index = (int32_t*)malloc(sizeof(int32_t) * n);
+	st->older = (int32_t*)malloc(sizeof(int32_t) * max_addresses);
+	st->newer = (int32_t*)malloc(sizeof(int32_t) * max_addresses);
+	if (!st->keys || !st->index || !st->older || !st->newer) {
+		oscstate_free(st);
+		return NULL;
+	}
+	memset(st->index, 0xff, sizeof(int32_t) * n);
+	st->oldest = st->newest = -1;
+
+	return st;
+}
+
+void oscstate_free(oscstate_t* st)
+{
+	int32_t i;
+
+	if (!st) {
+		return;
+	}
+	if (st->keys) {
+		for (i = 0; i < st->count; ++i) {
+			free(st->keys[i].address);
+		}
+	}
+	free(st->keys);
+	free(st->index);
+	free(st->older);
+	free(st->newer);
+	free(st->values);
+	free(st);
+}
+
+static int32_t oscstate_find(oscstate_t* st, const char* addr, int32_t len, uint32_t h,
+							 uint32_t* slot)
+{
+	uint32_t i;
+	int32_t id;
+
+	for (i = h & st->mask; ; i = (i + 1) & st->mask) {
+		id = __atomic_load_n(&st->index[i], __ATOMIC_ACQUIRE);
+		if (id == -1) {
+			if (slot) {
+				*slot = i;
+			}
+			return -1;
+		}
+		if (st->keys[id].hash == h && st->keys[id].len == len &&
+			memcmp(st->keys[id].address, addr, len) == 0) {
+			return id;
+		}
+	}
+}
+
+int32_t oscstate_intern(oscstate_t* st, const char* addr, int32_t len)
+{
+	uint32_t h = oscstate_hash(addr, len), slot;
+	int32_t id;
+
+	if ((id = oscstate_find(st, addr, len, h, &slot)) != -1) {
+		return id;
+	}
+	if (st->count == st->max || len >= OSCSTATE_ADDRESS_MAX) {
+		return -1;
+	}
+
+	id = st->count;
+	if ((st->keys[id].address = (char*)malloc(len + 1)) == NULL) {
+		return -1;
+	}
+	memcpy(st->keys[id].address, addr, len);
+	st->keys[id].address[len] = '\0';
+	st->keys[id].len = len;
+	st->keys[id].hash = h;
+
+	// Publish the ID only after its key is complete
+	__atomic_store_n(&st->count, id + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&st->index[slot], id, __ATOMIC_RELEASE);
+	return id;
+}
+
+int32_t oscstate_lookup(oscstate_t* st, const char* addr)
+{
+	int32_t len = (int32_t)strlen(addr);
+	return oscstate_find(st, addr, len, oscstate_hash(addr, len), NULL);
+}
+
+int32_t oscstate_count(oscstate_t* st)
+{
+	return __atomic_load_n(&st->count, __ATOMIC_ACQUIRE);
+}
+
+const char* oscstate_address(oscstate_t* st, int32_t id)
+{
+	if (id < 0 || id >= oscstate_count(st)) {
+		return NULL;
+	}
+	return st->keys[id].address;
+}
+
+int32_t oscstate_set(oscstate_t* st, const oscmsg_t* msg)
+{
+	struct oscstate_value* v;
+	const uint8_t* value;
+	int32_t id, size;
+	uint32_t seq;
+
+	// The value is everything after the address: type tag and arguments
+	value = (const uint8_t*)msg->address + ((msg->addrlen + 4) & ~3);
+	size = msg->size - (int32_t)(value - (const uint8_t*)msg->address);
+	if (size > OSCSTATE_VALUE_MAX) {
+		return -1;
+	}
+	if ((id = oscstate_intern(st, msg->address, msg->addrlen)) == -1) {
+		return -1;
+	}
+
+	v = &st->values[id];
+
+	// Move the ID to the newest end of the change order
+	if (v->version && st->newest != id) {
+		if (st->older[id] == -1) {
+			st->oldest = st->newer[id];
+		}
+		else {
+			st->newer[st->older[id]] = st->newer[id];
+		}
+		st->older[st->newer[id]] = st->older[id];
+	}
+	if (!v->version || st->newest != id) {
+		st->older[id] = st->newest;
+		st->newer[id] = -1;
+		if (st->newest == -1) {
+			st->oldest = id;
+		}
+		else {
+			st->newer[st->newest] = id;
+		}
+		st->newest = id;
+	}
+
+	seq = v->seq;
+	__atomic_store_n(&v->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(v->data, value, size);
+	v->size = size;
+	__atomic_store_n(&v->version, st->version + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&st->version, st->version + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&v->seq, seq + 2, __ATOMIC_RELEASE);
+
+	return id;
+}
+
+static int32_t oscstate_packet(oscstate_t* st, const uint8_t* buf, int32_t size, int depth)
+{
+	oscbundle_t b;
+	oscmsg_t msg;
+	const uint8_t* elem;
+	int32_t len, n, count = 0;
+
+	if (!oscisbundle(buf, size)) {
+		if (oscunpack(buf, size, &msg) == -1) {
+			return -1;
+		}
+		return oscstate_set(st, &msg) == -1 ? 0 : 1;
+	}
+
+	if (depth == OSCSTATE_MAX_DEPTH || oscbundle(buf, size, &b) == -1) {
+		return -1;
+	}
+	while ((len = oscbundle_next(&b, &elem)) > 0) {
+		if ((n = oscstate_packet(st, elem, len, depth + 1)) == -1) {
+			return -1;
+		}
+		count += n;
+	}
+	return len == -1 ? -1 : count;
+}
+
+int32_t oscstate_update(oscstate_t* st, const uint8_t* buf, int32_t size)
+{
+	return oscstate_packet(st, buf, size, 0);
+}
+
+int32_t oscstate_read(oscstate_t* st, int32_t id, uint8_t* buf, int32_t size,
+					  uint64_t* version)
+{
+	struct oscstate_value* v;
+	struct oscstate_key* k;
+	int32_t alen, vlen;
+	uint32_t s1, s2;
+	uint64_t ver;
+
+	if (id < 0 || id >= oscstate_count(st)) {
+		return -1;
+	}
+	k = &st->keys[id];
+	v = &st->values[id];
+	alen = (k->len + 4) & ~3;
+	if (size < alen + OSCSTATE_VALUE_MAX) {
+		return -1;
+	}
+
+	// The address never changes once published
+	memcpy(buf, k->address, k->len);
+	memset(buf + k->len, 0, alen - k->len);
+
+	do {
+		while ((s1 = __atomic_load_n(&v->seq, __ATOMIC_ACQUIRE)) & 1)
+			;
+		vlen = v->size;
+		ver = v->version;
+		if (vlen > 0 && vlen <= OSCSTATE_VALUE_MAX) {
+			memcpy(buf + alen, v->data, vlen);
+		}
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		s2 = __atomic_load_n(&v->seq, __ATOMIC_RELAXED);
+	} while (s1 != s2);
+
+	if (version) {
+		*version = ver;
+	}
+	return vlen > 0 ? alen + vlen : 0;
+}
+
+uint64_t oscstate_version(oscstate_t* st)
+{
+	return __atomic_load_n(&st->version, __ATOMIC_RELAXED);
+}
+
+uint64_t oscstate_changed(oscstate_t* st, int32_t id)
+{
+	if (id < 0 || id >= oscstate_count(st)) {
+		return 0;
+	}
+	return __atomic_load_n(&st->values[id].version, __ATOMIC_RELAXED);
+}
+
+int32_t oscstate_since(oscstate_t* st, uint64_t version)
+{
+	int32_t id = st->newest;
+
+	if (st->oldest != -1 && st->values[st->oldest].version > version) {
+		return st->oldest;
+	}
+
+	// Walk back from the newest: costs the number of changes since version
+	if (id == -1 || st->values[id].version <= version) {
+		return -1;
+	}
+	while (st->older[id] != -1 && st->values[st->older[id]].version > version) {
+		id = st->older[id];
+	}
+	return id;
+}
+
+int32_t oscstate_next(oscstate_t* st, int32_t id)
+{
+	if (id < 0 || id >= st->count || !st->values[id].version) {
+		return -1;
+	}
+	return st->newer[id];
+}
@@ -0,0 +1,166 @@
+/******************************************************************************
+ *  oscstate
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#ifndef __OSC_STATE_H__
+#define __OSC_STATE_H__
+
+#include <stdint.h>
+
+#include "../oscpack/oscunpack.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ *	oscstate keeps the last value received for every OSC address, for
+ *	consumers that only need the current value of a parameter and not the
+ *	stream of messages.
+ *
+ *	Each address is interned to a dense integer ID the first time it is seen.
+ *	The value (type tag and arguments) is stored inline in a fixed-size slot
+ *	guarded by a sequence lock. One thread feeds the store with received
+ *	packets; any number of other threads may read at the same time without
+ *	taking a lock. A reader retries if the value changed while it was
+ *	copying it, so it always gets a consistent snapshot.
+ *
+ *
+ *	Usage example for the receive thread:
+ *		oscstate_t* st = oscstate_new(100000);
+ *		while ((size = oscnet_recv(net, packet, sizeof(packet), -1)) > 0) {
+ *			oscstate_update(st, packet, size);
+ *		}
+ *
+ *	Usage example for a reader thread:
+ *		int32_t id = oscstate_lookup(st, "/mixer/ch/3/gain");
+ *		uint8_t msg[OSCSTATE_MAX_MESSAGE];
+ *		oscmsg_t m;
+ *		int32_t size = oscstate_read(st, id, msg, sizeof(msg), NULL);
+ *		if (size > 0) {
+ *			oscunpack(msg, size, &m);
+ *			...
+ *		}
+ */
+
+// Largest value (type tag and arguments) kept for an address
+#define OSCSTATE_VALUE_MAX 112
+
+// Largest address kept
+#define OSCSTATE_ADDRESS_MAX 256
+
+// Buffer size that holds any message returned by oscstate_read()
+#define OSCSTATE_MAX_MESSAGE (OSCSTATE_ADDRESS_MAX + OSCSTATE_VALUE_MAX)
+
+typedef struct oscstate oscstate_t;
+
+/*
+ *	oscstate_new() creates a store for up to max_addresses addresses. All
+ *	memory is allocated up front.
+ */
+oscstate_t* oscstate_new(int32_t max_addresses);
+
+void oscstate_free(oscstate_t* st);
+
+/*
+ *	oscstate_update() stores the values of every message in a packet,
+ *	including the messages of (nested) bundles. Only one thread may update
+ *	the store.
+ *
+ *	Return:
+ *		Number of messages stored, or -1 if the packet is malformed. Messages
+ *		whose address or value is too large, or that do not fit in the store,
+ *		are skipped.
+ */
+int32_t oscstate_update(oscstate_t* st, const uint8_t* buf, int32_t size);
+
+/*
+ *	oscstate_set() stores the value of one unpacked message.
+ *
+ *	Return:
+ *		ID of the address, or -1 if the message was skipped.
+ */
+int32_t oscstate_set(oscstate_t* st, const oscmsg_t* msg);
+
+/*
+ *	oscstate_intern() returns the ID of an address, adding it if it is new.
+ *	Only the updating thread may call this. Returns -1 if the store is full.
+ */
+int32_t oscstate_intern(oscstate_t* st, const char* addr, int32_t len);
+
+/*
+ *	oscstate_lookup() returns the ID of an address or -1 if it has not been
+ *	seen. Safe to call from any thread; it never allocates.
+ */
+int32_t oscstate_lookup(oscstate_t* st, const char* addr);
+
+/* Number of interned addresses. IDs are 0 to oscstate_count()-1. */
+int32_t oscstate_count(oscstate_t* st);
+
+/* Address of an ID, or NULL if the ID is not valid. */
+const char* oscstate_address(oscstate_t* st, int32_t id);
+
+/*
+ *	oscstate_read() copies a consistent snapshot of the last message received
+ *	for an ID. Safe to call from any thread.
+ *
+ *	Arguments:
+ *		uint8_t* buf: Receives the OSC message (address, type tag and
+ *					  arguments). OSCSTATE_MAX_MESSAGE bytes is always enough.
+ *		uint64_t* version: Optional. Set to the update count of the store at
+ *						   the time this value was written, so a reader can
+ *						   tell whether the value changed since it last looked.
+ *
+ *	Return:
+ *		Size of the message, 0 if no value was stored yet, or -1 if the ID is
+ *		not valid or buf is too small.
+ */
+int32_t oscstate_read(oscstate_t* st, int32_t id, uint8_t* buf, int32_t size,
+					  uint64_t* version);
+
+/* Update count of the store: the version of the newest value. */
+uint64_t oscstate_version(oscstate_t* st);
+
+/* Version of the value of an ID, or 0 if it has none. */
+uint64_t oscstate_changed(oscstate_t* st, int32_t id);
+
+/*
+ *	oscstate_since() and oscstate_next() walk the IDs in the order their
+ *	values last changed, oldest first, so that only what changed since a
+ *	version needs to be looked at (see oscsync). An ID whose value changes
+ *	moves to the end. Only the updating thread may call them.
+ *
+ *	Usage example:
+ *		for (id = oscstate_since(st, version); id != -1; id = oscstate_next(st, id)) {
+ *			oscstate_read(st, id, msg, sizeof(msg), &version);
+ *			...
+ *		}
+ *
+ *	Return:
+ *		The first ID whose value changed after version, the ID that changed
+ *		next after id, or -1 if there is none.
+ */
+int32_t oscstate_since(oscstate_t* st, uint64_t version);
+int32_t oscstate_next(oscstate_t* st, int32_t id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __OSC_STATE_H__
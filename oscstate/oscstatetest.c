@@ -0,0 +1,164 @@
+/******************************************************************************
+ *  oscstatetest
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *
+ *  One writer thread feeds packets for many addresses into an oscstate
+ *  store while reader threads read random addresses. Prints update and read
+ *  rates and checks that every snapshot read was consistent.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include "oscstate.h"
+#include "../oscpack/oscpack.h"
+
+const char usage[] = "usage: oscstatetest [addresses] [readers] [seconds]\n";
+
+static oscstate_t* st;
+static int addresses = 100000;
+static volatile int running = 1;
+
+struct reader {
+	pthread_t thread;
+	uint64_t reads;
+	uint64_t torn;
+};
+
+static void* readloop(void* arg)
+{
+	struct reader* r = (struct reader*)arg;
+	uint8_t buf[OSCSTATE_MAX_MESSAGE];
+	uint32_t x = (uint32_t)(uintptr_t)arg | 1, a, b;
+	int32_t size;
+	oscmsg_t msg;
+
+	while (running) {
+		// xorshift
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		size = oscstate_read(st, (int32_t)(x % addresses), buf, sizeof(buf), NULL);
+
+		// The writer always stores two equal integers; a torn read would
+		// show them different.
+		if (size > 0 && oscunpack(buf, size, &msg) == 0) {
+			memcpy(&a, msg.args, 4);
+			memcpy(&b, msg.args + 4, 4);
+			if (a != b) {
+				r->torn++;
+			}
+		}
+		r->reads++;
+	}
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main (int argc, char* const argv[])
+{
+	struct reader* readers;
+	uint8_t** packets;
+	int32_t* sizes;
+	char addr[64];
+	int i, nreaders = 2, seconds = 2;
+	uint64_t updates = 0, reads = 0, torn = 0;
+	uint32_t bit32;
+	double t0, t;
+
+	if (argc > 4) {
+		printf(usage);
+		return 0;
+	}
+	if (argc > 1) addresses = atoi(argv[1]);
+	if (argc > 2) nreaders = atoi(argv[2]);
+	if (argc > 3) seconds = atoi(argv[3]);
+
+	if ((st = oscstate_new(addresses)) == NULL) {
+		fprintf(stderr, "oscstate_new: error\n");
+		return 1;
+	}
+
+	// Encode one packet per address up front, as if they were received
+	packets = (uint8_t**)malloc(sizeof(uint8_t*) * addresses);
+	sizes = (int32_t*)malloc(sizeof(int32_t) * addresses);
+	for (i = 0; i < addresses; ++i) {
+		snprintf(addr, sizeof(addr), "/mixer/ch/%d/gain", i);
+		packets[i] = (uint8_t*)malloc(64);
+		sizes[i] = oscpack(packets[i], addr, "ii", 0, 0);
+	}
+
+	t0 = now();
+	for (i = 0; i < addresses; ++i) {
+		oscstate_update(st, packets[i], sizes[i]);
+	}
+	t = now() - t0;
+	printf("oscstatetest: interned %d addresses in %.1f ms\n", addresses, t * 1e3);
+
+	readers = (struct reader*)calloc(nreaders, sizeof(struct reader));
+	for (i = 0; i < nreaders; ++i) {
+		pthread_create(&readers[i].thread, NULL, readloop, &readers[i]);
+	}
+
+	t0 = now();
+	while ((t = now() - t0) < seconds) {
+		for (i = 0; i < 1000; ++i) {
+			int k = (int)((updates * 2654435761u) % addresses);
+			uint8_t* args = packets[k] + sizes[k] - 8;
+			bit32 = htonl((uint32_t)updates);
+			memcpy(args, &bit32, 4);
+			memcpy(args + 4, &bit32, 4);
+			oscstate_update(st, packets[k], sizes[k]);
+			updates++;
+		}
+	}
+	running = 0;
+
+	for (i = 0; i < nreaders; ++i) {
+		pthread_join(readers[i].thread, NULL);
+		reads += readers[i].reads;
+		torn += readers[i].torn;
+	}
+
+	printf("oscstatetest: %d addresses, %d readers\n", addresses, nreaders);
+	printf("    updates: %.2f M/s\n", updates / t / 1e6);
+	printf("    reads:   %.2f M/s (%.2f M/s per reader)\n", reads / t / 1e6,
+		   nreaders ? reads / t / 1e6 / nreaders : 0.);
+	printf("    torn reads: %llu\n", (unsigned long long)torn);
+
+	for (i = 0; i < addresses; ++i) {
+		free(packets[i]);
+	}
+	free(packets);
+	free(sizes);
+	free(readers);
+	oscstate_free(st);
+	return torn == 0 ? 0 : 1;
+}
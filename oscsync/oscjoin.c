@@ -0,0 +1,146 @@
+/******************************************************************************
+ *  oscjoin
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *
+ *  This is a command line tool that joins the values kept by oscrecv -sync
+ *  over TCP or a unix socket and prints how long it took to be consistent
+ *  with them.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+
+#include "../oscnet/oscnet.h"
+#include "../oscstate/oscstate.h"
+#include "oscsync.h"
+
+#define OSCJOIN "oscjoin"
+#define ADDRESSES 65536
+
+const char usage[] =
+"usage: oscjoin [options] ip port\n" \
+"       oscjoin [options] unix:/path\n" \
+"    Options:\n" \
+"        -t seconds  give up if not consistent by then (default 10)\n" \
+"        -follow     keep receiving the values that change until interrupted\n" \
+"\n";
+
+static volatile sig_atomic_t done;
+
+static void stop(int sig)
+{
+	(void)sig;
+	done = 1;
+}
+
+static uint64_t mono_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int main (int argc, char* const argv[])
+{
+	oscnet_t* net;
+	oscstate_t* st;
+	oscsync_client_t* c;
+	oscsync_stats_t stats;
+	uint8_t buf[OSCNET_MAX_PACKET];
+	uint64_t deadline;
+	int32_t size;
+	double seconds = 10;
+	int i, follow = 0, rv = 0;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; ++i) {
+		if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+			seconds = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-follow") == 0) {
+			follow = 1;
+		}
+		else {
+			printf(usage);
+			return 0;
+		}
+	}
+
+	if (argc - i == 1 && oscnet_islocal(argv[i])) {
+		net = oscnet_connect(argv[i], NULL, NULL);
+	}
+	else if (argc - i == 2) {
+		net = oscnet_connect(argv[i], argv[i+1], "tcp");
+	}
+	else {
+		printf(usage);
+		return 0;
+	}
+	if (net == NULL || seconds <= 0) {
+		return 1;
+	}
+	if ((st = oscstate_new(ADDRESSES)) == NULL || (c = oscsync_client_new(st)) == NULL) {
+		return 1;
+	}
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+
+	size = oscsync_client_join(c, mono_ns(), buf, sizeof(buf));
+	if (oscnet_send(net, buf, size) != size) {
+		fprintf(stderr, "%s: could not send the join\n", OSCJOIN);
+		return 1;
+	}
+
+	deadline = mono_ns() + (uint64_t)(seconds * 1e9);
+	while (!done && (follow || !oscsync_client_consistent(c))) {
+		if (!oscsync_client_consistent(c) && mono_ns() >= deadline) {
+			fprintf(stderr, "%s: not consistent after %g s\n", OSCJOIN, seconds);
+			rv = 1;
+			break;
+		}
+		if ((size = oscnet_recv(net, buf, sizeof(buf), 100)) == 0) {
+			continue;
+		}
+		if (size < 0) {
+			fprintf(stderr, "%s: the server closed the connection\n", OSCJOIN);
+			rv = 1;
+			break;
+		}
+		if (oscsync_client_input(c, buf, size, mono_ns()) == -1) {
+			fprintf(stderr, "%s: malformed bundle of %d bytes\n", OSCJOIN, size);
+		}
+	}
+
+	oscsync_client_stats(c, &stats);
+	if (stats.consistent_ns >= 0) {
+		printf("consistent in %.1f ms\n", stats.consistent_ns * 1e-6);
+	}
+	printf("%d addresses, %llu values in %llu bundles, %llu bytes, version %llu\n",
+		   oscstate_count(st), (unsigned long long)stats.values,
+		   (unsigned long long)stats.bundles, (unsigned long long)stats.bytes,
+		   (unsigned long long)stats.version);
+
+	oscsync_client_free(c);
+	oscstate_free(st);
+	oscnet_close(net);
+	return rv;
+}
@@ -0,0 +1,344 @@
+/******************************************************************************
+ *  oscsync
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#include "oscsync.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "../oscpack/oscpack.h"
+#include "../oscpack/oscunpack.h"
+
+// "#bundle" and an immediate timetag
+#define BUNDLE_HEADER 16
+
+// Room kept at the end of a bundle for /_sync/v or /_sync/end and its size
+#define MARK_SIZE 28
+
+// Room for /_sync/begin and its size
+#define BEGIN_SIZE 40
+
+// Smallest mtu that holds the largest value with begin and mark
+#define MIN_MTU (BUNDLE_HEADER + BEGIN_SIZE + 4 + OSCSTATE_MAX_MESSAGE + MARK_SIZE)
+
+// Bundles the rate lets go back to back
+#define BURST 4
+
+struct oscsync {
+	oscstate_t* st;
+	uint64_t epoch;
+	int32_t mtu;
+	double rate;
+	double tokens;			// bytes that may go now
+	uint64_t last_ns;		// of the last refill
+	int joined;
+	int begin;				// /_sync/begin not sent yet
+	int synced;				// /_sync/end sent
+	uint64_t from;			// version of the join
+	uint64_t mark;			// version of the last value sent
+	int32_t cursor;			// ID of that value, -1 for none
+	oscsync_stats_t stats;
+};
+
+struct oscsync_client {
+	oscstate_t* st;
+	uint64_t epoch;
+	uint64_t version;
+	uint64_t join_ns;
+	int consistent;
+	oscsync_stats_t stats;
+};
+
+// Reads n int64 arguments of a control message; returns 0 if the types differ
+static int sync_args(const oscmsg_t* msg, int64_t* args, int n)
+{
+	oscargs_t it;
+	oscarg_t arg;
+	int i;
+
+	if (msg->typelen != n) {
+		return 0;
+	}
+	oscargs(msg, &it);
+	for (i = 0; i < n; ++i) {
+		if (!oscargs_next(&it, &arg) || arg.type != 'h') {
+			return 0;
+		}
+		args[i] = arg.h;
+	}
+	return 1;
+}
+
+static void put32(uint8_t* p, int32_t v)
+{
+	uint32_t n = htonl((uint32_t)v);
+	memcpy(p, &n, 4);
+}
+
+/* ----------------------------------------------------------------------------
+ *	Server
+ */
+
+oscsync_t* oscsync_new(oscstate_t* st, uint64_t epoch, int32_t mtu, double rate)
+{
+	oscsync_t* s;
+
+	if (mtu < MIN_MTU || rate < 0) {
+		fprintf(stderr, "oscsync: The mtu must be at least %d bytes\n", MIN_MTU);
+		return NULL;
+	}
+	if ((s = (oscsync_t*)calloc(1, sizeof(oscsync_t))) == NULL) {
+		fprintf(stderr, "oscsync: Critical memory error...\n");
+		return NULL;
+	}
+	s->st = st;
+	s->epoch = epoch;
+	s->mtu = mtu;
+	s->rate = rate;
+	s->tokens = BURST * mtu;
+	s->cursor = -1;
+	s->stats.consistent_ns = -1;
+	return s;
+}
+
+void oscsync_free(oscsync_t* s)
+{
+	free(s);
+}
+
+int oscsync_input(oscsync_t* s, const uint8_t* buf, int32_t size)
+{
+	oscmsg_t msg;
+	int64_t args[2];
+
+	if (oscisbundle(buf, size) || oscunpack(buf, size, &msg) == -1 ||
+		strcmp(msg.address, "/_sync/join") != 0 || !sync_args(&msg, args, 2)) {
+		return 0;
+	}
+
+	// Another life of the store, or a version it never had: everything
+	s->from = (uint64_t)args[0] == s->epoch && (uint64_t)args[1] <= oscstate_version(s->st) ?
+			  (uint64_t)args[1] : 0;
+	s->mark = s->from;
+	s->cursor = -1;
+	s->joined = 1;
+	s->begin = 1;
+	s->synced = 0;
+	return 1;
+}
+
+// Adds a message of int64 arguments to a bundle
+static int32_t mark(uint8_t* out, int32_t len, const char* addr, const char* types,
+					int64_t a, int64_t b)
+{
+	int32_t n = oscpack(out + len + 4, addr, types, a, b);
+
+	put32(out + len, n);
+	return len + 4 + n;
+}
+
+int32_t oscsync_poll(oscsync_t* s, uint64_t now_ns, uint8_t* out, int32_t outsize)
+{
+	uint8_t msg[OSCSTATE_MAX_MESSAGE];
+	uint64_t version;
+	int32_t size = outsize < s->mtu ? outsize : s->mtu, len, start, n, id;
+
+	if (!s->joined || size < MIN_MTU) {
+		return 0;
+	}
+	if (s->rate > 0) {
+		s->tokens += (now_ns - s->last_ns) * 1e-9 * s->rate;
+		if (s->tokens > BURST * s->mtu) {
+			s->tokens = BURST * s->mtu;
+		}
+		s->last_ns = now_ns;
+		if (s->tokens <= 0) {
+			return 0;
+		}
+	}
+
+	memcpy(out, "#bundle\0\0\0\0\0\0\0\0\1", BUNDLE_HEADER);
+	len = BUNDLE_HEADER;
+	if (s->begin) {
+		len = mark(out, len, "/_sync/begin", "hh", (int64_t)s->epoch, (int64_t)s->from);
+		s->begin = 0;
+	}
+	start = len;
+
+	// Carry on after the last value sent, unless it changed again and moved
+	id = s->cursor != -1 && oscstate_changed(s->st, s->cursor) == s->mark ?
+		 oscstate_next(s->st, s->cursor) : oscstate_since(s->st, s->mark);
+	for (; id != -1; id = oscstate_next(s->st, id)) {
+		if ((n = oscstate_read(s->st, id, msg, sizeof(msg), &version)) <= 0) {
+			continue;
+		}
+		if (len + 4 + n + MARK_SIZE > size) {
+			break;
+		}
+		put32(out + len, n);
+		memcpy(out + len + 4, msg, n);
+		len += 4 + n;
+		s->mark = version;
+		s->cursor = id;
+		s->stats.values++;
+	}
+
+	if (id == -1 && !s->synced) {
+		len = mark(out, len, "/_sync/end", "h", (int64_t)s->mark, 0);
+		s->synced = 1;
+	}
+	else if (len > start) {
+		len = mark(out, len, "/_sync/v", "h", (int64_t)s->mark, 0);
+	}
+	else {
+		return 0;
+	}
+	s->tokens -= len;
+	s->stats.bundles++;
+	s->stats.bytes += len;
+	s->stats.version = s->mark;
+	return len;
+}
+
+int64_t oscsync_timeout(oscsync_t* s, uint64_t now_ns)
+{
+	double tokens;
+
+	if (s->rate <= 0) {
+		return 0;
+	}
+	tokens = s->tokens + (now_ns - s->last_ns) * 1e-9 * s->rate;
+	return tokens > 0 ? 0 : (int64_t)(-tokens / s->rate * 1e9) + 1;
+}
+
+void oscsync_stats(oscsync_t* s, oscsync_stats_t* stats)
+{
+	*stats = s->stats;
+}
+
+/* ----------------------------------------------------------------------------
+ *	Client
+ */
+
+oscsync_client_t* oscsync_client_new(oscstate_t* st)
+{
+	oscsync_client_t* c;
+
+	if ((c = (oscsync_client_t*)calloc(1, sizeof(oscsync_client_t))) == NULL) {
+		fprintf(stderr, "oscsync: Critical memory error...\n");
+		return NULL;
+	}
+	c->st = st;
+	c->stats.consistent_ns = -1;
+	return c;
+}
+
+void oscsync_client_free(oscsync_client_t* c)
+{
+	free(c);
+}
+
+int32_t oscsync_client_join(oscsync_client_t* c, uint64_t now_ns, uint8_t* out,
+							int32_t outsize)
+{
+	if (outsize < oscsize("/_sync/join", "hh", (int64_t)0, (int64_t)0)) {
+		return -1;
+	}
+	c->join_ns = now_ns;
+	c->consistent = 0;
+	c->stats.consistent_ns = -1;
+	return oscpack(out, "/_sync/join", "hh", (int64_t)c->epoch, (int64_t)c->version);
+}
+
+static int client_message(oscsync_client_t* c, const uint8_t* buf, int32_t size,
+						  uint64_t now_ns)
+{
+	oscmsg_t msg;
+	int64_t args[2];
+
+	if (oscisbundle(buf, size)) {
+		return oscstate_update(c->st, buf, size) == -1 ? -1 : 0;
+	}
+	if (oscunpack(buf, size, &msg) == -1) {
+		return -1;
+	}
+	if (strncmp(msg.address, "/_sync/", 7) != 0) {
+		c->stats.values++;
+		oscstate_set(c->st, &msg);
+		return 0;
+	}
+	if (strcmp(msg.address + 7, "begin") == 0 && sync_args(&msg, args, 2)) {
+		c->epoch = (uint64_t)args[0];
+		c->version = (uint64_t)args[1];
+	}
+	else if (strcmp(msg.address + 7, "v") == 0 && sync_args(&msg, args, 1)) {
+		c->version = (uint64_t)args[0];
+	}
+	else if (strcmp(msg.address + 7, "end") == 0 && sync_args(&msg, args, 1)) {
+		c->version = (uint64_t)args[0];
+		if (!c->consistent) {
+			c->consistent = 1;
+			c->stats.consistent_ns = (int64_t)(now_ns - c->join_ns);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int oscsync_client_input(oscsync_client_t* c, const uint8_t* buf, int32_t size,
+						 uint64_t now_ns)
+{
+	oscbundle_t b;
+	const uint8_t* elem;
+	int32_t len;
+	int rv, became = 0;
+
+	c->stats.bundles++;
+	c->stats.bytes += size;
+	if (!oscisbundle(buf, size)) {
+		rv = client_message(c, buf, size, now_ns);
+	}
+	else if (oscbundle(buf, size, &b) == -1) {
+		return -1;
+	}
+	else {
+		while ((len = oscbundle_next(&b, &elem)) > 0) {
+			if ((rv = client_message(c, elem, len, now_ns)) == -1) {
+				return -1;
+			}
+			became |= rv;
+		}
+		rv = len == -1 ? -1 : became;
+	}
+	c->stats.version = c->version;
+	return rv;
+}
+
+int oscsync_client_consistent(oscsync_client_t* c)
+{
+	return c->consistent;
+}
+
+void oscsync_client_stats(oscsync_client_t* c, oscsync_stats_t* stats)
+{
+	*stats = c->stats;
+}
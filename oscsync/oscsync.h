@@ -0,0 +1,154 @@
+/******************************************************************************
+ *  oscsync
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#ifndef __OSC_SYNC_H__
+#define __OSC_SYNC_H__
+
+#include <stdint.h>
+
+#include "../oscstate/oscstate.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ *	oscsync brings a client that joins late up to date with the values in an
+ *	oscstate store, and keeps it there.
+ *
+ *	The client sends a join with the version it is consistent with, 0 the
+ *	first time. The server answers with bundles of at most mtu bytes, each
+ *	packed with values in the order they changed, starting after that
+ *	version. A client that reconnects only gets what changed while it was
+ *	away. When the server has sent everything up to the newest value, it
+ *	says so and the client is consistent. After that it keeps sending the
+ *	values that change. Bundles go out no faster than the byte rate given,
+ *	so a join does not flood the link.
+ *
+ *	Each bundle ends with the version of its last value, which the client
+ *	keeps for its next join. The epoch names one life of the store: a client
+ *	that joins with another epoch gets everything.
+ *
+ *	Messages (all "h" arguments are int64):
+ *
+ *		/_sync/join ,hh epoch version		client: send what changed after version
+ *		/_sync/begin ,hh epoch version		server: values after version follow
+ *		/_sync/v ,h version					server: the bundle is sent up to version
+ *		/_sync/end ,h version				server: the client is consistent
+ *
+ *	oscsync only builds and reads packets; the caller moves them over a
+ *	reliable transport (TCP or oscnet_reliable()). The server side walks the
+ *	change order of the store, so it must run on the thread that updates it.
+ *
+ *	Usage example for the server:
+ *		oscsync_t* s = oscsync_new(st, epoch, 1400, 10e6);	// 10 MB/s
+ *		oscsync_input(s, packet, size);			// a /_sync/join
+ *		while ((n = oscsync_poll(s, now, out, sizeof(out))) > 0)
+ *			oscnet_send(net, out, n);
+ *
+ *	Usage example for the client:
+ *		oscsync_client_t* c = oscsync_client_new(st);
+ *		oscnet_send(net, out, oscsync_client_join(c, now, out, sizeof(out)));
+ *		while (oscsync_client_input(c, packet, size, now) != 1)
+ *			...
+ */
+
+typedef struct oscsync oscsync_t;
+typedef struct oscsync_client oscsync_client_t;
+
+typedef struct {
+	uint64_t bundles;
+	uint64_t bytes;
+	uint64_t values;
+	uint64_t version;		// newest version sent or received
+	int64_t consistent_ns;	// client: from the join to consistent, -1 before
+} oscsync_stats_t;
+
+/*
+ *	oscsync_new() creates the server side of one client.
+ *
+ *	Arguments:
+ *		uint64_t epoch: Names this life of the store, such as the time it was
+ *						created. Every client of the store gets the same.
+ *		int32_t mtu: Largest bundle.
+ *		double rate: Bytes per second at most, or 0 for no limit.
+ *
+ *	Return:
+ *		State, or NULL on error.
+ */
+oscsync_t* oscsync_new(oscstate_t* st, uint64_t epoch, int32_t mtu, double rate);
+void oscsync_free(oscsync_t* s);
+
+/*
+ *	oscsync_input() reads a packet from the client.
+ *
+ *	Return:
+ *		1 for a join, 0 for any other packet.
+ */
+int oscsync_input(oscsync_t* s, const uint8_t* buf, int32_t size);
+
+/*
+ *	oscsync_poll() writes the next bundle for the client, once it joined.
+ *
+ *	Return:
+ *		Size of the bundle, or 0 if nothing changed or the rate does not
+ *		allow one yet (see oscsync_timeout()).
+ */
+int32_t oscsync_poll(oscsync_t* s, uint64_t now_ns, uint8_t* out, int32_t outsize);
+
+/* Nanoseconds until the rate allows the next bundle. */
+int64_t oscsync_timeout(oscsync_t* s, uint64_t now_ns);
+
+void oscsync_stats(oscsync_t* s, oscsync_stats_t* stats);
+
+/* oscsync_client_new() creates the client side, storing values in st. */
+oscsync_client_t* oscsync_client_new(oscstate_t* st);
+void oscsync_client_free(oscsync_client_t* c);
+
+/*
+ *	oscsync_client_join() writes the join to send, with the version the
+ *	client has. now_ns starts the time to consistent state.
+ *
+ *	Return:
+ *		Size of the message, or -1 if out is too small.
+ */
+int32_t oscsync_client_join(oscsync_client_t* c, uint64_t now_ns, uint8_t* out,
+							int32_t outsize);
+
+/*
+ *	oscsync_client_input() stores the values of a packet from the server.
+ *
+ *	Return:
+ *		1 if the client became consistent with this packet, 0 otherwise, or
+ *		-1 if the packet is malformed.
+ */
+int oscsync_client_input(oscsync_client_t* c, const uint8_t* buf, int32_t size,
+						 uint64_t now_ns);
+
+/* Non-zero once the client is consistent. */
+int oscsync_client_consistent(oscsync_client_t* c);
+
+void oscsync_client_stats(oscsync_client_t* c, oscsync_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __OSC_SYNC_H__
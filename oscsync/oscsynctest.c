@@ -0,0 +1,382 @@
+/******************************************************************************
+ *  oscsynctest
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ *  Checks a full join, a reconnect that only gets what changed, a join
+ *  with another epoch, values that change during a join and the pacing
+ *  between two oscsync states in memory. Then brings a client up to date
+ *  with a show of parameters over loopback TCP and prints the time to a
+ *  consistent state, the packets and the bytes: sending every value as its
+ *  own message, oscsync, oscsync paced, and a reconnect after some values
+ *  changed.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "oscsync.h"
+#include "../oscnet/oscnet.h"
+#include "../oscpack/oscpack.h"
+#include "../oscpack/oscunpack.h"
+#include "../oscpack/osctest.h"
+
+const char usage[] = "usage: oscsynctest [parameters] [port]\n";
+
+#define MTU 1400
+#define EPOCH 1234
+#define MAXSIZE 2048
+
+enum { REPLAY, FULL, PACED, DELTA, MODES };
+
+static const char* modes[MODES] = { "messages", "oscsync", "paced", "reconnect" };
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Sets parameter i of a store
+static void set(oscstate_t* st, int32_t i, float v)
+{
+	uint8_t buf[64];
+	char addr[32];
+
+	snprintf(addr, sizeof(addr), "/show/param/%d", i);
+	oscstate_update(st, buf, oscpack(buf, addr, "f", v));
+}
+
+static oscstate_t* show(int32_t params)
+{
+	oscstate_t* st = oscstate_new(params);
+	int32_t i;
+
+	for (i = 0; st != NULL && i < params; ++i) {
+		set(st, i, (float)i);
+	}
+	return st;
+}
+
+// Returns 1 if every value of a is in b
+static int same(oscstate_t* a, oscstate_t* b)
+{
+	uint8_t ma[OSCSTATE_MAX_MESSAGE], mb[OSCSTATE_MAX_MESSAGE];
+	uint64_t version;
+	int32_t id, other, na, nb;
+
+	for (id = 0; id < oscstate_count(a); ++id) {
+		na = oscstate_read(a, id, ma, sizeof(ma), &version);
+		if ((other = oscstate_lookup(b, oscstate_address(a, id))) == -1) {
+			return 0;
+		}
+		nb = oscstate_read(b, other, mb, sizeof(mb), &version);
+		if (na != nb || memcmp(ma, mb, na) != 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* ----------------------------------------------------------------------------
+ *	Checks in memory
+ */
+
+// Joins and hands bundles to the client until it is consistent; returns the bundles
+static int32_t pump(oscsync_t* s, oscsync_client_t* c, oscstate_t* live, int32_t params,
+					int32_t changes)
+{
+	uint8_t buf[MAXSIZE];
+	int32_t n, bundles = 0, big = 0, i;
+
+	n = oscsync_client_join(c, 0, buf, sizeof(buf));
+	expect(oscsync_input(s, buf, n) == 1, "join is read");
+	while ((n = oscsync_poll(s, 0, buf, sizeof(buf))) > 0) {
+		big |= n > MTU;
+		bundles++;
+		if (oscsync_client_input(c, buf, n, bundles) == -1) {
+			expect(0, "bundle is read");
+			break;
+		}
+		for (i = 0; !oscsync_client_consistent(c) && i < changes; ++i) {
+			set(live, rand() % params, (float)rand());
+		}
+	}
+	expect(!big, "bundles fit the mtu");
+	return bundles;
+}
+
+static void check(void)
+{
+	const int32_t params = 50000;
+	oscstate_t* st = show(params);
+	oscstate_t* copy = oscstate_new(params);
+	oscstate_t* other = oscstate_new(params);
+	oscsync_t* s = oscsync_new(st, EPOCH, MTU, 0);
+	oscsync_client_t* c = oscsync_client_new(copy);
+	oscsync_client_t* oc = oscsync_client_new(other);
+	oscsync_stats_t stats, before;
+	uint8_t buf[MAXSIZE];
+	uint64_t t;
+	int32_t i, n;
+	double sent;
+
+	printf("checks:\n");
+
+	// Everything the first time
+	pump(s, c, st, params, 0);
+	oscsync_client_stats(c, &stats);
+	expect(oscsync_client_consistent(c), "client is consistent after a full join");
+	expect(stats.values == (uint64_t)params, "full join sends every value once");
+	expect(stats.version == oscstate_version(st), "client has the newest version");
+	expect(stats.consistent_ns > 0, "time to consistent is reported");
+	expect(same(st, copy), "full join copies every value");
+
+	// Only what changed while away, once even if it changed twice
+	for (i = 0; i < 100; ++i) {
+		set(st, i * 7, -1.0f);
+		set(st, i * 7, -2.0f);
+	}
+	before = stats;
+	oscsync_free(s);
+	s = oscsync_new(st, EPOCH, MTU, 0);
+	expect(pump(s, c, st, params, 0) <= 3, "reconnect takes a few bundles");
+	oscsync_client_stats(c, &stats);
+	expect(stats.values - before.values == 100, "reconnect sends only the changes");
+	expect(same(st, copy), "reconnect copies the changes");
+
+	// A join with nothing new only says so
+	before = stats;
+	pump(s, c, st, params, 0);
+	oscsync_client_stats(c, &stats);
+	expect(stats.values == before.values && oscsync_client_consistent(c),
+		   "join without changes sends no values");
+
+	// Another life of the store: everything
+	oscsync_free(s);
+	s = oscsync_new(st, EPOCH + 1, MTU, 0);
+	before = stats;
+	pump(s, c, st, params, 0);
+	oscsync_client_stats(c, &stats);
+	expect(stats.values - before.values == (uint64_t)params, "epoch change sends everything");
+
+	// Values that change during the join are sent again before the end
+	oscsync_free(s);
+	s = oscsync_new(st, EPOCH, MTU, 0);
+	pump(s, oc, st, params, 5);
+	expect(oscsync_client_consistent(oc), "client is consistent despite changes");
+	expect(same(st, other), "changes during a join arrive");
+	for (i = 0; i < 500; ++i) {
+		set(st, rand() % params, (float)rand());
+	}
+	while ((n = oscsync_poll(s, 0, buf, sizeof(buf))) > 0) {
+		oscsync_client_input(oc, buf, n, 0);
+	}
+	expect(same(st, other), "changes after the join arrive");
+
+	// Pacing: no more than the rate and the burst
+	oscsync_free(s);
+	s = oscsync_new(st, EPOCH, MTU, 1e6);
+	oscsync_client_free(oc);
+	oc = oscsync_client_new(other);
+	n = oscsync_client_join(oc, 0, buf, sizeof(buf));
+	oscsync_input(s, buf, n);
+	sent = 0;
+	for (t = 1000000; t <= 100000000; t += 1000000) {
+		while ((n = oscsync_poll(s, t, buf, sizeof(buf))) > 0) {
+			sent += n;
+		}
+		expect(sent <= t * 1e-3 + 4 * MTU + MTU, "pacing keeps to the rate");
+		expect(oscsync_timeout(s, t) > 0, "timeout waits for the rate");
+	}
+	expect(sent >= 100000 - MTU, "pacing reaches the rate");
+
+	expect(oscsync_client_input(c, (const uint8_t*)"#bundle\0\0\0\0\0\0\0\0\1\0\0\1\0", 20, 0)
+		   == -1, "malformed bundle is an error");
+	expect(oscsync_new(st, EPOCH, 100, 0) == NULL, "small mtu is an error");
+
+	oscsync_free(s);
+	oscsync_client_free(c);
+	oscsync_client_free(oc);
+	oscstate_free(st);
+	oscstate_free(copy);
+	oscstate_free(other);
+	osctest_report();
+	printf("\n");
+}
+
+/* ----------------------------------------------------------------------------
+ *	Loopback benchmark
+ */
+
+struct server {
+	oscstate_t* st;
+	oscnet_t* in;			// joins, answered on their connection
+	int conn;
+	int mode;
+	int done;
+	uint64_t packets;
+	uint64_t bytes;
+};
+
+static void* server_main(void* arg)
+{
+	struct server* sv = (struct server*)arg;
+	uint8_t buf[MAXSIZE];
+	oscsync_t* s = NULL;
+	int64_t wait;
+	int32_t n, id;
+
+	while (!sv->done) {
+		if ((n = oscnet_recv(sv->in, buf, sizeof(buf), s == NULL ? 10 : 0)) > 0) {
+			sv->conn = oscnet_lastconn(sv->in);
+			if (sv->mode == REPLAY) {
+				// Today: every value as its own message
+				for (id = 0; id < oscstate_count(sv->st); ++id) {
+					n = oscstate_read(sv->st, id, buf, sizeof(buf), NULL);
+					oscnet_sendconn(sv->in, sv->conn, buf, n);
+					sv->packets++;
+					sv->bytes += 4 + n;
+				}
+				continue;
+			}
+			oscsync_free(s);
+			s = oscsync_new(sv->st, EPOCH, MTU, sv->mode == PACED ? 10e6 : 0);
+			oscsync_input(s, buf, n);
+		}
+		if (s == NULL) {
+			continue;
+		}
+		while ((n = oscsync_poll(s, now_ns(), buf, sizeof(buf))) > 0) {
+			oscnet_sendconn(sv->in, sv->conn, buf, n);
+			sv->packets++;
+			sv->bytes += 4 + n;
+		}
+		if ((wait = oscsync_timeout(s, now_ns())) > 0) {
+			struct timespec ts = { 0, wait };
+			nanosleep(&ts, NULL);
+		}
+		else {
+			struct timespec ts = { 0, 100000 };
+			nanosleep(&ts, NULL);
+		}
+	}
+	oscsync_free(s);
+	return NULL;
+}
+
+static void run(int32_t params, int port)
+{
+	char sport[12];
+	struct server sv;
+	pthread_t thread;
+	oscstate_t* copy = oscstate_new(params);
+	oscsync_client_t* c = oscsync_client_new(copy);
+	oscnet_t* join;
+	oscsync_stats_t stats;
+	uint8_t buf[MAXSIZE];
+	struct timespec pause = { 0, 20000000 };
+	uint64_t t, packets, bytes;
+	int32_t n, i, got;
+	int mode;
+
+	memset(&sv, 0, sizeof(sv));
+	sv.st = show(params);
+	snprintf(sport, sizeof(sport), "%d", port);
+	if ((sv.in = oscnet_listen("127.0.0.1", sport, "tcp")) == NULL ||
+		(join = oscnet_connect("127.0.0.1", sport, "tcp")) == NULL) {
+		fprintf(stderr, "oscsynctest: Could not open port %d\n", port);
+		exit(1);
+	}
+	pthread_create(&thread, NULL, server_main, &sv);
+
+	printf("%d parameters over loopback TCP, %d byte bundles, paced at 10 MB/s\n",
+		   params, MTU);
+	printf("%-10s %12s %9s %10s\n", "", "consistent", "packets", "bytes");
+	for (mode = 0; mode < MODES; ++mode) {
+		if (mode == DELTA) {
+			for (i = 0; i < params / 100; ++i) {
+				set(sv.st, rand() % params, (float)rand());
+			}
+		}
+		packets = sv.packets;
+		bytes = sv.bytes;
+		sv.mode = mode == DELTA ? FULL : mode;
+		t = now_ns();
+		got = 0;
+		n = oscsync_client_join(c, t, buf, sizeof(buf));
+		oscnet_send(join, buf, n);
+		while ((n = oscnet_recv(join, buf, sizeof(buf), 5000)) > 0) {
+			if (mode == REPLAY) {
+				oscsync_client_input(c, buf, n, now_ns());
+				if (++got == params) {
+					break;
+				}
+			}
+			else if (oscsync_client_input(c, buf, n, now_ns()) == 1) {
+				break;
+			}
+		}
+		t = now_ns() - t;
+		if (n <= 0) {
+			fprintf(stderr, "oscsynctest: Timed out in %s\n", modes[mode]);
+			exit(1);
+		}
+		oscsync_client_stats(c, &stats);
+		if (mode == REPLAY) {
+			stats.consistent_ns = (int64_t)t;
+		}
+		if (mode != PACED) {
+			// The reconnect starts from the paced join
+			oscsync_client_free(c);
+			c = oscsync_client_new(copy);
+		}
+		// Let the server catch up with the packet counts
+		nanosleep(&pause, NULL);
+		printf("%-10s %9.1f ms %9llu %10llu\n", modes[mode], stats.consistent_ns / 1e6,
+			   (unsigned long long)(sv.packets - packets),
+			   (unsigned long long)(sv.bytes - bytes));
+	}
+	expect(same(sv.st, copy), "client has every value");
+	osctest_report();
+
+	sv.done = 1;
+	pthread_join(thread, NULL);
+	oscnet_close(join);
+	oscnet_close(sv.in);
+	oscsync_client_free(c);
+	oscstate_free(sv.st);
+	oscstate_free(copy);
+}
+
+int main (int argc, char* const argv[])
+{
+	int32_t params = argc > 1 ? atoi(argv[1]) : 50000;
+	int port = argc > 2 ? atoi(argv[2]) : 7400;
+
+	if (params <= 0 || port <= 0) {
+		printf(usage);
+		return 1;
+	}
+	check();
+	run(params, port);
+	return osctest_errors != 0;
+}
@@ -0,0 +1,273 @@
+/******************************************************************************
+ *  osctrace
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#include "osctrace.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+// Seconds from 1900 (NTP) to 1970 (Unix)
+#define NTP_EPOCH 2208988800ull
+
+// Values below 2^SUB_BITS have a bucket each; every power of two above is
+// split into HALF buckets.
+#define SUB_BITS 7
+#define HALF (1 << (SUB_BITS - 1))
+#define BUCKETS ((64 - SUB_BITS + 1) * HALF + HALF)
+
+struct osctrace_hist {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint64_t negative;
+	uint64_t buckets[BUCKETS];
+};
+
+uint64_t osctrace_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+uint64_t osctrace_timetag(uint64_t ns)
+{
+	uint64_t sec = ns / 1000000000ull, frac = ns % 1000000000ull;
+	return ((sec + NTP_EPOCH) << 32) | ((frac << 32) / 1000000000ull);
+}
+
+uint64_t osctrace_ns(uint64_t timetag)
+{
+	uint64_t sec = timetag >> 32, frac = timetag & 0xffffffffull;
+
+	if (sec < NTP_EPOCH) {
+		return 0;
+	}
+	return (sec - NTP_EPOCH) * 1000000000ull + ((frac * 1000000000ull) >> 32);
+}
+
+void osctrace_header(uint8_t* hdr, uint64_t timetag, int32_t size)
+{
+	uint32_t be;
+
+	memcpy(hdr, "#bundle\0", 8);
+	be = htonl((uint32_t)(timetag >> 32));
+	memcpy(hdr + 8, &be, 4);
+	be = htonl((uint32_t)timetag);
+	memcpy(hdr + 12, &be, 4);
+	be = htonl((uint32_t)size);
+	memcpy(hdr + 16, &be, 4);
+}
+
+int osctrace_unstamp(const uint8_t* buf, int32_t size, uint64_t* stamp_ns,
+					 const uint8_t** packet, int32_t* packetsize)
+{
+	uint32_t hi, lo, len;
+
+	if (size < OSCTRACE_HEADER + 4 || memcmp(buf, "#bundle\0", 8) != 0) {
+		return -1;
+	}
+	memcpy(&len, buf + 16, 4);
+	len = ntohl(len);
+	if (len != (uint32_t)(size - OSCTRACE_HEADER) || len % 4 != 0) {
+		return -1;
+	}
+	memcpy(&hi, buf + 8, 4);
+	memcpy(&lo, buf + 12, 4);
+	*stamp_ns = osctrace_ns(((uint64_t)ntohl(hi) << 32) | ntohl(lo));
+	*packet = buf + OSCTRACE_HEADER;
+	*packetsize = (int32_t)len;
+	return 0;
+}
+
+osctrace_hist_t* osctrace_hist_new(void)
+{
+	osctrace_hist_t* h = (osctrace_hist_t*)malloc(sizeof(osctrace_hist_t));
+	if (!h) {
+		fprintf(stderr, "osctrace: Critical memory error...\n");
+		return NULL;
+	}
+	osctrace_hist_reset(h);
+	return h;
+}
+
+void osctrace_hist_free(osctrace_hist_t* h)
+{
+	free(h);
+}
+
+void osctrace_hist_reset(osctrace_hist_t* h)
+{
+	memset(h, 0, sizeof(*h));
+	h->min = UINT64_MAX;
+}
+
+static int bucket(uint64_t v)
+{
+	int shift;
+
+	if (v < (1u << SUB_BITS)) {
+		return (int)v;
+	}
+	shift = 63 - __builtin_clzll(v) - SUB_BITS + 1;
+	return shift * HALF + (int)(v >> shift);
+}
+
+// Highest value that falls in bucket i
+static uint64_t highest(int i)
+{
+	int shift;
+
+	if (i < (1 << SUB_BITS)) {
+		return (uint64_t)i;
+	}
+	shift = i / HALF - 1;
+	return (((uint64_t)(i - shift * HALF) + 1) << shift) - 1;
+}
+
+void osctrace_record(osctrace_hist_t* h, int64_t ns)
+{
+	uint64_t v, x;
+
+	if (ns < 0) {
+		__atomic_fetch_add(&h->negative, 1, __ATOMIC_RELAXED);
+		ns = 0;
+	}
+	v = (uint64_t)ns;
+
+	__atomic_fetch_add(&h->buckets[bucket(v)], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&h->sum, v, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+
+	x = __atomic_load_n(&h->min, __ATOMIC_RELAXED);
+	while (v < x && !__atomic_compare_exchange_n(&h->min, &x, v, 1,
+												 __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+	x = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+	while (v > x && !__atomic_compare_exchange_n(&h->max, &x, v, 1,
+												 __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+uint64_t osctrace_count(const osctrace_hist_t* h)
+{
+	return __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+}
+
+// Value of the target-th recorded latency and how many are at or below it.
+// The buckets are summed as they are walked, so recording threads never
+// make the walk run past the end.
+static uint64_t walk(const osctrace_hist_t* h, uint64_t target, uint64_t* total)
+{
+	uint64_t n = 0, max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+	int i, last = 0;
+
+	for (i = 0; i < BUCKETS; ++i) {
+		if (h->buckets[i] == 0) {
+			continue;
+		}
+		n += __atomic_load_n(&h->buckets[i], __ATOMIC_RELAXED);
+		last = i;
+		if (n >= target) {
+			break;
+		}
+	}
+	if (total) {
+		*total = n;
+	}
+	// The bucket's top is an upper bound; the recorded max is exact
+	return highest(last) < max ? highest(last) : max;
+}
+
+uint64_t osctrace_percentile(const osctrace_hist_t* h, double p)
+{
+	uint64_t count = osctrace_count(h), target;
+
+	if (count == 0) {
+		return 0;
+	}
+	target = (uint64_t)(p / 100.0 * count + 0.5);
+	return walk(h, target < 1 ? 1 : target, NULL);
+}
+
+void osctrace_summary(FILE* fp, const char* name, const osctrace_hist_t* h)
+{
+	uint64_t count;
+
+	if (h == NULL) {
+		fprintf(fp, "%-10s %10s %10s %10s %10s %10s %10s %10s %10s\n", "stage (us)",
+				"count", "min", "mean", "50%", "90%", "99%", "99.9%", "max");
+		return;
+	}
+	if ((count = osctrace_count(h)) == 0) {
+		fprintf(fp, "%-10s %10d\n", name, 0);
+		return;
+	}
+	fprintf(fp, "%-10s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f",
+			name, (unsigned long long)count, h->min / 1e3, (double)h->sum / count / 1e3,
+			osctrace_percentile(h, 50.0) / 1e3, osctrace_percentile(h, 90.0) / 1e3,
+			osctrace_percentile(h, 99.0) / 1e3, osctrace_percentile(h, 99.9) / 1e3,
+			h->max / 1e3);
+	if (h->negative) {
+		fprintf(fp, "  (%llu negative)", (unsigned long long)h->negative);
+	}
+	fprintf(fp, "\n");
+}
+
+void osctrace_percentiles(FILE* fp, const osctrace_hist_t* h, int ticks)
+{
+	uint64_t count = osctrace_count(h), value, total, target;
+	double lo, hi, q, half = 1.0;
+	int t;
+
+	fprintf(fp, "%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount",
+			"1/(1-Percentile)");
+	if (count == 0) {
+		return;
+	}
+	if (ticks < 1) {
+		ticks = 5;
+	}
+
+	// ticks lines between 0 and 50%, between 50% and 75%, ...
+	for (;;) {
+		lo = 1.0 - half;
+		hi = 1.0 - half / 2;
+		for (t = 0; t < ticks; ++t) {
+			q = lo + (hi - lo) * t / ticks;
+			target = (uint64_t)(q * count + 0.5);
+			value = walk(h, target < 1 ? 1 : target, &total);
+			fprintf(fp, "%12.3f %14.12f %10llu %14.2f\n", value / 1e3,
+					(double)total / count, (unsigned long long)total,
+					1.0 / (1.0 - q));
+		}
+		half /= 2;
+		if (half * count < 1.0) {
+			break;
+		}
+	}
+	fprintf(fp, "%12.3f %14.12f %10llu\n", h->max / 1e3, 1.0, (unsigned long long)count);
+	fprintf(fp, "#[Mean    = %12.3f, Total count    = %12llu]\n",
+			(double)h->sum / count / 1e3, (unsigned long long)count);
+	fprintf(fp, "#[Max     = %12.3f, Buckets        = %12d]\n", h->max / 1e3, BUCKETS);
+}
@@ -0,0 +1,131 @@
+/******************************************************************************
+ *  osctrace
+ *
+ *  Copyright (C) 2010-2011 The Regents of the University of California.
+ *  All Rights Reserved.
+ *
+ *  Sonic Arts Research and Development Group
+ *  California Institute for Telocommunications and Information Technology
+ *  University of California,
+ *  La Jolla, CA 92093
+ *
+ *  Commercial use of this program without express permission of the
+ *  University of California, San Diego, is strictly prohibited. Information
+ *  about usage and redistribution, and a disclaimer of all warrenties are
+ *  available in the Copyright file provided with this code.
+ *
+ *  Author: Toshiro Yamada
+ *  Contact: toyamada [at] ucsd.edu
+ *
+ ******************************************************************************/
+#ifndef __OSC_TRACE_H__
+#define __OSC_TRACE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ *	osctrace measures the latency of OSC packets from sender to handler.
+ *
+ *	The sender wraps each packet in a bundle whose timetag is the time the
+ *	packet was sent, so the packet itself is forwarded unchanged. The receiver
+ *	takes the kernel receive time from oscnet_timestamps(), the time the
+ *	packet was dequeued and the time its handler ran, and records each stage
+ *	into a histogram:
+ *
+ *		network		send stamp to kernel receive
+ *		queue		kernel receive to dequeue by the receiver
+ *		dispatch	dequeue to the start of the packet's handler
+ *		handler		time spent in the handler
+ *
+ *	Send stamps and kernel stamps are CLOCK_REALTIME, so the network stage is
+ *	only meaningful between hosts with synchronized clocks (PTP or NTP).
+ *
+ *	Usage example:
+ *		// sender
+ *		uint8_t hdr[OSCTRACE_HEADER];
+ *		osctrace_header(hdr, osctrace_timetag(osctrace_now()), size);
+ *		// send hdr followed by packet
+ *
+ *		// receiver, with oscnet_timestamps(net, 1) for kernel stamps
+ *		n = oscnet_recvmsgs(net, msgs, count, -1);
+ *		for (i = 0; i < n; ++i) {
+ *			if (osctrace_unstamp(msgs[i].buf, msgs[i].size, &stamp, &packet,
+ *								 &size) == 0) {
+ *				osctrace_record(network, (int64_t)(msgs[i].stamp_ns - stamp));
+ *				...
+ *			}
+ *		}
+ */
+
+// Size of the bundle wrapper in front of a stamped packet
+#define OSCTRACE_HEADER 20
+
+/* Current CLOCK_REALTIME in nanoseconds; a vDSO call, no system call. */
+uint64_t osctrace_now(void);
+
+/* Converts between nanoseconds since 1970 and an OSC (NTP) timetag. */
+uint64_t osctrace_timetag(uint64_t ns);
+uint64_t osctrace_ns(uint64_t timetag);
+
+/*
+ *	osctrace_header() writes the bundle wrapper for a packet of size bytes:
+ *	"#bundle", the timetag and the size of the packet. Sending the header
+ *	followed by the packet (e.g. as two iovecs) makes a stamped packet.
+ */
+void osctrace_header(uint8_t* hdr, uint64_t timetag, int32_t size);
+
+/*
+ *	osctrace_unstamp() takes the wrapper off a stamped packet.
+ *
+ *	Return:
+ *		0 and the stamp in nanoseconds since 1970, the packet and its size,
+ *		or -1 if buf is not a bundle holding exactly one element.
+ */
+int osctrace_unstamp(const uint8_t* buf, int32_t size, uint64_t* stamp_ns,
+					 const uint8_t** packet, int32_t* packetsize);
+
+/*
+ *	osctrace_hist_t is a log-linear histogram of nanosecond latencies, like
+ *	HdrHistogram with 64 sub-buckets per power of two (under 2% error).
+ *	osctrace_record() is a few atomic adds and may be called from any number
+ *	of threads while another thread reads the histogram.
+ */
+typedef struct osctrace_hist osctrace_hist_t;
+
+osctrace_hist_t* osctrace_hist_new(void);
+void osctrace_hist_free(osctrace_hist_t* h);
+void osctrace_hist_reset(osctrace_hist_t* h);
+
+/* Records one latency. Negative latencies (clock skew) are counted as 0. */
+void osctrace_record(osctrace_hist_t* h, int64_t ns);
+
+uint64_t osctrace_count(const osctrace_hist_t* h);
+
+/* Latency at percentile p (0 to 100), in nanoseconds. */
+uint64_t osctrace_percentile(const osctrace_hist_t* h, double p);
+
+/*
+ *	osctrace_summary() prints one line: count, min, mean, 50th, 90th, 99th
+ *	and 99.9th percentiles and max in microseconds. With a NULL h it prints
+ *	the column headings.
+ */
+void osctrace_summary(FILE* fp, const char* name, const osctrace_hist_t* h);
+
+/*
+ *	osctrace_percentiles() prints the whole distribution in the format of
+ *	HdrHistogram's percentile output (value in microseconds, percentile,
+ *	total count, 1/(1-percentile)), with ticks lines per halving of the
+ *	remaining percentile, for plotting.
+ */
+void osctrace_percentiles(FILE* fp, const osctrace_hist_t* h, int ticks);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __OSC_TRACE_H__